@@ -16,6 +16,7 @@
 // Uncomment PROFILING to enable profiling mode.
 // This disables the FFMPEG-based ffplay class and uses the ffplay-dummy driver instead.
 // This driver dummy simulates an active ffplay player, with regular reads from the DataBuffer.
+// Alternatively, build with 'make PROFILING=1'.
 //#define PROFILING 1
 // -----------------
 
@@ -35,6 +36,7 @@
 #include <fstream>
 #include <ostream>
 #include <condition_variable>
+#include <cinttypes>
 
 namespace fs = std::filesystem;
 
@@ -45,9 +47,21 @@ namespace fs = std::filesystem;
 #endif
 
 #include "ffplay/types.h"
+#include "ffplay/stream_handler.h"
+#include "ffplay/player.h"
+#include "ffplay/sync_target.h"
 #include "sdl_renderer.h"
 
 #include "databuffer.h"
+#include "session.h"
+#include "slavesender.h"
+#include "clocksync.h"
+#include "statuspublisher.h"
+#include "clientregistry.h"
+#include "logging.h"
+#include "metrics.h"
+#include "metricsserver.h"
+#include "threadpolicy.h"
 #include "screensaver.h"
 
 #include <nymph/nymph.h>
@@ -138,13 +152,6 @@ std::atomic<uint32_t> audio_volume = { 100 };
 #undef main
 #endif
 
-struct CastClient {
-	std::string name;
-	int handle;
-	bool sessionActive;
-	uint32_t filesize;
-};
-
 // --- Globals ---
 FileMetaInfo file_meta;
 std::atomic<bool> playerStarted = { false };
@@ -168,66 +175,65 @@ Ffplay ffplay;
 const uint32_t nymph_seek_event = SDL_RegisterEvents(1);
 std::string appsFolder;
 std::atomic<bool> running = { true };
-std::condition_variable dataRequestCv;
-std::mutex dataRequestMtx;
 std::string loggerName = "NymphCastServer";
+uint32_t request_window = 4;
+bool fast_start = true;		// Start the player on session start, rather than on the first data.
 
 NCApps nc_apps;
-std::map<int, CastClient> clients;
+ClientRegistry clients;
+uint32_t client_timeout = 30000;	// Milliseconds without contact before a failing client is removed.
+
+// Metrics.
+MetricsServer metricsServer;
+MetricCounter* metricBytesIngested = Metrics::counter("nymphcast_bytes_ingested_total",
+											"Media data received from clients, in bytes.");
+MetricHistogram* metricReadCallback = Metrics::histogram(
+				"nymphcast_rpc_callback_seconds{callback=\"MediaReadCallback\"}",
+				"Time taken by callbacks to clients.");
+MetricHistogram* metricStatusCallback = Metrics::histogram(
+				"nymphcast_rpc_callback_seconds{callback=\"MediaStatusCallback\"}",
+				"Time taken by callbacks to clients.");
+MetricCounter* metricCallbackFailures = Metrics::counter("nymphcast_rpc_callback_failures_total",
+											"Callbacks to clients which failed.");
 // ---
 
 
-// --- DATA REQUEST FUNCTION ---
-// This function can be signalled with the condition variable to request data from the client.
-void dataRequestFunction() {
-	// Create and share condition variable with DataBuffer class.
-	DataBuffer::setDataRequestCondition(&dataRequestCv);
+// --- START PLAYER ---
+// Starts playback of the given session, unless the player is already running.
+// Returns false if the player was already running.
+bool startPlayer(CastSessionPtr cs) {
+	bool started = false;
+	if (!playerStarted.compare_exchange_strong(started, true)) { return false; }
 	
-	while (running) {
-		// Wait for the condition to be signalled.
-		std::unique_lock<std::mutex> lk(dataRequestMtx);
-		using namespace std::chrono_literals;
-		dataRequestCv.wait(lk);
-		
-		if (!running) {
-			NYMPH_LOG_INFORMATION("Shutting down data request function...");
-			break;
-		}
-		
-		// Set data request as pending.
-		DataBuffer::dataRequestPending = true;
-		
-		NYMPH_LOG_INFORMATION("Asking for data...");
+	SessionManager::setActive(cs);
+	ffplay.setDataBuffer(cs->getBuffer());
+	avThread.start(ffplay);
 	
-		// Request more data.
-		std::vector<NymphType*> values;
-		std::string result;
-		if (!NymphRemoteClient::callCallback(DataBuffer::getSessionHandle(), "MediaReadCallback", values, result)) {
-			std::cerr << "Calling callback failed: " << result << std::endl;
-			return;
-		}
-		
-		// We're now playing, so make sure the data buffer stays fed. Check every 100 ms whether
-		// there's a pending request.
-		/* while (1) {
-			dataRequestCv.wait_for(lk, 500ms);
-			if (!playerStarted) { 
-				NYMPH_LOG_INFORMATION("DataRequestFunction: returning to waiting...");
-				break; 
-			}
-			else if (!DataBuffer::dataRequestPending) { continue; }
-		
-			NYMPH_LOG_INFORMATION("Asking for data...");
-		
-			// Request more data.
-			std::vector<NymphType*> values;
-			std::string result;
-			if (!NymphRemoteClient::callCallback(DataBuffer::getSessionHandle(), "MediaReadCallback", values, result)) {
-				std::cerr << "Calling callback failed: " << result << std::endl;
-				return;
-			}
-		} */
+	return true;
+}
+
+
+// --- REQUEST DATA ---
+// Called by a session's data request thread to request a range of the file from its client. The
+// block size adapts to the measured throughput of the client.
+bool requestData(uint32_t handle, uint64_t offset, uint32_t length) {
+	NC_LOG_DEBUG(LOG_SUB_DATA, "Asking for %u bytes of data at %" PRIu64 "...", length, offset);
+	
+	std::vector<NymphType*> values;
+	values.push_back(new NymphType(offset));
+	values.push_back(new NymphType(length));
+	std::string result;
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	bool ok = NymphRemoteClient::callCallback(handle, "MediaReadCallback", values, result);
+	metricReadCallback->record(std::chrono::duration_cast<std::chrono::microseconds>(
+									std::chrono::steady_clock::now() - begin).count());
+	if (!ok) {
+		NC_LOG_ERROR(LOG_SUB_DATA, "Calling callback failed: %s", result.c_str());
+		metricCallbackFailures->add();
+		return false;
 	}
+	
+	return true;
 }
 
 
@@ -259,200 +265,355 @@ void MediaStatusCallback(uint32_t session, NymphMessage* msg, void* data) {
 }
 
 
-// --- GET PLAYBACK STATUS ---
-std::map<std::string, NymphPair>* getPlaybackStatus() {
-	// Set the playback status.
-	// We're sending back whether we are playing something currently. If so, also includes:
-	// * duration of media in seconds.
-	// * position in the media, in seconds with remainder.
-	// * title of the media, if available.
-	// * artist of the media, if available.
-	std::map<std::string, NymphPair>* pairs = new std::map<std::string, NymphPair>();
-	NymphPair pair;
-	std::string* key;
+// --- SNAPSHOT PLAYBACK STATUS ---
+// Collects the current playback status. The status is updated in place, so that its strings keep
+// their storage.
+void snapshotPlaybackStatus(PlaybackStatus &status) {
+	status.volume = audio_volume;
+	status.hasSyncError = false;
+	status.syncError = 0;
 	if (playerStarted) {
 		// Distinguish between playing and paused for the player.
-		if (playerPaused) {
-			key = new std::string("status");
-			pair.key = new NymphType(key, true);
-			pair.value = new NymphType((uint32_t) NYMPH_PLAYBACK_STATUS_PAUSED);
-			pairs->insert(std::pair<std::string, NymphPair>(*key, pair));
+		status.status = playerPaused ? NYMPH_PLAYBACK_STATUS_PAUSED : NYMPH_PLAYBACK_STATUS_PLAYING;
+		status.playing = true;
+		status.duration = file_meta.duration;
+		status.position = file_meta.position;
+		file_meta.getTitle(status.title);
+		file_meta.getArtist(status.artist);
+		status.ttff = Player::getTimeToFirstFrame();
+		
+		// In slave mode: the difference between our audio and the master's timeline.
+		if (SyncTarget::isEnabled()) {
+			status.hasSyncError = true;
+			status.syncError = SyncTarget::getError();
+		}
+	}
+	else {
+		status.status = NYMPH_PLAYBACK_STATUS_STOPPED;
+		status.playing = false;
+		status.duration = 0;
+		status.position = 0.0;
+		status.title.clear();
+		status.artist.clear();
+		status.ttff = 0;
+	}
+}
+
+
+// Keys of the playback status map, in the order of the StatusField bits. The keys in the map 
+// refer to these, rather than to copies.
+std::string statusKeys[] = { "status", "playing", "duration", "position", "title", "artist", 
+								"volume", "ttff", "sync_error" };
+
+
+// Playback status as a map for the clients, along with the status it was built from. The string
+// values in the map refer to the strings in the status.
+struct StatusMap {
+	PlaybackStatus status;
+	uint32_t fields;
+	std::map<std::string, NymphPair> pairs;
+	
+	~StatusMap() {
+		std::map<std::string, NymphPair>::iterator it;
+		for (it = pairs.begin(); it != pairs.end(); ++it) {
+			delete it->second.key;
+			delete it->second.value;
+		}
+	}
+};
+
+
+// --- ADD STATUS PAIR ---
+void addStatusPair(StatusMap* sm, uint32_t field, NymphType* value) {
+	int i = 0;
+	while (field > 1) { field >>= 1; i++; }
+	
+	NymphPair pair;
+	pair.key = new NymphType(&statusKeys[i], false);
+	pair.value = value;
+	sm->pairs.insert(std::pair<std::string, NymphPair>(statusKeys[i], pair));
+}
+
+
+// --- BUILD STATUS MAP ---
+// Builds a map of the fields (StatusField mask) of the playback status.
+// We're sending back whether we are playing something currently. If so, also includes:
+// * duration of media in seconds.
+// * position in the media, in seconds with remainder.
+// * title of the media, if available.
+// * artist of the media, if available.
+StatusMap* buildStatusMap(const PlaybackStatus &status, uint32_t fields) {
+	StatusMap* sm = new StatusMap;
+	sm->status = status;
+	sm->fields = fields;
+	if (fields & STATUS_FIELD_STATUS) {
+		addStatusPair(sm, STATUS_FIELD_STATUS, new NymphType(status.status));
+	}
+	
+	if (fields & STATUS_FIELD_PLAYING) {
+		addStatusPair(sm, STATUS_FIELD_PLAYING, new NymphType(status.playing));
+	}
+	
+	if (fields & STATUS_FIELD_DURATION) {
+		addStatusPair(sm, STATUS_FIELD_DURATION, new NymphType(status.duration));
+	}
+	
+	if (fields & STATUS_FIELD_POSITION) {
+		addStatusPair(sm, STATUS_FIELD_POSITION, new NymphType(status.position));
+	}
+	
+	if (fields & STATUS_FIELD_TITLE) {
+		if (status.playing) {
+			addStatusPair(sm, STATUS_FIELD_TITLE, new NymphType(&sm->status.title, false));
 		}
 		else {
-			key = new std::string("status");
-			pair.key = new NymphType(key, true);
-			pair.value = new NymphType((uint32_t) NYMPH_PLAYBACK_STATUS_PLAYING);
-			pairs->insert(std::pair<std::string, NymphPair>(*key, pair));
+			addStatusPair(sm, STATUS_FIELD_TITLE, new NymphType((char*) 0, 0));
 		}
-		
-		key = new std::string("playing");
-		pair.key = new NymphType(key, true);
-		pair.value = new NymphType(true);
-		pairs->insert(std::pair<std::string, NymphPair>(*key, pair));
-		
-		key = new std::string("duration");
-		pair.key = new NymphType(key, true);
-		pair.value = new NymphType(file_meta.duration);
-		pairs->insert(std::pair<std::string, NymphPair>(*key, pair));
-		
-		key = new std::string("position");
-		pair.key = new NymphType(key, true);
-		pair.value = new NymphType(file_meta.position);
-		pairs->insert(std::pair<std::string, NymphPair>(*key, pair));
-		
-		key = new std::string("title");
-		pair.key = new NymphType(key, true);
-		std::string* val = new std::string(file_meta.getTitle());
-		pair.value = new NymphType(val, true);
-		pairs->insert(std::pair<std::string, NymphPair>(*key, pair));
-		
-		key = new std::string("artist");
-		pair.key = new NymphType(key, true);
-		val = new std::string(file_meta.getArtist());
-		pair.value = new NymphType(val, true);
-		pairs->insert(std::pair<std::string, NymphPair>(*key, pair));
-		
-		key = new std::string("volume");
-		pair.key = new NymphType(key, true);
-		pair.value = new NymphType(audio_volume);
-		pairs->insert(std::pair<std::string, NymphPair>(*key, pair));
 	}
-	else {
-		key = new std::string("status");
-		pair.key = new NymphType(key, true);
-		pair.value = new NymphType((uint32_t) NYMPH_PLAYBACK_STATUS_STOPPED);
-		pairs->insert(std::pair<std::string, NymphPair>(*key, pair));
-		
-		key = new std::string("playing");
-		pair.key = new NymphType(key, true);
-		pair.value = new NymphType(false);
-		pairs->insert(std::pair<std::string, NymphPair>(*key, pair));
-		
-		key = new std::string("duration");
-		pair.key = new NymphType(key, true);
-		pair.value = new NymphType((uint64_t) 0);
-		pairs->insert(std::pair<std::string, NymphPair>(*key, pair));
-		
-		key = new std::string("position");
-		pair.key = new NymphType(key, true);
-		pair.value = new NymphType((double) 0.0);
-		pairs->insert(std::pair<std::string, NymphPair>(*key, pair));
-		
-		key = new std::string("title");
-		pair.key = new NymphType(key, true);
-		pair.value = new NymphType((char*) 0, 0);
-		pairs->insert(std::pair<std::string, NymphPair>(*key, pair));
-		
-		key = new std::string("artist");
-		pair.key = new NymphType(key, true);
-		pair.value = new NymphType((char*) 0, 0);
-		pairs->insert(std::pair<std::string, NymphPair>(*key, pair));
-		
-		key = new std::string("volume");
-		pair.key = new NymphType(key, true);
-		pair.value = new NymphType(audio_volume);
-		pairs->insert(std::pair<std::string, NymphPair>(*key, pair));
+	
+	if (fields & STATUS_FIELD_ARTIST) {
+		if (status.playing) {
+			addStatusPair(sm, STATUS_FIELD_ARTIST, new NymphType(&sm->status.artist, false));
+		}
+		else {
+			addStatusPair(sm, STATUS_FIELD_ARTIST, new NymphType((char*) 0, 0));
+		}
 	}
 	
-	return pairs;
+	if (fields & STATUS_FIELD_VOLUME) {
+		addStatusPair(sm, STATUS_FIELD_VOLUME, new NymphType(status.volume));
+	}
+	
+	// Time from the playback request to the first audio or video frame, in milliseconds.
+	if ((fields & STATUS_FIELD_TTFF) && status.playing) {
+		addStatusPair(sm, STATUS_FIELD_TTFF, new NymphType(status.ttff));
+	}
+	
+	// In slave mode: the difference between our audio and the master's timeline, in microseconds.
+	if ((fields & STATUS_FIELD_SYNC_ERROR) && status.hasSyncError) {
+		addStatusPair(sm, STATUS_FIELD_SYNC_ERROR, new NymphType(status.syncError));
+	}
+	
+	return sm;
 }
 
 
-// --- SEND STATUS UPDATE ---
-void sendStatusUpdate(uint32_t handle) {
-	// Call the status update callback with the current playback status.
-	std::vector<NymphType*> values;
-	std::map<std::string, NymphPair>* status = getPlaybackStatus();
-	values.push_back(new NymphType(status, true));
-	NymphType* resVal = 0;
-	std::string result;
-	if (!NymphRemoteClient::callCallback(handle, "MediaStatusCallback", values, result)) {
-		std::cerr << "Calling media status callback failed: " << result << std::endl;
-		return;
+// Full playback status map, shared by all status requests until the status changes. A replaced
+// map is deleted once the last user releases it.
+// Replies refer to the map rather than to a copy. Each session holds the map its last reply refers
+// to. NymphRPC sends the reply before it handles the next message of that session, so the map is
+// released once a later reply replaces it, or the session ends.
+std::mutex statusMapMutex;
+std::shared_ptr<StatusMap> statusMap;
+std::map<int, std::shared_ptr<StatusMap> > replyStatusMaps;
+
+
+// --- GET STATUS MAP ---
+// Returns the full playback status map for the given status.
+std::shared_ptr<StatusMap> getStatusMap(const PlaybackStatus &status) {
+	std::lock_guard<std::mutex> lk(statusMapMutex);
+	if (!statusMap || statusMap->status.diff(status) != 0) {
+		statusMap.reset(buildStatusMap(status, STATUS_FIELD_ALL));
 	}
+	
+	return statusMap;
 }
 
 
-// --- SEND GLOBAL STATUS UPDATE ---
-// Send playback status update to all connected clients.
-void sendGlobalStatusUpdate() {
-	NYMPH_LOG_INFORMATION("Sending status update to all " + Poco::NumberFormatter::format(clients.size()) 
-					+ " clients.");
-					
-	std::map<std::string, NymphPair>* pairs = getPlaybackStatus();
-	std::map<int, CastClient>::const_iterator it;
-	for (it = clients.begin(); it != clients.end();/**/) {
-		NYMPH_LOG_DEBUG("Client ID: " + Poco::NumberFormatter::format(it->first) + "/" + it->second.name);
+// --- RELEASE PLAYBACK STATUS ---
+// Releases the status map held for the session, once it has ended.
+void releasePlaybackStatus(int session) {
+	std::shared_ptr<StatusMap> previous;
+	statusMapMutex.lock();
+	std::map<int, std::shared_ptr<StatusMap> >::iterator it = replyStatusMaps.find(session);
+	if (it != replyStatusMaps.end()) {
+		previous.swap(it->second);
+		replyStatusMaps.erase(it);
+	}
+	
+	statusMapMutex.unlock();
+}
+
+
+extern StatusPublisher statusPublisher;
+
+
+// --- PUBLISH STATUS ---
+// Called by the status publisher to send the changed fields of the playback status to all 
+// connected clients. Only clients which advertised CLIENT_CAP_STATUS_DELTA get just the changed
+// fields. Other clients always get the full status.
+void publishStatus(const PlaybackStatus &status, uint32_t fields) {
+	// Send to the clients connected at this time. Clients can connect and disconnect meanwhile.
+	std::vector<int> handles = clients.handles();
+	NC_LOG_DEBUG(LOG_SUB_STATUS, "Sending status update to all %zu clients.", handles.size());
+	
+	// Each kind of map is built at most once for all clients, and released after the last one.
+	std::shared_ptr<StatusMap> full;
+	StatusMap* delta = 0;
+	bool resync = false;
+	for (int i = 0; i < handles.size(); ++i) {
+		NC_LOG_TRACE(LOG_SUB_STATUS, "Client ID: %d", handles[i]);
+		CastClientPtr client = clients.get(handles[i]);
+		if (!client) { continue; }
 		
-		// Call the status update callback with the current playback status.
-		NymphType* resVal = 0;
+		bool deltas = (client->caps & CLIENT_CAP_STATUS_DELTA) != 0;
+		std::map<std::string, NymphPair>* pairs = 0;
+		if (deltas && fields != STATUS_FIELD_ALL) {
+			if (!delta) { delta = buildStatusMap(status, fields); }
+			pairs = &delta->pairs;
+		}
+		else {
+			if (!full) { full = getStatusMap(status); }
+			pairs = &full->pairs;
+		}
+		
+		// Call the status update callback with the playback status.
 		std::string result;
 		std::vector<NymphType*> values;
 		values.push_back(new NymphType(pairs));
-		if (!NymphRemoteClient::callCallback(it->first, "MediaStatusCallback", values, result)) {
-			NYMPH_LOG_ERROR("Calling media status callback failed: " + result);
+		std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+		bool ok = NymphRemoteClient::callCallback(handles[i], "MediaStatusCallback", values, result);
+		metricStatusCallback->record(std::chrono::duration_cast<std::chrono::microseconds>(
+										std::chrono::steady_clock::now() - begin).count());
+		if (!ok) {
+			NC_LOG_ERROR(LOG_SUB_STATUS, "Calling media status callback failed: %s", result.c_str());
+			metricCallbackFailures->add();
 			
-			// An error here very likely means that the client no long exists. Remove it.
-			it = clients.erase(it);
+			// The client may no longer exist. It gets removed if it isn't heard from for a while.
+			// A client which gets deltas missed this one, so the next update carries all fields.
+			clients.fail(handles[i]);
+			if (deltas) { resync = true; }
 		}
 		else {
-			++it;
+			clients.touch(handles[i]);
 		}
 	}
 	
-	// Delete the map.
-	// TODO: persist the data somehow.
-	delete pairs;
+	delete delta;
+	if (resync) { statusPublisher.resendAll(); }
+	
+	// Unresponsive clients are removed along with their session, as on a disconnect.
+	std::vector<int> evicted = clients.evict(client_timeout);
+	for (int i = 0; i < evicted.size(); ++i) {
+		SessionManager::remove(evicted[i]);
+		releasePlaybackStatus(evicted[i]);
+		NC_LOG_INFO(LOG_SUB_STATUS, "Removed unresponsive client %d", evicted[i]);
+	}
+}
+
+
+// Sends the playback status to the clients from its own thread. Routine changes are sent at most
+// once per 'status_interval' milliseconds, state transitions right away.
+StatusPublisher statusPublisher(snapshotPlaybackStatus, publishStatus, StatusPublisherConfig());
+
+
+// --- GET PLAYBACK STATUS ---
+// Returns the full playback status map for the current status, for a message to the session. The
+// map is held for the session until its next call, and must not be deleted by the caller.
+std::map<std::string, NymphPair>* getPlaybackStatus(int session) {
+	// Each RPC thread keeps its own status, which keeps the storage of its strings.
+	thread_local PlaybackStatus status;
+	statusPublisher.getStatus(status);
+	std::shared_ptr<StatusMap> sm = getStatusMap(status);
+	
+	// The map held before is released outside of the lock.
+	std::shared_ptr<StatusMap> previous;
+	statusMapMutex.lock();
+	previous.swap(replyStatusMaps[session]);
+	replyStatusMaps[session] = sm;
+	statusMapMutex.unlock();
+	
+	return &sm->pairs;
 }
 
 
 // --- SEEKING HANDLER ---
+// Called by a session's data buffer when it needs the client to seek.
 void seekingHandler(uint32_t session, int64_t offset) {
-	if (DataBuffer::seeking()) {
-		// Send message to client indicating that we're seeking in the file.
-		std::vector<NymphType*> values;
-		values.push_back(new NymphType((uint64_t) offset));
-		std::string result;
-		NymphType* resVal = 0;
-		if (!NymphRemoteClient::callCallback(session, "MediaSeekCallback", values, result)) {
-			std::cerr << "Calling media seek callback failed: " << result << std::endl;
-			return;
-		}
-				
-		return; 
+	// Send message to client indicating that we're seeking in the file.
+	std::vector<NymphType*> values;
+	values.push_back(new NymphType((uint64_t) offset));
+	std::string result;
+	NymphType* resVal = 0;
+	if (!NymphRemoteClient::callCallback(session, "MediaSeekCallback", values, result)) {
+		NC_LOG_ERROR(LOG_SUB_DATA, "Calling media seek callback failed: %s", result.c_str());
+		return;
+	}
+}
+
+
+// --- PREFETCH PLAYBACK ---
+// Called by the player's read thread near the end of a stream or file. Opens the stream or session
+// which finishPlayback() will continue with, so that it can start without a gap.
+void prefetchPlayback() {
+	std::string url = SessionManager::peekStreamTrack();
+	if (!url.empty()) {
+		ffplay.prefetch(url);
+		return;
+	}
+	
+	CastSessionPtr next = SessionManager::nextReady();
+	if (next) {
+		ffplay.prefetch(next->getBuffer());
 	}
 }
 
 
 // --- FINISH PLAYBACK ---
-// Called at the end of playback of a stream or file.
-// If a stream is queued, play it, otherwise end playback.
-void finishPlayback() {
+// Called by the player thread at the end of playback of a stream or file.
+// If a stream is queued, or another session has buffered data, play it, otherwise end playback.
+// Returns true if the player should continue with the next stream or session.
+bool finishPlayback() {
+	// The data of the finished session has been played, so release its buffer.
+	uint32_t handle = SessionManager::getActiveHandle();
+	CastSessionPtr finished = SessionManager::getActive();
+	if (finished && SessionManager::get(handle) == finished) {
+		SessionManager::remove(handle);
+	}
+	
 	// Check whether we have any queued URLs to stream next.
-	if (DataBuffer::hasStreamTrack()) {
+	if (SessionManager::hasStreamTrack()) {
 		playerStarted = true;
-		castUrl = DataBuffer::getStreamTrack();
+		castUrl = SessionManager::getStreamTrack();
 		castingUrl = true;
 		
-		avThread.start(ffplay);
+		return true;
+	}
+	
+	// Continue with the next session which has data ready.
+	CastSessionPtr next = SessionManager::nextReady();
+	if (next) {
+		castingUrl = false;
+		SessionManager::setActive(next);
+		ffplay.setDataBuffer(next->getBuffer());
 		
-		return;
+		// Tell the client of the finished session that we're done.
+		std::vector<NymphType*> values;
+		std::string result;
+		if (!NymphRemoteClient::callCallback(handle, "MediaStopCallback", values, result)) {
+			NC_LOG_ERROR(LOG_SUB_CORE, "Calling media stop callback failed: %s", result.c_str());
+		}
+		
+		statusPublisher.transition();
+		
+		return true;
 	}
 	
+	SessionManager::setActive(CastSessionPtr());
+	ffplay.setDataBuffer(std::shared_ptr<DataBuffer>());
 	castingUrl = false;
 	playerStarted = false;
 	
 	// Send message to client indicating that we're done.
-	uint32_t handle = DataBuffer::getSessionHandle();
 	std::vector<NymphType*> values;
 	std::string result;
 	if (!NymphRemoteClient::callCallback(handle, "MediaStopCallback", values, result)) {
-		std::cerr << "Calling media stop callback failed: " << result << std::endl;
-		return;
+		NC_LOG_ERROR(LOG_SUB_CORE, "Calling media stop callback failed: %s", result.c_str());
+		return false;
 	}
 	
 	// Call the status update callback to indicate to the clients that playback stopped.
-	sendGlobalStatusUpdate();
+	statusPublisher.transition();
 	
 	// Update the LCDProc daemon if enabled.
 	if (lcdproc_enabled) {
@@ -483,6 +644,8 @@ void finishPlayback() {
 			SDL_PushEvent(&event);
 		}
 	}
+	
+	return false;
 }
 
 
@@ -493,7 +656,7 @@ bool streamTrack(std::string url) {
 	// TODO: allow to cancel any currently playing track/empty queue?
 	if (playerStarted) {
 		// Add to queue.
-		DataBuffer::addStreamTrack(url);
+		SessionManager::addStreamTrack(url);
 		
 		return true;
 	}
@@ -503,11 +666,12 @@ bool streamTrack(std::string url) {
 	
 	if (!playerStarted) {
 		playerStarted = true;
+		Player::markStart();
 		avThread.start(ffplay);
 	}
 	
-	// Send status update to client.
-	sendStatusUpdate(DataBuffer::getSessionHandle());
+	// Send status update to clients.
+	statusPublisher.transition();
 	
 	return true;
 }
@@ -531,6 +695,8 @@ struct NymphCastSlaveRemote {
 	uint16_t port;
 	uint32_t handle;
 	int64_t delay;
+	SlaveSenderPtr sender;		// Sends the media data to the slave from its own thread.
+	ClockSyncPtr clock;			// Offset and drift of the slave's clock relative to ours.
 };
 
 
@@ -542,46 +708,47 @@ enum NcsMode {
 
 NcsMode serverMode = NCS_MODE_STANDALONE;
 std::vector<NymphCastSlaveRemote> slave_remotes;
-uint32_t slaveLatencyMax = 0;	// Max latency to slave remote in milliseconds.
+uint32_t slaveLatencyMax = 0;	// Max round trip to a slave remote in microseconds.
+SlaveSenderConfig slave_config;
+ClockSyncConfig clock_sync_config;
+uint32_t sync_start_delay = 250;	// Extra time before the synchronised start, in milliseconds.
 
 
 // Callback for the connect function.
 NymphMessage* connectClient(int session, NymphMessage* msg, void* data) {
-	std::cout << "Received message for session: " << session << ", msg ID: " << msg->getMessageId() << "\n";
+	NC_LOG_INFO(LOG_SUB_CORE, "Received message for session: %d, msg ID: %" PRIu64, session, 
+																(uint64_t) msg->getMessageId());
 	
 	std::string clientStr = msg->parameters()[0]->getString();
-	std::cout << "Client string: " << clientStr << "\n";
+	NC_LOG_INFO(LOG_SUB_CORE, "Client string: %s", clientStr.c_str());
 	
 	// TODO: check whether we're not operating in slave or master mode already.
-	std::cout << "Switching to stand-alone server mode." << std::endl;
+	NC_LOG_INFO(LOG_SUB_CORE, "Switching to stand-alone server mode.");
 	serverMode = NCS_MODE_STANDALONE;
+	SyncTarget::enable(false);
 	
-	// Register this client with its ID. Return error if the client ID already exists.
+	// Register this client with its ID and capabilities. Return error if the client ID already
+	// exists.
 	NymphMessage* returnMsg = msg->getReplyMessage();
-	std::map<int, CastClient>::iterator it;
-	it = clients.find(session);
 	NymphType* retVal = 0;
-	if (it != clients.end()) {
+	std::string clientId;
+	uint32_t caps = ClientRegistry::parseClientString(clientStr, clientId);
+	if (!clients.add(session, clientId, caps)) {
 		// Client ID already exists, abort.
 		retVal = new NymphType(false);
 	}
 	else {
-		CastClient c;
-		c.name = clientStr;
-		c.handle = session;
-		c.sessionActive = false;
-		c.filesize = 0;
-		clients.insert(std::pair<int, CastClient>(session, c));
 		retVal = new NymphType(true);
 	}
 	
-	// Send the client the current playback status.
+	// Send the client the full playback status. Clients which take deltas only get what changed
+	// from here on.
 	std::vector<NymphType*> values;
-	std::map<std::string, NymphPair>* status = getPlaybackStatus();
-	values.push_back(new NymphType(status, true));
+	std::map<std::string, NymphPair>* status = getPlaybackStatus(session);
+	values.push_back(new NymphType(status));
 	std::string result;
 	if (!NymphRemoteClient::callCallback(session, "MediaStatusCallback", values, result)) {
-		std::cerr << "Calling media status callback failed: " << result << std::endl;
+		NC_LOG_ERROR(LOG_SUB_STATUS, "Calling media status callback failed: %s", result.c_str());
 	}
 	
 	returnMsg->setResultValue(retVal);
@@ -598,7 +765,7 @@ NymphMessage* connectClient(int session, NymphMessage* msg, void* data) {
 // Returns the timestamp when the message was received.
 // sint64 connectMaster(sint64)
 NymphMessage* connectMaster(int session, NymphMessage* msg, void* data) {
-	std::cout << "Received master connect request, slave mode initiation requested." << std::endl;
+	NC_LOG_INFO(LOG_SUB_SLAVE, "Received master connect request, slave mode initiation requested.");
 	
 	NymphMessage* returnMsg = msg->getReplyMessage();
 	
@@ -609,23 +776,69 @@ NymphMessage* connectMaster(int session, NymphMessage* msg, void* data) {
 	}
 	else {
 		// FIXME: for now we just return the current time.
-		std::cout << "Switching to slave server mode." << std::endl;
+		NC_LOG_INFO(LOG_SUB_SLAVE, "Switching to slave server mode.");
 		serverMode = NCS_MODE_SLAVE;
-		//DataBuffer::setFileSize(it->second.filesize);
-		DataBuffer::setSessionHandle(session);
+		SessionManager::create(session);
+		
+		// Follow the master's presentation timeline during playback.
+		SyncTarget::clear();
+		SyncTarget::enable(true);
 		
 		Poco::Timestamp ts;
 		int64_t now = (int64_t) ts.epochMicroseconds();
 		returnMsg->setResultValue(new NymphType(now));
 	}
 	
-	// TODO: Obtain timestamp, compare with current time.
-	//time_t then = ((NymphSint64*) msg->parameters()[0])->getValue();
+	// The clocks get synchronised by the master afterwards, using syncClock and syncTimeline.
+	
+	msg->discard();
 	
-	// TODO: Send delay request to master.
+	return returnMsg;
+}
+
+
+// --- SYNC CLOCK ---
+// Master server calls this repeatedly to determine the offset and drift of our clock relative to
+// its own. Returns the times at which the request was received (t1) and the response was sent (t2).
+// struct syncClock(sint64 t0)
+NymphMessage* syncClock(int session, NymphMessage* msg, void* data) {
+	int64_t t1 = ClockSync::now();
+	NymphMessage* returnMsg = msg->getReplyMessage();
+	
+	std::map<std::string, NymphPair>* pairs = new std::map<std::string, NymphPair>();
+	NymphPair pair;
+	std::string* key = new std::string("t1");
+	pair.key = new NymphType(key, true);
+	pair.value = new NymphType(t1);
+	pairs->insert(std::pair<std::string, NymphPair>(*key, pair));
 	
-	// TODO: Determine final latency and share with master.
+	key = new std::string("t2");
+	pair.key = new NymphType(key, true);
+	pair.value = new NymphType(ClockSync::now());
+	pairs->insert(std::pair<std::string, NymphPair>(*key, pair));
 	
+	returnMsg->setResultValue(new NymphType(pairs, true));
+	msg->discard();
+	
+	return returnMsg;
+}
+
+
+// --- SYNC TIMELINE ---
+// Master server calls this periodically during playback with the anchor of its presentation
+// timeline, converted to our clock: the time at which playback is at the media position 'base'.
+// A 'base' of NaN is the start of the stream. Returns our current sync error in microseconds.
+// sint64 syncTimeline(sint64 start, double base)
+NymphMessage* syncTimeline(int session, NymphMessage* msg, void* data) {
+	NymphMessage* returnMsg = msg->getReplyMessage();
+	
+	int64_t start = msg->parameters()[0]->getInt64();
+	double base = msg->parameters()[1]->getDouble();
+	if (serverMode == NCS_MODE_SLAVE && playerStarted) {
+		SyncTarget::setTimeline(start, base);
+	}
+	
+	returnMsg->setResultValue(new NymphType(SyncTarget::getError()));
 	msg->discard();
 	
 	return returnMsg;
@@ -641,29 +854,43 @@ NymphMessage* receiveDataMaster(int session, NymphMessage* msg, void* data) {
 	// Extract data blob and add it to the buffer.
 	NymphType* mediaData = msg->parameters()[0];
 	bool done = msg->parameters()[1]->getBool();
+	metricBytesIngested->add(mediaData->string_length());
 	int64_t when = msg->parameters()[2]->getInt64();
 	
-	// Write string into buffer.
-	DataBuffer::write(mediaData->getChar(), mediaData->string_length());
+	// Write string into the buffer of the master's session. A new session is started for the next
+	// file after the previous one has been played.
+	CastSessionPtr cs = SessionManager::get(session);
+	if (!cs) { cs = SessionManager::create(session); }
+	if (!cs) {
+		returnMsg->setResultValue(new NymphType((uint8_t) 1));
+		msg->discard();
+		
+		return returnMsg;
+	}
+	
+	std::shared_ptr<DataBuffer> buffer = cs->getBuffer();
+	buffer->write(mediaData->getChar(), mediaData->string_length());
 	
 	if (!playerStarted) {
-		// Start the player when the delay in 'when' has been reached.
+		// Start the player at the time in 'when'. This is the start of the master's presentation
+		// timeline, converted to our clock by the master.
 		std::condition_variable cv;
 		std::mutex cv_m;
 		std::unique_lock<std::mutex> lk(cv_m);
-		//std::chrono::system_clock::time_point then = std::chrono::system_clock::from_time_t(when);
 		std::chrono::microseconds dur(when);
 		std::chrono::time_point<std::chrono::system_clock> then(dur);
-		//while (cv.wait_until(lk, then) != std::cv_status::timeout) { }
-		while (cv.wait_for(lk, dur) != std::cv_status::timeout) { }
+		while (cv.wait_until(lk, then) != std::cv_status::timeout) { }
+		SyncTarget::setTimeline(when);
 		
 		// Start player.
+		SessionManager::setActive(cs);
+		ffplay.setDataBuffer(buffer);
 		playerStarted = true;
 		avThread.start(ffplay);
 	}
 	
 	if (done) {
-		DataBuffer::setEof(done);
+		buffer->setEof(done);
 	}
 	
 	msg->discard();
@@ -677,33 +904,45 @@ NymphMessage* receiveDataMaster(int session, NymphMessage* msg, void* data) {
 NymphMessage* disconnect(int session, NymphMessage* msg, void* data) {
 	
 	// Remove the client ID from the list.
-	std::map<int, CastClient>::iterator it;
-	it = clients.find(session);
-	if (it != clients.end()) {
-		clients.erase(it);
+	clients.remove(session);
+	
+	// Stop sending data to slave remotes first. Queued data would otherwise still be sent.
+	if (serverMode == NCS_MODE_MASTER) {
+		for (int i = 0; i < slave_remotes.size(); ++i) {
+			if (slave_remotes[i].sender) { slave_remotes[i].sender->stop(); }
+			if (slave_remotes[i].clock) { slave_remotes[i].clock->stop(); }
+		}
 	}
 	
-	std::cout << "Current server mode: " << serverMode << std::endl;
+	// Stop the client's session, if any.
+	SessionManager::remove(session);
+	releasePlaybackStatus(session);
+	
+	NC_LOG_INFO(LOG_SUB_CORE, "Current server mode: %d", (int) serverMode);
 	
 	// Disconnect any slave remotes if we're connected.
 	if (serverMode == NCS_MODE_MASTER) {
-		std::cout << "# of slave remotes: " << slave_remotes.size() << std::endl;
+		NC_LOG_INFO(LOG_SUB_SLAVE, "# of slave remotes: %zu", slave_remotes.size());
 		for (int i = 0; i < slave_remotes.size(); ++i) {
 			// Disconnect from slave remote.
 			NymphCastSlaveRemote& rm = slave_remotes[i];
-			std::cout << "Disconnecting slave: " << rm.name << std::endl;
+			NC_LOG_INFO(LOG_SUB_SLAVE, "Disconnecting slave: %s", rm.name.c_str());
 			std::string result;
 			if (!NymphRemoteServer::disconnect(rm.handle, result)) {
 				// Failed to connect, error out. Disconnect from any already connected slaves.
-				std::cerr << "Slave disconnect error: " << result << std::endl;
+				NC_LOG_ERROR(LOG_SUB_SLAVE, "Slave disconnect error: %s", result.c_str());
 			}
 		}
 		
 		slave_remotes.clear();
+		slaveLatencyMax = 0;
 	}
 	
-	std::cout << "Switching to stand-alone server mode." << std::endl;
+	NC_LOG_INFO(LOG_SUB_CORE, "Switching to stand-alone server mode.");
 	serverMode = NCS_MODE_STANDALONE;
+	SyncTarget::enable(false);
+	SyncTarget::clear();
+	SessionManager::setRequestWindow(request_window);
 	
 	NymphMessage* returnMsg = msg->getReplyMessage();
 	returnMsg->setResultValue(new NymphType(true));
@@ -720,9 +959,8 @@ NymphMessage* session_start(int session, NymphMessage* msg, void* data) {
 	NymphMessage* returnMsg = msg->getReplyMessage();
 	
 	// Set up a new session instance for the client.
-	std::map<int, CastClient>::iterator it;
-	it = clients.find(session);
-	if (it == clients.end()) {
+	CastClientPtr client = clients.get(session);
+	if (!client) {
 		returnMsg->setResultValue(new NymphType((uint8_t) 1));
 		msg->discard();
 		
@@ -733,31 +971,70 @@ NymphMessage* session_start(int session, NymphMessage* msg, void* data) {
 	NymphType* fileInfo = msg->parameters()[0];
 	NymphType* num = 0;
 	if (!fileInfo->getStructValue("filesize", num)) {
-		std::cerr << "Didn't find entry 'filesize'. Aborting..." << std::endl;
+		NC_LOG_ERROR(LOG_SUB_CORE, "Didn't find entry 'filesize'. Aborting...");
 		returnMsg->setResultValue(new NymphType((uint8_t) 1));
 		msg->discard();
 		
 		return returnMsg;
 	}
 	
-	it->second.filesize = num->getUint32();
+	client->filesize = num->getUint32();
+	clients.touch(session);
 	
-	std::cout << "Starting new session for file with size: " << it->second.filesize << std::endl;
+	NC_LOG_INFO(LOG_SUB_CORE, "Starting new session for file with size: %u", 
+																	client->filesize.load());
 	
-	DataBuffer::setFileSize(it->second.filesize);
-	DataBuffer::setSessionHandle(session);
+	// Each session buffers its data in its own buffer. A new session replaces any earlier session
+	// of the same client.
+	CastSessionPtr cs = SessionManager::create(session);
+	if (!cs) {
+		NC_LOG_ERROR(LOG_SUB_CORE, "Failed to create session. Abort.");
+		returnMsg->setResultValue(new NymphType((uint8_t) 1));
+		msg->discard();
+		
+		return returnMsg;
+	}
+	
+	cs->getBuffer()->setFileSize(client->filesize);
+	
+	// A new file gets a new presentation timeline, which starts with its first data.
+	if (serverMode == NCS_MODE_MASTER) { SyncTarget::clear(); }
+	
+	// Optional hints on the file's format, which allow the player to skip probing for it.
+	MediaFormatHint hint;
+	NymphType* value = 0;
+	if (fileInfo->getStructValue("container", value)) {
+		hint.container = std::string(value->getChar(), value->string_length());
+	}
+	
+	if (fileInfo->getStructValue("extension", value)) {
+		hint.extension = std::string(value->getChar(), value->string_length());
+	}
+	
+	if (fileInfo->getStructValue("mime", value)) {
+		hint.mime = std::string(value->getChar(), value->string_length());
+	}
+	
+	cs->getBuffer()->setFormatHint(hint);
 	
 	// Start calling the client's read callback method to obtain data. Once the data buffer
 	// has been filled sufficiently, start the playback.
-	if (!DataBuffer::start()) {
-		std::cerr << "Failed to start buffering. Abort." << std::endl;
+	if (!playerStarted) { Player::markStart(); }
+	if (!cs->start()) {
+		NC_LOG_ERROR(LOG_SUB_CORE, "Failed to start buffering. Abort.");
 		returnMsg->setResultValue(new NymphType((uint8_t) 1));
 		msg->discard();
 		
 		return returnMsg;
 	}
 		
-	it->second.sessionActive = true;
+	client->sessionActive = true;
+	
+	// With fast start, the player opens the file while the first data is on its way, instead of
+	// after it has arrived. In master mode, the player is started with the slave remotes instead.
+	if (fast_start && serverMode != NCS_MODE_MASTER && startPlayer(cs)) {
+		statusPublisher.transition();
+	}
 	
 	// Stop screensaver.
 	if (!video_disable) {
@@ -801,6 +1078,101 @@ NymphMessage* session_meta(int session, NymphMessage* msg, void* data) {
 }
 
 
+// --- SEND SLAVE DATA ---
+// Sends a block of media data to a slave remote. Called from the slave's sender thread. The data 
+// is referenced, not copied, by the NymphType, so it has to stay valid until the call returns.
+bool sendSlaveData(uint32_t handle, const uint8_t* data, uint32_t length, bool done, int64_t then) {
+	std::vector<NymphType*> values;
+	values.push_back(new NymphType((char*) data, length, false));
+	values.push_back(new NymphType(done));
+	values.push_back(new NymphType(then));
+	
+	std::string result;
+	NymphType* returnValue = 0;
+	if (!NymphRemoteServer::callMethod(handle, "receiveDataMaster", values, returnValue, result)) {
+		NC_LOG_ERROR(LOG_SUB_SLAVE, "Sending data to slave failed: %s", result.c_str());
+		return false;
+	}
+	
+	delete returnValue;
+	return true;
+}
+
+
+// --- SYNC SLAVE CLOCK ---
+// Performs a timestamp exchange with a slave remote. Called by the slave's clock synchronisation.
+bool syncSlaveClock(uint32_t handle, int64_t t0, int64_t &t1, int64_t &t2) {
+	std::vector<NymphType*> values;
+	values.push_back(new NymphType(t0));
+	
+	std::string result;
+	NymphType* returnValue = 0;
+	if (!NymphRemoteServer::callMethod(handle, "syncClock", values, returnValue, result)) {
+		NC_LOG_ERROR(LOG_SUB_SLAVE, "Clock sync with slave failed: %s", result.c_str());
+		return false;
+	}
+	
+	NymphType* value = 0;
+	bool ok = returnValue->getStructValue("t1", value);
+	if (ok) { t1 = value->getInt64(); }
+	ok = ok && returnValue->getStructValue("t2", value);
+	if (ok) { t2 = value->getInt64(); }
+	
+	delete returnValue;
+	return ok;
+}
+
+
+// --- SYNC SLAVE TIMELINE ---
+// Sends the presentation timeline to a slave remote after each clock re-synchronisation, so that
+// it follows our clock as the estimate of its drift improves. Records the sync error it reports.
+void syncSlaveTimeline(ClockSync &clock) {
+	if (!playerStarted || playerPaused) { return; }
+	
+	int64_t start;
+	double base;
+	SyncTarget::getTimeline(start, base);
+	if (start == 0) { return; }
+	
+	std::vector<NymphType*> values;
+	values.push_back(new NymphType(clock.toRemote(start)));
+	values.push_back(new NymphType(base));
+	
+	std::string result;
+	NymphType* returnValue = 0;
+	if (!NymphRemoteServer::callMethod(clock.getHandle(), "syncTimeline", values, returnValue, 
+																				result)) {
+		NC_LOG_ERROR(LOG_SUB_SLAVE, "Timeline sync with slave failed: %s", result.c_str());
+		return;
+	}
+	
+	clock.setSyncError(returnValue->getInt64());
+	delete returnValue;
+}
+
+
+// --- REMOVE DROPPED SLAVES ---
+// Disconnects the slave remotes which could not keep up with the master, or failed to receive data.
+void removeDroppedSlaves() {
+	for (int i = 0; i < slave_remotes.size();) {
+		NymphCastSlaveRemote& rm = slave_remotes[i];
+		if (!rm.sender || !rm.sender->isDropped()) { ++i; continue; }
+		
+		SlaveSenderStats st = rm.sender->getStats();
+		NC_LOG_WARNING(LOG_SUB_SLAVE, "Removing slave %s after %" PRIu64 " bytes in %" PRIu64 
+					" blocks.", rm.name.c_str(), (uint64_t) st.bytesSent, (uint64_t) st.blocksSent);
+		rm.sender->stop();
+		if (rm.clock) { rm.clock->stop(); }
+		std::string result;
+		if (!NymphRemoteServer::disconnect(rm.handle, result)) {
+			NC_LOG_ERROR(LOG_SUB_SLAVE, "Slave disconnect error: %s", result.c_str());
+		}
+		
+		slave_remotes.erase(slave_remotes.begin() + i);
+	}
+}
+
+
 // --- SESSION ADD SLAVE ---
 // Client sends list of slave server which this server instance should control.
 // Returns: OK (0), ERROR (1).
@@ -831,14 +1203,15 @@ NymphMessage* session_add_slave(int session, NymphMessage* msg, void* data) {
 		slave_remotes.push_back(remote);
 	}
 	
-	// Validate that each slave remote is accessible and determine latency.
+	// Validate that each slave remote is accessible and synchronise clocks with it.
 	for (int i = 0; i < slave_remotes.size(); ++i) {
-		// Establish RPC connection to remote. Starts the PTP-like handshake.
+		// Establish RPC connection to remote. Slaves from an earlier call are connected already.
 		NymphCastSlaveRemote& rm = slave_remotes[i];
+		if (rm.clock) { continue; }
 		std::string result;
 		if (!NymphRemoteServer::connect(rm.ipv4, 4004, rm.handle, 0, result)) {
 			// Failed to connect, error out. Disconnect from any already connected slaves.
-			std::cerr << "Slave connection error: " << result << std::endl;
+			NC_LOG_ERROR(LOG_SUB_SLAVE, "Slave connection error: %s", result.c_str());
 			for (; i >= 0; --i) {
 				NymphCastSlaveRemote& drm = slave_remotes[i];
 				NymphRemoteServer::disconnect(drm.handle, result);
@@ -851,14 +1224,13 @@ NymphMessage* session_add_slave(int session, NymphMessage* msg, void* data) {
 		}
 		
 		// Attempt to start slave mode on the remote.
-		// Send the current timestamp to the slave remote as part of the latency determination.
 		Poco::Timestamp ts;
 		int64_t now = (int64_t) ts.epochMicroseconds();
 		std::vector<NymphType*> values;
 		values.push_back(new NymphType(now));
 		NymphType* returnValue = 0;
 		if (!NymphRemoteServer::callMethod(rm.handle, "connectMaster", values, returnValue, result)) {
-			std::cerr << "Slave connect master failed: " << result << std::endl;
+			NC_LOG_ERROR(LOG_SUB_SLAVE, "Slave connect master failed: %s", result.c_str());
 			// TODO: disconnect from slave remotes.
 			returnMsg->setResultValue(new NymphType((uint8_t) 1));
 			msg->discard();
@@ -866,13 +1238,10 @@ NymphMessage* session_add_slave(int session, NymphMessage* msg, void* data) {
 			return returnMsg;
 		}
 		
-		// Get new time. This should be roughly twice the latency to the slave remote.
-		ts.update();
-		int64_t pong = ts.epochMicroseconds();
 		time_t theirs = returnValue->getInt64();
 		delete returnValue;
 		if (theirs == 0) {
-			std::cerr << "Configuring remote as slave failed." << std::endl;
+			NC_LOG_ERROR(LOG_SUB_SLAVE, "Configuring remote as slave failed.");
 			// TODO: disconnect from slave remotes.
 			returnMsg->setResultValue(new NymphType((uint8_t) 1));
 			msg->discard();
@@ -880,23 +1249,48 @@ NymphMessage* session_add_slave(int session, NymphMessage* msg, void* data) {
 			return returnMsg;
 		}
 		
-		// Use returned time stamp to calculate the delay.
-		// FIXME: using stopwatch-style local time to determine latency for now.
+		// Determine the offset of the slave's clock and the round trip to it, using a number of
+		// timestamp exchanges.
+		rm.clock = std::make_shared<ClockSync>(rm.handle, syncSlaveClock, clock_sync_config);
+		rm.clock->setUpdateHandler(syncSlaveTimeline);
+		if (!rm.clock->sync()) {
+			NC_LOG_ERROR(LOG_SUB_SLAVE, "Clock synchronisation with slave failed.");
+			// TODO: disconnect from slave remotes.
+			rm.clock.reset();
+			returnMsg->setResultValue(new NymphType((uint8_t) 1));
+			msg->discard();
+			
+			return returnMsg;
+		}
 		
-		//rm.delay = theirs - now;
-		rm.delay = pong - now;
-		std::cout << "Slave delay: " << rm.delay << " microseconds." << std::endl;
-		std::cout << "Current max slave delay: " << slaveLatencyMax << std::endl;
+		rm.delay = rm.clock->getDelay();
+		NC_LOG_INFO(LOG_SUB_SLAVE, "Slave delay: %" PRId64 " microseconds, clock offset: %" PRId64 
+					" microseconds.", (int64_t) rm.delay, (int64_t) rm.clock->getOffset());
+		NC_LOG_INFO(LOG_SUB_SLAVE, "Current max slave delay: %u", slaveLatencyMax);
 		if (rm.delay > slaveLatencyMax) { 
 			slaveLatencyMax = rm.delay;
-			std::cout << "Max slave latency increased to: " << slaveLatencyMax << " microseconds." 
-						<< std::endl;
+			NC_LOG_INFO(LOG_SUB_SLAVE, "Max slave latency increased to: %u microseconds.", 
+																			slaveLatencyMax);
 		}
 	}
 	
-	NYMPH_LOG_INFORMATION("Switching to master server mode.");
+	// Each slave gets its own sender, so that the data is sent to all slaves at the same time.
+	for (int i = 0; i < slave_remotes.size(); ++i) {
+		NymphCastSlaveRemote& rm = slave_remotes[i];
+		if (rm.sender) { continue; }
+		rm.sender = std::make_shared<SlaveSender>(rm.handle, rm.name, sendSlaveData, slave_config);
+		rm.sender->start();
+		
+		// Keep the clocks synchronised during playback.
+		rm.clock->start();
+	}
+	
+	NC_LOG_INFO(LOG_SUB_SLAVE, "Switching to master server mode.");
 	serverMode = NCS_MODE_MASTER;
 	
+	// Data is passed on to the slaves as it arrives, so it has to arrive in order.
+	SessionManager::setRequestWindow(1);
+	
 	returnMsg->setResultValue(new NymphType((uint8_t) 0));
 	msg->discard();
 	
@@ -904,77 +1298,90 @@ NymphMessage* session_add_slave(int session, NymphMessage* msg, void* data) {
 }
 
 
-// Client sends a chunk of track data.
-// Returns: OK (0), ERROR (1).
-// int session_data(string buffer, boolean done)
-NymphMessage* session_data(int session, NymphMessage* msg, void* data) {
+// --- SESSION DATA ---
+// Handles a chunk of track data sent by the client. Tagged data carries the file offset it starts
+// at, as its third parameter.
+NymphMessage* sessionData(int session, NymphMessage* msg, bool tagged) {
 	NymphMessage* returnMsg = msg->getReplyMessage();
 	
-	// Get iterator to the session instance for the client.
-	std::map<int, CastClient>::iterator it;
-	it = clients.find(session);
-	if (it == clients.end()) {
+	// Each data block counts as contact with the client.
+	if (!clients.touch(session)) {
 		returnMsg->setResultValue(new NymphType((uint8_t) 1));
 		msg->discard();
 		return returnMsg;
 	}
 	
+	CastSessionPtr cs = SessionManager::get(session);
+	if (!cs) {
+		returnMsg->setResultValue(new NymphType((uint8_t) 1));
+		msg->discard();
+		return returnMsg;
+	}
+	
+	std::shared_ptr<DataBuffer> buffer = cs->getBuffer();
+	
 	// Safely write the data for this session to the buffer.
 	//std::string mediaData = ((NymphBlob*) msg->parameters()[0])->getValue();
 	NymphType* mediaData = msg->parameters()[0];
 	bool done = msg->parameters()[1]->getBool();
+	metricBytesIngested->add(mediaData->string_length());
 	
-	// Write string into buffer.
-	DataBuffer::write(mediaData->getChar(), mediaData->string_length());
+	// Write string into buffer. Tagged data is placed at its offset, and can arrive out of order.
+	uint64_t position = 0;
+	uint32_t written = 0;
+	if (tagged) {
+		position = msg->parameters()[2]->getUint64();
+		written = buffer->writeAt(position, mediaData->getChar(), mediaData->string_length(), done);
+	}
+	else {
+		written = buffer->write(mediaData->getChar(), mediaData->string_length(), position);
+	}
 	
-	// If passing the message through to slave remotes, add the timestamp to the message.
-	// This timestamp is the current time plus the largest master-slave latency times 2.
-	int64_t then = 0;
+	// If passing the message through to slave remotes, add the timestamp to the message. Before
+	// playback starts, this is the start of the presentation timeline, converted to the slave's
+	// clock. The start leaves time for the data to reach every slave.
 	if (serverMode == NCS_MODE_MASTER) {
-		Poco::Timestamp ts;
-		int64_t now = (int64_t) ts.epochMicroseconds();
-		//then = now + (slaveLatencyMax * 2);
+		int64_t start = 0;
+		if (!playerStarted) {
+			start = SyncTarget::getStart();
+			if (start == 0) {
+				start = ClockSync::now() + slaveLatencyMax + (int64_t) sync_start_delay * 1000;
+				SyncTarget::setTimeline(start);
+			}
+		}
 		
-		// Timing: 	Multiply the max slave latency by the number of slaves. After sending this delay
-		// 			to the first slave (minus half its recorded latency), 
-		// 			subtract the time it took to send to this slave from the
-		//			first delay, then send this new delay to the second slave, and so on.
-		int64_t countdown = slaveLatencyMax * slave_remotes.size();
+		// Send the data to the slaves straight from the data buffer. The chunk keeps it from being
+		// overwritten until all slaves have been served. Only the data which was stored is sent:
+		// the rest gets requested again, and is sent on once it has been stored.
+		MediaChunkPtr chunk;
+		if (written > 0) {
+			chunk = buffer->getChunk(position, written, done && written == mediaData->string_length());
+		}
 		
+		// The data is queued with each slave's sender, which sends it on from its own thread.
+		// A slave whose queue is full either holds up this call until it catches up, or gets
+		// dropped, depending on the lag policy.
 		for (int i = 0; i < slave_remotes.size(); ++i) {
 			NymphCastSlaveRemote& rm = slave_remotes[i];
-			//then = slaveLatencyMax - rm.delay;
-			then = countdown - (rm.delay / 2);
-			
-			int64_t send = (int64_t) ts.epochMicroseconds();
+			if (!rm.sender || !chunk) { continue; }
+			int64_t then = (start != 0 && rm.clock) ? rm.clock->toRemote(start) : 0;
+			rm.sender->send(buffer, chunk, then);
+		}
 		
-			// Prepare data vector.
-			NymphType* media = new NymphType((char*) mediaData->getChar(), mediaData->string_length());
-			NymphType* doneBool = new NymphType(done);
-			std::vector<NymphType*> values;
-			values.push_back(media);
-			values.push_back(doneBool);
-			values.push_back(new NymphType(then));
-			
-			std::string result;
-			NymphType* returnValue = 0;
-			if (!NymphRemoteServer::callMethod(rm.handle, "receiveDataMaster", values, returnValue, result)) {
-				// TODO:
+		removeDroppedSlaves();
+		
+		if (done) {
+			// Log the per-slave statistics for this file.
+			for (int i = 0; i < slave_remotes.size(); ++i) {
+				NymphCastSlaveRemote& rm = slave_remotes[i];
+				if (!rm.sender) { continue; }
+				SlaveSenderStats st = rm.sender->getStats();
+				NC_LOG_INFO(LOG_SUB_SLAVE, "Slave %s: %" PRIu64 " bytes sent, %u B/s, %u us per block, "
+							"%u blocks max queued, %" PRId64 " us sync error.", rm.name.c_str(), 
+							st.bytesSent, st.throughput, st.sendTime, st.queuedMax, 
+							rm.clock ? rm.clock->getSyncError() : (int64_t) 0);
 			}
-			
-			delete returnValue;
-			
-			int64_t receive = (int64_t) ts.epochMicroseconds();
-			
-			countdown -= (receive - send);
 		}
-		
-		// Wait out the countdown.
-		std::condition_variable cv;
-		std::mutex cv_m;
-		std::unique_lock<std::mutex> lk(cv_m);
-		std::chrono::microseconds dur(countdown);
-		while (cv.wait_for(lk, dur) != std::cv_status::timeout) { }
 	}
 	
 	// Start the player if it hasn't yet. This ensures we have a buffer ready.
@@ -989,30 +1396,30 @@ NymphMessage* session_data(int session, NymphMessage* msg, void* data) {
 		} */
 		
 		if (serverMode == NCS_MODE_MASTER) {
-			// Start the player when the delay in 'then' has been reached.
+			// Start the player at the start of the presentation timeline, like the slaves.
 			std::condition_variable cv;
 			std::mutex cv_m;
 			std::unique_lock<std::mutex> lk(cv_m);
-			std::chrono::microseconds dur(slaveLatencyMax);
-			//std::chrono::time_point<std::chrono::system_clock> when(dur);
-			while (cv.wait_for(lk, dur) != std::cv_status::timeout) { }
+			std::chrono::microseconds dur(SyncTarget::getStart());
+			std::chrono::time_point<std::chrono::system_clock> when(dur);
+			while (cv.wait_until(lk, when) != std::cv_status::timeout) { }
 		}
 		
 		// Start playback locally.
-		playerStarted = true;
-		avThread.start(ffplay);
+		startPlayer(cs);
 		
 		// Signal the clients that we're playing now.
-		sendGlobalStatusUpdate();
+		statusPublisher.transition();
 	}
 	else {
-		// Send status update to clients.
-		sendGlobalStatusUpdate();
+		// New data. The clients get the status with the next routine update.
+		statusPublisher.notify();
 	}
 	
 	// if 'done' is true, the client has sent the last bytes. Signal session end in this case.
-	if (done) {
-		DataBuffer::setEof(done);
+	// For tagged data the buffer sets EOF itself, once all data up to this point has arrived.
+	if (done && !tagged) {
+		buffer->setEof(done);
 	}
 	
 	returnMsg->setResultValue(new NymphType((uint8_t) 0));
@@ -1022,6 +1429,23 @@ NymphMessage* session_data(int session, NymphMessage* msg, void* data) {
 }
 
 
+// Client sends a chunk of track data.
+// Returns: OK (0), ERROR (1).
+// int session_data(string buffer, boolean done)
+NymphMessage* session_data(int session, NymphMessage* msg, void* data) {
+	return sessionData(session, msg, false);
+}
+
+
+// Client sends a chunk of track data for the file range starting at 'offset', in response to a
+// MediaReadCallback or MediaSeekCallback. Chunks may be sent in any order.
+// Returns: OK (0), ERROR (1).
+// int session_data_offset(string buffer, boolean done, uint64 offset)
+NymphMessage* session_data_offset(int session, NymphMessage* msg, void* data) {
+	return sessionData(session, msg, true);
+}
+
+
 // Client ends the session.
 // Returns: OK (0), ERROR (1).
 // int session_end()
@@ -1029,16 +1453,21 @@ NymphMessage* session_end(int session, NymphMessage* msg, void* data) {
 	NymphMessage* returnMsg = msg->getReplyMessage();
 	
 	// Mark session as inactive.
-	std::map<int, CastClient>::iterator it;
-	it = clients.find(session);
-	if (it == clients.end()) {
+	CastClientPtr client = clients.get(session);
+	if (!client) {
 		returnMsg->setResultValue(new NymphType((uint8_t) 1));
 		msg->discard();
 		
 		return returnMsg;
 	}
 	
-	it->second.sessionActive = false;
+	client->sessionActive = false;
+	
+	// Release the session's buffer, unless its data is being played back, or waiting to be played.
+	CastSessionPtr cs = SessionManager::get(session);
+	if (cs && cs != SessionManager::getActive() && !cs->ready()) {
+		SessionManager::remove(session);
+	}
 	
 	returnMsg->setResultValue(new NymphType((uint8_t) 0));
 	msg->discard();
@@ -1203,7 +1632,7 @@ NymphMessage* playback_start(int session, NymphMessage* msg, void* data) {
 	playerPaused = false;
 	
 	// Send status update to clients.
-	sendGlobalStatusUpdate();
+	statusPublisher.transition();
 	
 	returnMsg->setResultValue(new NymphType((uint8_t) 0));
 	msg->discard();
@@ -1272,7 +1701,7 @@ NymphMessage* playback_pause(int session, NymphMessage* msg, void* data) {
 	playerPaused = ~playerPaused;
 	
 	// Send status update to clients.
-	sendGlobalStatusUpdate();
+	statusPublisher.transition();
 	
 	returnMsg->setResultValue(new NymphType((uint8_t) 0));
 	msg->discard();
@@ -1397,37 +1826,40 @@ NymphMessage* cycle_subtitle(int session, NymphMessage* msg, void* data) {
 }
 
 
-enum {
-	NYMPH_SEEK_TYPE_BYTES = 1,
-	NYMPH_SEEK_TYPE_PERCENTAGE = 2
-};
-
-
 // --- PLAYBACK SEEK ---
-// uint8 playback_seek(uint64)
+// Seeks to the position in the array: [uint8 type, value]. The type is one of NymphSeekType:
+// bytes (uint64), percentage (uint8), or absolute or relative seconds (double).
+// The position at which the seek lands gets sent to the clients as a status update.
+// uint8 playback_seek(array)
 NymphMessage* playback_seek(int session, NymphMessage* msg, void* data) {
 	NymphMessage* returnMsg = msg->getReplyMessage();
 	
-	uint8_t type = msg->parameters()[0]->getUint8();
+	std::vector<NymphType*>* values = msg->parameters()[0]->getArray();
+	if (values->size() < 2) {
+		returnMsg->setResultValue(new NymphType((uint8_t) 1));
+		msg->discard();
+		return returnMsg;
+	}
+	
+	uint8_t type = (*values)[0]->getUint8();
 	if (type == NYMPH_SEEK_TYPE_PERCENTAGE) {
-		uint8_t percentage = msg->parameters()[1]->getUint8();
+		uint8_t percentage = (*values)[1]->getUint8();
 		
 		// Sanity check.
 		// We accept a value from 0 - 100.
 		if (percentage > 100) { percentage = 100; }
-	
-		// Create mouse event structure.
-		SDL_Event event;
-		event.type = nymph_seek_event;
-		event.user.code = NYMPH_SEEK_EVENT;
-		event.user.code = percentage;
-		SDL_PushEvent(&event);
+		
+		Player::requestSeek(type, percentage);
 	}
 	else if (type == NYMPH_SEEK_TYPE_BYTES) {
-		// TODO: implement.
+		Player::requestSeek(type, (double) (*values)[1]->getUint64());
+	}
+	else if (type == NYMPH_SEEK_TYPE_TIME || type == NYMPH_SEEK_TYPE_RELATIVE) {
+		Player::requestSeek(type, (*values)[1]->getDouble());
 	}
 	else {
 		returnMsg->setResultValue(new NymphType((uint8_t) 1));
+		msg->discard();
 		return returnMsg;
 	}
 	
@@ -1438,6 +1870,14 @@ NymphMessage* playback_seek(int session, NymphMessage* msg, void* data) {
 }
 
 
+// --- SEEK LANDED ---
+// Called by the player's read thread with the position at which a seek landed.
+void seekLanded(double position) {
+	file_meta.position = position;
+	statusPublisher.transition();
+}
+
+
 // --- PLAYBACK URL ---
 // uint8 playback_url(string)
 NymphMessage* playback_url(int session, NymphMessage* msg, void* data) {
@@ -1467,8 +1907,8 @@ NymphMessage* playback_url(int session, NymphMessage* msg, void* data) {
 		retval->setValue((uint8_t) 0);
 	}
 	
-	// Send status update to client.
-	sendStatusUpdate(DataBuffer::getSessionHandle());
+	// Send status update to clients.
+	statusPublisher.transition();
 	
 	returnMsg->setResultValue(retval);
 	msg->discard();
@@ -1482,8 +1922,25 @@ NymphMessage* playback_url(int session, NymphMessage* msg, void* data) {
 // struct playback_status()
 NymphMessage* playback_status(int session, NymphMessage* msg, void* data) {
 	NymphMessage* returnMsg = msg->getReplyMessage();
+	
+	// Status requests count as contact with the client.
+	clients.touch(session);
 		
-	returnMsg->setResultValue(new NymphType(getPlaybackStatus(), true));
+	// The reply refers to the shared status map, instead of a copy. See getPlaybackStatus().
+	returnMsg->setResultValue(new NymphType(getPlaybackStatus(session)));
+	msg->discard();
+	
+	return returnMsg;
+}
+
+
+// --- METRICS GET ---
+// string metrics_get()
+NymphMessage* metrics_get(int session, NymphMessage* msg, void* data) {
+	NymphMessage* returnMsg = msg->getReplyMessage();
+	
+	std::string* text = new std::string(Metrics::exportText());
+	returnMsg->setResultValue(new NymphType(text, true));
 	msg->discard();
 	
 	return returnMsg;
@@ -1532,17 +1989,17 @@ NymphMessage* app_send(int session, NymphMessage* msg, void* data) {
 	std::string* result = new std::string();
 	NymphCastApp app = nc_apps.findApp(appId);
 	if (app.id.empty()) {
-		std::cerr << "Failed to find a matching application for '" << appId << "'." << std::endl;
+		NC_LOG_ERROR(LOG_SUB_CORE, "Failed to find a matching application for '%s'.", appId.c_str());
 		returnMsg->setResultValue(new NymphType(result, true));
 		msg->discard();
 			
 		return returnMsg;
 	}
 	
-	std::cout << "Found " << appId << " app." << std::endl;
+	NC_LOG_INFO(LOG_SUB_CORE, "Found %s app.", appId.c_str());
 	
 	if (!nc_apps.runApp(appId, message, *result)) {
-		std::cerr << "Error running app: " << result << std::endl;
+		NC_LOG_ERROR(LOG_SUB_CORE, "Error running app: %s", result->c_str());
 		
 		// TODO: report back error to client.
 	}
@@ -1570,7 +2027,7 @@ NymphMessage* app_loadResource(int session, NymphMessage* msg, void* data) {
 		// First check that the name doesn't contain a '/' or '\' as this might be used to create
 		// a relative path that breaks security (hierarchy travel).
 		if (name.find('/') != std::string::npos || name.find('\\') != std::string::npos) {
-			std::cerr << "File name contained illegal directory separator character." << std::endl;
+			NC_LOG_ERROR(LOG_SUB_CORE, "File name contained illegal directory separator character.");
 			returnMsg->setResultValue(new NymphType(result, true));
 			msg->discard();
 			
@@ -1579,7 +2036,7 @@ NymphMessage* app_loadResource(int session, NymphMessage* msg, void* data) {
 		
 		fs::path f = appsFolder + name;
 		if (!fs::exists(f)) {
-			std::cerr << "Failed to find requested file '" << f.string() << "'." << std::endl;
+			NC_LOG_ERROR(LOG_SUB_CORE, "Failed to find requested file '%s'.", f.string().c_str());
 			returnMsg->setResultValue(new NymphType(result, true));
 			msg->discard();
 			
@@ -1587,7 +2044,7 @@ NymphMessage* app_loadResource(int session, NymphMessage* msg, void* data) {
 		}
 		
 		// Read in file data.
-		std::cout << "Reading file: " << f.string() << std::endl;
+		NC_LOG_INFO(LOG_SUB_CORE, "Reading file: %s", f.string().c_str());
 		std::ifstream fstr(f.string());
 		fstr.seekg(0, std::ios::end);
 		size_t size = fstr.tellg();
@@ -1602,7 +2059,7 @@ NymphMessage* app_loadResource(int session, NymphMessage* msg, void* data) {
 		// relative path that lead up the hierarchy.
 		NymphCastApp app = nc_apps.findApp(appId);
 		if (app.id.empty()) {
-			std::cerr << "Failed to find a matching application for '" << appId << "'." << std::endl;
+			NC_LOG_ERROR(LOG_SUB_CORE, "Failed to find a matching application for '%s'.", appId.c_str());
 			returnMsg->setResultValue(new NymphType(result, true));
 			msg->discard();
 			
@@ -1612,7 +2069,7 @@ NymphMessage* app_loadResource(int session, NymphMessage* msg, void* data) {
 		// Next check that the name doesn't contain a '/' or '\' as this might be used to create
 		// a relative path that breaks security (hierarchy travel).
 		if (name.find('/') != std::string::npos || name.find('\\') != std::string::npos) {
-			std::cerr << "File name contained illegal directory separator character." << std::endl;
+			NC_LOG_ERROR(LOG_SUB_CORE, "File name contained illegal directory separator character.");
 			returnMsg->setResultValue(new NymphType(result, true));
 			msg->discard();
 			
@@ -1621,7 +2078,7 @@ NymphMessage* app_loadResource(int session, NymphMessage* msg, void* data) {
 		
 		fs::path f = appsFolder + appId + "/" + name;
 		if (!fs::exists(f)) {
-			std::cerr << "Failed to find requested file '" << f.string() << "'." << std::endl;
+			NC_LOG_ERROR(LOG_SUB_CORE, "Failed to find requested file '%s'.", f.string().c_str());
 			returnMsg->setResultValue(new NymphType(result, true));
 			msg->discard();
 			
@@ -1629,7 +2086,7 @@ NymphMessage* app_loadResource(int session, NymphMessage* msg, void* data) {
 		}
 		
 		// Read in file data.
-		std::cout << "Reading file: " << f.string() << std::endl;
+		NC_LOG_INFO(LOG_SUB_CORE, "Reading file: %s", f.string().c_str());
 		std::ifstream fstr(f.string());
 		fstr.seekg(0, std::ios::end);
 		size_t size = fstr.tellg();
@@ -1718,6 +2175,17 @@ int main(int argc, char** argv) {
 		return 1;
 	}
 	
+	// Log levels, for all subsystems and per subsystem. Messages are written by a separate thread.
+	LogLevel logLevel = Logging::parseLevel(config.getValue<std::string>("log_level", "info"), 
+																			LOG_LEVEL_INFO);
+	for (int i = 0; i < LOG_SUBSYSTEMS; ++i) {
+		LogSubsystem sub = (LogSubsystem) i;
+		std::string key = std::string("log_level_") + Logging::subsystemName(sub);
+		Logging::setLevel(sub, Logging::parseLevel(config.getValue<std::string>(key, ""), logLevel));
+	}
+	
+	Logging::start();
+	
 	is_full_screen = config.getValue<bool>("fullscreen", false);
 	display_disable = config.getValue<bool>("disable_video", false);
 	screensaver_enable = config.getValue<bool>("enable_screensaver", false);
@@ -1767,6 +2235,21 @@ int main(int argc, char** argv) {
 	NymphMethod connectMasterFunction("connectMaster", parameters, NYMPH_SINT64, connectMaster);
 	NymphRemoteClient::registerMethod("connectMaster", connectMasterFunction);
 	
+	// Master server calls this to synchronise its clock with ours.
+	// struct syncClock(sint64)
+	parameters.clear();
+	parameters.push_back(NYMPH_SINT64);
+	NymphMethod syncClockFunction("syncClock", parameters, NYMPH_STRUCT, syncClock);
+	NymphRemoteClient::registerMethod("syncClock", syncClockFunction);
+	
+	// Master server calls this to keep us on its presentation timeline.
+	// sint64 syncTimeline(sint64 start, double base)
+	parameters.clear();
+	parameters.push_back(NYMPH_SINT64);
+	parameters.push_back(NYMPH_DOUBLE);
+	NymphMethod syncTimelineFunction("syncTimeline", parameters, NYMPH_SINT64, syncTimeline);
+	NymphRemoteClient::registerMethod("syncTimeline", syncTimelineFunction);
+	
 	// Receives data chunks for playback.
 	// uint8 receiveDataMaster(blob data, bool done, sint64)
 	parameters.clear();
@@ -1818,6 +2301,16 @@ int main(int argc, char** argv) {
 	NymphMethod sessionDataFunction("session_data", parameters, NYMPH_UINT8, session_data);
 	NymphRemoteClient::registerMethod("session_data", sessionDataFunction);
 	
+	// Client sends a chunk of track data for the requested file range starting at 'offset'.
+	// Returns: OK (0), ERROR (1).
+	// int session_data_offset(string buffer, boolean done, uint64 offset)
+	parameters.clear();
+	parameters.push_back(NYMPH_STRING);
+	parameters.push_back(NYMPH_BOOL);
+	parameters.push_back(NYMPH_UINT64);
+	NymphMethod sessionDataOffsetFunction("session_data_offset", parameters, NYMPH_UINT8, session_data_offset);
+	NymphRemoteClient::registerMethod("session_data_offset", sessionDataOffsetFunction);
+	
 	// Client ends the session.
 	// Returns: OK (0), ERROR (1).
 	// int session_end()
@@ -1914,8 +2407,8 @@ int main(int argc, char** argv) {
 	NymphRemoteClient::registerMethod("cycle_subtitle", cycleSubtitleFunction);
 	
 	// PlaybackSeek
-	// uint8 playback_seek(uint64)
-	// Seek to the indicated position.
+	// uint8 playback_seek(array)
+	// Seek to the indicated position: [uint8 type, value].
 	// Returns success or error number.
 	parameters.clear();
 	parameters.push_back(NYMPH_ARRAY);
@@ -1948,6 +2441,14 @@ int main(int argc, char** argv) {
 	NymphMethod appListFunction("app_list", parameters, NYMPH_STRING, app_list);
 	NymphRemoteClient::registerMethod("app_list", appListFunction);	
 	
+	// MetricsGet
+	// string metrics_get()
+	// Returns the receiver's metrics (buffer level, underruns, latencies, dropped frames, ...), in
+	// the Prometheus text format.
+	parameters.clear();
+	NymphMethod metricsGetFunction("metrics_get", parameters, NYMPH_STRING, metrics_get);
+	NymphRemoteClient::registerMethod("metrics_get", metricsGetFunction);
+	
 	// AppSend
 	// string app_send(uint32 appId, string data)
 	// Allows a client to send data to a NymphCast application.
@@ -1974,8 +2475,12 @@ int main(int argc, char** argv) {
 	// Register client callbacks
 	//
 	// MediaReadCallback
+	// Requests the block of data with the given length, starting at the given file offset. 
+	// Multiple requests can be outstanding.
+	// void MediaReadCallback(uint64 offset, uint32 length)
 	parameters.clear();
-	//parameters.push_back(NYMPH_STRING);
+	parameters.push_back(NYMPH_UINT64);
+	parameters.push_back(NYMPH_UINT32);
 	NymphMethod mediaReadCallback("MediaReadCallback", parameters, NYMPH_NULL);
 	mediaReadCallback.enableCallback();
 	NymphRemoteClient::registerCallback("MediaReadCallback", mediaReadCallback);
@@ -2024,12 +2529,108 @@ int main(int argc, char** argv) {
 	NymphRemoteServer::registerCallback("MediaStopCallback", MediaStopCallback, 0);
 	NymphRemoteServer::registerCallback("MediaStatusCallback", MediaStatusCallback, 0);
 	
-	// Initialise buffer of the desired size.
-	uint32_t buffer_size = config.getValue<uint32_t>("buffer_size", 20971520); // Default 20 MB.
-	DataBuffer::init(buffer_size);
-	DataBuffer::setSeekRequestCallback(seekingHandler);
+	// Each cast session gets a buffer of the desired size.
+	SessionConfig session_config;
+	session_config.bufferSize = config.getValue<uint32_t>("buffer_size", 20971520); // Default 20 MB.
+	
+	// Limits for the size of the data blocks requested from clients.
+	session_config.blockSizeMin = config.getValue<uint32_t>("block_size_min", 65536); // Default 64 kB.
+	session_config.blockSizeMax = config.getValue<uint32_t>("block_size_max", 8388608); // Default 8 MB.
+	
+	// Refill the buffer once it drops below the low watermark, up to the high watermark. Both are
+	// set as a percentage of the buffer size.
+	session_config.lowWatermark = config.getValue<uint32_t>("buffer_low_watermark", 25);
+	session_config.highWatermark = config.getValue<uint32_t>("buffer_high_watermark", 75);
+	
+	// Maximum number of data requests in flight.
+	request_window = config.getValue<uint32_t>("request_window", 4);
+	session_config.requestWindow = request_window;
+	
+	// Number of clients which can cast at the same time. Each session uses its own buffer.
+	session_config.maxSessions = config.getValue<uint32_t>("max_sessions", 2);
+	if (session_config.maxSessions == 0) { session_config.maxSessions = 1; }
+	
+	SessionManager::init(session_config, requestData, seekingHandler);
+	
+	// Per slave remote in master mode: the number of blocks queued for sending, and what happens
+	// when a slave falls behind by that much.
+	slave_config.queueDepth = config.getValue<uint32_t>("slave_queue_depth", 8);
+	slave_config.lagTimeout = config.getValue<uint32_t>("slave_lag_timeout", 2000);
+	if (config.getValue<uint32_t>("slave_lag_policy", 0) == 1) {
+		slave_config.policy = SLAVE_LAG_DROP;
+	}
+	
+	// Clock synchronisation with slave remotes: the number of timestamp exchanges when a slave is
+	// added, the interval between exchanges during playback, and the extra time before the start.
+	clock_sync_config.samples = config.getValue<uint32_t>("clock_sync_samples", 8);
+	clock_sync_config.interval = config.getValue<uint32_t>("clock_sync_interval", 5000);
+	sync_start_delay = config.getValue<uint32_t>("sync_start_delay", 250);
+	
+	// Minimum time between routine status updates to the clients.
+	StatusPublisherConfig status_config;
+	status_config.interval = config.getValue<uint32_t>("status_interval", 500);
+	statusPublisher.setConfig(status_config);
+	
+	// Clients which fail to receive status updates get removed after this many milliseconds
+	// without contact.
+	client_timeout = config.getValue<uint32_t>("client_timeout", 30000);
+	
+	// Start the player as soon as a session starts, and limit the data read to detect the streams.
+	fast_start = config.getValue<bool>("fast_start", true);
+	ffplay.setProbeLimits(config.getValue<int64_t>("probesize", 1048576),
+							config.getValue<int64_t>("analyzeduration", 1000000));
+	
+	// Open the next track this many seconds before the end of the current one.
+	StreamHandler::setPrefetchHandler(config.getValue<uint32_t>("prefetch_seconds", 10), 
+																			prefetchPlayback);
+	StreamHandler::setSeekHandler(seekLanded);
+	
+	// Keep the keyframe indices of index-less files, for fast seeks on the next play.
+	StreamHandler::setIndexPath(config.getValue<std::string>("keyframe_index_path", ""));
+	
+	// Decoder threading per codec and picture height, which defaults to the rules of the platform,
+	// and the cores and priority of the player's threads.
+	std::string decoder_threads = config.getValue<std::string>("decoder_threads", 
+																	DECODER_THREADS_DEFAULT);
+	if (!ThreadPolicy::setRules(decoder_threads)) {
+		NC_LOG_WARNING(LOG_SUB_CORE, "Invalid decoder_threads rules: '%s'. Ignoring.", 
+																	decoder_threads.c_str());
+	}
+	
+	const char* coreKeys[THREAD_ROLES] = { "cpu_video_decode", "cpu_audio", "cpu_audio", 
+																				"cpu_render" };
+	for (int i = 0; i < THREAD_ROLES; ++i) {
+		std::string cores = config.getValue<std::string>(coreKeys[i], "");
+		if (!ThreadPolicy::setCores((ThreadRole) i, cores)) {
+			NC_LOG_WARNING(LOG_SUB_CORE, "Invalid %s cores: '%s'. Ignoring.", coreKeys[i], 
+																			cores.c_str());
+		}
+	}
+	
+	ThreadPolicy::setAudioPriority(config.getValue<int>("audio_rt_priority", 0));
+	
+	// The buffer level of the active session is read when the metrics are requested.
+	Metrics::addCollector([] {
+		static MetricGauge* fill = Metrics::gauge("nymphcast_buffer_fill_bytes", 
+											"Unread data in the buffer of the active session.");
+		static MetricGauge* throughput = Metrics::gauge("nymphcast_client_throughput_bytes", 
+											"Measured throughput of the active session's client, "
+											"in bytes per second.");
+		static MetricGauge* clientCount = Metrics::gauge("nymphcast_clients", 
+											"Connected clients.");
+		CastSessionPtr cs = SessionManager::getActive();
+		std::shared_ptr<DataBuffer> buffer = cs ? cs->getBuffer() : std::shared_ptr<DataBuffer>();
+		fill->set(buffer ? buffer->getUnread() : 0);
+		throughput->set(buffer ? buffer->getThroughput() : 0);
+		clientCount->set(clients.handles().size());
+	});
 	
-	std::cout << "Set up new buffer with size: " << buffer_size << " bytes." << std::endl;
+	// Serve the metrics over HTTP on this port, if not zero. They are also available with the
+	// 'metrics_get' method.
+	uint32_t metrics_port = config.getValue<uint32_t>("metrics_port", 0);
+	
+	std::cout << "Sessions use a buffer with size: " << session_config.bufferSize << " bytes." 
+				<< std::endl;
 	
 	playerStarted = false;
 	
@@ -2051,6 +2652,7 @@ int main(int argc, char** argv) {
 	signal(SIGINT, signal_handler);
 	
 	// Start server on port 4004.
+	statusPublisher.start();
 	NymphRemoteClient::start(4004);
 	
 	// Start NyanSD announcement server.
@@ -2063,6 +2665,10 @@ int main(int argc, char** argv) {
 	std::cout << "Starting NyanSD on port 4004 UDP..." << std::endl;
 	NyanSD::startListener(4004);
 	
+	if (metrics_port != 0) {
+		metricsServer.start(metrics_port);
+	}
+	
 	if (lcdproc_enabled) {
 		// Try to connect to the local LCDProc daemon if it's running.
 		try {
@@ -2097,9 +2703,6 @@ int main(int argc, char** argv) {
 		}
 	}
 	
-	// Start the data request handler in its own thread.
-	std::thread drq(dataRequestFunction);
-	
 	// Start idle wallpaper & clock display.
 	// Transition time is 15 seconds.
 	bool init_success = true;
@@ -2153,10 +2756,8 @@ int main(int argc, char** argv) {
 	}
 	
 	// Clean-up
-	DataBuffer::cleanup();
 	running = false;
-	dataRequestCv.notify_one();
-	drq.join();
+	SessionManager::cleanup();
  
 	// Close window and clean up libSDL.
 	ffplay.quit();
@@ -2166,10 +2767,14 @@ int main(int argc, char** argv) {
 	std::cout << "Stopping SDL loop..." << std::endl;
 	
 	NyanSD::stopListener();
+	metricsServer.stop();
+	statusPublisher.stop();
 	NymphRemoteClient::shutdown();
 	
 	// Wait before exiting, giving threads time to exit.
 	Thread::sleep(2000); // 2 seconds.
 	
+	Logging::stop();
+	
 	return 0;
 }
@@ -0,0 +1,197 @@
+/*
+	clientregistry.cpp - Implementation of the client registry class.
+
+	Revision 0
+
+	Notes:
+			- A client is seen whenever it calls us, or a call to it succeeds. Failures alone do
+				not remove a client, as a call can fail while the client is busy or reconnecting.
+*/
+
+
+//#define DEBUG 1
+
+#include "clientregistry.h"
+
+#ifdef DEBUG
+#include <iostream>
+#endif
+
+
+// --- NOW ---
+// Returns the steady clock time, in milliseconds.
+int64_t ClientRegistry::now() {
+	return std::chrono::duration_cast<std::chrono::milliseconds>(
+								std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+// --- SHARD ---
+ClientRegistry::Shard& ClientRegistry::shard(int handle) {
+	return shards[(uint32_t) handle % CLIENT_REGISTRY_SHARDS];
+}
+
+
+// --- PARSE CLIENT STRING ---
+// Splits the client string of the connect call into the client ID and its capabilities. Unknown
+// capabilities are ignored.
+// Returns the capabilities (ClientCapability mask).
+uint32_t ClientRegistry::parseClientString(const std::string &str, std::string &name) {
+	size_t end = str.find(';');
+	name = str.substr(0, end);
+
+	uint32_t caps = 0;
+	while (end != std::string::npos) {
+		size_t start = end + 1;
+		end = str.find(';', start);
+		std::string cap = str.substr(start, (end == std::string::npos) ? end : end - start);
+		if (cap == "status_delta") { caps |= CLIENT_CAP_STATUS_DELTA; }
+	}
+
+	return caps;
+}
+
+
+// --- ADD ---
+// Adds a client. Returns false if a client with this handle exists already.
+bool ClientRegistry::add(int handle, const std::string &name, uint32_t caps) {
+	CastClientPtr client = std::make_shared<CastClient>();
+	client->name = name;
+	client->handle = handle;
+	client->caps = caps;
+	client->lastSeen = now();
+
+	Shard &sh = shard(handle);
+	std::unique_lock<std::shared_mutex> lk(sh.mutex);
+	if (!sh.clients.insert(std::pair<int, CastClientPtr>(handle, client)).second) {
+		return false;
+	}
+
+	count++;
+
+	return true;
+}
+
+
+// --- REMOVE ---
+// Removes a client. Threads which got the client before keep a valid instance.
+// Returns false if the client was not found.
+bool ClientRegistry::remove(int handle) {
+	CastClientPtr client;
+	Shard &sh = shard(handle);
+	std::unique_lock<std::shared_mutex> lk(sh.mutex);
+	std::map<int, CastClientPtr>::iterator it = sh.clients.find(handle);
+	if (it == sh.clients.end()) { return false; }
+
+	client = it->second;		// Released outside the lock.
+	sh.clients.erase(it);
+	count--;
+	lk.unlock();
+
+	return true;
+}
+
+
+// --- GET ---
+// Returns the client with this handle, or an empty pointer.
+CastClientPtr ClientRegistry::get(int handle) {
+	Shard &sh = shard(handle);
+	std::shared_lock<std::shared_mutex> lk(sh.mutex);
+	std::map<int, CastClientPtr>::iterator it = sh.clients.find(handle);
+	if (it == sh.clients.end()) { return CastClientPtr(); }
+
+	return it->second;
+}
+
+
+// --- CONTAINS ---
+bool ClientRegistry::contains(int handle) {
+	Shard &sh = shard(handle);
+	std::shared_lock<std::shared_mutex> lk(sh.mutex);
+	return sh.clients.find(handle) != sh.clients.end();
+}
+
+
+// --- TOUCH ---
+// Records contact with a client. Returns false if the client was not found.
+bool ClientRegistry::touch(int handle) {
+	CastClientPtr client = get(handle);
+	if (!client) { return false; }
+
+	client->lastSeen = now();
+	client->failures = 0;
+
+	return true;
+}
+
+
+// --- FAIL ---
+// Records a failed call to a client.
+void ClientRegistry::fail(int handle) {
+	CastClientPtr client = get(handle);
+	if (client) { client->failures++; }
+}
+
+
+// --- HANDLES ---
+// Returns the handles of all clients at this time.
+std::vector<int> ClientRegistry::handles() {
+	std::vector<int> out;
+	out.reserve(count);
+	for (int i = 0; i < CLIENT_REGISTRY_SHARDS; ++i) {
+		std::shared_lock<std::shared_mutex> lk(shards[i].mutex);
+		std::map<int, CastClientPtr>::iterator it;
+		for (it = shards[i].clients.begin(); it != shards[i].clients.end(); ++it) {
+			out.push_back(it->first);
+		}
+	}
+
+	return out;
+}
+
+
+// --- EVICT ---
+// Removes the clients which failed to respond, and have not been seen for 'timeout' milliseconds.
+// Returns the handles of the removed clients.
+std::vector<int> ClientRegistry::evict(uint32_t timeout) {
+	std::vector<int> evicted;
+	int64_t limit = now() - timeout;
+	for (int i = 0; i < CLIENT_REGISTRY_SHARDS; ++i) {
+		std::unique_lock<std::shared_mutex> lk(shards[i].mutex);
+		std::map<int, CastClientPtr>::iterator it;
+		for (it = shards[i].clients.begin(); it != shards[i].clients.end();/**/) {
+			if (it->second->failures > 0 && it->second->lastSeen < limit) {
+				evicted.push_back(it->first);
+				it = shards[i].clients.erase(it);
+				count--;
+			}
+			else {
+				++it;
+			}
+		}
+	}
+
+#ifdef DEBUG
+	for (int i = 0; i < evicted.size(); ++i) {
+		std::cout << "ClientRegistry: evicted client " << evicted[i] << std::endl;
+	}
+#endif
+
+	return evicted;
+}
+
+
+// --- SIZE ---
+uint32_t ClientRegistry::size() {
+	return count;
+}
+
+
+// --- CLEAR ---
+void ClientRegistry::clear() {
+	for (int i = 0; i < CLIENT_REGISTRY_SHARDS; ++i) {
+		std::unique_lock<std::shared_mutex> lk(shards[i].mutex);
+		count -= shards[i].clients.size();
+		shards[i].clients.clear();
+	}
+}
@@ -0,0 +1,85 @@
+/*
+	clientregistry.h - Header for the client registry class.
+
+	Revision 0
+
+	Features:
+			- Keeps the connected clients, for access from any RPC thread.
+			- Splits the clients over shards with their own lock, so that lookups rarely contend,
+				and only wait for a writer on the same shard, for the duration of a map update.
+			- Hands out clients by shared pointer, so that a client being removed remains valid
+				for threads still using it.
+			- Evicts clients which failed to respond, and have not been heard from for a while,
+				instead of on the first failure.
+
+	Notes:
+			- The client handle is the NymphRPC session.
+			- Clients advertise capabilities after their ID in the client string, separated by
+				';', e.g. 'MyClient;status_delta'. Older clients send only the ID.
+*/
+
+
+#ifndef CLIENTREGISTRY_H
+#define CLIENTREGISTRY_H
+
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+
+
+#define CLIENT_REGISTRY_SHARDS 16
+
+
+// Capabilities of a client, as a bit mask.
+enum ClientCapability {
+	CLIENT_CAP_STATUS_DELTA	= 0x1	// 'status_delta': takes updates of the changed fields only.
+};
+
+
+struct CastClient {
+	std::string name;
+	int handle;
+	uint32_t caps = 0;			// ClientCapability mask.
+	std::atomic<bool> sessionActive = { false };
+	std::atomic<uint32_t> filesize = { 0 };
+	std::atomic<int64_t> lastSeen = { 0 };		// Last contact, in milliseconds (steady clock).
+	std::atomic<uint32_t> failures = { 0 };		// Failed calls since the last contact.
+};
+
+typedef std::shared_ptr<CastClient> CastClientPtr;
+
+
+class ClientRegistry {
+	struct Shard {
+		std::shared_mutex mutex;
+		std::map<int, CastClientPtr> clients;
+	};
+
+	Shard shards[CLIENT_REGISTRY_SHARDS];
+	std::atomic<uint32_t> count = { 0 };
+
+	Shard& shard(int handle);
+
+public:
+	static int64_t now();
+	static uint32_t parseClientString(const std::string &str, std::string &name);
+
+	bool add(int handle, const std::string &name, uint32_t caps = 0);
+	bool remove(int handle);
+	CastClientPtr get(int handle);
+	bool contains(int handle);
+	bool touch(int handle);
+	void fail(int handle);
+	std::vector<int> handles();
+	std::vector<int> evict(uint32_t timeout);
+	uint32_t size();
+	void clear();
+};
+
+#endif
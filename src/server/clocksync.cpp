@@ -0,0 +1,260 @@
+/*
+	clocksync.cpp - Implementation of the master-slave clock synchronisation class.
+
+	Revision 0
+
+	Notes:
+			- Each exchange yields an offset estimate, which is off by at most half the
+				asymmetry of the round trip. Exchanges with a short round trip have little room for
+				asymmetry, so only the shorter half of the window is used.
+			- The drift is the slope of a least-squares fit of these offsets over time.
+*/
+
+
+//#define DEBUG 1
+
+#include "clocksync.h"
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#ifdef DEBUG
+#include <iostream>
+#endif
+
+
+// Minimum time covered by the fitted exchanges before the drift gets estimated, in microseconds.
+#define CLOCKSYNC_DRIFT_SPAN 1000000
+
+
+// --- CONSTRUCTOR ---
+ClockSync::ClockSync(uint32_t handle, ClockExchangeHandler handler, const ClockSyncConfig &config,
+																			ClockSource clock) {
+	this->handle = handle;
+	this->handler = handler;
+	this->config = config;
+	this->clock = clock;
+	if (this->config.samples == 0) { this->config.samples = 1; }
+	if (this->config.window < this->config.samples) { this->config.window = this->config.samples; }
+}
+
+
+// --- DESTRUCTOR ---
+ClockSync::~ClockSync() {
+	stop();
+}
+
+
+// --- NOW ---
+// Returns the system time, in microseconds since the epoch.
+int64_t ClockSync::now() {
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+							std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+
+// --- EXCHANGE ---
+// Performs a single timestamp exchange with the slave, and updates the estimate.
+// Returns false if the exchange failed.
+bool ClockSync::exchange() {
+	if (!handler) { return false; }
+
+	ClockSample sample;
+	sample.t0 = clock();
+	if (!handler(handle, sample.t0, sample.t1, sample.t2)) { return false; }
+	sample.t3 = clock();
+
+	addSample(sample);
+
+	return true;
+}
+
+
+// --- SYNC ---
+// Performs the initial synchronisation with the slave.
+// Returns true if at least one exchange succeeded.
+bool ClockSync::sync() {
+	for (uint32_t i = 0; i < config.samples; ++i) {
+		exchange();
+	}
+
+	return isSynced();
+}
+
+
+// --- ADD SAMPLE ---
+// Adds the result of an exchange to the window, and updates the estimate.
+void ClockSync::addSample(const ClockSample &sample) {
+	std::lock_guard<std::mutex> lk(sampleMutex);
+	samples.push_back(sample);
+	while (samples.size() > config.window) { samples.pop_front(); }
+
+	estimate();
+	synced = true;
+}
+
+
+// --- ESTIMATE ---
+// Fits the offset and drift to the exchanges with the shortest round trips in the window.
+// Expects the sample mutex to be held.
+void ClockSync::estimate() {
+	std::vector<ClockSample> best(samples.begin(), samples.end());
+	std::sort(best.begin(), best.end(), [](const ClockSample &a, const ClockSample &b) {
+		return a.delay() < b.delay();
+	});
+
+	best.resize((best.size() + 1) / 2);
+	delay = best[0].delay();
+
+	int64_t first = best[0].time();
+	int64_t last = first;
+	double meanTime = 0.0;
+	double meanOffset = 0.0;
+	for (int i = 0; i < best.size(); ++i) {
+		first = std::min(first, best[i].time());
+		last = std::max(last, best[i].time());
+		meanTime += (double) (best[i].time() - best[0].time());
+		meanOffset += (double) best[i].offset();
+	}
+
+	meanTime /= best.size();
+	meanOffset /= best.size();
+
+	// Without enough time between the exchanges, keep the drift and use the best exchange.
+	if (best.size() < 3 || last - first < CLOCKSYNC_DRIFT_SPAN) {
+		reference = best[0].time();
+		offset = best[0].offset();
+		return;
+	}
+
+	double sxx = 0.0;
+	double sxy = 0.0;
+	for (int i = 0; i < best.size(); ++i) {
+		double x = (double) (best[i].time() - best[0].time()) - meanTime;
+		double y = (double) best[i].offset() - meanOffset;
+		sxx += x * x;
+		sxy += x * y;
+	}
+
+	drift = sxy / sxx;
+	reference = best[0].time() + (int64_t) meanTime;
+	offset = (int64_t) meanOffset;
+
+#ifdef DEBUG
+	std::cout << "ClockSync " << handle << ": offset " << offset << " us, drift "
+				<< drift * 1000000.0 << " ppm, delay " << delay << " us." << std::endl;
+#endif
+}
+
+
+// --- SET UPDATE HANDLER ---
+// Sets the function which is called after each periodic re-synchronisation.
+void ClockSync::setUpdateHandler(ClockUpdateHandler handler) {
+	updateHandler = handler;
+}
+
+
+// --- START ---
+// Starts re-synchronising periodically.
+bool ClockSync::start() {
+	std::lock_guard<std::mutex> lk(syncMutex);
+	if (running) { return false; }
+
+	running = true;
+	syncThread = std::thread(&ClockSync::run, this);
+
+	return true;
+}
+
+
+// --- STOP ---
+void ClockSync::stop() {
+	std::unique_lock<std::mutex> lk(syncMutex);
+	running = false;
+	lk.unlock();
+	syncCV.notify_one();
+
+	if (syncThread.joinable()) { syncThread.join(); }
+}
+
+
+// --- RUN ---
+// Performs an exchange every interval.
+void ClockSync::run() {
+	std::unique_lock<std::mutex> lk(syncMutex);
+	while (running) {
+		syncCV.wait_for(lk, std::chrono::milliseconds(config.interval), [this] { return !running; });
+		if (!running) { break; }
+
+		lk.unlock();
+		if (exchange() && updateHandler) { updateHandler(*this); }
+		lk.lock();
+	}
+}
+
+
+// --- GET HANDLE ---
+uint32_t ClockSync::getHandle() {
+	return handle;
+}
+
+
+// --- IS SYNCED ---
+bool ClockSync::isSynced() {
+	std::lock_guard<std::mutex> lk(sampleMutex);
+	return synced;
+}
+
+
+// --- GET OFFSET ---
+// Returns the current offset of the slave clock relative to the master's, in microseconds.
+int64_t ClockSync::getOffset() {
+	int64_t local = clock();
+	return toRemote(local) - local;
+}
+
+
+// --- GET DRIFT ---
+// Returns the drift of the slave clock relative to the master's, in parts per million.
+double ClockSync::getDrift() {
+	std::lock_guard<std::mutex> lk(sampleMutex);
+	return drift * 1000000.0;
+}
+
+
+// --- GET DELAY ---
+// Returns the shortest round trip to the slave, in microseconds.
+int64_t ClockSync::getDelay() {
+	std::lock_guard<std::mutex> lk(sampleMutex);
+	return delay;
+}
+
+
+// --- TO REMOTE ---
+// Converts a master time to slave time.
+int64_t ClockSync::toRemote(int64_t local) {
+	std::lock_guard<std::mutex> lk(sampleMutex);
+	return local + offset + (int64_t) (drift * (double) (local - reference));
+}
+
+
+// --- TO LOCAL ---
+// Converts a slave time to master time.
+int64_t ClockSync::toLocal(int64_t remote) {
+	std::lock_guard<std::mutex> lk(sampleMutex);
+	return reference + (int64_t) ((double) (remote - offset - reference) / (1.0 + drift));
+}
+
+
+// --- SET SYNC ERROR ---
+// Records the difference between the slave's playback and the timeline, in microseconds.
+void ClockSync::setSyncError(int64_t error) {
+	syncError = error;
+}
+
+
+// --- GET SYNC ERROR ---
+int64_t ClockSync::getSyncError() {
+	return syncError;
+}
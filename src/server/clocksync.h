@@ -0,0 +1,118 @@
+/*
+	clocksync.h - Header for the master-slave clock synchronisation class.
+
+	Revision 0
+
+	Features:
+			- Estimates the offset and drift of a slave remote's clock relative to the master's,
+				from repeated timestamp exchanges.
+			- Filters out exchanges which were delayed on the network, by fitting only the
+				exchanges with the shortest round trip.
+			- Re-synchronises periodically from its own thread, after which an update handler is
+				called. The server uses it to send the slave the presentation timeline.
+			- Converts between master and slave time, so that the slave can be given absolute
+				times on a shared timeline.
+
+	Notes:
+			- Times are in microseconds since the epoch.
+*/
+
+
+#ifndef CLOCKSYNC_H
+#define CLOCKSYNC_H
+
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+
+// Sends the master's time 't0' to the slave remote with the given handle. The slave returns its
+// time when it received the request in 't1', and its time when it sent the response in 't2'.
+// Returns false if the exchange failed.
+typedef std::function<bool(uint32_t handle, int64_t t0, int64_t &t1, int64_t &t2)> ClockExchangeHandler;
+
+// Returns the current local time, in microseconds.
+typedef std::function<int64_t()> ClockSource;
+
+class ClockSync;
+
+// Called after each re-synchronisation, from the synchronisation thread.
+typedef std::function<void(ClockSync &clock)> ClockUpdateHandler;
+
+
+// One timestamp exchange. t0 and t3 are in master time, t1 and t2 in slave time.
+struct ClockSample {
+	int64_t t0;		// Request sent.
+	int64_t t1;		// Request received.
+	int64_t t2;		// Response sent.
+	int64_t t3;		// Response received.
+
+	int64_t offset() const { return ((t1 - t0) + (t2 - t3)) / 2; }
+	int64_t delay() const { return (t3 - t0) - (t2 - t1); }
+	int64_t time() const { return t0 + (t3 - t0) / 2; }
+};
+
+
+struct ClockSyncConfig {
+	uint32_t samples = 8;			// Exchanges for the initial synchronisation.
+	uint32_t window = 32;			// Exchanges kept for the estimate.
+	uint32_t interval = 5000;		// Milliseconds between re-synchronisations.
+};
+
+
+class ClockSync {
+	uint32_t handle;
+	ClockExchangeHandler handler;
+	ClockUpdateHandler updateHandler;
+	ClockSource clock;
+	ClockSyncConfig config;
+
+	std::mutex sampleMutex;
+	std::deque<ClockSample> samples;
+	int64_t offset = 0;			// Slave time minus master time at 'reference', in microseconds.
+	double drift = 0.0;			// Rate of the slave clock relative to the master's, minus one.
+	int64_t reference = 0;		// Master time the offset applies to.
+	int64_t delay = 0;			// Shortest round trip in the window, in microseconds.
+	bool synced = false;
+	std::atomic<int64_t> syncError = { 0 };	// Playback sync error reported by the slave.
+
+	std::thread syncThread;
+	std::mutex syncMutex;
+	std::condition_variable syncCV;
+	bool running = false;
+
+	void estimate();
+	void run();
+
+public:
+	ClockSync(uint32_t handle, ClockExchangeHandler handler, const ClockSyncConfig &config,
+															ClockSource clock = ClockSync::now);
+	~ClockSync();
+
+	static int64_t now();
+
+	bool exchange();
+	bool sync();
+	void addSample(const ClockSample &sample);
+	void setUpdateHandler(ClockUpdateHandler handler);
+	bool start();
+	void stop();
+	uint32_t getHandle();
+	bool isSynced();
+	int64_t getOffset();
+	double getDrift();
+	int64_t getDelay();
+	int64_t toRemote(int64_t local);
+	int64_t toLocal(int64_t remote);
+	void setSyncError(int64_t error);
+	int64_t getSyncError();
+};
+
+typedef std::shared_ptr<ClockSync> ClockSyncPtr;
+
+#endif
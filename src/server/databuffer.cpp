@@ -4,7 +4,8 @@
 	Revision 0.
 	
 	Notes:
-			- 
+			- Each cast session has its own instance. Chunks refer back to the instance they came
+				from, so it has to outlive them.
 			
 	2020/11/19, Maya Posch
 */
@@ -21,6 +22,14 @@
 #include <iostream>
 #endif
 
+// Targeted time between requesting a block and receiving it, in microseconds. 
+// The block size is adapted to keep the per-request overhead low, while keeping requests short
+// enough to react to seeks and underruns.
+#define DATABUFFER_BLOCK_TIME_TARGET 200000
+
+// Longest time a read waits for data to arrive in an empty buffer, in milliseconds.
+#define DATABUFFER_READ_TIMEOUT 5000
+
 // Enable profiling.
 //#define PROFILING_DB 1
 #ifdef PROFILING_DB
@@ -31,64 +40,40 @@ uint32_t profcount = 0;
 #endif
 
 
-// Static initialisations.
-uint8_t* DataBuffer::buffer = 0;
-uint8_t* DataBuffer::end = 0;
-uint8_t* DataBuffer::front = 0;
-uint8_t* DataBuffer::back = 0;
-uint8_t* DataBuffer::index = 0;
-uint32_t DataBuffer::capacity = 0;
-uint32_t DataBuffer::size = 0;
-int64_t DataBuffer::filesize = 0;
-std::atomic<uint32_t> DataBuffer::unread = { 0 };
-std::atomic<uint32_t> DataBuffer::free = { 0 };
-uint32_t DataBuffer::byteIndex = 0;
-uint32_t DataBuffer::byteIndexLow = 0;
-uint32_t DataBuffer::byteIndexHigh = 0;
-std::atomic<bool> DataBuffer::eof = { false };
-std::atomic<DataBuffer::BufferState> DataBuffer::state;
-std::mutex DataBuffer::bufferMutex;
-SeekRequestCallback DataBuffer::seekRequestCallback = 0;
-std::condition_variable* DataBuffer::dataRequestCV = 0;
-std::mutex DataBuffer::dataWaitMutex;
-std::condition_variable DataBuffer::dataWaitCV;
-std::atomic<bool> DataBuffer::dataRequestPending = { false };
-std::mutex DataBuffer::seekRequestMutex;
-std::condition_variable DataBuffer::seekRequestCV;
-std::atomic<bool> DataBuffer::seekRequestPending = { false };
-std::atomic<bool> DataBuffer::resetRequest = { false };
-std::atomic<bool> DataBuffer::writeStarted = { false };
-uint32_t DataBuffer::sessionHandle = 0;
-
-std::mutex DataBuffer::streamTrackQueueMutex;
-std::queue<std::string> DataBuffer::streamTrackQueue;
+// --- CONSTRUCTOR ---
+DataBuffer::DataBuffer() {
+	//
+}
+
+
+// --- DESTRUCTOR ---
+DataBuffer::~DataBuffer() {
+	cleanup();
+}
 
 
 // --- INIT ---
 // Initialises new data buffer. Capacity is provided in bytes.
+// A quarter of the capacity is used for the segment cache, if at least two segments of 
+// 'segmentSize' bytes fit into it.
 // Returns false on error, otherwise true.
-bool DataBuffer::init(uint32_t capacity) {
-	if (buffer != 0) {
-		// An existing buffer exists. Erase it first.
-		delete[] buffer;
+bool DataBuffer::init(uint32_t capacity, uint32_t segmentSize) {
+	cacheBudget = capacity / 4;
+	if (cache.init(cacheBudget, segmentSize)) {
+		cacheBudget -= cacheBudget % segmentSize;
+		capacity -= cacheBudget;
+	}
+	else {
+		cacheBudget = 0;
 	}
 	
-	// Allocate new buffer and return result.
-	buffer = new uint8_t[capacity];
-	DataBuffer::capacity = capacity;
-	
-	end = buffer + capacity;
-	front = buffer;
-	back = buffer;
-	index = buffer;
-	
-	size = 0;
-	unread = 0;
-	free = capacity;
+	// Allocate new buffer. Any existing buffer is erased first.
+	// A quarter of the buffer is used to retain already read data, for seeking back into.
+	if (!ring.init(capacity, capacity / 4)) { return false; }
 	
-	byteIndex = 0;
-	byteIndexLow = 0;
-	byteIndexHigh = 0;
+	setBlockSizeLimits(blockSizeMin, blockSizeMax);
+	setWatermarks(lowPercent, highPercent);
+	reset();
 	
 	eof = false;
 	dataRequestPending = false;
@@ -110,10 +95,8 @@ bool DataBuffer::init(uint32_t capacity) {
 // --- CLEAN UP ---
 // Clean up resources, delete the buffer.
 bool DataBuffer::cleanup() {
-	if (buffer != 0) {
-		delete[] buffer;
-		buffer = 0;
-	}
+	ring.cleanup();
+	cache.cleanup();
 	
 #ifdef PROFILING_DB
 	if (db_debugfile.is_open()) {
@@ -132,9 +115,24 @@ void DataBuffer::setSeekRequestCallback(SeekRequestCallback cb) {
 }
 
 
+// --- SET DATA CALLBACK ---
+// Sets the function to call whenever data arrives or the buffer state changes, in addition to
+// waking up readers blocked in read(). Once this returns, the previous function is no longer called.
+void DataBuffer::setDataCallback(DataCallback cb) {
+	std::lock_guard<std::mutex> lk(dataWaitMutex);
+	dataCallback = cb;
+}
+
+
 // --- SET DATA REQUEST CONDITION ---
-void DataBuffer::setDataRequestCondition(std::condition_variable* condition) {
+// Sets the condition variable to signal when requests can be sent. If a mutex and flag are given,
+// the flag is set under that mutex before each signal, so that the waiting thread can use it as
+// its predicate and no signal gets lost.
+void DataBuffer::setDataRequestCondition(std::condition_variable* condition, std::mutex* mutex,
+																			bool* pending) {
 	dataRequestCV = condition;
+	dataRequestMutex = mutex;
+	dataRequestFlag = pending;
 }
 
 
@@ -150,6 +148,281 @@ uint32_t DataBuffer::getSessionHandle() {
 }
 
 
+// --- SET FORMAT HINT ---
+// Sets the format of the media file, as far as the client knows it.
+void DataBuffer::setFormatHint(const MediaFormatHint &hint) {
+	std::lock_guard<std::mutex> lk(hintMutex);
+	formatHint = hint;
+}
+
+
+// --- GET FORMAT HINT ---
+MediaFormatHint DataBuffer::getFormatHint() {
+	std::lock_guard<std::mutex> lk(hintMutex);
+	return formatHint;
+}
+
+
+// --- SET BLOCK SIZE LIMITS ---
+// Sets the smallest and largest block size to request from the client. The largest block size is
+// limited to a quarter of the ring buffer, so that smaller buffers get smaller blocks.
+void DataBuffer::setBlockSizeLimits(uint32_t min, uint32_t max) {
+	std::lock_guard<std::mutex> lk(requestMutex);
+	if (ring.size() > 0 && max > ring.size() / 4) { max = ring.size() / 4; }
+	if (max == 0) { max = 1; }
+	if (min > max) { min = max; }
+	if (min == 0) { min = 1; }
+	
+	blockSizeMin = min;
+	blockSizeMax = max;
+	blockSize = min;
+}
+
+
+// --- SET REQUEST WINDOW ---
+// Sets the maximum number of data requests which can be outstanding at the same time. 
+// Setting this to 1 ensures that the client sends the data in order.
+void DataBuffer::setRequestWindow(uint32_t max) {
+	std::lock_guard<std::mutex> lk(requestMutex);
+	if (max == 0) { max = 1; }
+	windowMax = max;
+	if (window > windowMax) { window = windowMax; }
+}
+
+
+// --- SET WATERMARKS ---
+// Sets the low and high watermarks, as a percentage of the buffer size. A refill starts once the
+// unread data drops below the low watermark, and continues until the data requested ahead of the
+// read position reaches the high watermark. As a quarter of the buffer is used for retained data,
+// a high watermark above 75% means that the buffer gets filled completely.
+void DataBuffer::setWatermarks(uint32_t low, uint32_t high) {
+	std::lock_guard<std::mutex> lk(requestMutex);
+	if (high > 100) { high = 100; }
+	if (low > high) { low = high; }
+	
+	lowPercent = low;
+	highPercent = high;
+	lowWatermark = (uint32_t) (((uint64_t) ring.size() * low) / 100);
+	highWatermark = (uint32_t) (((uint64_t) ring.size() * high) / 100);
+	if (highWatermark == 0) { highWatermark = 1; }
+}
+
+
+// --- GET REQUEST WINDOW ---
+uint32_t DataBuffer::getRequestWindow() {
+	return window;
+}
+
+
+// --- REQUESTABLE ---
+// Determines the range of the next data request, if the request window and the free space in the
+// buffer allow for one. Request mutex must be held.
+// Returns true if a request can be sent.
+bool DataBuffer::requestable(uint64_t &offset, uint32_t &length) {
+	if (eof || ring.size() == 0 || requests.size() >= window) { return false; }
+	
+	// Only start a refill once the unread data has dropped below the low watermark, then keep
+	// requesting until the data requested ahead of the read position reaches the high watermark.
+	if (!refilling) {
+		if (ring.unread() >= lowWatermark) { return false; }
+		refilling = true;
+	}
+	
+	uint64_t end = eofPosition;
+	if (filesize > 0 && (uint64_t) filesize < end) { end = filesize; }
+	if (requestPosition < ring.writePosition()) { requestPosition = ring.writePosition(); }
+	if (requestPosition >= end) { return false; }
+	if (requestPosition - ring.readPosition() >= highWatermark) {
+		refilling = false;
+		return false;
+	}
+	
+	// Only request data which fits in the free space after the data already requested. Data
+	// pinned by chunks which are still being sent on to slaves can't be overwritten yet either.
+	uint64_t low = ring.lowPosition();
+	uint64_t pin = ring.pinPosition();
+	if (pin < low) { low = pin; }
+	uint64_t limit = low + ring.size();
+	if (requestPosition >= limit) { return false; }
+	
+	length = blockSize;
+	if (length > end - requestPosition) { length = (uint32_t) (end - requestPosition); }
+	if (length > limit - requestPosition) { return false; }
+	
+	offset = requestPosition;
+	
+	return true;
+}
+
+
+// --- NEXT REQUEST ---
+// Called by the data request handler to obtain the next range to request from the client. The
+// request is recorded as outstanding until its data arrives.
+// Returns false if no further request should be sent at this point.
+bool DataBuffer::nextRequest(uint64_t &offset, uint32_t &length) {
+	std::lock_guard<std::mutex> lk(requestMutex);
+	if (!requestable(offset, length)) { return false; }
+	
+	DataRequest rq;
+	rq.length = length;
+	rq.time = std::chrono::steady_clock::now();
+	requests[offset] = rq;
+	requestPosition = offset + length;
+	dataRequestPending = true;
+	
+	return true;
+}
+
+
+// --- ADD REQUEST ---
+// Records a request for a block at 'offset', sent as part of a seek request.
+void DataBuffer::addRequest(uint64_t offset) {
+	std::lock_guard<std::mutex> lk(requestMutex);
+	DataRequest rq;
+	rq.length = blockSize;
+	rq.time = std::chrono::steady_clock::now();
+	requests[offset] = rq;
+	requestPosition = offset + blockSize;
+	dataRequestPending = true;
+}
+
+
+// --- COMPLETE REQUEST ---
+// Matches data received from the client with an outstanding request. Tagged data has to match the
+// offset of a request. Untagged data from clients which send the data in order answers the oldest
+// request. If it does not match that request, the remaining requests are dropped and requested
+// again from the new write position.
+// Returns false if tagged data does not match any request, e.g. when it was requested before a
+// seek. The data should be dropped in that case.
+bool DataBuffer::completeRequest(uint64_t offset, uint32_t length, bool tagged) {
+	std::lock_guard<std::mutex> lk(requestMutex);
+	std::map<uint64_t, DataRequest>::iterator it;
+	if (tagged) { it = requests.find(offset); }
+	else 		{ it = requests.begin(); }
+	
+	if (it == requests.end()) { return !tagged; }
+	
+	// Time the block from when it was requested, or from the previous response if that was 
+	// later, as the block then queued behind the earlier blocks on the client side.
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	std::chrono::steady_clock::time_point start = it->second.time;
+	if (responseTime > start) { start = responseTime; }
+	responseTime = now;
+	uint64_t elapsed = std::chrono::duration_cast<std::chrono::microseconds>(now - start).count();
+	updateBlockSize(length, it->second.length, elapsed);
+	
+	bool match = (it->first == offset && it->second.length == length);
+	requests.erase(it);
+	if (!tagged && !match) {
+		requests.clear();
+		requestPosition = ring.writePosition();
+	}
+	
+	// Adapt the request window to the fill level of the buffer: more requests in flight while 
+	// the buffer is running low, fewer as it fills up. Only clients which send tagged data can 
+	// have more than one request outstanding.
+	if (tagged) {
+		if (ring.unread() < ring.size() / 4 && window < windowMax) 	{ window++; }
+		else if (ring.unread() > ring.size() / 2 && window > 1) 	{ window--; }
+	}
+	
+	dataRequestPending = !requests.empty();
+	
+	return true;
+}
+
+
+// --- UPDATE BLOCK SIZE ---
+// Called with the size of the response to a data request, and the time it took to receive it.
+// Updates the throughput and timing estimates, and adapts the block size: double it while blocks
+// arrive well within the targeted time, halve it when they take much longer. This starts with
+// small blocks for a fast start, and grows to large blocks on fast links. 
+// Request mutex must be held.
+void DataBuffer::updateBlockSize(uint32_t bytes, uint32_t requested, uint64_t elapsed) {
+	if (elapsed == 0) { elapsed = 1; }
+	
+	uint64_t sample = ((uint64_t) bytes * 1000000) / elapsed;
+	if (sample > UINT32_MAX) { sample = UINT32_MAX; }
+	if (throughput == 0) 	{ throughput = (uint32_t) sample; }
+	else 					{ throughput = (uint32_t) ((3 * (uint64_t) throughput + sample) / 4); }
+	if (blockTime == 0) 	{ blockTime = (uint32_t) elapsed; }
+	else 					{ blockTime = (uint32_t) ((3 * (uint64_t) blockTime + elapsed) / 4); }
+	
+	if (bytes < requested) { return; } // Short response, e.g. old client or end of file.
+	
+	if (elapsed < DATABUFFER_BLOCK_TIME_TARGET / 2 && blockSize < blockSizeMax) {
+		blockSize = (blockSize > blockSizeMax / 2) ? blockSizeMax : blockSize * 2;
+	}
+	else if (elapsed > DATABUFFER_BLOCK_TIME_TARGET * 2 && blockSize > blockSizeMin) {
+		blockSize = (blockSize / 2 < blockSizeMin) ? blockSizeMin : blockSize / 2;
+	}
+}
+
+
+// --- REQUEST MORE ---
+// Signals the data request handler if another request can be sent.
+void DataBuffer::requestMore() {
+	if (eof || dataRequestCV == 0) { return; }
+	
+	// Nothing to do between the watermarks. This keeps the read path free of locking.
+	if (!refilling && ring.unread() >= lowWatermark) { return; }
+	
+	uint64_t offset;
+	uint32_t length;
+	requestMutex.lock();
+	bool more = requestable(offset, length);
+	requestMutex.unlock();
+	
+	if (more) { signalRequest(); }
+}
+
+
+// --- SIGNAL REQUEST ---
+// Wakes up the data request handler.
+void DataBuffer::signalRequest() {
+	if (dataRequestMutex != 0 && dataRequestFlag != 0) {
+		std::lock_guard<std::mutex> lk(*dataRequestMutex);
+		*dataRequestFlag = true;
+	}
+	
+	dataRequestCV->notify_one();
+}
+
+
+// --- SIGNAL DATA ---
+// Wakes up any thread waiting for data to arrive.
+void DataBuffer::signalData() {
+	{
+		// Taking the mutex ensures that a waiting thread is either still before its check, or
+		// waiting on the condition variable.
+		std::lock_guard<std::mutex> lk(dataWaitMutex);
+		if (dataCallback) { dataCallback(); }
+	}
+	
+	dataWaitCV.notify_all();
+}
+
+
+// --- GET BLOCK SIZE ---
+uint32_t DataBuffer::getBlockSize() {
+	return blockSize;
+}
+
+
+// --- GET THROUGHPUT ---
+// Returns the smoothed throughput of data requests, in bytes per second.
+uint32_t DataBuffer::getThroughput() {
+	return throughput;
+}
+
+
+// --- GET BLOCK TIME ---
+// Returns the smoothed time to receive a requested block, in microseconds.
+uint32_t DataBuffer::getBlockTime() {
+	return blockTime;
+}
+
+
 // --- SET FILE SIZE ---
 void DataBuffer::setFileSize(int64_t size) {
 	filesize = size;
@@ -168,51 +441,130 @@ bool DataBuffer::start() {
 	if (dataRequestCV == 0) { return false; }
 	
 	writeStarted = true;
-	dataRequestCV->notify_one();
+	aborted = false;
+	signalRequest();
 	
 	return true;
 }
 
 
 // --- REQUEST DATA ---
+// Triggers a refill, then blocks until unread data is available, EOF has been reached, or the
+// read times out.
 void DataBuffer::requestData() {
 	if (dataRequestCV == 0) { return; }
 	
-	// Trigger a data request from the client.
-	dataRequestCV->notify_one();
+	requestMore();
 	
-	// Wait until we have received data or time out.
 	std::unique_lock<std::mutex> lk(dataWaitMutex);
-	using namespace std::chrono_literals;
-	while (dataWaitCV.wait_for(lk, 100us) != std::cv_status::timeout) {
-		if (!dataRequestPending) { break; }
-	}
+	dataWaitCV.wait_for(lk, std::chrono::milliseconds(DATABUFFER_READ_TIMEOUT), [this]() {
+		return ring.unread() > 0 || eof || aborted;
+	});
 }
 
 
 // --- RESET ---
 // Reset the buffer to the initialised state. This leaves the existing allocated buffer intact, 
-// but erases its contents.
+// but erases its contents, including the segment cache.
 bool DataBuffer::reset() {
-	front = buffer;
-	back = buffer;
-	size = 0;
-	index = buffer;
+	cache.clear();
+	resetState(0);
+	
+	requestMutex.lock();
+	tagged = false;
+	window = 1;
+	requestMutex.unlock();
+	
+	aborted = false;
+	
+	return true;
+}
+
+
+// --- RESET STATE ---
+// Empties the ring buffer, setting its position to 'position', and resets the buffer state.
+void DataBuffer::resetState(uint64_t position) {
+	// Wait until all chunks have been released, as the reset makes their data invalid.
+	std::unique_lock<std::mutex> plk(pinMutex);
+	pinCV.wait(plk, [this]() { return pins.empty(); });
 	
-	unread = 0;
-	free = capacity;
+	writeMutex.lock();
+	ring.reset(position);
+	writeMutex.unlock();
+	plk.unlock();
 	
-	byteIndex = 0;
-	byteIndexLow = 0;
-	byteIndexHigh = 0;
+	// Drop outstanding requests. Any data still arriving for them is either dropped or, for
+	// clients which don't tag their data, waited for by the caller.
+	requestMutex.lock();
+	requests.clear();
+	requestPosition = position;
+	eofPosition = UINT64_MAX;
+	refilling = true;
+	requestMutex.unlock();
 	
 	eof = false;
 	dataRequestPending = false;
 	seekRequestPending = false;
 	resetRequest = false;
 	state = DBS_IDLE;
+}
+
+
+// --- ABORT ---
+// Wakes up and fails any read or seek which is waiting for the client, e.g. when playback is 
+// stopped. Cleared by reset().
+void DataBuffer::abort() {
+	aborted = true;
+	signalData();
 	
-	return true;
+	seekRequestMutex.lock();
+	seekRequestMutex.unlock();
+	seekRequestCV.notify_all();
+}
+
+
+// --- SPILL TO CACHE ---
+// Copies the data around the read position into the segment cache, before the ring buffer gets
+// reset. At most half of the cache's budget is copied, so that the ranges around the previous
+// two positions (e.g. the index and the media data) both stay in the cache.
+void DataBuffer::spillToCache() {
+	if (!cache.enabled()) { return; }
+	
+	uint64_t start = ring.readPosition();
+	if (start - ring.lowPosition() > cacheBudget / 4) 	{ start -= cacheBudget / 4; }
+	else 												{ start = ring.lowPosition(); }
+	
+	RingBufferSpan spans[2];
+	uint32_t n = ring.peek(start, cacheBudget / 2, spans);
+	if (n == 0) { return; }
+	
+	cache.insert(start, spans[0].data, spans[0].length);
+	if (spans[1].length > 0) {
+		cache.insert(start + spans[0].length, spans[1].data, spans[1].length);
+	}
+}
+
+
+// --- FILL FROM CACHE ---
+// Writes up to 'length' bytes from the segment cache into the empty ring buffer, starting at the
+// ring buffer's write position. Only to be used while no data is expected from the client.
+// Returns the number of bytes written.
+uint64_t DataBuffer::fillFromCache(uint64_t length) {
+	uint64_t filled = 0;
+	while (filled < length) {
+		const uint8_t* data = 0;
+		uint32_t n = cache.span(ring.writePosition(), data);
+		if (n == 0) { break; }
+		if (n > length - filled) { n = (uint32_t) (length - filled); }
+		
+		writeMutex.lock();
+		uint32_t written = ring.write(data, n);
+		writeMutex.unlock();
+		filled += written;
+		if (written < n) { break; }	// Ring buffer is full.
+	}
+	
+	return filled;
 }
 
 
@@ -227,12 +579,12 @@ int64_t DataBuffer::seek(DataBufferSeek mode, int64_t offset) {
 	// Calculate absolute byte index.
 	int64_t new_offset = -1;
 	if 		(mode == DB_SEEK_START)		{ new_offset = offset; }
-	else if (mode == DB_SEEK_CURRENT) 	{ new_offset = byteIndex + offset; }
+	else if (mode == DB_SEEK_CURRENT) 	{ new_offset = ring.readPosition() + offset; }
 	else if (mode == DB_SEEK_END)		{ new_offset = filesize - offset - 1; }
 	
 #ifdef DEBUG
 	std::cout << "New offset: " << new_offset << std::endl;
-	std::cout << "ByteIndex: " << byteIndex << std::endl;
+	std::cout << "ByteIndex: " << ring.readPosition() << std::endl;
 #endif
 
 	// Ensure that the new offset isn't past the beginning/end of the file. If so, return -1.
@@ -243,65 +595,71 @@ int64_t DataBuffer::seek(DataBufferSeek mode, int64_t offset) {
 		return -1;
 	}
 	
-	// Ensure we're not in the midst of a data request action.
-	while (dataRequestPending) {
-		// Sleep in 1 ms segments until the data request is done.
-		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	// Check whether we have the requested data in the buffer. The buffer holds the range
+	// [byteIndexLow, byteIndexHigh]: a window of already read data, followed by the unread data.
+	// Seeks within this range are handled locally.
+	uint64_t byteIndexLow = ring.lowPosition();
+	uint64_t byteIndexHigh = ring.writePosition();
+	if ((uint64_t) new_offset >= byteIndexLow && (uint64_t) new_offset <= byteIndexHigh) {
+#ifdef DEBUG
+		std::cout << "Setting new buffer position." << std::endl;
+#endif
+		if (ring.seek(new_offset)) { return new_offset; }
 	}
 	
-	// TODO: removing local check. We just assume the local data isn't in the buffer and reload.
-	// In testing, the local data check has offered little benefits (not enough data in buffer).
-	// Check that this feature can be fully removed, or maybe reimplemented.
-	
-	// Check whether we have the requested data in the buffer.
-	//if (new_offset < byteIndexLow || new_offset > byteIndexHigh) {
-		// Data is not in buffer. Reset buffer and send seek request to client.
-		/* if (writeStarted) {
-			resetRequest = true;
-			while (resetRequest) {
-				// Wait for the write thread to acknowledge the request.
-				std::this_thread::sleep_for(std::chrono::milliseconds(1));
-			}
-		} */
-		
-		reset();
-		byteIndexLow = (uint32_t) new_offset;
-		byteIndexHigh = (uint32_t) new_offset;
-		if (seekRequestCallback == 0) { return -1; }
-		seekRequestPending = true;
-		state = DBS_SEEKING;
-		seekRequestCallback(sessionHandle, new_offset);
-		
-		// Wait for response.
-		std::unique_lock<std::mutex> lk(seekRequestMutex);
-		using namespace std::chrono_literals;
-		while (seekRequestPending) {
-			std::cv_status stat = seekRequestCV.wait_for(lk, 1s);
-			if (stat == std::cv_status::timeout) {
+	// Data is not in buffer. Reset buffer and send seek request to client.
+	// Ensure we're not in the midst of a data request action, unless the client tags its data,
+	// in which case data for earlier requests gets dropped as it arrives.
+	{
+		std::unique_lock<std::mutex> lk(dataWaitMutex);
+		dataWaitCV.wait(lk, [this]() { return !dataRequestPending || tagged || aborted; });
+	}
+	
+	if (aborted) { return -1; }
+	
+	// Keep the data we have in the segment cache, then check whether the cache has the data at
+	// the new position. If it does, we continue from the cache and only ask the client for the 
+	// data following it, without waiting.
+	spillToCache();
+	resetState(new_offset);
+	uint64_t cached = cache.lookup(new_offset, filesize - new_offset);
+	if (cached > ring.free() / 2) { cached = ring.free() / 2; }	// Leave room for client data.
+	if (cached > 0) {
+		uint64_t next = new_offset + fillFromCache(cached);
 #ifdef DEBUG
-				std::cout << "Time-out on seek request. Returning -1." << std::endl;
+		std::cout << "Served " << next - new_offset << " bytes from segment cache." << std::endl;
 #endif
-				return -1; 
-			}
+		if (next >= (uint64_t) filesize) {
+			eof = true;
+			return new_offset;
 		}
 		
-		state = DBS_IDLE;
-	/* }
-	else {	
+		if (seekRequestCallback == 0) { return -1; }
+		addRequest(next);
+		seekRequestPending = true;
+		state = DBS_SEEKING;
+		seekRequestCallback(sessionHandle, next);
+		return new_offset;
+	}
+	
+	// The client answers the seek request with a block at the new offset.
+	if (seekRequestCallback == 0) { return -1; }
+	addRequest(new_offset);
+	seekRequestPending = true;
+	state = DBS_SEEKING;
+	seekRequestCallback(sessionHandle, new_offset);
+	
+	// Wait for response.
+	std::unique_lock<std::mutex> lk(seekRequestMutex);
+	using namespace std::chrono_literals;
+	if (!seekRequestCV.wait_for(lk, 1s, [this]() { return !seekRequestPending || aborted; }) || aborted) {
 #ifdef DEBUG
-		std::cout << "Setting new buffer position." << std::endl;
+		std::cout << "Time-out on seek request. Returning -1." << std::endl;
 #endif
-
-		// Set the new position in the buffer.
-		uint32_t oldUnread = unread;
-		//byteIndex = new_offset;							// Absolute byte index.
-		index = front + (new_offset - byteIndexLow);	// Index into buffer translation.
-		unread = byteIndexHigh - new_offset;
-		//unreadLow += new_offset - byteIndexLow;
-		//unreadHigh -= unread - oldUnread;
-	} */
+		return -1; 
+	}
 	
-	byteIndex = (uint32_t) new_offset;
+	state = DBS_IDLE;
 	
 	return new_offset;
 }
@@ -325,158 +683,39 @@ uint32_t DataBuffer::read(uint32_t len, uint8_t* bytes) {
 	std::chrono::high_resolution_clock::time_point begin = std::chrono::high_resolution_clock::now();
 #endif
 
-	// Request more data if the buffer does not have enough unread data left, and EOF condition
-	// has not been reached.
-	if (!eof && len > unread) {
+	if (aborted) { return 0; }
+
+	// Wait for data if the buffer has run empty, and EOF condition has not been reached.
+	if (!eof && ring.unread() == 0) {
 		// More data should be available on the client, try to request it.
 #ifdef DEBUG
 		std::cout << "Requesting more data..." << std::endl;
 #endif
 
 #ifdef PROFILING_DB
-		db_debugfile << "Requesting more data... Unread: " << unread << ".\n";
+		db_debugfile << "Requesting more data... Unread: " << ring.unread() << ".\n";
 #endif
 		requestData();
 	}
 	
-	if (unread == 0) {
-		if (eof) {
+	// Copy out whatever is available, up to 'len' bytes. The ring buffer handles the wrap-around
+	// with at most two copies.
+	uint32_t bytesRead = ring.read(bytes, len);
+	if (bytesRead == 0) {
 #ifdef DEBUG
-			std::cout << "Reached EOF." << std::endl;
+		if (eof) 	{ std::cout << "Reached EOF." << std::endl; }
+		else 		{ std::cout << "Read failed due to empty buffer." << std::endl; }
 #endif
-			return 0;
-		}
-		else {
-#ifdef DEBUG
-			std::cout << "Read failed due to empty buffer." << std::endl;
-#endif
-			return 0;
-		}
+		return 0;
 	}
-	
-	uint32_t bytesRead = 0;
-	
-	// Determine the number of bytes we can read in one copy operation.
-	// This depends on the location of the write pointer ('back') compared to the 
-	// read pointer ('index'). If the write pointer is ahead of the read pointer, we can read up 
-	// till there, otherwise to the end of the buffer.
-	uint32_t locunread = unread;
-	uint32_t bytesSingleRead = locunread;
-	if ((end - index) < bytesSingleRead) { bytesSingleRead = end - index; } // Unread section wraps around.
-	
-#ifdef DEBUG
-	std::cout << "bytesSingleRead: " << bytesSingleRead << std::endl;
-#endif
-	
-	if (len <= bytesSingleRead) {
-		// Can read requested data in single chunk.
-#ifdef DEBUG
-		std::cout << "Read whole block." << std::endl;
-		std::cout << "Index: " << index - buffer << ", Back: " << back - buffer << std::endl;
-#endif
-		memcpy(bytes, index, len);
-		index += len;		// Advance read pointer.
-		bytesRead += len;
-		byteIndex += len;
-		unread -= len;		// Unread bytes decreases by read byte count.
-		free += len;		// Read bytes become free for overwriting.
-		
-		if (index >= end) {
-			index = buffer;	// Read pointer went past the buffer end. Reset to buffer begin.
-		}
 
 #ifdef PROFILING_DB
-		std::chrono::high_resolution_clock::time_point end = std::chrono::high_resolution_clock::now();
-		db_debugfile << "SR. Duration: " << std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count() << "µs. ";
+	std::chrono::high_resolution_clock::time_point end = std::chrono::high_resolution_clock::now();
+	db_debugfile << "Read " << bytesRead << ". Duration: " << std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count() << "µs.";
 #endif
-	}
-	else if (bytesSingleRead > 0 && locunread == bytesSingleRead) {
-		// Less data in buffer than needed & nothing at the front.
-		// Read what we can from the back, then return.
-#ifdef DEBUG
-		std::cout << "Read partial data from back." << std::endl;
-		std::cout << "Index: " << index - buffer << ", Back: " << back - buffer << std::endl;
-#endif
-		memcpy(bytes, index, bytesSingleRead);
-		index += bytesSingleRead;		// Advance read pointer.
-		bytesRead += bytesSingleRead;
-		byteIndex += bytesSingleRead;
-		unread -= bytesSingleRead;		// Unread bytes decreases by read byte count.
-		free += bytesSingleRead;		// Read bytes become free for overwriting.
-		
-		if (index >= end) {
-			index = buffer;	// Read pointer went past the buffer end. Reset to buffer begin.
-		}
-
-#ifdef PROFILING_DB
-		std::chrono::high_resolution_clock::time_point end = std::chrono::high_resolution_clock::now();
-		db_debugfile << "PR. Duration: " << std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count() << "µs.";
-#endif
-	}
-	else if (bytesSingleRead > 0 && locunread > bytesSingleRead) {
-		// Read part from the end of the buffer, then read rest from the front.
-#ifdef DEBUG
-		std::cout << "Read back, then front." << std::endl;
-		std::cout << "Index: " << index - buffer << ", Back: " << back - buffer << std::endl;
-#endif
-		memcpy(bytes, index, bytesSingleRead);
-		index += bytesSingleRead;		// Advance read pointer.
-		bytesRead += bytesSingleRead;
-		byteIndex += bytesSingleRead;
-		unread -= bytesSingleRead;		// Unread bytes decreases by read byte count.
-		free += bytesSingleRead;		// Read bytes become free for overwriting.
-		
-		index = buffer;	// Switch read pointer to front of the buffer.
-		
-		// Read remainder from front.
-		uint32_t bytesToRead = len - bytesRead;
-#ifdef DEBUG
-		std::cout << "bytesRead: " << bytesRead << ", bytesToRead: " << bytesToRead << std::endl;
-#endif
-		if (bytesToRead <= locunread) {
-			// Read the remaining bytes we need.
-			memcpy(bytes + bytesRead, index, bytesToRead);
-			index += bytesToRead;
-			bytesRead += bytesToRead;
-			byteIndex += bytesToRead;
-			unread -= bytesToRead;
-			free += bytesToRead;
-		}
-		else {
-			// Read the unread bytes still available in the buffer.
-			memcpy(bytes + bytesRead, index, locunread);
-			index += locunread;
-			bytesRead += locunread;
-			byteIndex += locunread;
-			unread -= locunread;
-			free += locunread;
-		}
-
-#ifdef PROFILING_DB
-		std::chrono::high_resolution_clock::time_point end = std::chrono::high_resolution_clock::now();
-		db_debugfile << "FB. Duration: " << std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count() << "µs.";
-#endif
-	}
-	else {
-		// Default case.
-#ifdef DEBUG
-		std::cout << "FIXME: Default case." << std::endl;
-#endif
-		// FIXME: This shouldn't happen.
-		
-	}
 	
 	// Trigger a data request from the client if we have space.
-	if (eof) {
-		// Do nothing.
-	}
-	else if (!dataRequestPending && free > 204799) {
-		// Single block is 200 kB (204,800 bytes). We have space, so request another block.
-		// TODO: make it possible to request a specific block size from client.
-		if (dataRequestCV != 0) {
-			dataRequestCV->notify_one();
-		}
-	}
+	requestMore();
 
 #ifdef PROFILING_DB
 		std::chrono::high_resolution_clock::time_point end2 = std::chrono::high_resolution_clock::now();
@@ -484,7 +723,7 @@ uint32_t DataBuffer::read(uint32_t len, uint8_t* bytes) {
 #endif
 	
 #ifdef DEBUG
-	std::cout << "unread " << unread << ", free " << free << std::endl;
+	std::cout << "unread " << ring.unread() << ", free " << ring.free() << std::endl;
 	std::cout << "bytesRead: " << bytesRead << std::endl;
 #endif
 	
@@ -500,179 +739,212 @@ uint32_t DataBuffer::write(std::string &data) {
 
 
 uint32_t DataBuffer::write(const char* data, uint32_t length) {
+	uint64_t position;
+	return write(data, length, position);
+}
+
+
+// Sets 'position' to the file offset at which the data was written.
+uint32_t DataBuffer::write(const char* data, uint32_t length, uint64_t &position) {
 #ifdef DEBUG
 	std::cout << "DataBuffer::write: len " << length << std::endl;
-	std::cout << "Index: " << index - buffer << ", Back: " << back - buffer << std::endl;
 #endif
 
-	// First check whether we can perform a straight copy. For this we need enough available bytes
-	// at the end of the buffer. Else we have to attempt to write the remainder into the front of
-	// the buffer.
-	// The bytesFreeLow and bytesFreeHigh counters are for keeping track of the number of free bytes
-	// at the low (beginning) and high (end) side respectively.
-	//bufferMutex.lock();
-	uint32_t bytesWritten = 0;
-	
-	// Determine the number of bytes we can write in one copy operation.
-	// This depends on the number of 'free' bytes, and the location of the read pointer ('index') 
-	// compared to the  write pointer ('back'). If the read pointer is ahead of the write pointer, 
-	// we can write up till there, otherwise to the end of the buffer.
-	uint32_t locfree = free;
-	uint32_t bytesSingleWrite = locfree;
-	if ((end - back) < bytesSingleWrite) { bytesSingleWrite = end - back; }
-	
-	if (length <= bytesSingleWrite) {
-#ifdef DEBUG
-		std::cout << "Write whole chunk at back. Single write: " << bytesSingleWrite << std::endl;
-#endif
-		// Enough space to write the data in one go.
-		memcpy(back, data, length);
-		bytesWritten = length;
-		back += bytesWritten;
-		unread += bytesWritten;
-		free -= bytesWritten;
-		
-		if (back >= end) {
-			back = buffer;
-		}
+	// Write as much as fits. The ring buffer handles the wrap-around with at most two copies.
+	// Untagged data is always appended at the write position.
+	RingBufferSpan spans[2];
+	uint32_t bytesWritten = reserve(length, spans, position);
+	if (bytesWritten == 0) {
+		commit(0);
+		return 0;
 	}
-	else if (bytesSingleWrite > 0 && locfree == bytesSingleWrite) {
-#ifdef DEBUG
-		std::cout << "Partial write at back. Single write: " << bytesSingleWrite << std::endl;
-#endif
-		// Only enough space in buffer to write to the back. Write what we can, then return.
-		memcpy(back, data, bytesSingleWrite);
-		bytesWritten = bytesSingleWrite;
-		back += bytesWritten;
-		unread += bytesWritten;
-		free -= bytesWritten;
-		
-		if (back >= end) {
-			back = buffer;
-		}
-	}
-	else if (bytesSingleWrite > 0 && locfree > bytesSingleWrite) {
-#ifdef DEBUG
-		std::cout << "Partial write at back, rest at front. Single write: " << bytesSingleWrite << std::endl;
-#endif
-		// Write to the back, then the rest at the front.
-		memcpy(back, data, bytesSingleWrite);
-		bytesWritten = bytesSingleWrite;
-		unread += bytesWritten;
-		free -= bytesWritten;
-		
-		back = buffer;
-		
-		// Write remainder at the front.
-		uint32_t bytesToWrite = length - bytesWritten;
-#ifdef DEBUG
-	std::cout << "Write remainder: " << bytesToWrite << std::endl;
-	std::cout << "Index: " << index - buffer << ", Back: " << back - buffer << std::endl;
-#endif
-		if (bytesToWrite <= locfree) {
-			// Write the remaining bytes we have.
-			memcpy(back, data + bytesWritten, bytesToWrite);
-			bytesWritten += bytesToWrite;
-			unread += bytesToWrite;
-			free -= bytesToWrite;
-			back += bytesToWrite;
-		}
-		else {
-			// Write the unread bytes still available in the buffer.
-			memcpy(back, data + bytesWritten, locfree);
-			bytesWritten += locfree;
-			unread += locfree;
-			free -= locfree;
-			back += locfree;
-		}
+	
+	memcpy(spans[0].data, data, spans[0].length);
+	if (spans[1].length > 0) {
+		memcpy(spans[1].data, data + spans[0].length, spans[1].length);
 	}
-	else {
-		// FIXME: shouldn't happen.
+	
+	commit(bytesWritten);
+	
 #ifdef DEBUG
-		std::cout << "FIXME: Default case." << std::endl;
+		std::cout << "unread: " << ring.unread() << ", free: " 
+					<< ring.free() << ", bytesWritten: " << bytesWritten << std::endl;
 #endif
+	
+	return bytesWritten;
+}
+
+
+// --- RESERVE ---
+// Provides direct access to up to 'length' bytes of free space at the write position, in up to
+// two spans. This allows data to be received or decoded straight into the buffer. 'position' is 
+// set to the file offset of the first byte. Every call has to be followed by a call to commit(), 
+// as other writers are blocked until then.
+// Returns the total number of bytes in the spans.
+uint32_t DataBuffer::reserve(uint32_t length, RingBufferSpan spans[2], uint64_t &position) {
+	writeMutex.lock();
+	position = ring.writePosition();
+	reservePosition = position;
+	
+	return ring.reserve(length, spans);
+}
+
+
+// --- COMMIT ---
+// Makes 'length' bytes written into the spans returned by reserve() available for reading. Like
+// with write(), the data answers the oldest outstanding request. Committing nothing only ends the
+// reservation: a pending seek still waits for its data.
+void DataBuffer::commit(uint32_t length) {
+	if (length == 0) {
+		writeMutex.unlock();
+		return;
 	}
 	
-#ifdef DEBUG
-		std::cout << "unread: " << unread << ", free: " 
-					<< free << ", bytesWritten: " << bytesWritten << std::endl;
-#endif
+	ring.commit(length);
+	completeRequest(reservePosition, length, false);
+	writeMutex.unlock();
+	signalData();
 	
 	// If we're in seeking mode, signal that we're done.
 	if (state == DBS_SEEKING) {
 #ifdef DEBUG
 		std::cout << "In seeking mode. Notifying seeking routine." << std::endl;
 #endif
+		seekRequestMutex.lock();
 		seekRequestPending = false;
-		dataRequestPending = false;
+		state = DBS_IDLE;
+		seekRequestMutex.unlock();
 		seekRequestCV.notify_one();
 		
-		return bytesWritten;
+		return;
 	}
 	
-	dataRequestPending = false;
-	
 	// Trigger a data request from the client if we have space.
-	if (eof) {
-		// Do nothing.
-	}/* 
-	else if (resetRequest) {
-		// Reset request is pending. Ensure no data requests are pending before we signal okay.
-		while (dataRequestPending) {
-			// Sleep in 1 ms segments until the data request is done.
-			std::this_thread::sleep_for(std::chrono::milliseconds(1));
-		}
+	requestMore();
+}
+
+
+// --- WRITE AT ---
+// Write data for the file range starting at 'offset' into the buffer. The data has to answer an
+// outstanding request, but can arrive in any order. 'done' indicates that this range ends at the
+// end of the file.
+// Returns the number of bytes written, or 0 if the data was not requested.
+uint32_t DataBuffer::writeAt(uint64_t offset, const char* data, uint32_t length, bool done) {
+#ifdef DEBUG
+	std::cout << "DataBuffer::writeAt: offset " << offset << ", len " << length << std::endl;
+#endif
+
+	writeMutex.lock();
+	if (!completeRequest(offset, length, true)) {
+		writeMutex.unlock();
+#ifdef DEBUG
+		std::cout << "No request for offset " << offset << ". Dropping data." << std::endl;
+#endif
+		return 0;
+	}
+	
+	tagged = true;
+	uint32_t bytesWritten = ring.writeAt(offset, (const uint8_t*) data, length);
+	
+	// EOF is reached once all data up to the end of the file has arrived.
+	requestMutex.lock();
+	if (done) { eofPosition = offset + length; }
+	if (ring.writePosition() >= eofPosition) { eof = true; }
+	requestMutex.unlock();
+	writeMutex.unlock();
+	signalData();
+	
+	// If we're in seeking mode and the data at the seek position has arrived, signal that we're
+	// done.
+	if (state == DBS_SEEKING && ring.unread() > 0) {
+		seekRequestMutex.lock();
+		seekRequestPending = false;
+		state = DBS_IDLE;
+		seekRequestMutex.unlock();
+		seekRequestCV.notify_one();
 		
-		resetRequest = false;
-	} */
-	else if (free > 204799) {
-		// Single block is 200 kB (204,800 bytes). We have space, so request another block.
-		// TODO: make it possible to request a specific block size from client.
-		if (dataRequestCV != 0) {
-			dataRequestCV->notify_one();
-		}
+		return bytesWritten;
 	}
 	
+	requestMore();
+	
 	return bytesWritten;
 }
 
 
+// --- GET CHUNK ---
+// Returns a view on the written data in the range ['position', 'position' + 'length'), which is
+// kept from being overwritten until the last reference to it is released. Used to send data on
+// to slave remotes without copying it. Resetting the buffer waits until all chunks have been 
+// released, so chunks should be released quickly.
+// Returns an empty pointer if the range is not in the buffer.
+MediaChunkPtr DataBuffer::getChunk(uint64_t position, uint32_t length, bool done) {
+	std::lock_guard<std::mutex> plk(pinMutex);
+	std::lock_guard<std::mutex> wlk(writeMutex);
+	
+	// With the writers blocked, data at or above the low position is still valid, and the pin
+	// keeps it that way once the writers continue.
+	RingBufferSpan spans[2];
+	if (ring.peek(position, length, spans) < length) { return MediaChunkPtr(); }
+	
+	pins.insert(position);
+	ring.setPin(*pins.begin());
+	
+	MediaChunkPtr chunk = std::make_shared<MediaChunk>();
+	chunk->buffer = this;
+	chunk->position = position;
+	chunk->length = length;
+	chunk->spans[0] = spans[0];
+	chunk->spans[1] = spans[1];
+	chunk->done = done;
+	
+	return chunk;
+}
+
+
+// --- RELEASE CHUNK ---
+// Releases the pin of a chunk. The space this frees up may allow for further data requests.
+void DataBuffer::releaseChunk(uint64_t position) {
+	pinMutex.lock();
+	std::multiset<uint64_t>::iterator it = pins.find(position);
+	if (it != pins.end()) { pins.erase(it); }
+	ring.setPin(pins.empty() ? UINT64_MAX : *pins.begin());
+	pinMutex.unlock();
+	pinCV.notify_all();
+	
+	requestMore();
+}
+
+
+// --- MEDIA CHUNK ---
+MediaChunk::~MediaChunk() {
+	buffer->releaseChunk(position);
+}
+
+
 // --- SET EOF ---
 // Set the End-Of-File status of the file being streamed.
 void DataBuffer::setEof(bool eof) {
-	DataBuffer::eof = eof;
+	this->eof = eof;
+	if (eof) { signalData(); }
 }
 
 
 // --- IS EOF ---
 bool DataBuffer::isEof() {
-	return DataBuffer::eof;
+	return eof;
 }
 
 
-// --- ADD STREAM TRACK ---
-// Add a streaming track to the queue.
-void DataBuffer::addStreamTrack(std::string track) {
-	streamTrackQueueMutex.lock();
-	streamTrackQueue.push(track);
-	streamTrackQueueMutex.unlock();
+// --- GET UNREAD ---
+// Returns the number of bytes in the buffer which have not been read yet.
+uint32_t DataBuffer::getUnread() {
+	return ring.unread();
 }
 
 
-// --- HAS STREAM TRACK ---
-bool DataBuffer::hasStreamTrack() {
-	return !streamTrackQueue.empty();
-}
-
-
-// --- GET STREAM TRACK ---
-// Returns the next stream string in the queue, or an empty string if queue is empty.
-std::string DataBuffer::getStreamTrack() {
-	streamTrackQueueMutex.lock();
-	if (streamTrackQueue.empty()) { return std::string(); }
-	std::string tStr = streamTrackQueue.front();
-	streamTrackQueue.pop();
-	streamTrackQueueMutex.unlock();
-	
-	return tStr;
+// --- CACHE STATS ---
+// Returns the hit, miss and eviction counters of the segment cache.
+SegmentCacheStats DataBuffer::cacheStats() {
+	return cache.stats();
 }
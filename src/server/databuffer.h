@@ -5,6 +5,10 @@
 	
 	Features:
 			- Provides API for a ring buffer implementation.
+			- Keeps a window of outstanding data requests, each for a specific range of the file.
+			- Refills between a low and a high watermark. Readers block until data arrives.
+			- Provides reference-counted views on written data, for sending it on without copies.
+			- One instance per cast session, so that several sessions can buffer at the same time.
 			
 	2020/11/19, Maya Posch
 */
@@ -18,11 +22,42 @@
 #include <mutex>
 #include <functional>
 #include <condition_variable>
-#include <queue>
+#include <map>
+#include <memory>
+#include <set>
 #include <string>
+#include <chrono>
+
+#include "ringbuffer.h"
+#include "segmentcache.h"
 
 
 typedef std::function<void(uint32_t, int64_t)> SeekRequestCallback;
+typedef std::function<void()> DataCallback;
+
+class DataBuffer;
+
+// A view on data written into the buffer, in up to two spans. The data is kept from being
+// overwritten for as long as a reference to the chunk exists.
+struct MediaChunk {
+	DataBuffer* buffer;			// Buffer the data is in. Has to outlive the chunk.
+	uint64_t position;			// File offset of the first byte.
+	uint32_t length;
+	RingBufferSpan spans[2];
+	bool done;					// True if this chunk ends at the end of the file.
+	
+	~MediaChunk();
+};
+
+typedef std::shared_ptr<MediaChunk> MediaChunkPtr;
+
+// Hints from the client on the format of the media file, which allow the player to skip probing.
+// Any of the entries may be empty.
+struct MediaFormatHint {
+	std::string container;		// FFmpeg demuxer name, e.g. 'matroska' or 'mp3'.
+	std::string extension;		// File extension, without the dot.
+	std::string mime;			// MIME type, e.g. 'audio/flac'.
+};
 
 enum DataBufferSeek {
 	DB_SEEK_START = 0,
@@ -38,61 +73,116 @@ class DataBuffer {
 		DBS_SEEKING
 	};
 	
-	static uint8_t* buffer;		// Pointer to buffer.
-	static uint8_t* end;		// Pointer to buffer end (idx Nsize).
-	static uint8_t* front;		// Pointer to front of data in buffer (low).
-	static uint8_t* back;		// Pointer to back of data in buffer (last byte + 1).
-	static uint8_t* index;		// Pointer to first unread byte or buffer start.
-	static uint32_t capacity;	// Total capacity of buffer in bytes.
-	static uint32_t size;		// Total size of data in buffer in bytes.
-	static int64_t filesize;	// Size of the media file being streamed, in bytes.
-	static std::atomic<uint32_t> unread;		// Number of unread bytes in the buffer.
-	static std::atomic<uint32_t> free;		// Number of free bytes in the buffer.
-	static uint32_t byteIndex;		// First unread byte index into the media file data.
-	static uint32_t byteIndexLow;	// Lowest media file byte index present in the buffer.
-	static uint32_t byteIndexHigh;	// Highest media file byte index present in the buffer.
-	static std::mutex bufferMutex;
-	static std::atomic<bool> eof;
-	static std::atomic<BufferState> state;
-	static SeekRequestCallback seekRequestCallback;
-	static std::condition_variable* dataRequestCV;
-	static std::mutex dataWaitMutex;
-	static std::condition_variable dataWaitCV;
-	static std::mutex seekRequestMutex;
-	static std::condition_variable seekRequestCV;
-	static std::atomic<bool> seekRequestPending;
-	static std::atomic<bool> resetRequest;
-	static std::atomic<bool> writeStarted;
-	static uint32_t sessionHandle;		// Active session this buffer is associated with.
+	RingBuffer ring;		// SPSC ring buffer. Positions are media file byte indices.
+	SegmentCache cache;	// Disjoint ranges of the media file, kept across seeks.
+	uint32_t cacheBudget = 0;	// Size of the segment cache in bytes.
+	std::atomic<int64_t> filesize = { 0 };	// Size of the media file being streamed, in bytes.
+	std::atomic<bool> eof = { false };
+	std::atomic<BufferState> state = { DBS_IDLE };
+	SeekRequestCallback seekRequestCallback = 0;
+	DataCallback dataCallback = 0;		// Called under dataWaitMutex.
+	std::condition_variable* dataRequestCV = 0;
+	std::mutex* dataRequestMutex = 0;
+	bool* dataRequestFlag = 0;		// Set under dataRequestMutex before each signal.
+	std::mutex dataWaitMutex;
+	std::condition_variable dataWaitCV;
+	std::mutex seekRequestMutex;
+	std::condition_variable seekRequestCV;
+	std::atomic<bool> seekRequestPending = { false };
+	std::atomic<bool> resetRequest = { false };
+	std::atomic<bool> writeStarted = { false };
+	std::atomic<bool> aborted = { false };
+	std::mutex pinMutex;
+	std::condition_variable pinCV;
+	std::multiset<uint64_t> pins;	// Start positions of the chunks in use.
+	uint64_t reservePosition = 0;	// Write position at the last reserve().
+	uint32_t sessionHandle = 0;		// Active session this buffer is associated with.
+	std::mutex hintMutex;
+	MediaFormatHint formatHint;
+	
+	struct DataRequest {
+		uint32_t length;
+		std::chrono::steady_clock::time_point time;	// When the request was sent.
+	};
+	
+	std::mutex writeMutex;		// Serialises writers, and resets against writers.
+	std::mutex requestMutex;
+	std::map<uint64_t, DataRequest> requests;	// Outstanding requests, by file offset.
+	uint64_t requestPosition = 0;	// File offset of the next block to request.
+	uint64_t eofPosition = UINT64_MAX;		// File offset at which the client reported EOF.
+	uint32_t window = 1;				// Current maximum number of outstanding requests.
+	uint32_t windowMax = 4;
+	std::atomic<bool> tagged = { false };	// True if the client sends offset-tagged data.
+	std::atomic<bool> refilling = { true };	// True while requesting data up to the high watermark.
+	uint32_t lowWatermark = 0;		// Unread bytes below which a refill starts.
+	uint32_t highWatermark = 0;		// Requested bytes ahead of the reader at which it stops.
+	uint32_t lowPercent = 25;
+	uint32_t highPercent = 75;
+	uint32_t blockSize = 65536;			// Bytes to request from the client per data request.
+	uint32_t blockSizeMin = 65536;
+	uint32_t blockSizeMax = 8388608;
+	std::chrono::steady_clock::time_point responseTime;	// When the last response arrived.
+	uint32_t throughput = 0;			// Smoothed client throughput, in bytes per second.
+	uint32_t blockTime = 0;			// Smoothed time to receive a block, in microseconds.
+	
+	void resetState(uint64_t position);
+	bool requestable(uint64_t &offset, uint32_t &length);
+	void addRequest(uint64_t offset);
+	bool completeRequest(uint64_t offset, uint32_t length, bool tagged);
+	void updateBlockSize(uint32_t bytes, uint32_t requested, uint64_t elapsed);
+	void requestMore();
+	void signalRequest();
+	void signalData();
+	void releaseChunk(uint64_t position);
 	
-	static std::mutex streamTrackQueueMutex;
-	static std::queue<std::string> streamTrackQueue;
+	friend struct MediaChunk;
+	void spillToCache();
+	uint64_t fillFromCache(uint64_t length);
 	
 public:
-	static bool init(uint32_t capacity);
-	static bool cleanup();
-	static void setSeekRequestCallback(SeekRequestCallback cb);
-	static void setDataRequestCondition(std::condition_variable* condition);
-	static void setSessionHandle(uint32_t handle);
-	static uint32_t getSessionHandle();
-	static void setFileSize(int64_t size);
-	static int64_t getFileSize();
-	static bool start();
-	static void requestData();
-	static bool reset();
-	static int64_t seek(DataBufferSeek mode, int64_t offset);
-	static bool seeking();
-	static uint32_t read(uint32_t len, uint8_t* bytes);
-	static uint32_t write(std::string &data);
-	static uint32_t write(const char* data, uint32_t length);
-	static void setEof(bool eof);
-	static bool isEof();
+	DataBuffer();
+	~DataBuffer();
 	
-	static void addStreamTrack(std::string track);
-	static bool hasStreamTrack();
-	static std::string getStreamTrack();
+	bool init(uint32_t capacity, uint32_t segmentSize = 1048576);
+	bool cleanup();
+	void setSeekRequestCallback(SeekRequestCallback cb);
+	void setDataCallback(DataCallback cb);
+	void setDataRequestCondition(std::condition_variable* condition, std::mutex* mutex = 0,
+																bool* pending = 0);
+	void setSessionHandle(uint32_t handle);
+	uint32_t getSessionHandle();
+	void setFormatHint(const MediaFormatHint &hint);
+	MediaFormatHint getFormatHint();
+	void setBlockSizeLimits(uint32_t min, uint32_t max);
+	void setRequestWindow(uint32_t max);
+	void setWatermarks(uint32_t low, uint32_t high);
+	bool nextRequest(uint64_t &offset, uint32_t &length);
+	uint32_t getRequestWindow();
+	uint32_t getBlockSize();
+	uint32_t getThroughput();
+	uint32_t getBlockTime();
+	void setFileSize(int64_t size);
+	int64_t getFileSize();
+	bool start();
+	void requestData();
+	bool reset();
+	void abort();
+	int64_t seek(DataBufferSeek mode, int64_t offset);
+	bool seeking();
+	uint32_t read(uint32_t len, uint8_t* bytes);
+	uint32_t write(std::string &data);
+	uint32_t write(const char* data, uint32_t length);
+	uint32_t write(const char* data, uint32_t length, uint64_t &position);
+	uint32_t writeAt(uint64_t offset, const char* data, uint32_t length, bool done);
+	uint32_t reserve(uint32_t length, RingBufferSpan spans[2], uint64_t &position);
+	void commit(uint32_t length);
+	MediaChunkPtr getChunk(uint64_t position, uint32_t length, bool done);
+	void setEof(bool eof);
+	bool isEof();
+	uint32_t getUnread();
+	SegmentCacheStats cacheStats();
 	
-	static std::atomic<bool> dataRequestPending;
+	std::atomic<bool> dataRequestPending = { false };
 };
 
 #endif
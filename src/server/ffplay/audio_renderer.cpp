@@ -2,13 +2,35 @@
 #include "audio_renderer.h"
 
 #include "frame_queue.h"
+#include "packet_queue.h"
 #include "clock.h"
 #include "stream_handler.h"
 #include "decoder.h"
+#include "player.h"
+#include "sync_target.h"
+
+#include "../metrics.h"
+#include "../threadpolicy.h"
 
 
 // Static initialisations.
 std::atomic<bool> AudioRenderer::run;
+VideoState* AudioRenderer::attached = 0;
+AudioParams AudioRenderer::deviceParams;
+int AudioRenderer::deviceBufSize = 0;
+int64_t AudioRenderer::deviceLayout = 0;
+int AudioRenderer::deviceChannels = 0;
+int AudioRenderer::deviceRate = 0;
+std::atomic<bool> AudioRenderer::nullSink = { false };
+
+static MetricHistogram* metricCallbackJitter = Metrics::histogram(
+                "nymphcast_audio_callback_jitter_seconds",
+                "Difference between the interval of audio callbacks, and the audio they request.");
+static MetricCounter* metricAudioQueued = Metrics::counter(
+                "nymphcast_frames_queued_total{stream=\"audio\"}",
+                "Frames queued for output, after filtering.");
+static MetricCounter* metricAudioUnderruns = Metrics::counter("nymphcast_audio_underruns_total",
+                "Audio callbacks which had to output silence while playing.");
 
 
 static inline
@@ -54,7 +76,12 @@ static int synchronize_audio(VideoState *is, int nb_samples)
                 /* estimate the A-V difference */
                 avg_diff = is->audio_diff_cum * (1.0 - is->audio_diff_avg_coef);
 
-                if (fabs(avg_diff) >= is->audio_diff_threshold) {
+                if (SyncTarget::active()) { SyncTarget::setError(avg_diff); }
+
+                if (SyncTarget::active() && fabs(avg_diff) < SYNC_TARGET_JUMP_THRESHOLD) {
+                    /* follow the shared timeline by resampling slightly */
+                    wanted_nb_samples = SyncTarget::correct(nb_samples, avg_diff);
+                } else if (fabs(avg_diff) >= is->audio_diff_threshold) {
                     wanted_nb_samples = nb_samples + (int)(diff * is->audio_src.freq);
                     min_nb_samples = ((nb_samples * (100 - SAMPLE_CORRECTION_PERCENT_MAX) / 100));
                     max_nb_samples = ((nb_samples * (100 + SAMPLE_CORRECTION_PERCENT_MAX) / 100));
@@ -339,24 +366,57 @@ static void update_sample_display(VideoState *is, short *samples, int samples_si
 
 
 /* prepare a new audio buffer */
-static void sdl_audio_callback(void *opaque, Uint8 *stream, int len)
+// The audio device stays open between tracks, so the stream is not passed in 'opaque', but
+// attached to the device with AudioRenderer::audio_attach(). Outputs silence while no stream is
+// attached.
+void sdl_audio_callback(void *opaque, Uint8 *stream, int len)
 {
-    VideoState *is = (VideoState*) opaque;
+    VideoState *is = AudioRenderer::attached;
     int audio_size, len1;
+    int64_t last_callback_time = audio_callback_time;
 
     audio_callback_time = av_gettime_relative();
+    
+    // The device's thread lives as long as the device is open, so the policy is applied once.
+    static thread_local bool policyApplied = false;
+    if (!policyApplied) {
+        if (!ThreadPolicy::apply(THREAD_ROLE_AUDIO_OUTPUT))
+            av_log(NULL, AV_LOG_WARNING, "Failed to apply the thread policy to the audio output.\n");
+        policyApplied = true;
+    }
+    
+    // The device asks for audio as it plays out the previous buffer. Deviations from that pace
+    // are jitter in the callback.
+    static VideoState *last_is = 0;
+    if (is && is == last_is && last_callback_time && is->audio_tgt.bytes_per_sec > 0) {
+        int64_t expected = (int64_t) len * 1000000 / is->audio_tgt.bytes_per_sec;
+        metricCallbackJitter->record(llabs(audio_callback_time - last_callback_time - expected));
+    }
+    last_is = is;
+    
+    if (!is) {
+        memset(stream, 0, len);
+        return;
+    }
 
     while (len > 0) {
         if (is->audio_buf_index >= is->audio_buf_size) {
+           is->audio_write_buf_size = 0;	// All samples have been passed on to the device.
            audio_size = audio_decode_frame(is);
            if (audio_size < 0) {
                 /* if error, just output silence */
+               if (!is->paused && !is->eof)
+                   metricAudioUnderruns->add();
+               /* the output has drained: the read thread may be waiting for this to end playback */
+               if (is->audio_buf && is->audioq.wakeup)
+                   PacketQueueC::packet_queue_wake(is->audioq.wakeup);
                is->audio_buf = NULL;
                is->audio_buf_size = SDL_AUDIO_MIN_BUFFER_SIZE / is->audio_tgt.frame_size * is->audio_tgt.frame_size;
            } else {
                if (is->show_mode != SHOW_MODE_VIDEO)
                    update_sample_display(is, (int16_t *)is->audio_buf, audio_size);
                is->audio_buf_size = audio_size;
+               Player::firstFrame();
            }
            is->audio_buf_index = 0;
         }
@@ -378,10 +438,17 @@ static void sdl_audio_callback(void *opaque, Uint8 *stream, int len)
     /* Let's assume the audio driver that is used by SDL has two periods. */
     if (!isnan(is->audio_clock)) {
         ClockC::set_clock_at(&is->audclk, is->audio_clock - (double)(2 * is->audio_hw_buf_size + is->audio_write_buf_size) / is->audio_tgt.bytes_per_sec, is->audio_clock_serial, audio_callback_time / 1000000.0);
-        ClockC::sync_clock_to_slave(&is->extclk, &is->audclk);
+        if (SyncTarget::active())
+            SyncTarget::update(is);
+        else
+            ClockC::sync_clock_to_slave(&is->extclk, &is->audclk);
     }
 }
 
+// --- AUDIO OPEN ---
+// Opens the audio device for the wanted parameters. If the device is still open from the previous
+// track with the same parameters, it is reused as-is, so that no gap or click occurs between
+// tracks. The stream only gets played once it has been attached with audio_attach().
 int AudioRenderer::audio_open(void *opaque, int64_t wanted_channel_layout, int wanted_nb_channels, int wanted_sample_rate, struct AudioParams *audio_hw_params)
 {
     SDL_AudioSpec wanted_spec, spec;
@@ -389,6 +456,18 @@ int AudioRenderer::audio_open(void *opaque, int64_t wanted_channel_layout, int w
     static const int next_nb_channels[] = {0, 0, 1, 6, 2, 6, 4, 6};
     static const int next_sample_rates[] = {0, 44100, 48000, 96000, 192000};
     int next_sample_rate_idx = FF_ARRAY_ELEMS(next_sample_rates) - 1;
+    
+    if (audio_dev && wanted_channel_layout == deviceLayout && wanted_nb_channels == deviceChannels &&
+													wanted_sample_rate == deviceRate) {
+        av_log(NULL, AV_LOG_INFO, "Reusing open audio device.\n");
+        *audio_hw_params = deviceParams;
+        return deviceBufSize;
+    }
+    
+    audio_close();
+    deviceLayout = wanted_channel_layout;
+    deviceChannels = wanted_nb_channels;
+    deviceRate = wanted_sample_rate;
 
     env = SDL_getenv("SDL_AUDIO_CHANNELS");
     if (env) {
@@ -412,8 +491,15 @@ int AudioRenderer::audio_open(void *opaque, int64_t wanted_channel_layout, int w
     wanted_spec.silence = 0;
     wanted_spec.samples = FFMAX(SDL_AUDIO_MIN_BUFFER_SIZE, 2 << av_log2(wanted_spec.freq / SDL_AUDIO_MAX_CALLBACKS_PER_SEC));
     wanted_spec.callback = sdl_audio_callback;
-    wanted_spec.userdata = opaque;
-    while (!(audio_dev = SDL_OpenAudioDevice(NULL, 0, &wanted_spec, &spec, SDL_AUDIO_ALLOW_FREQUENCY_CHANGE | SDL_AUDIO_ALLOW_CHANNELS_CHANGE))) {
+    wanted_spec.userdata = 0;
+    
+    // Without a device, the caller takes the samples from the sample queue itself.
+    if (nullSink) {
+        spec = wanted_spec;
+        spec.size = spec.samples * spec.channels * 2;
+    }
+    
+    while (!nullSink && !(audio_dev = SDL_OpenAudioDevice(NULL, 0, &wanted_spec, &spec, SDL_AUDIO_ALLOW_FREQUENCY_CHANGE | SDL_AUDIO_ALLOW_CHANNELS_CHANGE))) {
         av_log(NULL, AV_LOG_WARNING, "SDL_OpenAudio (%d channels, %d Hz): %s\n",
                wanted_spec.channels, wanted_spec.freq, SDL_GetError());
         wanted_spec.channels = next_nb_channels[FFMIN(7, wanted_spec.channels)];
@@ -452,10 +538,50 @@ int AudioRenderer::audio_open(void *opaque, int64_t wanted_channel_layout, int w
         av_log(NULL, AV_LOG_ERROR, "av_samples_get_buffer_size failed\n");
         return -1;
     }
+	
+    deviceParams = *audio_hw_params;
+    deviceBufSize = spec.size;
     return spec.size;
 }
 
 
+// --- AUDIO ATTACH ---
+// Makes the audio device play the samples of the given stream, and starts the device.
+void AudioRenderer::audio_attach(VideoState *is) {
+	if (!audio_dev) { return; }		// Null sink.
+	
+	SDL_LockAudioDevice(audio_dev);
+	attached = is;
+	SDL_UnlockAudioDevice(audio_dev);
+	SDL_PauseAudioDevice(audio_dev, 0);
+}
+
+
+// --- AUDIO DETACH ---
+// Stops the audio device from playing the samples of the given stream. The device stays open and
+// outputs silence until the next stream is attached.
+// The stream's sample queue has to be aborted first, as the callback may be waiting on it.
+void AudioRenderer::audio_detach(VideoState *is) {
+	if (!audio_dev) { return; }
+	
+	SDL_LockAudioDevice(audio_dev);
+	if (attached == is) { attached = 0; }
+	SDL_UnlockAudioDevice(audio_dev);
+}
+
+
+// --- AUDIO CLOSE ---
+// Closes the audio device, if it is open.
+void AudioRenderer::audio_close() {
+	if (!audio_dev) { return; }
+	
+	av_log(NULL, AV_LOG_INFO, "Closing audio device...\n");
+	SDL_CloseAudioDevice(audio_dev);
+	audio_dev = 0;
+	attached = 0;
+}
+
+
 extern "C" {
 #include <libavfilter/buffersrc.h>
 #include <libavfilter/buffersink.h>
@@ -477,6 +603,9 @@ int AudioRenderer::audio_thread(void *arg) {
 
     if (!frame)
         return AVERROR(ENOMEM);
+    
+    if (!ThreadPolicy::apply(THREAD_ROLE_AUDIO_DECODE))
+        av_log(NULL, AV_LOG_WARNING, "Failed to apply the thread policy to the audio decoder.\n");
 
 	run = true;
     do {
@@ -536,13 +665,17 @@ int AudioRenderer::audio_thread(void *arg) {
 
                 av_frame_move_ref(af->frame, frame);
                 FrameQueueC::frame_queue_push(&is->sampq);
+                metricAudioQueued->add();
 
 #if CONFIG_AVFILTER
                 if (is->audioq.serial != is->auddec.pkt_serial)
                     break;
             }
-            if (ret == AVERROR_EOF)
+            if (ret == AVERROR_EOF) {
                 is->auddec.finished = is->auddec.pkt_serial;
+                if (is->audioq.wakeup)
+                    PacketQueueC::packet_queue_wake(is->audioq.wakeup);
+            }
 #endif
         }
     } while (ret >= 0 || ret == AVERROR(EAGAIN) || ret == AVERROR_EOF);
@@ -558,3 +691,11 @@ int AudioRenderer::audio_thread(void *arg) {
 void AudioRenderer::quit() {
 	run = false;
 }
+
+
+// --- SET NULL SINK ---
+// Makes audio_open() skip opening the audio device, for headless use such as benchmarks. The
+// decoded samples stay in the sample queue, for the caller to consume.
+void AudioRenderer::setNullSink(bool enable) {
+	nullSink = enable;
+}
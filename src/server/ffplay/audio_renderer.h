@@ -12,13 +12,26 @@
 
 class AudioRenderer {
 	static std::atomic<bool> run;
+	static VideoState* attached;
+	static AudioParams deviceParams;
+	static int deviceBufSize;
+	static int64_t deviceLayout;
+	static int deviceChannels;
+	static int deviceRate;
+	static std::atomic<bool> nullSink;
+	
+	friend void sdl_audio_callback(void *opaque, Uint8 *stream, int len);
 	
 public:
 	static int audio_open(void *opaque, int64_t wanted_channel_layout, int wanted_nb_channels, int wanted_sample_rate, struct AudioParams *audio_hw_params);
+	static void audio_attach(VideoState *is);
+	static void audio_detach(VideoState *is);
+	static void audio_close();
 	static int audio_thread(void *arg);
 	static int configure_audio_filters(VideoState *is, const char *afilters, int force_output_format);
 	
 	static void quit();
+	static void setNullSink(bool enable);
 };
 
 
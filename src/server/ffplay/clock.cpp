@@ -2,6 +2,12 @@
 
 #include "clock.h"
 
+#include "../metrics.h"
+
+
+static MetricGauge* metricSyncError = Metrics::gauge("nymphcast_av_sync_error_seconds",
+                "Video clock minus the master clock, as of the last displayed frame.");
+
 
 double ClockC::get_clock(Clock *c) {
     if (*c->queue_serial != c->serial)
@@ -102,6 +108,8 @@ double ClockC::compute_target_delay(double delay, VideoState *is) {
         /* if video is slave, we try to correct big delays by
            duplicating or deleting a frame */
         diff = get_clock(&is->vidclk) - get_master_clock(is);
+        if (!isnan(diff))
+            metricSyncError->set(diff);
 
         /* skip or repeat frame. We take into account the
            delay to compute the threshold. I still don't know
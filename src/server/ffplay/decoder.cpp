@@ -5,6 +5,13 @@
 #include "packet_queue.h"
 #include "frame_queue.h"
 
+#include "../metrics.h"
+
+
+static MetricCounter* metricAudioDecoded = Metrics::counter(
+                "nymphcast_frames_decoded_total{stream=\"audio\"}", "Frames output by the decoders.");
+static MetricCounter* metricVideoDecoded = Metrics::counter(
+                "nymphcast_frames_decoded_total{stream=\"video\"}", "Frames output by the decoders.");
 
 
 void DecoderC::decoder_init(Decoder *d, AVCodecContext *avctx, PacketQueue *queue, SDL_cond *empty_queue_cond) {
@@ -55,17 +62,29 @@ int DecoderC::decoder_decode_frame(Decoder *d, AVFrame *frame, AVSubtitle *sub)
                 }
                 if (ret == AVERROR_EOF) {
                     d->finished = d->pkt_serial;
+                    if (d->queue->wakeup)
+                        PacketQueueC::packet_queue_wake(d->queue->wakeup);
                     avcodec_flush_buffers(d->avctx);
                     return 0;
                 }
-                if (ret >= 0)
+                if (ret >= 0) {
+                    if (d->avctx->codec_type == AVMEDIA_TYPE_AUDIO)
+                        metricAudioDecoded->add();
+                    else
+                        metricVideoDecoded->add();
                     return 1;
+                }
             } while (ret != AVERROR(EAGAIN));
         }
 
         do {
-            if (d->queue->nb_packets == 0)
-                SDL_CondSignal(d->empty_queue_cond);
+            /* through the queue's wakeup, so that the read thread doesn't miss it */
+            if (d->queue->nb_packets == 0) {
+                if (d->queue->wakeup)
+                    PacketQueueC::packet_queue_wake(d->queue->wakeup);
+                else
+                    SDL_CondSignal(d->empty_queue_cond);
+            }
             if (d->packet_pending) {
                 av_packet_move_ref(&pkt, &d->pkt);
                 d->packet_pending = 0;
@@ -28,12 +28,22 @@ AVPacket flush_pkt;
 #include <Poco/NumberFormatter.h>
 #include <nymph/nymph_logger.h>
 
+#include "../logging.h"
+#include "../metrics.h"
+
 
 // Global objects.
 Poco::Condition playerCon;
 Poco::Mutex playerMutex;
 // ---
 
+// Metrics.
+static MetricCounter* metricUnderruns = Metrics::counter("nymphcast_buffer_underruns_total",
+								"Reads by the player which found the data buffer empty.");
+static MetricHistogram* metricBufferSeek = Metrics::histogram("nymphcast_buffer_seek_seconds",
+								"Time taken by seeks in the data buffer, including the request to "
+								"the client.");
+
 // Static definitions.
 std::string Ffplay::loggerName = "Ffplay";
 
@@ -52,7 +62,9 @@ std::string Ffplay::loggerName = "Ffplay";
 
 #include "player.h"
 #include "stream_handler.h"
+#include "packet_queue.h"
 #include "sdl_renderer.h"
+#include "audio_renderer.h"
 
 
 static void do_exit(VideoState *is) {
@@ -285,13 +297,15 @@ void show_help_default(const char *opt, const char *arg)
  * @return The number of bytes read into the buffer.
  */
 int Ffplay::media_read(void* opaque, uint8_t* buf, int buf_size) {
-	uint32_t bytesRead = DataBuffer::read(buf_size, buf);
-	//std::cout << "Read " << bytesRead << " bytes." << std::endl;
-	NYMPH_LOG_INFORMATION("Read " + Poco::NumberFormatter::format(bytesRead) + " bytes.");
+	DataBuffer* db = (DataBuffer*) opaque;
+	uint32_t bytesRead = db->read(buf_size, buf);
+	NC_LOG_TRACE(LOG_SUB_READ, "Read %u bytes.", bytesRead);
 	if (bytesRead == 0) {
-		std::cout << "EOF is " << DataBuffer::isEof() << std::endl;
-		if (DataBuffer::isEof()) { return AVERROR_EOF; }
-		else { return AVERROR(EIO); }
+		NC_LOG_DEBUG(LOG_SUB_READ, "EOF is %d", (int) db->isEof());
+		if (db->isEof()) { return AVERROR_EOF; }
+		
+		metricUnderruns->add();
+		return AVERROR(EIO);
 	}
 	
 	return bytesRead;
@@ -308,40 +322,44 @@ int Ffplay::media_read(void* opaque, uint8_t* buf, int buf_size) {
  * @return  The new byte position in the file or -1 in case of failure.
  */
 int64_t Ffplay::media_seek(void* opaque, int64_t offset, int whence) {
-	NYMPH_LOG_INFORMATION("media_seek: offset " + Poco::NumberFormatter::format(offset) + 
-							", whence " + Poco::NumberFormatter::format(whence));
+	NC_LOG_DEBUG(LOG_SUB_READ, "media_seek: offset %" PRId64 ", whence %d", offset, whence);
 	
+	DataBuffer* db = (DataBuffer*) opaque;
 	int64_t new_offset = AVERROR(EIO);
+	int64_t begin = av_gettime_relative();
 	switch (whence) {
 		case SEEK_SET:	// Seek from the beginning of the file.
-			NYMPH_LOG_INFORMATION("media_seek: SEEK_SET");
-			new_offset = DataBuffer::seek(DB_SEEK_START, offset);
+			NC_LOG_TRACE(LOG_SUB_READ, "media_seek: SEEK_SET");
+			new_offset = db->seek(DB_SEEK_START, offset);
 			break;
 		case SEEK_CUR:	// Seek from the current position.
-			NYMPH_LOG_INFORMATION("media_seek: SEEK_CUR");
-			new_offset = DataBuffer::seek(DB_SEEK_CURRENT, offset);
+			NC_LOG_TRACE(LOG_SUB_READ, "media_seek: SEEK_CUR");
+			new_offset = db->seek(DB_SEEK_CURRENT, offset);
 			break;
 		case SEEK_END:	// Seek from the end of the file.
-			NYMPH_LOG_INFORMATION("media_seek: SEEK_END");
-			new_offset = DataBuffer::seek(DB_SEEK_END, offset);
+			NC_LOG_TRACE(LOG_SUB_READ, "media_seek: SEEK_END");
+			new_offset = db->seek(DB_SEEK_END, offset);
 			break;
 		case AVSEEK_SIZE:
-			NYMPH_LOG_INFORMATION("media_seek: received AVSEEK_SIZE, returning file size.");
-			return DataBuffer::getFileSize();
+			NC_LOG_TRACE(LOG_SUB_READ, "media_seek: received AVSEEK_SIZE, returning file size.");
+			return db->getFileSize();
 			break;
 		default:
-			NYMPH_LOG_ERROR("media_seek: default. The universe broke.");
+			NC_LOG_ERROR(LOG_SUB_READ, "media_seek: default. The universe broke.");
 			/* new_offset = -1;
 			return new_offset; */
 	}
 	
 	if (new_offset < 0) {
 		// Some error occurred.
-		NYMPH_LOG_ERROR("Error during seeking.");
+		NC_LOG_ERROR(LOG_SUB_READ, "Error during seeking.");
 		new_offset = AVERROR(EIO);
 	}
+	else {
+		metricBufferSeek->record(av_gettime_relative() - begin);
+	}
 	
-	NYMPH_LOG_INFORMATION("New offset: " + Poco::NumberFormatter::format(new_offset));
+	NC_LOG_DEBUG(LOG_SUB_READ, "New offset: %" PRId64, new_offset);
 	
 	return new_offset;
 }
@@ -381,8 +399,242 @@ void avLogCallback(void *ptr, int level, const char *fmt, va_list vargs) {
 #endif
 
 
+// --- SET DATA BUFFER ---
+// Sets the buffer to read the media data from, when not streaming from a URL.
+void Ffplay::setDataBuffer(std::shared_ptr<DataBuffer> buffer) {
+	std::lock_guard<std::mutex> lk(bufferMutex);
+	this->buffer = buffer;
+}
+
+
+// --- SET PROBE LIMITS ---
+// Sets the maximum number of bytes, and the maximum duration in microseconds, which FFmpeg may read
+// to detect the streams of a cast file. 0 uses FFmpeg's defaults.
+void Ffplay::setProbeLimits(int64_t size, int64_t duration) {
+	probeSize = size;
+	analyzeDuration = duration;
+}
+
+
+// --- FIND INPUT FORMAT ---
+// Returns the demuxer for the format the client indicated, or null if the format has to be probed.
+// The container name is used first, then the MIME type, then the file extension.
+AVInputFormat* Ffplay::findInputFormat(const MediaFormatHint &hint) {
+	if (!hint.container.empty()) {
+		AVInputFormat* fmt = av_find_input_format(hint.container.c_str());
+		if (fmt) { return fmt; }
+	}
+	
+	const AVInputFormat* fmt = 0;
+	void* it = 0;
+	if (!hint.mime.empty()) {
+		while ((fmt = av_demuxer_iterate(&it))) {
+			if (fmt->mime_type && av_match_name(hint.mime.c_str(), fmt->mime_type)) {
+				return (AVInputFormat*) fmt;
+			}
+		}
+	}
+	
+	if (!hint.extension.empty()) {
+		std::string name = "file." + hint.extension;
+		it = 0;
+		while ((fmt = av_demuxer_iterate(&it))) {
+			if (fmt->extensions && av_match_ext(name.c_str(), fmt->extensions)) {
+				return (AVInputFormat*) fmt;
+			}
+		}
+	}
+	
+	return 0;
+}
+
+
+// --- CREATE FORMAT CONTEXT ---
+// Creates the AVFormatContext with the AVIOContext through which FFmpeg reads from the data buffer.
+AVFormatContext* Ffplay::createFormatContext(DataBuffer* db, AVIOContext* &ioContext) {
+	// Create internal buffer for FFmpeg. A larger buffer means fewer calls into the data buffer 
+	// while the streams are being probed.
+	size_t iBufSize = 256 * 1024; // 256 kB
+	uint8_t* pBuffer = (uint8_t*) av_malloc(iBufSize);
+	 
+	// Allocate the AVIOContext:
+	// The fourth parameter (pStream) is a user parameter which will be passed to our callback functions
+	ioContext = avio_alloc_context(pBuffer, iBufSize,  // internal Buffer and its size
+											 0,				  // bWriteable (1=true,0=false) 
+											 db,			  // user data
+											 media_read, 
+											 0,				  // Write callback function. 
+											 media_seek);
+	
+	// Allocate the AVFormatContext. This holds information about the container format.
+	AVFormatContext* formatContext = avformat_alloc_context();
+	formatContext->pb = ioContext;	// Set the IOContext.
+	if (probeSize > 0) { formatContext->probesize = probeSize; }
+	if (analyzeDuration > 0) { formatContext->max_analyze_duration = analyzeDuration; }
+	
+	return formatContext;
+}
+
+
 // --- RUN ---
+// Plays the current file or stream, followed by any which have been queued in the meantime.
+// The audio device stays open until the last track has finished.
 void Ffplay::run() {
+	do {
+		play();
+	}
+	while (finishPlayback());	// Calls handler for post-playback steps.
+	
+	dropPrefetched();
+	AudioRenderer::audio_close();
+}
+
+
+// --- PREFETCH ---
+// Opens the next track from the given buffer, or URL, in the background, so that it can start
+// playing without delay after the current track. Only one track is prefetched at a time.
+void Ffplay::prefetch(std::shared_ptr<DataBuffer> buffer) {
+	startPrefetch(buffer, std::string());
+}
+
+
+void Ffplay::prefetch(std::string url) {
+	startPrefetch(std::shared_ptr<DataBuffer>(), url);
+}
+
+
+// --- START PREFETCH ---
+void Ffplay::startPrefetch(std::shared_ptr<DataBuffer> buffer, std::string url) {
+	std::lock_guard<std::mutex> lk(prefetchMutex);
+	if (prefetchThread.joinable() || nextContext) { return; }
+	
+	NYMPH_LOG_INFORMATION("Prefetching next track.");
+	
+	nextBuffer = buffer;
+	nextUrl = url;
+	prefetchAbort = false;
+	prefetchThread = std::thread(&Ffplay::preopen, this);
+}
+
+
+static int prefetch_interrupt_cb(void* ctx) {
+	std::atomic<bool>* abort = (std::atomic<bool>*) ctx;
+	return *abort;
+}
+
+
+// --- PRE-OPEN ---
+// Prefetch thread. Opens the input of the next track and probes its streams, which is where most 
+// of the start-up time of a track goes.
+void Ffplay::preopen() {
+	prefetchMutex.lock();
+	std::shared_ptr<DataBuffer> db = nextBuffer;
+	std::string url = nextUrl;
+	prefetchMutex.unlock();
+	
+	AVFormatContext* context = 0;
+	AVIOContext* ioContext = 0;
+	AVInputFormat* iformat = file_iformat;
+	if (db) {
+		context = createFormatContext(db.get(), ioContext);
+		iformat = findInputFormat(db->getFormatHint());
+	}
+	else {
+		context = avformat_alloc_context();
+	}
+	
+	context->interrupt_callback.callback = prefetch_interrupt_cb;
+	context->interrupt_callback.opaque = &prefetchAbort;
+	
+	AVDictionary* opts = 0;
+	av_dict_set(&opts, "scan_all_pmts", "1", 0);
+	int err = avformat_open_input(&context, db ? "" : url.c_str(), iformat, &opts);
+	av_dict_free(&opts);
+	if (err >= 0 && find_stream_info) {
+		AVDictionary** sopts = setup_find_stream_info_opts(context, codec_opts);
+		int orig_nb_streams = context->nb_streams;
+		err = avformat_find_stream_info(context, sopts);
+		for (int i = 0; i < orig_nb_streams; i++) { av_dict_free(&sopts[i]); }
+		av_freep(&sopts);
+		
+		if (err < 0) { avformat_close_input(&context); }
+	}
+	
+	if (err < 0) {
+		// The context has been freed on failure.
+		NYMPH_LOG_ERROR("Failed to prefetch next track.");
+		if (ioContext) {
+			av_freep(&ioContext->buffer);
+			av_freep(&ioContext);
+		}
+		
+		return;
+	}
+	
+	prefetchMutex.lock();
+	nextContext = context;
+	nextIoContext = ioContext;
+	prefetchMutex.unlock();
+}
+
+
+// --- TAKE PREFETCHED ---
+// Waits for any prefetch to finish. If it was for the track which is about to be played, its input
+// is handed over, otherwise it's discarded.
+void Ffplay::takePrefetched(std::shared_ptr<DataBuffer> db, AVFormatContext* &context, 
+															AVIOContext* &ioContext) {
+	if (prefetchThread.joinable()) { prefetchThread.join(); }
+	
+	prefetchMutex.lock();
+	bool match = castingUrl ? (!nextBuffer && nextUrl == castUrl) : (nextBuffer && nextBuffer == db);
+	if (nextContext && match) {
+		NYMPH_LOG_INFORMATION("Using prefetched track.");
+		context = nextContext;
+		ioContext = nextIoContext;
+		nextContext = 0;
+		nextIoContext = 0;
+		nextBuffer.reset();
+		nextUrl.clear();
+	}
+	
+	prefetchMutex.unlock();
+	
+	dropPrefetched();
+}
+
+
+// --- DROP PREFETCHED ---
+// Discards the prefetched track, if any. Its buffer is rewound, in case it gets played later on.
+void Ffplay::dropPrefetched() {
+	prefetchAbort = true;
+	if (prefetchThread.joinable()) { prefetchThread.join(); }
+	
+	std::lock_guard<std::mutex> lk(prefetchMutex);
+	if (nextContext) { avformat_close_input(&nextContext); }
+	if (nextIoContext) {
+		av_freep(&nextIoContext->buffer);
+		av_freep(&nextIoContext);
+	}
+	
+	if (nextBuffer) {
+		nextBuffer->seek(DB_SEEK_START, 0);
+		nextBuffer.reset();
+	}
+	
+	nextUrl.clear();
+}
+
+
+// --- PLAY ---
+void Ffplay::play() {
+	// Use the track which was opened while the previous one was playing, if it's this one.
+	AVFormatContext* formatContext = 0;
+	AVIOContext* ioContext = 0;
+	bufferMutex.lock();
+	std::shared_ptr<DataBuffer> db = buffer;
+	bufferMutex.unlock();
+	takePrefetched(db, formatContext, ioContext);
+	
 	init_dynload();
 	
 	// Fake command line arguments.
@@ -421,27 +673,24 @@ void Ffplay::run() {
 		
 		
 	// --- AVIOContext section ---
-	AVFormatContext* formatContext = 0;
-	AVIOContext* ioContext = 0;
-	if (!castingUrl) {
+	if (castingUrl) {
+		input_filename = castUrl.c_str();
+	}
+	else {
 		input_filename = "";
+	}
+	
+	AVInputFormat* iformat = file_iformat;
+	if (!castingUrl && db) {
+		// Skip probing for the format if the client told us what it is.
+		iformat = findInputFormat(db->getFormatHint());
+		if (iformat) {
+			NYMPH_LOG_INFORMATION("Format hint: using demuxer " + std::string(iformat->name) + ".");
+		}
+	}
 	
-		// Create internal buffer for FFmpeg.
-		size_t iBufSize = 32 * 1024; // 32 kB
-		uint8_t* pBuffer = (uint8_t*) av_malloc(iBufSize);
-		 
-		// Allocate the AVIOContext:
-		// The fourth parameter (pStream) is a user parameter which will be passed to our callback functions
-		ioContext = avio_alloc_context(pBuffer, iBufSize,  // internal Buffer and its size
-												 0,				  // bWriteable (1=true,0=false) 
-												 0, //&media_buffer,	  // user data
-												 media_read, 
-												 0,				  // Write callback function. 
-												 media_seek);
-		 
-		// Allocate the AVFormatContext. This holds information about the container format.
-		formatContext = avformat_alloc_context();
-		formatContext->pb = ioContext;	// Set the IOContext.
+	if (!castingUrl && !formatContext) {
+		formatContext = createFormatContext(db.get(), ioContext);
 		//formatContext->flags = AVFMT_FLAG_CUSTOM_IO;
 		
 		// Determine the input format.
@@ -459,12 +708,9 @@ void Ffplay::run() {
 		
 	// --- End AVIOContext section ---
 	}
-	else {
-		input_filename = castUrl.c_str();
-	}
 	
 	// Start player.
-	is = StreamHandler::stream_open(input_filename, file_iformat, formatContext);
+	is = StreamHandler::stream_open(input_filename, iformat, formatContext);
 	if (!is) {
 		av_log(NULL, AV_LOG_FATAL, "Failed to initialize VideoState!\n");
 		do_exit(NULL);
@@ -476,6 +722,12 @@ void Ffplay::run() {
 		file_meta.duration = is->ic->duration / AV_TIME_BASE; // Convert to seconds.
 	}
 
+	// Wake the read thread as data arrives, rather than have it poll the buffer after an underrun.
+	if (!castingUrl && db) {
+		ReadWakeup* wakeup = &is->read_wakeup;
+		db->setDataCallback([wakeup]() { PacketQueueC::packet_queue_wake(wakeup); });
+	}
+	
 	Player::setVideoState(is);
 	SdlRenderer::playerEvents(true);
 	
@@ -492,28 +744,38 @@ void Ffplay::run() {
 	// Immediately disable player events since we're no longer processing them.
 	SdlRenderer::playerEvents(false);
 	
-	SDL_Delay(500); // wait 500 ms.
+	if (db) { db->setDataCallback(0); }
+	if (is) {
+		StreamHandler::stream_close(is);
+		is = 0;
+	}
 	
+	// The format context has been closed, which leaves the custom IO context to us.
 	if (ioContext) {
 		av_freep(&ioContext->buffer);
 		av_freep(&ioContext);
 	}
 	
-	if (is) {
-		StreamHandler::stream_close(is);
-		is = 0;
-	}
-	
 	av_log(NULL, AV_LOG_INFO, "Terminating player...\n");
 	
-	DataBuffer::reset();	// Clears the data buffer (file data buffer).
-	finishPlayback();		// Calls handler for post-playback steps.
+	if (db) {
+		SegmentCacheStats cst = db->cacheStats();
+		NYMPH_LOG_INFORMATION("Segment cache: " + Poco::NumberFormatter::format(cst.hits) + " hits, " +
+								Poco::NumberFormatter::format(cst.misses) + " misses, " + 
+								Poco::NumberFormatter::format(cst.evictions) + " evictions.");
+		
+		db->reset();	// Clears the data buffer (file data buffer).
+	}
 }
  
  
 // --- QUIT ---
 void Ffplay::quit() {
-	// Stop player.
+	// Stop player. Wake up the read thread if it's waiting for data from the client.
+	bufferMutex.lock();
+	if (buffer) { buffer->abort(); }
+	bufferMutex.unlock();
+	prefetchAbort = true;
 	Player::quit();
 }
 
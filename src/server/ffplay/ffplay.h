@@ -17,6 +17,10 @@
 #include <iostream>
 #include <atomic>
 #include <queue>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
 
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_mutex.h>
@@ -27,6 +31,7 @@
 #include <Poco/Runnable.h>
 
 #include "types.h"
+#include "../databuffer.h"
 
 
 struct FileMetaInfo {
@@ -46,9 +51,11 @@ struct FileMetaInfo {
 	
 	void setTitle(std::string t) { mutex.lock(); title = t; mutex.unlock(); }
 	std::string getTitle() { mutex.lock(); std::string t = title; mutex.unlock(); return t; }
+	void getTitle(std::string &t) { mutex.lock(); t = title; mutex.unlock(); }
 	
 	void setArtist(std::string a) { mutex.lock(); artist = a; mutex.unlock(); }
 	std::string getArtist() { mutex.lock(); std::string a = artist; mutex.unlock(); return a; }
+	void getArtist(std::string &a) { mutex.lock(); a = artist; mutex.unlock(); }
 	
 	void setAlbum(std::string a) { mutex.lock(); album = a; mutex.unlock(); }
 	std::string getAlbum() { mutex.lock(); std::string a = album; mutex.unlock(); return a; }
@@ -59,18 +66,44 @@ struct FileMetaInfo {
 extern FileMetaInfo file_meta;
 extern std::atomic<bool> playerStarted;
 	
-void finishPlayback(); // Defined in NymphCastServer.cpp
+bool finishPlayback(); // Defined in NymphCastServer.cpp
 
 	
 class Ffplay : public Poco::Runnable {
     VideoState* is = 0;
 	static std::string loggerName;
+	std::shared_ptr<DataBuffer> buffer;	// Buffer of the session being played back.
+	std::mutex bufferMutex;
+	
+	// Next track, opened while the current one is playing.
+	std::thread prefetchThread;
+	std::mutex prefetchMutex;
+	std::atomic<bool> prefetchAbort = { false };
+	std::shared_ptr<DataBuffer> nextBuffer;
+	std::string nextUrl;
+	AVFormatContext* nextContext = 0;
+	AVIOContext* nextIoContext = 0;
+	
+	std::atomic<int64_t> probeSize = { 0 };
+	std::atomic<int64_t> analyzeDuration = { 0 };
 	
 	static int media_read(void* opaque, uint8_t* buf, int buf_size);
 	static int64_t media_seek(void* opaque, int64_t pos, int whence);
+	static AVInputFormat* findInputFormat(const MediaFormatHint &hint);
+	AVFormatContext* createFormatContext(DataBuffer* db, AVIOContext* &ioContext);
+	void play();
+	void startPrefetch(std::shared_ptr<DataBuffer> buffer, std::string url);
+	void preopen();
+	void takePrefetched(std::shared_ptr<DataBuffer> db, AVFormatContext* &context, 
+															AVIOContext* &ioContext);
+	void dropPrefetched();
 	
 public:
 	virtual void run();
+	void setDataBuffer(std::shared_ptr<DataBuffer> buffer);
+	void prefetch(std::shared_ptr<DataBuffer> buffer);
+	void prefetch(std::string url);
+	void setProbeLimits(int64_t size, int64_t duration);
 	uint8_t getVolume();
 	void setVolume(uint8_t volume);
 	void quit();
@@ -1,6 +1,7 @@
 
 
 #include "frame_queue.h"
+#include "packet_queue.h"
 
 
 // --- FRAME QUEUE INIT ---
@@ -110,6 +111,9 @@ void FrameQueueC::frame_queue_next(FrameQueue *f) {
     f->size--;
     SDL_CondSignal(f->cond);
     SDL_UnlockMutex(f->mutex);
+    /* the read thread ends playback once the frame queues have drained */
+    if (frame_queue_nb_remaining(f) == 0 && f->pktq && f->pktq->wakeup)
+        PacketQueueC::packet_queue_wake(f->pktq->wakeup);
 }
 
 /* return the number of undisplayed frames in the queue */
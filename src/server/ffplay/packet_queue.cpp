@@ -3,13 +3,43 @@
 #include "packet_queue.h"
 
 
+// --- PACKET NODE GET ---
+// Takes a list node from the queue's pool, or allocates one if the pool is empty. Once a stream
+// has been playing for a bit, the pool holds enough nodes that no further allocations are made.
+// Call with the queue mutex held.
+MyAVPacketList* PacketQueueC::packet_node_get(PacketQueue *q) {
+    MyAVPacketList *node = q->free_pkt;
+    if (!node)
+        return (MyAVPacketList*) av_malloc(sizeof(MyAVPacketList));
+
+    q->free_pkt = node->next;
+    q->nb_free--;
+    return node;
+}
+
+
+// --- PACKET NODE PUT ---
+// Returns a list node to the queue's pool, or frees it if the pool is full.
+// Call with the queue mutex held.
+void PacketQueueC::packet_node_put(PacketQueue *q, MyAVPacketList *node) {
+    if (q->nb_free >= q->max_free) {
+        av_free(node);
+        return;
+    }
+
+    node->next = q->free_pkt;
+    q->free_pkt = node;
+    q->nb_free++;
+}
+
+
 int PacketQueueC::packet_queue_put_private(PacketQueue *q, AVPacket *pkt) {
     MyAVPacketList *pkt1;
 
     if (q->abort_request)
        return -1;
 
-    pkt1 = (MyAVPacketList*) av_malloc(sizeof(MyAVPacketList));
+    pkt1 = packet_node_get(q);
     if (!pkt1)
         return -1;
     pkt1->pkt = *pkt;
@@ -70,6 +100,7 @@ int PacketQueueC::packet_queue_init(PacketQueue *q) {
         return AVERROR(ENOMEM);
     }
     q->abort_request = 1;
+    q->max_free = PACKET_QUEUE_POOL_SIZE;
     return 0;
 }
 
@@ -81,7 +112,7 @@ void PacketQueueC::packet_queue_flush(PacketQueue *q) {
     for (pkt = q->first_pkt; pkt; pkt = pkt1) {
         pkt1 = pkt->next;
         av_packet_unref(&pkt->pkt);
-        av_freep(&pkt);
+        packet_node_put(q, pkt);
     }
     q->last_pkt = NULL;
     q->first_pkt = NULL;
@@ -93,7 +124,15 @@ void PacketQueueC::packet_queue_flush(PacketQueue *q) {
 
 
 void PacketQueueC::packet_queue_destroy(PacketQueue *q) {
+    MyAVPacketList *pkt, *pkt1;
+
     packet_queue_flush(q);
+    for (pkt = q->free_pkt; pkt; pkt = pkt1) {
+        pkt1 = pkt->next;
+        av_free(pkt);
+    }
+    q->free_pkt = NULL;
+    q->nb_free = 0;
     SDL_DestroyMutex(q->mutex);
     SDL_DestroyCond(q->cond);
 }
@@ -122,6 +161,7 @@ void PacketQueueC::packet_queue_start(PacketQueue *q) {
 int PacketQueueC::packet_queue_get(PacketQueue *q, AVPacket *pkt, int block, int *serial) {
     MyAVPacketList *pkt1;
     int ret;
+    bool wake = false;
 
     SDL_LockMutex(q->mutex);
 
@@ -142,7 +182,11 @@ int PacketQueueC::packet_queue_get(PacketQueue *q, AVPacket *pkt, int block, int
             *pkt = pkt1->pkt;
             if (serial)
                 *serial = pkt1->serial;
-            av_free(pkt1);
+            packet_node_put(q, pkt1);
+            if (q->wake_packets && q->nb_packets < q->wake_packets) {
+                q->wake_packets = 0;
+                wake = true;
+            }
             ret = 1;
             break;
         } else if (!block) {
@@ -153,5 +197,30 @@ int PacketQueueC::packet_queue_get(PacketQueue *q, AVPacket *pkt, int block, int
         }
     }
     SDL_UnlockMutex(q->mutex);
+
+    if (wake && q->wakeup)
+        packet_queue_wake(q->wakeup);
+
     return ret;
 }
+
+
+// --- PACKET QUEUE ARM ---
+// Sets the watermark at which the queue wakes the read thread: once a quarter of the packets now
+// queued have been taken by the decoder. The read thread sets this before it sleeps on full queues.
+void PacketQueueC::packet_queue_arm(PacketQueue *q) {
+    SDL_LockMutex(q->mutex);
+    q->wake_packets = q->nb_packets - q->nb_packets / 4;
+    SDL_UnlockMutex(q->mutex);
+}
+
+
+// --- PACKET QUEUE WAKE ---
+// Wakes the read thread. A wakeup sent while the read thread is not sleeping yet is not lost, but
+// makes its next sleep return right away.
+void PacketQueueC::packet_queue_wake(ReadWakeup *w) {
+    SDL_LockMutex(w->mutex);
+    w->pending = 1;
+    SDL_CondSignal(w->cond);
+    SDL_UnlockMutex(w->mutex);
+}
@@ -10,6 +10,9 @@
 class PacketQueueC {
 	PacketQueue *f;
 	
+	static MyAVPacketList* packet_node_get(PacketQueue *q);
+	static void packet_node_put(PacketQueue *q, MyAVPacketList *node);
+	
 public:
 	static int packet_queue_put_private(PacketQueue *q, AVPacket *pkt);
 	static int packet_queue_put(PacketQueue *q, AVPacket *pkt);
@@ -20,6 +23,8 @@ public:
 	static void packet_queue_abort(PacketQueue *q);
 	static void packet_queue_start(PacketQueue *q);
 	static int packet_queue_get(PacketQueue *q, AVPacket *pkt, int block, int *serial);
+	static void packet_queue_arm(PacketQueue *q);
+	static void packet_queue_wake(ReadWakeup *w);
 };
 
 #endif
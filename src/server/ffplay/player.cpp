@@ -22,6 +22,11 @@ uint32_t profcount = 0;
 std::atomic_bool Player::run;
 VideoState* Player::cur_stream = 0;
 double Player::remaining_time = 0.0;
+std::atomic<int64_t> Player::startTime = { 0 };
+std::atomic<uint32_t> Player::timeToFirstFrame = { 0 };
+std::mutex Player::seekMutex;
+SeekRequest Player::pendingSeek;
+bool Player::seekPending = false;
 
 
 // --- CONSTRUCTOR ---
@@ -376,26 +381,8 @@ void Player::event_loop(VideoState *cur_stream) {
         }
 		
 		if (event.type == nymph_seek_event) {
-			// Seek to the desired location.
-			int64_t ts;
-			int ns, hh, mm, ss;
-			int tns, thh, tmm, tss;
-			tns  = cur_stream->ic->duration / 1000000LL;
-			thh  = tns / 3600;
-			tmm  = (tns % 3600) / 60;
-			tss  = (tns % 60);
-			frac = event.user.code / 100.0;
-			ns   = frac * tns;
-			hh   = ns / 3600;
-			mm   = (ns % 3600) / 60;
-			ss   = (ns % 60);
-			av_log(NULL, AV_LOG_INFO,
-				   "Seek to %2.0f%% (%2d:%02d:%02d) of total duration (%2d:%02d:%02d)       \n", frac*100,
-					hh, mm, ss, thh, tmm, tss);
-			ts = frac * cur_stream->ic->duration;
-			if (cur_stream->ic->start_time != AV_NOPTS_VALUE)
-				ts += cur_stream->ic->start_time;
-			StreamHandler::stream_seek(cur_stream, ts, 0, 0);
+			// Seek to the requested location.
+			seek(cur_stream);
 		}			
     }
 }
@@ -418,12 +405,19 @@ void Player::run_updates() {
 	std::chrono::high_resolution_clock::time_point begin = std::chrono::high_resolution_clock::now();
 #endif
 	
+	// Sleep until the next frame is due, or an event arrives. The event is handled by the caller.
 	if (remaining_time > 0.0) {
-		av_usleep((int64_t)(remaining_time * 1000000.0));
+		int ms = (int) (remaining_time * 1000.0);
+		if (ms > 0) { SDL_WaitEventTimeout(NULL, ms); }
+		else { av_usleep((int64_t)(remaining_time * 1000000.0)); }
 	}
 	
-	remaining_time = REFRESH_RATE;
-	if (cur_stream->show_mode != SHOW_MODE_NONE && (!cur_stream->paused || cur_stream->force_refresh)) {
+	// Without video or visualisation to show, nothing needs refreshing until an event arrives.
+	bool refresh = cur_stream->show_mode != SHOW_MODE_NONE && 
+							(!cur_stream->paused || cur_stream->force_refresh);
+	remaining_time = (refresh && (cur_stream->video_st || (!display_disable && cur_stream->audio_st))) 
+														? REFRESH_RATE : IDLE_REFRESH_RATE;
+	if (refresh) {
 		VideoRenderer::video_refresh(cur_stream, &remaining_time);
 	}
 
@@ -661,32 +655,100 @@ bool Player::process_event(SDL_Event &event) {
 	}
 	
 	if (event.type == nymph_seek_event) {
-		// Seek to the desired location.
-		int64_t ts;
-		int ns, hh, mm, ss;
-		int tns, thh, tmm, tss;
-		tns  = cur_stream->ic->duration / 1000000LL;
-		thh  = tns / 3600;
-		tmm  = (tns % 3600) / 60;
-		tss  = (tns % 60);
-		frac = event.user.code / 100.0;
-		ns   = frac * tns;
-		hh   = ns / 3600;
-		mm   = (ns % 3600) / 60;
-		ss   = (ns % 60);
-		av_log(NULL, AV_LOG_INFO,
-			   "Seek to %2.0f%% (%2d:%02d:%02d) of total duration (%2d:%02d:%02d)       \n", frac*100,
-				hh, mm, ss, thh, tmm, tss);
-		ts = frac * cur_stream->ic->duration;
-		if (cur_stream->ic->start_time != AV_NOPTS_VALUE)
-			ts += cur_stream->ic->start_time;
-		StreamHandler::stream_seek(cur_stream, ts, 0, 0);
+		// Seek to the requested location.
+		seek(cur_stream);
 	}
 	
 	return true;
 }
 
 
+// --- REQUEST SEEK ---
+// Asks the player thread to seek. A request which has not been handled yet gets replaced, so that 
+// while scrubbing, only the latest position is sought.
+void Player::requestSeek(int type, double value) {
+	{
+		std::lock_guard<std::mutex> lk(seekMutex);
+		pendingSeek.type = type;
+		pendingSeek.value = value;
+		seekPending = true;
+	}
+	
+	SDL_Event event;
+	event.type = nymph_seek_event;
+	event.user.code = NYMPH_SEEK_EVENT;
+	SDL_PushEvent(&event);
+}
+
+
+// --- SEEK ---
+// Performs the pending seek request. Time-based seeks use the container's index, if it has one.
+// The position at which playback lands is reported by the stream handler.
+void Player::seek(VideoState* is) {
+	SeekRequest req;
+	{
+		std::lock_guard<std::mutex> lk(seekMutex);
+		if (!seekPending) { return; }
+		req = pendingSeek;
+		seekPending = false;
+	}
+	
+	if (!is || !is->ic) { return; }
+	
+	double start = (is->ic->start_time != AV_NOPTS_VALUE) ? is->ic->start_time / (double) AV_TIME_BASE : 0.0;
+	double duration = (is->ic->duration > 0) ? is->ic->duration / (double) AV_TIME_BASE : 0.0;
+	double pos;
+	switch (req.type) {
+	case NYMPH_SEEK_TYPE_PERCENTAGE: {
+		double frac = req.value / 100.0;
+		int tns = duration;
+		int ns = frac * tns;
+		av_log(NULL, AV_LOG_INFO,
+			   "Seek to %2.0f%% (%2d:%02d:%02d) of total duration (%2d:%02d:%02d)       \n", frac*100,
+				ns / 3600, (ns % 3600) / 60, ns % 60, tns / 3600, (tns % 3600) / 60, tns % 60);
+		pos = start + frac * duration;
+		StreamHandler::stream_seek(is, (int64_t)(pos * AV_TIME_BASE), 0, 0);
+		break;
+	}
+	case NYMPH_SEEK_TYPE_TIME:
+		pos = req.value;
+		if (pos < start) { pos = start; }
+		if (duration > 0 && pos > start + duration) { pos = start + duration; }
+		av_log(NULL, AV_LOG_INFO, "Seek to %.3f s.\n", pos);
+		StreamHandler::stream_seek(is, (int64_t)(pos * AV_TIME_BASE), 0, 0);
+		break;
+	case NYMPH_SEEK_TYPE_RELATIVE:
+		// As with the arrow keys: the seek lands on a keyframe in the direction of the seek.
+		pos = ClockC::get_master_clock(is);
+		if (isnan(pos))
+			pos = (double)is->seek_pos / AV_TIME_BASE;
+		pos += req.value;
+		if (pos < start) { pos = start; }
+		av_log(NULL, AV_LOG_INFO, "Seek by %.3f s to %.3f s.\n", req.value, pos);
+		StreamHandler::stream_seek(is, (int64_t)(pos * AV_TIME_BASE), (int64_t)(req.value * AV_TIME_BASE), 0);
+		break;
+	case NYMPH_SEEK_TYPE_BYTES:
+		if (!(is->ic->iformat->flags & AVFMT_NO_BYTE_SEEK)) {
+			av_log(NULL, AV_LOG_INFO, "Seek to byte %.0f.\n", req.value);
+			StreamHandler::stream_seek(is, (int64_t) req.value, 0, 1);
+		}
+		else if (is->ic->bit_rate > 0) {
+			// Formats without byte seeking: estimate the time from the bit rate.
+			pos = start + req.value * 8.0 / is->ic->bit_rate;
+			av_log(NULL, AV_LOG_INFO, "Seek to byte %.0f, estimated at %.3f s.\n", req.value, pos);
+			StreamHandler::stream_seek(is, (int64_t)(pos * AV_TIME_BASE), 0, 0);
+		}
+		else {
+			av_log(NULL, AV_LOG_WARNING, "Format does not support seeking by bytes.\n");
+		}
+		
+		break;
+	default:
+		break;
+	}
+}
+
+
 // --- QUIT ---
 void Player::quit() {
 	run = false;
@@ -699,3 +761,32 @@ void Player::quit() {
 #endif
 }
 
+
+
+// --- MARK START ---
+// Marks the moment at which playback was requested, from which the time to the first frame is
+// measured.
+void Player::markStart() {
+	startTime = av_gettime_relative();
+}
+
+
+// --- FIRST FRAME ---
+// Called by the renderers for every frame which gets output. Records the time to the first frame
+// after markStart().
+void Player::firstFrame() {
+	if (startTime.load(std::memory_order_relaxed) == 0) { return; }
+	int64_t start = startTime.exchange(0);
+	if (start == 0) { return; }
+	
+	timeToFirstFrame = (uint32_t) ((av_gettime_relative() - start) / 1000);
+	av_log(NULL, AV_LOG_INFO, "Time to first frame: %u ms.\n", (uint32_t) timeToFirstFrame);
+}
+
+
+// --- GET TIME TO FIRST FRAME ---
+// Returns the time from the last playback request to its first audio or video frame, in 
+// milliseconds.
+uint32_t Player::getTimeToFirstFrame() {
+	return timeToFirstFrame;
+}
@@ -6,6 +6,7 @@
 #include "types.h"
 
 #include <atomic>
+#include <mutex>
 
 
 class Player {
@@ -14,6 +15,13 @@ class Player {
 	
 	static std::atomic_bool run;
 	static double remaining_time;
+	static std::atomic<int64_t> startTime;
+	static std::atomic<uint32_t> timeToFirstFrame;
+	static std::mutex seekMutex;
+	static SeekRequest pendingSeek;
+	static bool seekPending;
+	
+	static void seek(VideoState* is);
 	
 public:
 	Player();
@@ -22,6 +30,10 @@ public:
 	static void setVideoState(VideoState* vs);
 	
 	static void quit();
+	static void markStart();
+	static void firstFrame();
+	static uint32_t getTimeToFirstFrame();
+	static void requestSeek(int type, double value);
 	static void event_loop(VideoState *cur_stream);
 	static void refresh_loop(VideoState* is);
 	static bool process_event(SDL_Event &event);
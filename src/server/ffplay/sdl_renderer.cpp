@@ -9,6 +9,7 @@
 #include "frame_queue.h"
 #include "player.h"
 #include "types.h"
+#include "../threadpolicy.h"
 #ifndef TESTING
 #include "../gui.h"
 #endif
@@ -396,6 +397,10 @@ void SdlRenderer::image_display(std::string image) {
 
 void SdlRenderer::run_event_loop() {
 	run_events = true;
+	if (!ThreadPolicy::apply(THREAD_ROLE_RENDER)) {
+		av_log(NULL, AV_LOG_WARNING, "Failed to apply the thread policy to the event loop.\n");
+	}
+	
 	SDL_Event event;
 	while (run_events) {
 		while (SDL_PollEvent(&event)) {
@@ -471,14 +476,8 @@ void SdlRenderer::run_event_loop() {
 		}
 #endif
 		
-		// Pause for a bit to ease off on the CPU load.
-		if (playerEventsActive) {
-			// No delay.
-			continue;
-		}
-		else {
-			SDL_Delay(10);
-		}
+		// Pause for a bit to ease off on the CPU load, unless an event comes in.
+		SDL_WaitEventTimeout(NULL, 10);
 	}
 
 	// Final check in case playback is still running.
@@ -10,9 +10,13 @@
 #include "sdl_renderer.h"
 #include "player.h"
 #include "ffplay.h"
+#include "sync_target.h"
 
 #include "stream_handler.h"
 
+#include "../metrics.h"
+#include "../threadpolicy.h"
+
 // Enable profiling.
 //#define PROFILING_SH 1
 #ifdef PROFILING_SH
@@ -26,6 +30,22 @@ uint32_t profcount = 0;
 // Static initialisations.
 std::atomic_bool StreamHandler::run;
 std::atomic<bool> StreamHandler::eof;
+std::function<void()> StreamHandler::prefetchHandler;
+std::atomic<uint32_t> StreamHandler::prefetchSeconds = { 0 };
+std::function<void(double)> StreamHandler::seekHandler;
+KeyframeIndex StreamHandler::keyframeIndex;
+std::string StreamHandler::indexPath;
+
+static MetricHistogram* metricSeek = Metrics::histogram("nymphcast_seek_seconds",
+                "Time from a seek in the read thread to the first packet after it.");
+static MetricCounter* metricPacketsRead = Metrics::counter("nymphcast_packets_read_total",
+                "Packets read from the input by the demuxer.");
+static MetricGauge* metricAudioQueue = Metrics::gauge(
+                "nymphcast_packet_queue_packets{stream=\"audio\"}",
+                "Packets queued for the decoders.");
+static MetricGauge* metricVideoQueue = Metrics::gauge(
+                "nymphcast_packet_queue_packets{stream=\"video\"}",
+                "Packets queued for the decoders.");
 
 
 #if CONFIG_AVFILTER
@@ -91,6 +111,8 @@ int StreamHandler::stream_component_open(VideoState *is, int stream_index) {
     int64_t channel_layout;
     int ret = 0;
     int stream_lowres = lowres;
+    DecoderThreading threading;
+    std::vector<int> readCores;		// Cores of the calling thread, while opening a video codec.
 
     if (stream_index < 0 || stream_index >= ic->nb_streams) {
 		av_log(NULL, AV_LOG_ERROR, "stream_index: %d, ic->nb_streams: %d.\n", stream_index, ic->nb_streams);
@@ -144,8 +166,18 @@ int StreamHandler::stream_component_open(VideoState *is, int stream_index) {
         avctx->flags2 |= AV_CODEC_FLAG2_FAST;
 
     opts = filter_codec_opts(codec_opts, avctx->codec_id, ic, ic->streams[stream_index], codec);
-    if (!av_dict_get(opts, "threads", NULL, 0))
-        av_dict_set(&opts, "threads", "auto", 0);
+    
+    // Threading as set by the policy for this codec and size, unless set with the codec options.
+    threading = ThreadPolicy::select(avcodec_get_name(avctx->codec_id), avctx->height);
+    if (!av_dict_get(opts, "threads", NULL, 0)) {
+        if (threading.threads > 0)
+            av_dict_set_int(&opts, "threads", threading.threads, 0);
+        else
+            av_dict_set(&opts, "threads", "auto", 0);
+    }
+    
+    if (threading.type != THREAD_TYPE_AUTO && !av_dict_get(opts, "thread_type", NULL, 0))
+        av_dict_set(&opts, "thread_type", threading.type == THREAD_TYPE_FRAME ? "frame" : "slice", 0);
 	
     if (stream_lowres)
         av_dict_set_int(&opts, "lowres", stream_lowres, 0);
@@ -153,7 +185,13 @@ int StreamHandler::stream_component_open(VideoState *is, int stream_index) {
     if (avctx->codec_type == AVMEDIA_TYPE_VIDEO || avctx->codec_type == AVMEDIA_TYPE_AUDIO)
         av_dict_set(&opts, "refcounted_frames", "1", 0);
 	
-    if ((ret = avcodec_open2(avctx, codec, &opts)) < 0) {
+    // The codec's threads get created here, and inherit the cores of the video decoder.
+    if (avctx->codec_type == AVMEDIA_TYPE_VIDEO && ThreadPolicy::getAffinity(readCores))
+        ThreadPolicy::apply(THREAD_ROLE_VIDEO_DECODE);
+    
+    ret = avcodec_open2(avctx, codec, &opts);
+    ThreadPolicy::setAffinity(readCores);
+    if (ret < 0) {
 		av_log(NULL, AV_LOG_ERROR, "avcodec_open2() failed.\n");
         goto fail;
     }
@@ -220,7 +258,7 @@ int StreamHandler::stream_component_open(VideoState *is, int stream_index) {
         }
         if ((ret = DecoderC::decoder_start(&is->auddec, AudioRenderer::audio_thread, "audio_decoder", is)) < 0)
             goto out;
-        SDL_PauseAudioDevice(audio_dev, 0);
+        AudioRenderer::audio_attach(is);
         break;
     case AVMEDIA_TYPE_VIDEO:
         is->video_stream = stream_index;
@@ -264,8 +302,9 @@ static void stream_component_close(VideoState *is, int stream_index)
     switch (codecpar->codec_type) {
     case AVMEDIA_TYPE_AUDIO:
         DecoderC::decoder_abort(&is->auddec, &is->sampq);
-		av_log(NULL, AV_LOG_INFO, "Closing audio device...\n");
-        SDL_CloseAudioDevice(audio_dev);
+		
+		// Keep the audio device open for the next track. It gets closed once playback ends.
+        AudioRenderer::audio_detach(is);
         DecoderC::decoder_destroy(&is->auddec);
         swr_free(&is->swr_ctx);
         av_freep(&is->audio_buf1);
@@ -313,6 +352,8 @@ static void stream_component_close(VideoState *is, int stream_index)
 void StreamHandler::stream_close(VideoState *is) {
     /* XXX: use a special url_shutdown call to abort parse cleanly */
     is->abort_request = 1;
+    if (is->read_wakeup.mutex)
+        PacketQueueC::packet_queue_wake(&is->read_wakeup);
     SDL_WaitThread(is->read_tid, NULL);
 
     /* close each stream */
@@ -324,6 +365,12 @@ void StreamHandler::stream_close(VideoState *is) {
     if (is->subtitle_stream >= 0)
         stream_component_close(is, is->subtitle_stream);
 
+    // Keep the keyframe index for the next time this file is played.
+    if (!indexPath.empty() && keyframeIndex.size() > 0) {
+        keyframeIndex.save(index_file(keyframeIndex.getKey()));
+        keyframeIndex.reset();
+    }
+
     avformat_close_input(&is->ic);
 
     PacketQueueC::packet_queue_destroy(&is->videoq);
@@ -335,6 +382,7 @@ void StreamHandler::stream_close(VideoState *is) {
     FrameQueueC::frame_queue_destroy(&is->sampq);
     FrameQueueC::frame_queue_destroy(&is->subpq);
     SDL_DestroyCond(is->continue_read_thread);
+    SDL_DestroyMutex(is->read_wakeup.mutex);
     sws_freeContext(is->img_convert_ctx);
     sws_freeContext(is->sub_convert_ctx);
     av_free(is->filename);
@@ -391,6 +439,13 @@ void StreamHandler::stream_toggle_pause(VideoState *is) {
 	av_log(NULL, AV_LOG_INFO, "Toggle: toggling paused state.\n");
     ClockC::set_clock(&is->extclk, ClockC::get_clock(&is->extclk), is->extclk.serial);
     is->paused = is->audclk.paused = is->vidclk.paused = is->extclk.paused = !is->paused;
+    
+    // The shared timeline stands still while paused.
+    if (is->paused) { SyncTarget::pause(); }
+    else { SyncTarget::resume(); }
+    
+    // Let the read thread pause or resume a network stream.
+    PacketQueueC::packet_queue_wake(&is->read_wakeup);
 }
 
 /* seek in the stream */
@@ -403,7 +458,7 @@ void StreamHandler::stream_seek(VideoState *is, int64_t pos, int64_t rel, int se
         if (seek_by_bytes)
             is->seek_flags |= AVSEEK_FLAG_BYTE;
         is->seek_req = 1;
-        SDL_CondSignal(is->continue_read_thread);
+        PacketQueueC::packet_queue_wake(&is->read_wakeup);
     }
 }
 
@@ -434,6 +489,56 @@ static void update_video_pts(VideoState *is, double pts, int64_t pos, int serial
 }
 
 
+// --- OPEN INDEX ---
+// Starts the keyframe index for the opened file, loading it from the index path if it was saved
+// on an earlier play. The file is identified by its name and properties, as hashing its contents
+// would mean reading all of it.
+void StreamHandler::open_index(AVFormatContext *ic) {
+    uint64_t key = KeyframeIndex::hash(ic->url, ic->url ? strlen(ic->url) : 0);
+    key = KeyframeIndex::hash(&ic->duration, sizeof(ic->duration), key);
+    key = KeyframeIndex::hash(&ic->bit_rate, sizeof(ic->bit_rate), key);
+    key = KeyframeIndex::hash(&ic->nb_streams, sizeof(ic->nb_streams), key);
+    int64_t size = ic->pb ? avio_size(ic->pb) : 0;
+    key = KeyframeIndex::hash(&size, sizeof(size), key);
+    for (unsigned int i = 0; i < ic->nb_streams; ++i) {
+        AVCodecID id = ic->streams[i]->codecpar->codec_id;
+        key = KeyframeIndex::hash(&id, sizeof(id), key);
+    }
+    
+    AVDictionaryEntry *title = av_dict_get(ic->metadata, "title", NULL, 0);
+    if (title) { key = KeyframeIndex::hash(title->value, strlen(title->value), key); }
+    
+    if (indexPath.empty() || !keyframeIndex.load(index_file(key), key)) {
+        keyframeIndex.reset(key);
+        return;
+    }
+    
+    av_log(NULL, AV_LOG_INFO, "Loaded keyframe index with %zu entries.\n", keyframeIndex.size());
+}
+
+
+// --- INDEX FILE ---
+// Returns the path of the saved keyframe index for the file with this key.
+std::string StreamHandler::index_file(uint64_t key) {
+    char name[24];
+    snprintf(name, sizeof(name), "%016llx.idx", (unsigned long long) key);
+    return indexPath + "/" + name;
+}
+
+
+// --- INDEX PACKET ---
+// Adds the packet to the keyframe index, if it is a keyframe of the master stream.
+void StreamHandler::index_packet(VideoState *is, AVPacket *pkt) {
+    if (!(pkt->flags & AV_PKT_FLAG_KEY) || pkt->pts == AV_NOPTS_VALUE || pkt->pos < 0) { return; }
+    if (pkt->stream_index != (is->video_stream >= 0 ? is->video_stream : is->audio_stream)) {
+        return;
+    }
+    
+    AVStream *st = is->ic->streams[pkt->stream_index];
+    keyframeIndex.add(av_rescale_q(pkt->pts, st->time_base, AV_TIME_BASE_Q), pkt->pos);
+}
+
+
 /* this thread gets the stream from the disk or the network */
 int StreamHandler::read_thread(void *arg) {
 #ifdef PROFILING_SH
@@ -451,15 +556,15 @@ int StreamHandler::read_thread(void *arg) {
     int64_t stream_start_time;
     int pkt_in_play_range = 0;
     AVDictionaryEntry *t;
-    SDL_mutex *wait_mutex = SDL_CreateMutex();
+    SDL_mutex *wait_mutex = is->read_wakeup.mutex;
     int scan_all_pmts_set = 0;
     int64_t pkt_ts;
-
-    if (!wait_mutex) {
-        av_log(NULL, AV_LOG_FATAL, "SDL_CreateMutex(): %s\n", SDL_GetError());
-        ret = AVERROR(ENOMEM);
-        goto fail;
-    }
+    bool preopened = false;
+    bool prefetched = false;
+    bool seekLanding = false;		// The first packet after a seek gives its landing position.
+    bool useIndex = false;			// Seeks are resolved with our own keyframe index.
+    int64_t indexTarget = AV_NOPTS_VALUE;	// Keyframe the last seek was resolved to.
+    int64_t seekStart = 0;					// Time at which the last seek started.
 
     memset(st_index, -1, sizeof(st_index));
     is->last_video_stream = is->video_stream = -1;
@@ -479,38 +584,47 @@ int StreamHandler::read_thread(void *arg) {
 		ic->interrupt_callback.opaque = is;
 		is->ic = ic;
 	}
+	else if (ic->iformat) {
+		// The input was already opened and probed while the previous track was playing.
+		av_log(NULL, AV_LOG_INFO, "Using pre-opened input.\n");
+		ic->interrupt_callback.callback = decode_interrupt_cb;
+		ic->interrupt_callback.opaque = is;
+		preopened = true;
+	}
 	
-    if (!av_dict_get(format_opts, "scan_all_pmts", NULL, AV_DICT_MATCH_CASE)) {
-        av_dict_set(&format_opts, "scan_all_pmts", "1", AV_DICT_DONT_OVERWRITE);
-        scan_all_pmts_set = 1;
-    }
-	
-	// Open the input file or stream.
-    err = avformat_open_input(&ic, is->filename, is->iformat, &format_opts);
-    if (err < 0) {
-        print_error(is->filename, err);
-        ret = -1;
-        goto fail;
-    }
+	if (!preopened) {
+		if (!av_dict_get(format_opts, "scan_all_pmts", NULL, AV_DICT_MATCH_CASE)) {
+			av_dict_set(&format_opts, "scan_all_pmts", "1", AV_DICT_DONT_OVERWRITE);
+			scan_all_pmts_set = 1;
+		}
+		
+		// Open the input file or stream.
+		err = avformat_open_input(&ic, is->filename, is->iformat, &format_opts);
+		if (err < 0) {
+			print_error(is->filename, err);
+			ret = -1;
+			goto fail;
+		}
+		
+		if (scan_all_pmts_set)
+			av_dict_set(&format_opts, "scan_all_pmts", NULL, AV_DICT_MATCH_CASE);
+
+		if ((t = av_dict_get(format_opts, "", NULL, AV_DICT_IGNORE_SUFFIX))) {
+			av_log(NULL, AV_LOG_ERROR, "Option %s not found.\n", t->key);
+			ret = AVERROR_OPTION_NOT_FOUND;
+			goto fail;
+		}
+	}
 	
 	// Log stream info.
 	av_log(NULL, AV_LOG_INFO, "Format %s, duration %lld us", ic->iformat->long_name, ic->duration);
-	
-    if (scan_all_pmts_set)
-        av_dict_set(&format_opts, "scan_all_pmts", NULL, AV_DICT_MATCH_CASE);
-
-    if ((t = av_dict_get(format_opts, "", NULL, AV_DICT_IGNORE_SUFFIX))) {
-        av_log(NULL, AV_LOG_ERROR, "Option %s not found.\n", t->key);
-        ret = AVERROR_OPTION_NOT_FOUND;
-        goto fail;
-    }
 
     if (genpts)
         ic->flags |= AVFMT_FLAG_GENPTS;
 
     av_format_inject_global_side_data(ic);
 
-    if (find_stream_info) {
+    if (find_stream_info && !preopened) {
         AVDictionary **opts = setup_find_stream_info_opts(ic, codec_opts);
         int orig_nb_streams = ic->nb_streams;
 
@@ -536,6 +650,11 @@ int StreamHandler::read_thread(void *arg) {
 	}
 
     is->max_frame_duration = (ic->iformat->flags & AVFMT_TS_DISCONT) ? 10.0 : 3600.0;
+    
+    // Formats without an index of their own get one built as their packets are read.
+    useIndex = (ic->iformat->flags & (AVFMT_TS_DISCONT | AVFMT_GENERIC_INDEX)) && 
+                                            strcmp("ogg", ic->iformat->name) && !is_realtime(ic);
+    if (useIndex) { open_index(ic); }
 
     if (!window_title && (t = av_dict_get(ic->metadata, "title", NULL, 0))) {
         window_title = av_asprintf("%s - %s", t->value, input_filename);
@@ -556,6 +675,7 @@ int StreamHandler::read_thread(void *arg) {
 	}
 	
 	file_meta.duration = is->ic->duration / AV_TIME_BASE; // Convert to seconds.
+	file_meta.position = 0;
 
     /* if seeking requested, we execute it */
     if (start_time != AV_NOPTS_VALUE) {
@@ -679,6 +799,8 @@ int StreamHandler::read_thread(void *arg) {
 	eof = false;
 	while (run) {
         if (is->abort_request) { break; }
+        metricAudioQueue->set(is->audioq.nb_packets);
+        metricVideoQueue->set(is->videoq.nb_packets);
         if (is->paused != is->last_paused) {
             is->last_paused = is->paused;
             if (is->paused) { is->read_pause_return = av_read_pause(ic); }
@@ -696,13 +818,27 @@ int StreamHandler::read_thread(void *arg) {
 #endif
         if (is->seek_req) {
 			av_log(NULL, AV_LOG_INFO, "Seek request: %d, target: %d\n", is->seek_rel, is->seek_pos);
+            seekStart = av_gettime_relative();
             int64_t seek_target = is->seek_pos;
             int64_t seek_min    = is->seek_rel > 0 ? seek_target - is->seek_rel + 2: INT64_MIN;
             int64_t seek_max    = is->seek_rel < 0 ? seek_target - is->seek_rel - 2: INT64_MAX;
 // FIXME the +-2 is due to rounding being not done in the correct direction in generation
 //      of the seek_pos/seek_rel variables
 
-            ret = avformat_seek_file(is->ic, -1, seek_min, seek_target, seek_max, is->seek_flags);
+            // Go straight to the byte offset of the keyframe before the target, if indexed.
+            KeyframeEntry entry;
+            indexTarget = AV_NOPTS_VALUE;
+            if (useIndex && !(is->seek_flags & AVSEEK_FLAG_BYTE) && 
+                                                keyframeIndex.lookup(seek_target, entry)) {
+                av_log(NULL, AV_LOG_INFO, "Seek resolved by index to byte %lld.\n", entry.pos);
+                ret = avformat_seek_file(is->ic, -1, INT64_MIN, entry.pos, INT64_MAX, 
+                                                                            AVSEEK_FLAG_BYTE);
+                if (ret >= 0) { indexTarget = entry.pts; }
+            }
+            
+            if (indexTarget == AV_NOPTS_VALUE) {
+                ret = avformat_seek_file(is->ic, -1, seek_min, seek_target, seek_max, is->seek_flags);
+            }
             if (ret < 0) {
                 av_log(NULL, AV_LOG_ERROR,
                        "%s: error while seeking\n", is->ic->url);
@@ -721,9 +857,14 @@ int StreamHandler::read_thread(void *arg) {
                 }
                 if (is->seek_flags & AVSEEK_FLAG_BYTE) {
                    ClockC::set_clock(&is->extclk, NAN, 0);
+                   SyncTarget::seek(NAN);
                 } else {
+                   // An indexed seek lands on the keyframe, rather than the target.
+                   if (indexTarget != AV_NOPTS_VALUE) { seek_target = indexTarget; }
                    ClockC::set_clock(&is->extclk, seek_target / (double)AV_TIME_BASE, 0);
+                   SyncTarget::seek(seek_target / (double)AV_TIME_BASE);
                 }
+                seekLanding = true;
             }
             is->seek_req = 0;
             is->queue_attachments_req = 1;
@@ -749,16 +890,22 @@ int StreamHandler::read_thread(void *arg) {
             || (stream_has_enough_packets(is->audio_st, is->audio_stream, &is->audioq) &&
                 stream_has_enough_packets(is->video_st, is->video_stream, &is->videoq) &&
                 stream_has_enough_packets(is->subtitle_st, is->subtitle_stream, &is->subtitleq)))) {
-            /* wait 10 ms */
+            /* sleep until the decoders drain a queue, or a seek, pause or close request */
+            PacketQueueC::packet_queue_arm(&is->audioq);
+            PacketQueueC::packet_queue_arm(&is->videoq);
+            PacketQueueC::packet_queue_arm(&is->subtitleq);
             SDL_LockMutex(wait_mutex);
-            SDL_CondWaitTimeout(is->continue_read_thread, wait_mutex, 10);
+            if (!is->read_wakeup.pending)
+                SDL_CondWaitTimeout(is->continue_read_thread, wait_mutex, READ_THREAD_WAIT_MAX);
+            is->read_wakeup.pending = 0;
             SDL_UnlockMutex(wait_mutex);
 			
             continue;
         }
 		
         if (!is->paused &&
-            (!is->audio_st || (is->auddec.finished == is->audioq.serial && FrameQueueC::frame_queue_nb_remaining(&is->sampq) == 0)) &&
+            (!is->audio_st || (is->auddec.finished == is->audioq.serial && FrameQueueC::frame_queue_nb_remaining(&is->sampq) == 0 &&
+							(is->audio_write_buf_size == 0 || !is->audio_buf))) &&
             (!is->video_st || (is->viddec.finished == is->videoq.serial && FrameQueueC::frame_queue_nb_remaining(&is->pictq) == 0))) {
             if (loop != 1 && (!loop || --loop)) {
                 StreamHandler::stream_seek(is, start_time != AV_NOPTS_VALUE ? start_time : 0, 0, 0);
@@ -772,6 +919,13 @@ int StreamHandler::read_thread(void *arg) {
 			av_log(NULL, AV_LOG_INFO, "Would have quit here if auto-exit was enabled.\n");
         }
 		
+		// Let the next track get ready during the last seconds of this one.
+		if (!prefetched && prefetchHandler && (eof || (ic->duration > 0 && 
+				(double) ic->duration / AV_TIME_BASE - file_meta.position <= prefetchSeconds))) {
+			prefetched = true;
+			prefetchHandler();
+		}
+		
 #ifdef PROFILING_SH
 		debugfile << "Reading frame.\t";
 		std::chrono::high_resolution_clock::time_point begin = std::chrono::high_resolution_clock::now();
@@ -779,12 +933,11 @@ int StreamHandler::read_thread(void *arg) {
 
         ret = av_read_frame(ic, pkt);
         if (ret < 0) {
-			// FIXME: hack.
-			if (ret == AVERROR_EOF) { eof = true; break; }
-			
-			av_log(NULL, AV_LOG_WARNING, "av_read_frame() returned <0, no EOF.\n");
+			// EOF or error. On EOF, the decoders get flushed and playback ends once the last
+			// frames have been output (auto-exit), rather than cutting off the queued frames.
+			if (ret == AVERROR_EOF) { eof = true; }
+			else { av_log(NULL, AV_LOG_WARNING, "av_read_frame() returned <0, no EOF.\n"); }
 			
-			// EOF or error. 
             if ((ret == AVERROR_EOF || avio_feof(ic->pb)) && !is->eof) {
                 if (is->video_stream >= 0)
                     PacketQueueC::packet_queue_put_nullpacket(&is->videoq, is->video_stream);
@@ -796,13 +949,40 @@ int StreamHandler::read_thread(void *arg) {
             }
 			
             if (ic->pb && ic->pb->error) { break; }
+			
+            /* sleep until data arrives, the decoders and outputs have drained, or a seek, pause
+               or close request. The timeout is only a safety net. */
             SDL_LockMutex(wait_mutex);
-            SDL_CondWaitTimeout(is->continue_read_thread, wait_mutex, 10);
+            if (!is->read_wakeup.pending)
+                SDL_CondWaitTimeout(is->continue_read_thread, wait_mutex, READ_THREAD_WAIT_MAX);
+            is->read_wakeup.pending = 0;
             SDL_UnlockMutex(wait_mutex);
             continue;
         } else {
             is->eof = 0;
         }
+        
+        metricPacketsRead->add();
+        
+        // Report where the last seek landed: at the first packet of the master stream after it.
+        if (seekLanding && pkt->pts != AV_NOPTS_VALUE && (pkt->stream_index == is->audio_stream ||
+                (is->audio_stream < 0 && pkt->stream_index == is->video_stream))) {
+            seekLanding = false;
+            double landing = pkt->pts * av_q2d(ic->streams[pkt->stream_index]->time_base);
+            av_log(NULL, AV_LOG_INFO, "Seek landed at %.3f s.\n", landing);
+            metricSeek->record(av_gettime_relative() - seekStart);
+            
+            // An index which sent us elsewhere does not belong to this file. Start over.
+            if (indexTarget != AV_NOPTS_VALUE && fabs(landing - indexTarget / (double) AV_TIME_BASE)
+                                                > SEEK_INDEX_TOLERANCE) {
+                av_log(NULL, AV_LOG_WARNING, "Keyframe index is off, discarding it.\n");
+                keyframeIndex.reset(keyframeIndex.getKey());
+            }
+            
+            if (seekHandler) { seekHandler(landing); }
+        }
+        
+        if (useIndex) { index_packet(is, pkt); }
 
 #ifdef PROFILING_SH
 		std::chrono::high_resolution_clock::time_point end = std::chrono::high_resolution_clock::now();
@@ -855,8 +1035,6 @@ fail:
 	// Signal the player thread that the playback has ended.
 	playerCon.signal();
 	
-	SDL_DestroyMutex(wait_mutex);
-	
 #ifdef PROFILING
 	if (debugfile.is_open()) {
 		debugfile.flush();
@@ -915,6 +1093,18 @@ VideoState* StreamHandler::stream_open(const char *filename, AVInputFormat *ifor
         return 0;
     }
 	
+    // The decoders wake the read thread once they have drained a packet queue far enough.
+    if (!(is->read_wakeup.mutex = SDL_CreateMutex())) {
+        av_log(NULL, AV_LOG_FATAL, "SDL_CreateMutex(): %s\n", SDL_GetError());
+        stream_close(is);
+        return 0;
+    }
+	
+    is->read_wakeup.cond = is->continue_read_thread;
+    is->videoq.wakeup = &is->read_wakeup;
+    is->audioq.wakeup = &is->read_wakeup;
+    is->subtitleq.wakeup = &is->read_wakeup;
+	
 	// Set via global variable.
 	int startup_volume = audio_volume;
 
@@ -930,7 +1120,8 @@ VideoState* StreamHandler::stream_open(const char *filename, AVInputFormat *ifor
     startup_volume = av_clip(SDL_MIX_MAXVOLUME * startup_volume / 100, 0, SDL_MIX_MAXVOLUME);
     is->audio_volume = startup_volume;
     is->muted = 0;
-    is->av_sync_type = av_sync_type;
+    // Slaves follow the master's timeline through the external clock.
+    is->av_sync_type = SyncTarget::isEnabled() ? AV_SYNC_EXTERNAL_CLOCK : av_sync_type;
 	is->ic = context;
     is->read_tid     = SDL_CreateThread(read_thread, "read_thread", is);
     if (!is->read_tid) {
@@ -1028,3 +1219,28 @@ void StreamHandler::quit() {
 	}
 #endif
 }
+
+
+// --- SET PREFETCH HANDLER ---
+// Sets the handler which is called once per track, when 'seconds' or less of the track remain to
+// be played, or once the end of the input has been reached.
+void StreamHandler::setPrefetchHandler(uint32_t seconds, std::function<void()> handler) {
+	prefetchSeconds = seconds;
+	prefetchHandler = handler;
+}
+
+
+// --- SET INDEX PATH ---
+// Sets the folder in which keyframe indices are saved, for files without an index of their own.
+// An empty path disables saving them.
+void StreamHandler::setIndexPath(std::string path) {
+	indexPath = path;
+}
+
+
+// --- SET SEEK HANDLER ---
+// Sets the handler which is called with the position (seconds) at which a seek landed. This is
+// the keyframe the seek ended up at, rather than the position asked for.
+void StreamHandler::setSeekHandler(std::function<void(double)> handler) {
+	seekHandler = handler;
+}
@@ -6,17 +6,32 @@
 
 #include "types.h"
 
+#include "../keyframeindex.h"
+
 #include <atomic>
+#include <functional>
+#include <string>
 
 
 class StreamHandler {
 	VideoState* vstate;
 	static std::atomic_bool run;
 	static std::atomic<bool> eof;
+	static std::function<void()> prefetchHandler;
+	static std::atomic<uint32_t> prefetchSeconds;
+	static std::function<void(double)> seekHandler;
+	static KeyframeIndex keyframeIndex;
+	static std::string indexPath;
 	
+	static void open_index(AVFormatContext *ic);
+	static std::string index_file(uint64_t key);
+	static void index_packet(VideoState *is, AVPacket *pkt);
 	static int read_thread(void *arg);
 	
 public:
+	static void setPrefetchHandler(uint32_t seconds, std::function<void()> handler);
+	static void setSeekHandler(std::function<void(double)> handler);
+	static void setIndexPath(std::string path);
 	static VideoState *stream_open(const char *filename, AVInputFormat *iformat, AVFormatContext* context);
 	static int stream_component_open(VideoState *is, int stream_index);
 	static void stream_close(VideoState *is);
@@ -0,0 +1,178 @@
+
+
+#include "sync_target.h"
+
+#include "clock.h"
+
+
+// Static initialisations.
+std::mutex SyncTarget::timelineMutex;
+std::atomic<bool> SyncTarget::enabled = { false };
+int64_t SyncTarget::start = 0;
+double SyncTarget::base = NAN;
+int64_t SyncTarget::pausedAt = 0;
+double SyncTarget::remainder = 0.0;
+std::atomic<int64_t> SyncTarget::error = { 0 };
+
+
+// --- ENABLE ---
+// Makes the player follow the timeline. Used in slave mode.
+void SyncTarget::enable(bool enable) {
+	enabled = enable;
+	error = 0;
+}
+
+
+// --- IS ENABLED ---
+bool SyncTarget::isEnabled() {
+	return enabled;
+}
+
+
+// --- ACTIVE ---
+// Returns true if the player follows the timeline, and the timeline has been set.
+bool SyncTarget::active() {
+	if (!enabled) { return false; }
+
+	std::lock_guard<std::mutex> lk(timelineMutex);
+	return start != 0;
+}
+
+
+// --- SET TIMELINE ---
+// Anchors the timeline: playback is at media position 'base' (seconds) at local time 'start'
+// (microseconds since the epoch). A 'base' of NAN is the start of the stream.
+void SyncTarget::setTimeline(int64_t start, double base) {
+	std::lock_guard<std::mutex> lk(timelineMutex);
+	SyncTarget::start = start;
+	SyncTarget::base = base;
+}
+
+
+// --- GET TIMELINE ---
+void SyncTarget::getTimeline(int64_t &start, double &base) {
+	std::lock_guard<std::mutex> lk(timelineMutex);
+	start = SyncTarget::start;
+	base = SyncTarget::base;
+}
+
+
+// --- GET START ---
+int64_t SyncTarget::getStart() {
+	std::lock_guard<std::mutex> lk(timelineMutex);
+	return start;
+}
+
+
+// --- CLEAR ---
+void SyncTarget::clear() {
+	std::lock_guard<std::mutex> lk(timelineMutex);
+	start = 0;
+	base = NAN;
+	pausedAt = 0;
+	remainder = 0.0;
+	error = 0;
+}
+
+
+// --- PAUSE ---
+// The timeline stands still while playback is paused.
+void SyncTarget::pause() {
+	std::lock_guard<std::mutex> lk(timelineMutex);
+	if (start == 0 || pausedAt != 0) { return; }
+	pausedAt = av_gettime();
+}
+
+
+// --- RESUME ---
+void SyncTarget::resume() {
+	std::lock_guard<std::mutex> lk(timelineMutex);
+	if (start == 0 || pausedAt == 0) { return; }
+	start += av_gettime() - pausedAt;
+	pausedAt = 0;
+}
+
+
+// --- SEEK ---
+// Re-anchors the timeline at the seek target, from now. A 'position' of NAN (byte seek) clears
+// the timeline, until a new one is set.
+void SyncTarget::seek(double position) {
+	std::lock_guard<std::mutex> lk(timelineMutex);
+	if (start == 0) { return; }
+
+	remainder = 0.0;
+	if (isnan(position)) {
+		start = 0;
+		base = NAN;
+		pausedAt = 0;
+		return;
+	}
+
+	int64_t now = av_gettime();
+	start = now;
+	base = position;
+	if (pausedAt != 0) { pausedAt = now; }
+}
+
+
+// --- POSITION ---
+// Returns the media position on the timeline right now, in seconds, or NAN if no timeline is set.
+double SyncTarget::position(VideoState *is) {
+	std::lock_guard<std::mutex> lk(timelineMutex);
+	if (start == 0) { return NAN; }
+
+	double pos = base;
+	if (isnan(pos)) {
+		pos = (is->ic && is->ic->start_time != AV_NOPTS_VALUE) ?
+											is->ic->start_time / (double) AV_TIME_BASE : 0.0;
+	}
+
+	int64_t now = (pausedAt != 0) ? pausedAt : av_gettime();
+	return pos + (now - start) / 1000000.0;
+}
+
+
+// --- UPDATE ---
+// Sets the external clock to the position on the timeline.
+void SyncTarget::update(VideoState *is) {
+	if (is->paused) { return; }
+
+	double pos = position(is);
+	if (isnan(pos)) { return; }
+
+	ClockC::set_clock_at(&is->extclk, pos, is->extclk.serial, av_gettime_relative() / 1000000.0);
+}
+
+
+// --- CORRECT ---
+// Returns the number of samples to turn 'nb_samples' into, to correct the average difference
+// 'diff' (seconds) between the audio clock and the timeline within SYNC_TARGET_CORRECTION_TIME.
+// The speed change is limited to SYNC_TARGET_CORRECTION_MAX, which keeps it inaudible.
+int SyncTarget::correct(int nb_samples, double diff) {
+	double delta = diff * nb_samples / SYNC_TARGET_CORRECTION_TIME;
+	double max = nb_samples * SYNC_TARGET_CORRECTION_MAX;
+	delta = av_clipd(delta, -max, max);
+
+	// Carry over fractions of a sample, so that small drifts get corrected as well.
+	std::lock_guard<std::mutex> lk(timelineMutex);
+	delta += remainder;
+	int samples = (int) lrint(delta);
+	remainder = delta - samples;
+
+	return nb_samples + samples;
+}
+
+
+// --- SET ERROR ---
+// Records the average difference between the audio clock and the timeline, in seconds.
+void SyncTarget::setError(double diff) {
+	error = (int64_t) (diff * 1000000.0);
+}
+
+
+// --- GET ERROR ---
+// Returns the last measured difference between the audio clock and the timeline, in microseconds.
+// Positive values mean the audio is ahead of the timeline.
+int64_t SyncTarget::getError() {
+	return error;
+}
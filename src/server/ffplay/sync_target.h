@@ -0,0 +1,54 @@
+
+
+#ifndef SYNC_TARGET_H
+#define SYNC_TARGET_H
+
+
+#include "types.h"
+
+#include <atomic>
+#include <mutex>
+
+
+/* Errors below this are corrected by resampling within SYNC_TARGET_CORRECTION_MAX, larger ones
+ * with the regular sample correction of up to SAMPLE_CORRECTION_PERCENT_MAX */
+#define SYNC_TARGET_JUMP_THRESHOLD 0.1
+/* maximum speed change when following the timeline, as a fraction of the sample rate */
+#define SYNC_TARGET_CORRECTION_MAX 0.001
+/* time in seconds over which an error is corrected */
+#define SYNC_TARGET_CORRECTION_TIME 2.0
+
+
+// Presentation timeline shared between a master and its slave receivers. The timeline is anchored
+// at a local time (microseconds since the epoch) at which playback is at a media position. On a
+// slave, the player follows the timeline: it drives the external clock, and audio is resampled
+// slightly to keep up with it.
+class SyncTarget {
+	static std::mutex timelineMutex;
+	static std::atomic<bool> enabled;
+	static int64_t start;		// Local time at which the timeline is at 'base'. 0 if not set.
+	static double base;			// Media position at 'start', in seconds. NAN for the stream start.
+	static int64_t pausedAt;	// Local time at which playback got paused, or 0.
+	static double remainder;	// Fraction of a sample not yet corrected.
+	static std::atomic<int64_t> error;
+
+public:
+	static void enable(bool enable);
+	static bool isEnabled();
+	static bool active();
+	static void setTimeline(int64_t start, double base = NAN);
+	static void getTimeline(int64_t &start, double &base);
+	static int64_t getStart();
+	static void clear();
+	static void pause();
+	static void resume();
+	static void seek(double position);
+	static double position(VideoState *is);
+	static void update(VideoState *is);
+	static int correct(int nb_samples, double diff);
+	static void setError(double diff);
+	static int64_t getError();
+};
+
+
+#endif
@@ -79,12 +79,21 @@ extern "C" {
 /* polls for possible required screen refresh at least this often, should be less than 1/fps */
 #define REFRESH_RATE 0.01
 
+/* refresh interval when there is nothing to display, e.g. audio without visualisation */
+#define IDLE_REFRESH_RATE 0.1
+
+/* longest time the read thread sleeps with full queues, in case a wakeup gets missed (ms) */
+#define READ_THREAD_WAIT_MAX 250
+
 /* NOTE: the size must be big enough to compensate the hardware audio buffersize size */
 /* TODO: We assume that a decoded and resampled frame fits into this buffer */
 #define SAMPLE_ARRAY_SIZE (8 * 65536)
 
 #define CURSOR_HIDE_DELAY 1000000
 
+/* a seek resolved by the keyframe index must land this close (seconds) to the indexed keyframe */
+#define SEEK_INDEX_TOLERANCE 1.0
+
 #define USE_ONEPASS_SUBTITLE_RENDER 1
 
 
@@ -94,8 +103,23 @@ typedef struct MyAVPacketList {
 	int serial;
 } MyAVPacketList;
 
+/* wakes the read thread, e.g. once a packet queue has drained below its watermark */
+typedef struct ReadWakeup {
+	SDL_mutex *mutex;
+	SDL_cond *cond;
+	int pending;					// Set by wakers, cleared by the read thread. Use with 'mutex'.
+} ReadWakeup;
+
+/* packet list nodes kept per packet queue for reuse, instead of freeing and allocating them */
+#define PACKET_QUEUE_POOL_SIZE 1024
+
 typedef struct PacketQueue {
 	MyAVPacketList *first_pkt, *last_pkt;
+	MyAVPacketList *free_pkt;		// Unused nodes, linked through 'next'.
+	int nb_free;
+	int max_free;					// Nodes kept beyond this are freed. 0 disables the pool.
+	ReadWakeup *wakeup;				// Woken when 'nb_packets' drops below 'wake_packets'.
+	int wake_packets;				// 0 when not armed.
 	std::atomic<int> nb_packets;
 	std::atomic<int> size;
 	int64_t duration;
@@ -295,6 +319,7 @@ struct VideoState {
 	int last_video_stream, last_audio_stream, last_subtitle_stream;
 
 	SDL_cond *continue_read_thread;
+	ReadWakeup read_wakeup;			// Uses 'continue_read_thread' as its condition.
 };
 
 
@@ -453,6 +478,19 @@ enum NymphEvents {
 	NYMPH_SEEK_EVENT = 1
 };
 
+// Seek types, as used by the playback_seek() RPC method.
+enum NymphSeekType {
+	NYMPH_SEEK_TYPE_BYTES = 1,			// Byte offset in the file.
+	NYMPH_SEEK_TYPE_PERCENTAGE = 2,		// Percentage of the duration.
+	NYMPH_SEEK_TYPE_TIME = 3,			// Position in seconds, as in the playback status.
+	NYMPH_SEEK_TYPE_RELATIVE = 4		// Seconds from the current position, forward or back.
+};
+
+struct SeekRequest {
+	int type;
+	double value;
+};
+
 extern const uint32_t nymph_seek_event;
 
 
@@ -6,15 +6,31 @@
 #include "clock.h"
 #include "stream_handler.h"
 #include "frame_queue.h"
+#include "packet_queue.h"
 #include "sdl_renderer.h"
 #include "decoder.h"
+#include "player.h"
 
 #include "ffplay.h"
+#include "sync_target.h"
+
+#include "../metrics.h"
+#include "../threadpolicy.h"
 
 
 // Static initialisations.
 std::atomic<bool> VideoRenderer::run;
 
+static MetricCounter* metricDropsLate = Metrics::counter(
+                "nymphcast_frame_drops_total{reason=\"late\"}",
+                "Video frames dropped: late for display, or early in decoding when behind.");
+static MetricCounter* metricVideoQueued = Metrics::counter(
+                "nymphcast_frames_queued_total{stream=\"video\"}",
+                "Frames queued for output, after filtering.");
+static MetricCounter* metricDropsEarly = Metrics::counter(
+                "nymphcast_frame_drops_total{reason=\"early\"}",
+                "Video frames dropped: late for display, or early in decoding when behind.");
+
 
 static double vp_duration(VideoState *is, Frame *vp, Frame *nextvp) {
     if (vp->serial == nextvp->serial) {
@@ -31,7 +47,8 @@ static double vp_duration(VideoState *is, Frame *vp, Frame *nextvp) {
 static void update_video_pts(VideoState *is, double pts, int64_t pos, int serial) {
     /* update current video pts */
     ClockC::set_clock(&is->vidclk, pts, serial);
-    ClockC::sync_clock_to_slave(&is->extclk, &is->vidclk);
+    if (!SyncTarget::active())
+        ClockC::sync_clock_to_slave(&is->extclk, &is->vidclk);
 }
 
 
@@ -55,6 +72,7 @@ static int video_open(VideoState *is) {
 static void video_display(VideoState *is) {
     if (!is->width) { video_open(is); }
     SdlRenderer::video_display(is);
+	Player::firstFrame();
 }
 
 /* called to display each frame */
@@ -64,7 +82,10 @@ void VideoRenderer::video_refresh(void *opaque, double *remaining_time) {
 
     Frame *sp, *sp2;
 
-    if (!is->paused && StreamHandler::get_master_sync_type(is) == AV_SYNC_EXTERNAL_CLOCK && is->realtime)
+    /* on a slave, the external clock follows the shared timeline */
+    if (SyncTarget::active())
+        SyncTarget::update(is);
+    else if (!is->paused && StreamHandler::get_master_sync_type(is) == AV_SYNC_EXTERNAL_CLOCK && is->realtime)
         ClockC::check_external_clock_speed(is);
 
     if (!display_disable && is->show_mode != SHOW_MODE_VIDEO && is->audio_st) {
@@ -123,6 +144,7 @@ retry:
                 duration = vp_duration(is, vp, nextvp);
                 if(!is->step && (framedrop>0 || (framedrop && StreamHandler::get_master_sync_type(is) != AV_SYNC_VIDEO_MASTER)) && time > is->frame_timer + duration){
                     is->frame_drops_late++;
+                    metricDropsLate->add();
                     FrameQueueC::frame_queue_next(&is->pictq);
                     goto retry;
                 }
@@ -399,6 +421,7 @@ static int queue_picture(VideoState *is, AVFrame *src_frame, double pts, double
 
     av_frame_move_ref(vp->frame, src_frame);
     FrameQueueC::frame_queue_push(&is->pictq);
+    metricVideoQueued->add();
     return 0;
 }
 
@@ -425,6 +448,7 @@ static int get_video_frame(VideoState *is, AVFrame *frame)
                     is->viddec.pkt_serial == is->vidclk.serial &&
                     is->videoq.nb_packets) {
                     is->frame_drops_early++;
+                    metricDropsEarly->add();
                     av_frame_unref(frame);
                     got_picture = 0;
                 }
@@ -450,6 +474,9 @@ int VideoRenderer::video_thread(void *arg) {
     int ret;
     AVRational tb = is->video_st->time_base;
     AVRational frame_rate = av_guess_frame_rate(is->ic, is->video_st, NULL);
+    
+    if (!ThreadPolicy::apply(THREAD_ROLE_VIDEO_DECODE))
+        av_log(NULL, AV_LOG_WARNING, "Failed to apply the thread policy to the video decoder.\n");
 
 #if CONFIG_AVFILTER
     AVFilterGraph *graph = NULL;
@@ -518,8 +545,11 @@ int VideoRenderer::video_thread(void *arg) {
 
             ret = av_buffersink_get_frame_flags(filt_out, frame, 0);
             if (ret < 0) {
-                if (ret == AVERROR_EOF)
+                if (ret == AVERROR_EOF) {
                     is->viddec.finished = is->viddec.pkt_serial;
+                    if (is->videoq.wakeup)
+                        PacketQueueC::packet_queue_wake(is->videoq.wakeup);
+                }
                 ret = 0;
                 break;
             }
@@ -11,6 +11,7 @@
 
 
 #include "ffplaydummy.h"
+#include "metrics.h"
 
 
 // Disable NymphLogger.
@@ -31,6 +32,7 @@ ChronoTrigger FfplayDummy::ct;
 int FfplayDummy::buf_size = 128 * 1024;
 uint8_t* FfplayDummy::buf;
 uint8_t FfplayDummy::count = 0;
+std::shared_ptr<DataBuffer> FfplayDummy::buffer;
 uint32_t start_size = 27 * 1024; 	// Initial size of a request.
 uint32_t step_size = 1 * 1014;		// Request 1 kB more each cycle until buf_size is reached.
 uint32_t read_size = 0;
@@ -41,6 +43,13 @@ Poco::Condition dummyCon;
 Poco::Mutex dummyMutex;
 // ---
 
+// Metrics, as with the Ffplay class.
+static MetricCounter* metricUnderruns = Metrics::counter("nymphcast_buffer_underruns_total",
+								"Reads by the player which found the data buffer empty.");
+static MetricHistogram* metricBufferSeek = Metrics::histogram("nymphcast_buffer_seek_seconds",
+								"Time taken by seeks in the data buffer, including the request to "
+								"the client for data outside of the buffer.");
+
 
 #include <inttypes.h>
 #include <math.h>
@@ -66,16 +75,18 @@ Poco::Mutex dummyMutex;
  * @return The number of bytes read into the buffer.
  */
 int FfplayDummy::media_read(void* opaque, uint8_t* buf, int buf_size) {
-	uint32_t bytesRead = DataBuffer::read(buf_size, buf);
+	uint32_t bytesRead = buffer->read(buf_size, buf);
 #ifndef NO_NYMPH_LOGGER
 	NYMPH_LOG_INFORMATION("Read " + Poco::NumberFormatter::format(bytesRead) + " bytes.");
 #else
 	std::cout << "Read " << bytesRead << " bytes." << std::endl;;
 #endif
 	if (bytesRead == 0) {
-		std::cout << "EOF is " << DataBuffer::isEof() << std::endl;
-		if (DataBuffer::isEof()) { return -1; }
-		else { return -1; }
+		std::cout << "EOF is " << buffer->isEof() << std::endl;
+		if (buffer->isEof()) { return -1; }
+		
+		metricUnderruns->add();
+		return -1;
 	}
 	
 	return bytesRead;
@@ -101,13 +112,14 @@ int64_t FfplayDummy::media_seek(void* opaque, int64_t offset, int whence) {
 							
 	
 	int64_t new_offset = -1;
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
 	switch (whence) {
 		case SEEK_SET:	// Seek from the beginning of the file.
 #ifndef NO_NYMPH_LOGGER
 			NYMPH_LOG_INFORMATION("media_seek: SEEK_SET");
 #else
 			std::cout << "media_seek: SEEK_SET" << std::endl;
-			new_offset = DataBuffer::seek(DB_SEEK_START, offset);
+			new_offset = buffer->seek(DB_SEEK_START, offset);
 #endif
 			break;
 		case SEEK_CUR:	// Seek from the current position.
@@ -116,7 +128,7 @@ int64_t FfplayDummy::media_seek(void* opaque, int64_t offset, int whence) {
 #else
 			std::cout << "media_seek: SEEK_CUR" << std::endl;;
 #endif
-			new_offset = DataBuffer::seek(DB_SEEK_CURRENT, offset);
+			new_offset = buffer->seek(DB_SEEK_CURRENT, offset);
 			break;
 		case SEEK_END:	// Seek from the end of the file.
 #ifndef NO_NYMPH_LOGGER
@@ -124,7 +136,7 @@ int64_t FfplayDummy::media_seek(void* opaque, int64_t offset, int whence) {
 #else
 			std::cout << "media_seek: SEEK_END" << std::endl;
 #endif
-			new_offset = DataBuffer::seek(DB_SEEK_END, offset);
+			new_offset = buffer->seek(DB_SEEK_END, offset);
 			break;
 		case AVSEEK_SIZE:
 #ifndef NO_NYMPH_LOGGER
@@ -132,7 +144,7 @@ int64_t FfplayDummy::media_seek(void* opaque, int64_t offset, int whence) {
 #else
 			std::cout << "media_seek: received AVSEEK_SIZE, returning file size." << std::endl;
 #endif
-			return DataBuffer::getFileSize();
+			return buffer->getFileSize();
 			break;
 		default:
 #ifndef NO_NYMPH_LOGGER
@@ -142,6 +154,9 @@ int64_t FfplayDummy::media_seek(void* opaque, int64_t offset, int whence) {
 #endif
 	}
 	
+	metricBufferSeek->record(std::chrono::duration_cast<std::chrono::microseconds>(
+											std::chrono::steady_clock::now() - begin).count());
+	
 	if (new_offset < 0) {
 		// Some error occurred.
 #ifndef NO_NYMPH_LOGGER
@@ -180,7 +195,7 @@ void FfplayDummy::triggerRead(int) {
 	// If second read, seek to beginning.
 	if (count == 0) {
 		// Seek to end - 10 kB.
-		media_seek(0, DataBuffer::getFileSize() - (10 * 1024), SEEK_SET);
+		media_seek(0, buffer->getFileSize() - (10 * 1024), SEEK_SET);
 		count++;
 		return;
 	}
@@ -198,7 +213,9 @@ void FfplayDummy::triggerRead(int) {
 		read_size = start_size;
 	}
 	
-	if (media_read(0, buf, read_size) == -1) {
+	// An empty buffer before the end of the file is an underrun, after which reading continues
+	// with the next trigger, as with the real player.
+	if (media_read(0, buf, read_size) == -1 && buffer->isEof()) {
 		// Signal the player thread that the playback has ended.
 		dummyCon.signal();
 	}
@@ -219,8 +236,41 @@ void FfplayDummy::cleanUp() {
 }
 
 
+// --- SET DATA BUFFER ---
+void FfplayDummy::setDataBuffer(std::shared_ptr<DataBuffer> buffer) {
+	FfplayDummy::buffer = buffer;
+}
+
+
+// --- PREFETCH ---
+// Nothing to open ahead of time for the dummy player.
+void FfplayDummy::prefetch(std::shared_ptr<DataBuffer> buffer) {
+	//
+}
+
+
+void FfplayDummy::prefetch(std::string url) {
+	//
+}
+
+
+// --- SET PROBE LIMITS ---
+void FfplayDummy::setProbeLimits(int64_t size, int64_t duration) {
+	//
+}
+
+
 // --- RUN ---
 void FfplayDummy::run() {
+	do {
+		play();
+	}
+	while (finishPlayback());	// Calls handler for post-playback steps.
+}
+
+
+// --- PLAY ---
+void FfplayDummy::play() {
 	buf = (uint8_t*) malloc(buf_size);
 	
 	read_size = start_size;
@@ -240,8 +290,7 @@ void FfplayDummy::run() {
 	
 	ct.stop();
 	
-	DataBuffer::reset();	// Clears the data buffer (file data buffer).
-	finishPlayback();		// Calls handler for post-playback steps.
+	buffer->reset();	// Clears the data buffer (file data buffer).
 	
 	// Clean up.
 	free(buf);
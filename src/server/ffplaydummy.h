@@ -17,6 +17,7 @@
 #include <iostream>
 #include <atomic>
 #include <queue>
+#include <memory>
 
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_mutex.h>
@@ -28,6 +29,7 @@
 
 #include "ffplay/types.h"
 #include "chronotrigger.h"
+#include "databuffer.h"
 
 
 struct FileMetaInfo {
@@ -60,7 +62,7 @@ struct FileMetaInfo {
 extern FileMetaInfo file_meta;
 extern std::atomic<bool> playerStarted;
 	
-void finishPlayback(); // Defined in NymphCastServer.cpp
+bool finishPlayback(); // Defined in NymphCastServer.cpp
 
 	
 class FfplayDummy : public Poco::Runnable {
@@ -70,14 +72,20 @@ class FfplayDummy : public Poco::Runnable {
 	static int buf_size;
 	static uint8_t* buf;
 	static uint8_t count;
+	static std::shared_ptr<DataBuffer> buffer;
 	
 	static void triggerRead(int);
 	static void cleanUp();
+	void play();
 	static int media_read(void* opaque, uint8_t* buf, int buf_size);
 	static int64_t media_seek(void* opaque, int64_t pos, int whence);
 	
 public:
 	virtual void run();
+	void setDataBuffer(std::shared_ptr<DataBuffer> buffer);
+	void prefetch(std::shared_ptr<DataBuffer> buffer);
+	void prefetch(std::string url);
+	void setProbeLimits(int64_t size, int64_t duration);
 	uint8_t getVolume();
 	void setVolume(uint8_t volume);
 	void quit();
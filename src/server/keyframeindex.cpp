@@ -0,0 +1,176 @@
+/*
+	keyframeindex.cpp - Implementation of the KeyframeIndex class.
+
+	Revision 0
+
+	Notes:
+			- Entries closer than 'spacing' to an existing entry are skipped, which keeps the
+				index small for formats where every packet is a keyframe (audio).
+			- A lookup only succeeds within the indexed range, or just past its end. Further
+				on, the keyframe would be too far from the target to be of use.
+*/
+
+
+//#define DEBUG 1
+
+#include "keyframeindex.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+
+#ifdef DEBUG
+#include <iostream>
+#endif
+
+
+// Identifies index files, and their version.
+#define KEYFRAMEINDEX_MAGIC 0x494b434e		// "NCKI"
+#define KEYFRAMEINDEX_VERSION 1
+
+
+// --- CONSTRUCTOR ---
+KeyframeIndex::KeyframeIndex(int64_t spacing) {
+	this->spacing = spacing;
+}
+
+
+// --- HASH ---
+// FNV-1a hash of the data. Chain calls by passing the previous hash as seed.
+uint64_t KeyframeIndex::hash(const void* data, size_t length, uint64_t seed) {
+	const uint8_t* bytes = (const uint8_t*) data;
+	uint64_t h = seed;
+	for (size_t i = 0; i < length; ++i) {
+		h ^= bytes[i];
+		h *= 1099511628211ULL;
+	}
+
+	return h;
+}
+
+
+// --- RESET ---
+// Empties the index, for the media file identified by 'key'.
+void KeyframeIndex::reset(uint64_t key) {
+	std::lock_guard<std::mutex> lk(mutex);
+	entries.clear();
+	this->key = key;
+}
+
+
+// --- GET KEY ---
+uint64_t KeyframeIndex::getKey() {
+	std::lock_guard<std::mutex> lk(mutex);
+	return key;
+}
+
+
+// --- ADD ---
+// Adds a keyframe. Returns false if it was skipped, as an entry close to it exists already.
+bool KeyframeIndex::add(int64_t pts, int64_t pos) {
+	if (pos < 0) { return false; }
+
+	std::lock_guard<std::mutex> lk(mutex);
+
+	// Packets mostly arrive in order, so check the end first.
+	if (entries.empty() || pts >= entries.back().pts) {
+		if (!entries.empty() && pts - entries.back().pts < spacing) { return false; }
+		entries.push_back({ pts, pos });
+		return true;
+	}
+
+	// After a seek back, packets fill in earlier parts of the index.
+	std::vector<KeyframeEntry>::iterator it = std::lower_bound(entries.begin(), entries.end(), pts,
+							[](const KeyframeEntry &e, int64_t t) { return e.pts < t; });
+	if (it != entries.end() && it->pts - pts < spacing) { return false; }
+	if (it != entries.begin() && pts - (it - 1)->pts < spacing) { return false; }
+	entries.insert(it, { pts, pos });
+
+	return true;
+}
+
+
+// --- LOOKUP ---
+// Finds the last keyframe at or before 'pts'. Returns false if the index does not cover 'pts'.
+bool KeyframeIndex::lookup(int64_t pts, KeyframeEntry &entry) {
+	std::lock_guard<std::mutex> lk(mutex);
+	std::vector<KeyframeEntry>::iterator it = std::upper_bound(entries.begin(), entries.end(), pts,
+							[](int64_t t, const KeyframeEntry &e) { return t < e.pts; });
+	if (it == entries.begin()) { return false; }
+
+	// Past the last entry, the next keyframe may be anywhere.
+	if (it == entries.end() && pts - entries.back().pts > 2 * spacing) { return false; }
+
+	entry = *(it - 1);
+
+#ifdef DEBUG
+	std::cout << "KeyframeIndex: " << pts << " us resolves to " << entry.pts << " us at byte "
+				<< entry.pos << std::endl;
+#endif
+
+	return true;
+}
+
+
+// --- SIZE ---
+size_t KeyframeIndex::size() {
+	std::lock_guard<std::mutex> lk(mutex);
+	return entries.size();
+}
+
+
+// --- SAVE ---
+// Writes the index to the file at 'path'. Returns false if the file could not be written.
+bool KeyframeIndex::save(const std::string &path) {
+	std::lock_guard<std::mutex> lk(mutex);
+	if (entries.empty()) { return false; }
+
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if (!file.is_open()) { return false; }
+
+	uint32_t magic = KEYFRAMEINDEX_MAGIC;
+	uint32_t version = KEYFRAMEINDEX_VERSION;
+	uint64_t count = entries.size();
+	file.write((const char*) &magic, sizeof(magic));
+	file.write((const char*) &version, sizeof(version));
+	file.write((const char*) &key, sizeof(key));
+	file.write((const char*) &count, sizeof(count));
+	file.write((const char*) entries.data(), count * sizeof(KeyframeEntry));
+
+	return file.good();
+}
+
+
+// --- LOAD ---
+// Reads the index for the media file identified by 'key' from the file at 'path'. Returns false if
+// the file does not exist, or is not for this media file. The index is left empty in that case.
+bool KeyframeIndex::load(const std::string &path, uint64_t key) {
+	std::lock_guard<std::mutex> lk(mutex);
+	entries.clear();
+	this->key = key;
+
+	std::ifstream file(path, std::ios::binary);
+	if (!file.is_open()) { return false; }
+
+	uint32_t magic = 0;
+	uint32_t version = 0;
+	uint64_t fileKey = 0;
+	uint64_t count = 0;
+	file.read((char*) &magic, sizeof(magic));
+	file.read((char*) &version, sizeof(version));
+	file.read((char*) &fileKey, sizeof(fileKey));
+	file.read((char*) &count, sizeof(count));
+	if (!file.good() || magic != KEYFRAMEINDEX_MAGIC || version != KEYFRAMEINDEX_VERSION
+			|| fileKey != key || count > (1 << 24)) {
+		return false;
+	}
+
+	entries.resize(count);
+	file.read((char*) entries.data(), count * sizeof(KeyframeEntry));
+	if (!file.good()) {
+		entries.clear();
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,55 @@
+/*
+	keyframeindex.h - Header for the KeyframeIndex class.
+
+	Revision 0
+
+	Features:
+			- Maps the timestamps of keyframes to their byte offset in the media file, as the
+				player reads packets.
+			- Resolves a seek to a time into a seek to the byte offset of the keyframe before it.
+			- Can be saved to and loaded from a file per media file, for repeat plays.
+
+	Notes:
+			- Meant for containers without an index of their own, e.g. MPEG-TS, raw AAC and MP3,
+				which would otherwise have to be searched through for the seek target.
+			- Timestamps are in microseconds.
+*/
+
+
+#ifndef KEYFRAMEINDEX_H
+#define KEYFRAMEINDEX_H
+
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+
+struct KeyframeEntry {
+	int64_t pts;		// Microseconds.
+	int64_t pos;		// Byte offset in the file.
+};
+
+
+class KeyframeIndex {
+	std::vector<KeyframeEntry> entries;		// Ordered by timestamp.
+	std::mutex mutex;
+	uint64_t key = 0;						// Identifies the media file.
+	int64_t spacing;						// Minimum time between entries.
+
+public:
+	KeyframeIndex(int64_t spacing = 500000);
+
+	static uint64_t hash(const void* data, size_t length, uint64_t seed = 14695981039346656037ULL);
+
+	void reset(uint64_t key = 0);
+	uint64_t getKey();
+	bool add(int64_t pts, int64_t pos);
+	bool lookup(int64_t pts, KeyframeEntry &entry);
+	size_t size();
+	bool save(const std::string &path);
+	bool load(const std::string &path, uint64_t key);
+};
+
+#endif
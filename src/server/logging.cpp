@@ -0,0 +1,262 @@
+/*
+	logging.cpp - Implementation of the Logging class.
+
+	Revision 0
+
+	Notes:
+			- The ring is a bounded multi-producer queue with a sequence number per slot. The
+				sequences are kept relative to the slot index, so that the zero-initialised ring
+				is valid before start() gets called.
+			- Errors and warnings wake the drain thread right away, as does a ring which is half
+				full. Other messages get written within LOG_DRAIN_INTERVAL.
+*/
+
+
+#include "logging.h"
+
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <iostream>
+
+
+#define LOG_RING_MASK (LOG_RING_SIZE - 1)
+
+
+// Static initialisations.
+std::atomic<int> Logging::levels[LOG_SUBSYSTEMS] = { { LOG_LEVEL_INFO }, { LOG_LEVEL_INFO },
+									{ LOG_LEVEL_INFO }, { LOG_LEVEL_INFO }, { LOG_LEVEL_INFO } };
+Logging::Slot Logging::ring[LOG_RING_SIZE];
+std::atomic<uint64_t> Logging::head = { 0 };
+std::atomic<uint64_t> Logging::tail = { 0 };
+std::atomic<uint64_t> Logging::written = { 0 };
+std::atomic<uint64_t> Logging::dropped = { 0 };
+std::vector<LogSink> Logging::sinks;
+std::mutex Logging::sinkMutex;
+std::mutex Logging::drainMutex;
+std::condition_variable Logging::drainCv;
+std::thread Logging::drainThread;
+std::atomic<bool> Logging::running = { false };
+
+
+static const char* levelNames[] = { "none", "error", "warning", "info", "debug", "trace" };
+static const char* subsystemNames[] = { "core", "read", "data", "status", "slave" };
+
+
+// --- WRITE ---
+// Formats the message into a free slot of the ring. Drops the message if the ring is full.
+void Logging::write(LogSubsystem sub, LogLevel level, const char* file, int line,
+																const char* format, ...) {
+	// Claim the next slot. It is free once the drain thread has moved past it a lap ago.
+	uint64_t pos = head.load(std::memory_order_relaxed);
+	Slot* slot;
+	for (;;) {
+		slot = &ring[pos & LOG_RING_MASK];
+		uint64_t seq = slot->sequence.load(std::memory_order_acquire) + (pos & LOG_RING_MASK);
+		if (seq == pos) {
+			if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) { break; }
+		}
+		else if (seq < pos) {
+			dropped++;
+			return;
+		}
+		else {
+			pos = head.load(std::memory_order_relaxed);
+		}
+	}
+
+	LogRecord &record = slot->record;
+	record.time = std::chrono::duration_cast<std::chrono::microseconds>(
+							std::chrono::system_clock::now().time_since_epoch()).count();
+	record.level = level;
+	record.subsystem = sub;
+	record.file = file;
+	record.line = line;
+
+	va_list args;
+	va_start(args, format);
+	vsnprintf(record.message, LOG_MESSAGE_SIZE, format, args);
+	va_end(args);
+
+	// Hand the slot to the drain thread.
+	slot->sequence.store(pos + 1 - (pos & LOG_RING_MASK), std::memory_order_release);
+	written++;
+
+	if (level <= LOG_LEVEL_WARNING || pos + 1 - tail.load(std::memory_order_relaxed) >= 
+																		LOG_RING_SIZE / 2) {
+		drainCv.notify_one();
+	}
+}
+
+
+// --- DRAIN ---
+// Passes the records in the ring to the sinks. Call with 'drainMutex' held.
+void Logging::drain() {
+	std::lock_guard<std::mutex> lk(sinkMutex);
+	bool printed = false;
+	uint64_t tail = Logging::tail.load(std::memory_order_relaxed);
+	for (;;) {
+		Slot &slot = ring[tail & LOG_RING_MASK];
+		uint64_t seq = slot.sequence.load(std::memory_order_acquire) + (tail & LOG_RING_MASK);
+		if (seq != tail + 1) { break; }
+
+		if (sinks.empty()) {
+			printRecord(slot.record);
+			printed = true;
+		}
+		else {
+			for (int i = 0; i < sinks.size(); ++i) {
+				sinks[i](slot.record);
+			}
+		}
+
+		// Free the slot for the next lap.
+		slot.sequence.store(tail + LOG_RING_SIZE - (tail & LOG_RING_MASK),
+																std::memory_order_release);
+		tail++;
+		Logging::tail.store(tail, std::memory_order_relaxed);
+	}
+
+	// Flush once per batch, rather than per line.
+	if (printed) { std::cout.flush(); }
+}
+
+
+// --- RUN ---
+void Logging::run() {
+	std::unique_lock<std::mutex> lk(drainMutex);
+	while (running) {
+		drainCv.wait_for(lk, std::chrono::milliseconds(LOG_DRAIN_INTERVAL));
+		drain();
+	}
+
+	drain();
+}
+
+
+// --- PRINT RECORD ---
+// The sink used when no other sinks were added. Writes the record to standard output.
+void Logging::printRecord(const LogRecord &record) {
+	time_t seconds = record.time / 1000000;
+	char stamp[16];
+	strftime(stamp, sizeof(stamp), "%H:%M:%S", std::localtime(&seconds));
+	char millis[8];
+	snprintf(millis, sizeof(millis), ".%03d", (int) ((record.time / 1000) % 1000));
+
+	std::cout << stamp << millis << " " << levelNames[record.level] << " ["
+				<< subsystemNames[record.subsystem] << "] " << record.message << "\n";
+}
+
+
+// --- SET LEVEL ---
+// Sets the level up to which messages of the subsystem get logged.
+void Logging::setLevel(LogSubsystem sub, LogLevel level) {
+	levels[sub] = level;
+}
+
+
+// Sets the level of all subsystems.
+void Logging::setLevel(LogLevel level) {
+	for (int i = 0; i < LOG_SUBSYSTEMS; ++i) {
+		levels[i] = level;
+	}
+}
+
+
+// --- GET LEVEL ---
+LogLevel Logging::getLevel(LogSubsystem sub) {
+	return (LogLevel) levels[sub].load();
+}
+
+
+// --- PARSE LEVEL ---
+// Returns the level with this name (e.g. "warning"), or 'defaultLevel' if the name is unknown.
+LogLevel Logging::parseLevel(std::string name, LogLevel defaultLevel) {
+	for (int i = LOG_LEVEL_NONE; i <= LOG_LEVEL_TRACE; ++i) {
+		if (name == levelNames[i]) { return (LogLevel) i; }
+	}
+
+	return defaultLevel;
+}
+
+
+// --- LEVEL NAME ---
+const char* Logging::levelName(LogLevel level) {
+	return levelNames[level];
+}
+
+
+// --- SUBSYSTEM NAME ---
+const char* Logging::subsystemName(LogSubsystem sub) {
+	return subsystemNames[sub];
+}
+
+
+// --- ADD SINK ---
+// Adds a sink, which gets called with each record from the drain thread. Once a sink has been
+// added, records are no longer written to standard output.
+void Logging::addSink(LogSink sink) {
+	std::lock_guard<std::mutex> lk(sinkMutex);
+	sinks.push_back(sink);
+}
+
+
+// --- CLEAR SINKS ---
+void Logging::clearSinks() {
+	std::lock_guard<std::mutex> lk(sinkMutex);
+	sinks.clear();
+}
+
+
+// --- START ---
+// Starts the drain thread. Returns false if it is running already.
+bool Logging::start() {
+	if (running) { return false; }
+
+	// Write what is left when the application exits without calling stop().
+	static bool registered = false;
+	if (!registered) {
+		std::atexit(stop);
+		registered = true;
+	}
+
+	running = true;
+	drainThread = std::thread(run);
+
+	return true;
+}
+
+
+// --- STOP ---
+// Stops the drain thread, after writing the remaining records.
+void Logging::stop() {
+	if (!running) { return; }
+
+	{
+		std::lock_guard<std::mutex> lk(drainMutex);
+		running = false;
+	}
+
+	drainCv.notify_one();
+	drainThread.join();
+}
+
+
+// --- FLUSH ---
+// Writes the records in the ring from the calling thread.
+void Logging::flush() {
+	std::lock_guard<std::mutex> lk(drainMutex);
+	drain();
+}
+
+
+// --- GET STATS ---
+LogStats Logging::getStats() {
+	LogStats stats;
+	stats.written = written;
+	stats.dropped = dropped;
+
+	return stats;
+}
@@ -0,0 +1,137 @@
+/*
+	logging.h - Header for the Logging class.
+
+	Revision 0
+
+	Features:
+			- Level-gated logging macros. A message whose level is disabled costs a single
+				atomic load: its arguments are neither evaluated nor formatted.
+			- Levels per subsystem, which can be changed at any time.
+			- Messages are formatted into a lock-free ring, and written to the sinks by a drain
+				thread. Logging threads never wait on a lock or on output.
+
+	Notes:
+			- Messages are printf-style, and are truncated at LOG_MESSAGE_SIZE.
+			- When the ring is full, new messages are dropped and counted.
+*/
+
+
+#ifndef LOGGING_H
+#define LOGGING_H
+
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+#define LOG_MESSAGE_SIZE 200
+#define LOG_RING_SIZE 1024				// Records. Must be a power of two.
+#define LOG_DRAIN_INTERVAL 100			// Milliseconds.
+
+
+enum LogLevel {
+	LOG_LEVEL_NONE = 0,
+	LOG_LEVEL_ERROR,
+	LOG_LEVEL_WARNING,
+	LOG_LEVEL_INFO,
+	LOG_LEVEL_DEBUG,
+	LOG_LEVEL_TRACE
+};
+
+
+enum LogSubsystem {
+	LOG_SUB_CORE = 0,		// Server, sessions and RPC handlers.
+	LOG_SUB_READ,			// Player reads and seeks in the data buffer.
+	LOG_SUB_DATA,			// Data requests to clients.
+	LOG_SUB_STATUS,			// Status updates to clients.
+	LOG_SUB_SLAVE,			// Master and slave receivers.
+	LOG_SUBSYSTEMS
+};
+
+
+struct LogRecord {
+	int64_t time;						// Microseconds, system clock.
+	LogLevel level;
+	LogSubsystem subsystem;
+	const char* file;
+	int line;
+	char message[LOG_MESSAGE_SIZE];
+};
+
+
+typedef std::function<void(const LogRecord &record)> LogSink;
+
+
+struct LogStats {
+	uint64_t written;
+	uint64_t dropped;
+};
+
+
+// Logs a printf-style message, if 'level' is enabled for 'sub'.
+#define NC_LOG(sub, level, ...) do { if (Logging::enabled(sub, level)) { \
+				Logging::write(sub, level, __FILE__, __LINE__, __VA_ARGS__); } } while (0)
+
+#define NC_LOG_ERROR(sub, ...) NC_LOG(sub, LOG_LEVEL_ERROR, __VA_ARGS__)
+#define NC_LOG_WARNING(sub, ...) NC_LOG(sub, LOG_LEVEL_WARNING, __VA_ARGS__)
+#define NC_LOG_INFO(sub, ...) NC_LOG(sub, LOG_LEVEL_INFO, __VA_ARGS__)
+#define NC_LOG_DEBUG(sub, ...) NC_LOG(sub, LOG_LEVEL_DEBUG, __VA_ARGS__)
+#define NC_LOG_TRACE(sub, ...) NC_LOG(sub, LOG_LEVEL_TRACE, __VA_ARGS__)
+
+
+class Logging {
+	struct Slot {
+		std::atomic<uint64_t> sequence;
+		LogRecord record;
+	};
+
+	static std::atomic<int> levels[LOG_SUBSYSTEMS];
+	static Slot ring[LOG_RING_SIZE];
+	static std::atomic<uint64_t> head;		// Next slot to write.
+	static std::atomic<uint64_t> tail;		// Next slot to drain. Written by the drain thread only.
+	static std::atomic<uint64_t> written;
+	static std::atomic<uint64_t> dropped;
+	static std::vector<LogSink> sinks;
+	static std::mutex sinkMutex;
+	static std::mutex drainMutex;
+	static std::condition_variable drainCv;
+	static std::thread drainThread;
+	static std::atomic<bool> running;
+
+	static void drain();
+	static void run();
+	static void printRecord(const LogRecord &record);
+
+public:
+	static bool enabled(LogSubsystem sub, LogLevel level) {
+		return levels[sub].load(std::memory_order_relaxed) >= level;
+	}
+
+	static void write(LogSubsystem sub, LogLevel level, const char* file, int line,
+											const char* format, ...)
+#ifdef __GNUC__
+											__attribute__((format(printf, 5, 6)))
+#endif
+											;
+
+	static void setLevel(LogSubsystem sub, LogLevel level);
+	static void setLevel(LogLevel level);
+	static LogLevel getLevel(LogSubsystem sub);
+	static LogLevel parseLevel(std::string name, LogLevel defaultLevel);
+	static const char* levelName(LogLevel level);
+	static const char* subsystemName(LogSubsystem sub);
+	static void addSink(LogSink sink);
+	static void clearSinks();
+	static bool start();
+	static void stop();
+	static void flush();
+	static LogStats getStats();
+};
+
+#endif
@@ -0,0 +1,273 @@
+/*
+	metrics.cpp - Implementation of the Metrics registry.
+
+	Revision 0
+
+	Notes:
+			- Bucket i of a histogram holds the values from bucketLow(i) up to bucketLow(i + 1).
+				The first 2 * METRIC_HISTOGRAM_SUB_BUCKETS buckets hold a single value each.
+			- Exported histogram buckets are at the powers of two, which are bucket boundaries,
+				so their counts are exact.
+			- The registry is created on first use, so that metrics can be registered during the
+				static initialisation of other files.
+*/
+
+
+#include "metrics.h"
+
+#include <cmath>
+#include <cstdio>
+
+
+// --- ADD ---
+void MetricGauge::add(double v) {
+	double old = value.load(std::memory_order_relaxed);
+	while (!value.compare_exchange_weak(old, old + v, std::memory_order_relaxed)) { }
+}
+
+
+// --- CONSTRUCTOR ---
+MetricHistogram::MetricHistogram() {
+	reset();
+}
+
+
+// --- BUCKET INDEX ---
+// Returns the index of the bucket holding 'value'.
+int MetricHistogram::bucketIndex(uint64_t value) {
+	if (value < METRIC_HISTOGRAM_SUB_BUCKETS) { return (int) value; }
+
+	int msb = 63 - __builtin_clzll(value);
+	if (msb >= METRIC_HISTOGRAM_MAX_BITS) { return METRIC_HISTOGRAM_BUCKETS - 1; }
+
+	int shift = msb - METRIC_HISTOGRAM_SUB_BITS;
+	int sub = (int) (value >> shift) - METRIC_HISTOGRAM_SUB_BUCKETS;
+	return (shift + 1) * METRIC_HISTOGRAM_SUB_BUCKETS + sub;
+}
+
+
+// --- BUCKET LOW ---
+// Returns the lowest value held by the bucket at 'index'.
+uint64_t MetricHistogram::bucketLow(int index) {
+	if (index < 2 * METRIC_HISTOGRAM_SUB_BUCKETS) { return (uint64_t) index; }
+
+	int shift = index / METRIC_HISTOGRAM_SUB_BUCKETS - 1;
+	uint64_t sub = index % METRIC_HISTOGRAM_SUB_BUCKETS;
+	return (METRIC_HISTOGRAM_SUB_BUCKETS + sub) << shift;
+}
+
+
+// --- RECORD ---
+// Adds a value, in microseconds. Negative values count as zero.
+void MetricHistogram::record(int64_t value) {
+	if (value < 0) { value = 0; }
+	buckets[bucketIndex((uint64_t) value)].fetch_add(1, std::memory_order_relaxed);
+	sum.fetch_add((uint64_t) value, std::memory_order_relaxed);
+	count.fetch_add(1, std::memory_order_relaxed);
+}
+
+
+// --- COUNT BELOW ---
+// Returns the number of values below 'value'. Exact if 'value' is a bucket boundary.
+uint64_t MetricHistogram::countBelow(uint64_t value) {
+	int end = bucketIndex(value);
+	if (value >= bucketLow(METRIC_HISTOGRAM_BUCKETS)) { end = METRIC_HISTOGRAM_BUCKETS; }
+
+	uint64_t n = 0;
+	for (int i = 0; i < end; ++i) {
+		n += buckets[i].load(std::memory_order_relaxed);
+	}
+
+	return n;
+}
+
+
+// --- PERCENTILE ---
+// Returns the highest value of the bucket in which the 'p'th percentile (0 - 100) lies, or 0 if
+// the histogram is empty.
+uint64_t MetricHistogram::percentile(double p) {
+	uint64_t total = 0;
+	for (int i = 0; i < METRIC_HISTOGRAM_BUCKETS; ++i) {
+		total += buckets[i].load(std::memory_order_relaxed);
+	}
+
+	if (total == 0) { return 0; }
+
+	uint64_t target = (uint64_t) ceil(p / 100.0 * total);
+	if (target == 0) { target = 1; }
+	uint64_t n = 0;
+	for (int i = 0; i < METRIC_HISTOGRAM_BUCKETS; ++i) {
+		n += buckets[i].load(std::memory_order_relaxed);
+		if (n >= target) { return bucketLow(i + 1) - 1; }
+	}
+
+	return bucketLow(METRIC_HISTOGRAM_BUCKETS) - 1;
+}
+
+
+// --- RESET ---
+void MetricHistogram::reset() {
+	for (int i = 0; i < METRIC_HISTOGRAM_BUCKETS; ++i) {
+		buckets[i].store(0, std::memory_order_relaxed);
+	}
+
+	count = 0;
+	sum = 0;
+}
+
+
+// --- REGISTRY ---
+Metrics::Registry& Metrics::registry() {
+	static Registry reg;
+	return reg;
+}
+
+
+// --- FIND ---
+// Returns the entry with this name, after creating it if needed. Returns null if the name is in
+// use by a metric of another type. Call with the registry mutex held.
+Metrics::Entry* Metrics::find(const std::string &name, MetricType type, const std::string &help) {
+	std::map<std::string, Entry>::iterator it = registry().entries.find(name);
+	if (it != registry().entries.end()) {
+		return (it->second.type == type) ? &it->second : 0;
+	}
+
+	Entry &entry = registry().entries[name];
+	entry.type = type;
+	entry.help = help;
+	if (type == METRIC_COUNTER) { entry.counter.reset(new MetricCounter); }
+	else if (type == METRIC_GAUGE) { entry.gauge.reset(new MetricGauge); }
+	else { entry.histogram.reset(new MetricHistogram); }
+
+	return &entry;
+}
+
+
+// --- COUNTER ---
+// Returns the counter with this name, or null if the name is in use by another type of metric.
+MetricCounter* Metrics::counter(const std::string &name, const std::string &help) {
+	std::lock_guard<std::mutex> lk(registry().mutex);
+	Entry* entry = find(name, METRIC_COUNTER, help);
+	return entry ? entry->counter.get() : 0;
+}
+
+
+// --- GAUGE ---
+MetricGauge* Metrics::gauge(const std::string &name, const std::string &help) {
+	std::lock_guard<std::mutex> lk(registry().mutex);
+	Entry* entry = find(name, METRIC_GAUGE, help);
+	return entry ? entry->gauge.get() : 0;
+}
+
+
+// --- HISTOGRAM ---
+MetricHistogram* Metrics::histogram(const std::string &name, const std::string &help) {
+	std::lock_guard<std::mutex> lk(registry().mutex);
+	Entry* entry = find(name, METRIC_HISTOGRAM, help);
+	return entry ? entry->histogram.get() : 0;
+}
+
+
+// --- ADD COLLECTOR ---
+// Adds a function which gets called before each export, to update metrics which are cheaper to
+// read on demand than to keep up to date, such as buffer levels.
+void Metrics::addCollector(MetricCollector collector) {
+	std::lock_guard<std::mutex> lk(registry().mutex);
+	registry().collectors.push_back(collector);
+}
+
+
+// Appends 'name', with the labels and an extra label, if any, to 'out'.
+static void appendName(std::string &out, const std::string &name, const std::string &suffix,
+						const std::string &labels, const std::string &extra = std::string()) {
+	out += name;
+	out += suffix;
+	if (labels.empty() && extra.empty()) { return; }
+
+	out += "{";
+	out += labels;
+	if (!labels.empty() && !extra.empty()) { out += ","; }
+	out += extra;
+	out += "}";
+}
+
+
+// --- EXPORT TEXT ---
+// Returns all metrics in the Prometheus text format.
+std::string Metrics::exportText() {
+	std::vector<MetricCollector> collectors;
+	{
+		std::lock_guard<std::mutex> lk(registry().mutex);
+		collectors = registry().collectors;
+	}
+
+	// Collectors may register metrics, so they run without the lock.
+	for (int i = 0; i < collectors.size(); ++i) {
+		collectors[i]();
+	}
+
+	std::lock_guard<std::mutex> lk(registry().mutex);
+
+	// Metrics with the same base name have to be listed together, below a single header.
+	std::map<std::string, std::vector<std::map<std::string, Entry>::iterator> > families;
+	std::map<std::string, Entry>::iterator it;
+	for (it = registry().entries.begin(); it != registry().entries.end(); ++it) {
+		families[it->first.substr(0, it->first.find('{'))].push_back(it);
+	}
+
+	static const char* typeNames[] = { "counter", "gauge", "histogram" };
+	std::string out;
+	char value[64];
+	std::map<std::string, std::vector<std::map<std::string, Entry>::iterator> >::iterator fit;
+	for (fit = families.begin(); fit != families.end(); ++fit) {
+		const std::string &base = fit->first;
+		Entry &first = fit->second[0]->second;
+		out += "# HELP " + base + " " + first.help + "\n";
+		out += "# TYPE " + base + " " + typeNames[first.type] + "\n";
+		for (int i = 0; i < fit->second.size(); ++i) {
+			const std::string &name = fit->second[i]->first;
+			Entry &entry = fit->second[i]->second;
+			std::string labels;
+			size_t brace = name.find('{');
+			if (brace != std::string::npos) {
+				labels = name.substr(brace + 1, name.size() - brace - 2);
+			}
+
+			if (entry.type == METRIC_COUNTER) {
+				appendName(out, base, "", labels);
+				snprintf(value, sizeof(value), " %llu\n",
+										(unsigned long long) entry.counter->get());
+				out += value;
+			}
+			else if (entry.type == METRIC_GAUGE) {
+				appendName(out, base, "", labels);
+				snprintf(value, sizeof(value), " %.9g\n", entry.gauge->get());
+				out += value;
+			}
+			else {
+				// Cumulative buckets, ending with all values.
+				MetricHistogram* h = entry.histogram.get();
+				uint64_t count = h->getCount();
+				for (int b = METRIC_EXPORT_MIN_BITS; b <= METRIC_EXPORT_MAX_BITS; ++b) {
+					snprintf(value, sizeof(value), "le=\"%.9g\"", (double) (1ULL << b) / 1e6);
+					appendName(out, base, "_bucket", labels, value);
+					snprintf(value, sizeof(value), " %llu\n",
+											(unsigned long long) h->countBelow(1ULL << b));
+					out += value;
+				}
+
+				appendName(out, base, "_bucket", labels, "le=\"+Inf\"");
+				snprintf(value, sizeof(value), " %llu\n", (unsigned long long) count);
+				out += value;
+				appendName(out, base, "_sum", labels);
+				snprintf(value, sizeof(value), " %.9g\n", h->getSum() / 1e6);
+				out += value;
+				appendName(out, base, "_count", labels);
+				snprintf(value, sizeof(value), " %llu\n", (unsigned long long) count);
+				out += value;
+			}
+		}
+	}
+
+	return out;
+}
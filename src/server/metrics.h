@@ -0,0 +1,121 @@
+/*
+	metrics.h - Header for the Metrics registry.
+
+	Revision 0
+
+	Features:
+			- Counters, gauges and latency histograms, which can be updated from any thread at the
+				cost of an atomic operation, without locking.
+			- Histograms use log-linear buckets, as with HDR histograms: each power of two is
+				split into METRIC_HISTOGRAM_SUB_BUCKETS buckets, for a fixed relative error over
+				the whole range.
+			- Export of all metrics in the Prometheus text format.
+
+	Notes:
+			- Metrics are created on first use, and live until the application exits. Pointers
+				returned by the registry stay valid, and are meant to be kept by the caller.
+			- A name may carry labels, as in 'nymphcast_frame_drops_total{reason="late"}'. The
+				help text is that of the first metric registered with the base name.
+			- Histograms take microseconds, and are exported in seconds.
+*/
+
+
+#ifndef METRICS_H
+#define METRICS_H
+
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+
+#define METRIC_HISTOGRAM_SUB_BITS 4
+#define METRIC_HISTOGRAM_SUB_BUCKETS (1 << METRIC_HISTOGRAM_SUB_BITS)
+#define METRIC_HISTOGRAM_MAX_BITS 36		// Values of 2^36 µs (19 hours) and up are clamped.
+#define METRIC_HISTOGRAM_BUCKETS ((METRIC_HISTOGRAM_MAX_BITS - METRIC_HISTOGRAM_SUB_BITS + 1) \
+																* METRIC_HISTOGRAM_SUB_BUCKETS)
+#define METRIC_EXPORT_MIN_BITS 4			// Exported buckets: 16 µs ...
+#define METRIC_EXPORT_MAX_BITS 26			// ... to 67 seconds.
+
+
+enum MetricType {
+	METRIC_COUNTER = 0,
+	METRIC_GAUGE,
+	METRIC_HISTOGRAM
+};
+
+
+class MetricCounter {
+	std::atomic<uint64_t> value = { 0 };
+
+public:
+	void add(uint64_t n = 1) { value.fetch_add(n, std::memory_order_relaxed); }
+	uint64_t get() { return value.load(std::memory_order_relaxed); }
+};
+
+
+class MetricGauge {
+	std::atomic<double> value = { 0 };
+
+public:
+	void set(double v) { value.store(v, std::memory_order_relaxed); }
+	void add(double v);
+	double get() { return value.load(std::memory_order_relaxed); }
+};
+
+
+class MetricHistogram {
+	std::atomic<uint64_t> buckets[METRIC_HISTOGRAM_BUCKETS];
+	std::atomic<uint64_t> count = { 0 };
+	std::atomic<uint64_t> sum = { 0 };
+
+public:
+	MetricHistogram();
+
+	static int bucketIndex(uint64_t value);
+	static uint64_t bucketLow(int index);
+
+	void record(int64_t value);
+	uint64_t getCount() { return count.load(std::memory_order_relaxed); }
+	uint64_t getSum() { return sum.load(std::memory_order_relaxed); }
+	uint64_t countBelow(uint64_t value);
+	uint64_t percentile(double p);
+	void reset();
+};
+
+
+typedef std::function<void()> MetricCollector;
+
+
+class Metrics {
+	struct Entry {
+		MetricType type;
+		std::string help;
+		std::unique_ptr<MetricCounter> counter;
+		std::unique_ptr<MetricGauge> gauge;
+		std::unique_ptr<MetricHistogram> histogram;
+	};
+
+	struct Registry {
+		std::mutex mutex;
+		std::map<std::string, Entry> entries;
+		std::vector<MetricCollector> collectors;
+	};
+
+	static Registry& registry();
+	static Entry* find(const std::string &name, MetricType type, const std::string &help);
+
+public:
+	static MetricCounter* counter(const std::string &name, const std::string &help);
+	static MetricGauge* gauge(const std::string &name, const std::string &help);
+	static MetricHistogram* histogram(const std::string &name, const std::string &help);
+	static void addCollector(MetricCollector collector);
+	static std::string exportText();
+};
+
+#endif
@@ -0,0 +1,85 @@
+/*
+	metricsserver.cpp - Implementation of the metrics HTTP server.
+
+	Revision 0
+*/
+
+
+#include "metricsserver.h"
+#include "metrics.h"
+#include "logging.h"
+
+#include <Poco/Net/HTTPRequestHandler.h>
+#include <Poco/Net/HTTPRequestHandlerFactory.h>
+#include <Poco/Net/HTTPServerParams.h>
+#include <Poco/Net/HTTPServerRequest.h>
+#include <Poco/Net/HTTPServerResponse.h>
+#include <Poco/Net/ServerSocket.h>
+#include <Poco/Exception.h>
+
+
+class MetricsRequestHandler : public Poco::Net::HTTPRequestHandler {
+public:
+	void handleRequest(Poco::Net::HTTPServerRequest &request, 
+										Poco::Net::HTTPServerResponse &response) {
+		if (request.getURI() != "/metrics") {
+			response.setStatusAndReason(Poco::Net::HTTPResponse::HTTP_NOT_FOUND);
+			response.send();
+			return;
+		}
+		
+		std::string text = Metrics::exportText();
+		response.setContentType("text/plain; version=0.0.4");
+		response.setContentLength(text.size());
+		response.send() << text;
+	}
+};
+
+
+class MetricsRequestHandlerFactory : public Poco::Net::HTTPRequestHandlerFactory {
+public:
+	Poco::Net::HTTPRequestHandler* createRequestHandler(
+										const Poco::Net::HTTPServerRequest &request) {
+		return new MetricsRequestHandler;
+	}
+};
+
+
+// --- DESTRUCTOR ---
+MetricsServer::~MetricsServer() {
+	stop();
+}
+
+
+// --- START ---
+// Starts listening on 'port'. Returns false if the port could not be opened.
+bool MetricsServer::start(uint16_t port) {
+	if (server) { return false; }
+	
+	try {
+		Poco::Net::ServerSocket socket(port);
+		Poco::Net::HTTPServerParams* params = new Poco::Net::HTTPServerParams;
+		params->setMaxThreads(2);
+		params->setKeepAlive(false);
+		server.reset(new Poco::Net::HTTPServer(new MetricsRequestHandlerFactory, socket, params));
+		server->start();
+	}
+	catch (Poco::Exception &e) {
+		NC_LOG_ERROR(LOG_SUB_CORE, "Failed to start metrics server on port %u: %s", 
+																port, e.displayText().c_str());
+		server.reset();
+		return false;
+	}
+	
+	NC_LOG_INFO(LOG_SUB_CORE, "Serving metrics on port %u.", port);
+	return true;
+}
+
+
+// --- STOP ---
+void MetricsServer::stop() {
+	if (!server) { return; }
+	
+	server->stopAll(true);
+	server.reset();
+}
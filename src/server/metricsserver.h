@@ -0,0 +1,35 @@
+/*
+	metricsserver.h - Header for the metrics HTTP server.
+
+	Revision 0
+
+	Features:
+			- Serves the Metrics export as plain text on GET /metrics, for Prometheus and for a
+				quick look with curl.
+
+	Notes:
+			- Listens on all interfaces on the configured port. Other paths return a 404.
+*/
+
+
+#ifndef METRICSSERVER_H
+#define METRICSSERVER_H
+
+
+#include <cstdint>
+#include <memory>
+
+#include <Poco/Net/HTTPServer.h>
+
+
+class MetricsServer {
+	std::unique_ptr<Poco::Net::HTTPServer> server;
+
+public:
+	~MetricsServer();
+
+	bool start(uint16_t port);
+	void stop();
+};
+
+#endif
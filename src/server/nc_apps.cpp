@@ -27,7 +27,7 @@
 #include <Poco/Timestamp.h>
 
 #include <nymph/nymph.h>
-#include "databuffer.h"
+#include "session.h"
 
 #include <angelscript/json/json.h>
 #include <angelscript/regexp/regexp.h>
@@ -253,7 +253,7 @@ void NCApps::clientSend(uint32_t id, std::string message) {
 	// Send a message to a client for an app, if the cliend ID exists.
 	std::vector<NymphType*> values;
 	std::string result;
-	if (!NymphRemoteClient::callCallback(DataBuffer::getSessionHandle(), "ReceiveFromAppCallback", 
+	if (!NymphRemoteClient::callCallback(SessionManager::getActiveHandle(), "ReceiveFromAppCallback", 
 																				values, result)) {
 		std::cerr << "Calling callback failed: " << result << std::endl;
 		return;
@@ -341,7 +341,7 @@ bool NCApps::streamTrack(std::string url) {
 	// TODO: allow to cancel any currently playing track/empty queue?
 	/* if (playerStarted) {
 		// Add to queue.
-		DataBuffer::addStreamTrack(url);
+		SessionManager::addStreamTrack(url);
 		
 		return true;
 	}
@@ -0,0 +1,8 @@
+
+TARGET_ARCH = armv7
+TARGET_SOC = bcm2836
+
+PLATFORM_FLAGS = -mcpu=cortex-a7 -mfpu=neon-vfpv4 -mfloat-abi=hard -mtune=cortex-a7
+
+# Four cores: keep HEVC frame threading from taking the cores the audio output needs.
+PLATFORM_FLAGS += -DDECODER_THREADS_DEFAULT='"hevc:frame:2,*:auto:3"'
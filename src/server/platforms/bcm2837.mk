@@ -0,0 +1,8 @@
+
+TARGET_ARCH = armv8
+TARGET_SOC = bcm2837
+
+PLATFORM_FLAGS = -mcpu=cortex-a53 -mfloat-abi=hard -mfpu=neon-fp-armv8 -mneon-for-64bits -mtune=cortex-a53
+
+# Four cores: keep HEVC frame threading from taking the cores the audio output needs.
+PLATFORM_FLAGS += -DDECODER_THREADS_DEFAULT='"hevc:frame:2,*:auto:3"'
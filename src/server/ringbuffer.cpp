@@ -0,0 +1,351 @@
+/*
+	ringbuffer.cpp - Implementation of the RingBuffer class.
+
+	Revision 0
+
+	Notes:
+			- The producer only ever stores 'head' and the consumer only ever stores 'tail' and
+				'low'. Each side publishes its counter with release semantics after the memcpy, and
+				the other side loads it with acquire semantics before touching the data.
+			- The producer never writes past 'low' + capacity. As 'low' only moves forward, all
+				data in the range ['low', 'head') stays valid, which is what makes seeking back
+				into the retained window safe without any locking.
+			- If 'pin' is set below 'low', the producer doesn't write past 'pin' + capacity 
+				instead. This keeps data valid after the consumer has read it.
+			- Data written past 'head' is tracked in 'pending', which is only accessed by the 
+				producer. It becomes visible to the consumer once 'head' moves over it.
+*/
+
+
+#include "ringbuffer.h"
+
+#include <cstring>
+#include <iterator>
+
+
+// --- DESTRUCTOR ---
+RingBuffer::~RingBuffer() {
+	cleanup();
+}
+
+
+// --- INIT ---
+// Allocates a new buffer of 'capacity' bytes. Any existing buffer is released first.
+// Up to 'retain' bytes of already read data are kept available for seeking back into. This must
+// be less than the capacity.
+// Returns false on error, otherwise true.
+bool RingBuffer::init(uint32_t capacity, uint32_t retain) {
+	cleanup();
+	if (capacity == 0 || retain >= capacity) { return false; }
+
+	buffer = new uint8_t[capacity];
+	this->capacity = capacity;
+	this->retain = retain;
+	reset(0);
+
+	return true;
+}
+
+
+// --- CLEAN UP ---
+void RingBuffer::cleanup() {
+	if (buffer != 0) {
+		delete[] buffer;
+		buffer = 0;
+	}
+
+	capacity = 0;
+}
+
+
+// --- RESET ---
+// Empties the buffer and sets both the read and write position to 'position'.
+void RingBuffer::reset(uint64_t position) {
+	lowCache = position;
+	headCache = position;
+	tail.store(position, std::memory_order_relaxed);
+	low.store(position, std::memory_order_relaxed);
+	head.store(position, std::memory_order_release);
+	pending.clear();
+}
+
+
+// --- COPY IN ---
+// Copies 'length' bytes into the buffer at absolute 'position', in at most two parts: up to the 
+// end of the buffer, then from the start.
+void RingBuffer::copyIn(uint64_t position, const uint8_t* data, uint32_t length) {
+	const uint32_t offset = (uint32_t) (position % capacity);
+	const uint32_t first = (capacity - offset < length) ? capacity - offset : length;
+	memcpy(buffer + offset, data, first);
+	if (first < length) {
+		memcpy(buffer, data + first, length - first);
+	}
+}
+
+
+// --- ADVANCE ---
+// Moves the write position 'h' over any pending ranges which it has reached.
+// Returns the new write position.
+uint64_t RingBuffer::advance(uint64_t h) {
+	while (!pending.empty() && pending.begin()->first <= h) {
+		if (pending.begin()->second > h) { h = pending.begin()->second; }
+		pending.erase(pending.begin());
+	}
+	
+	return h;
+}
+
+
+// --- LIMIT ---
+// Returns the position up to which the producer may write. Producer thread only.
+uint64_t RingBuffer::limit() {
+	lowCache = low.load(std::memory_order_acquire);
+	const uint64_t p = pin.load(std::memory_order_acquire);
+	
+	return ((p < lowCache) ? p : lowCache) + capacity;
+}
+
+
+// --- WRITE ---
+// Writes up to 'length' bytes into the buffer. Producer thread only.
+// Returns the number of bytes written, which is less than 'length' if the buffer is full.
+uint32_t RingBuffer::write(const uint8_t* data, uint32_t length) {
+	RingBufferSpan spans[2];
+	length = reserve(length, spans);
+	if (length == 0) { return 0; }
+	
+	memcpy(spans[0].data, data, spans[0].length);
+	if (spans[1].length > 0) {
+		memcpy(spans[1].data, data + spans[0].length, spans[1].length);
+	}
+	
+	commit(length);
+
+	return length;
+}
+
+
+// --- RESERVE ---
+// Provides direct access to up to 'length' bytes of free space at the write position, in up to
+// two spans, the second one being empty unless the range wraps around. The data written into the
+// spans becomes readable with commit(). Producer thread only.
+// Returns the total number of bytes in the spans, which is less than 'length' if the buffer is 
+// full.
+uint32_t RingBuffer::reserve(uint32_t length, RingBufferSpan spans[2]) {
+	spans[0].length = 0;
+	spans[1].length = 0;
+	if (buffer == 0) { return 0; }
+
+	const uint64_t h = head.load(std::memory_order_relaxed);
+	uint64_t space = capacity - (h - lowCache);
+	if (space < length || pin.load(std::memory_order_relaxed) != UINT64_MAX) {
+		// Cached low position is stale, or a pin is set. Refresh the limit before giving up on 
+		// any of the data.
+		const uint64_t l = limit();
+		space = (l > h) ? l - h : 0;
+	}
+
+	if (length > space) { length = (uint32_t) space; }
+	if (length == 0) { return 0; }
+
+	const uint32_t offset = (uint32_t) (h % capacity);
+	spans[0].data = buffer + offset;
+	spans[0].length = (capacity - offset < length) ? capacity - offset : length;
+	spans[1].data = buffer;
+	spans[1].length = length - spans[0].length;
+
+	return length;
+}
+
+
+// --- COMMIT ---
+// Makes 'length' bytes written into the spans returned by reserve() available for reading.
+// Producer thread only.
+void RingBuffer::commit(uint32_t length) {
+	const uint64_t h = head.load(std::memory_order_relaxed) + length;
+	head.store(pending.empty() ? h : advance(h), std::memory_order_release);
+}
+
+
+// --- WRITE AT ---
+// Writes up to 'length' bytes for absolute 'position', which may lie past the write position. 
+// Such data is held back until the data before it has been written. Producer thread only.
+// Returns the number of bytes accepted, which is less than 'length' if part of the range lies 
+// before the write position or beyond the free space.
+uint32_t RingBuffer::writeAt(uint64_t position, const uint8_t* data, uint32_t length) {
+	if (buffer == 0) { return 0; }
+	
+	const uint64_t h = head.load(std::memory_order_relaxed);
+	if (position < h) {
+		// Skip the part we already have.
+		if (h - position >= length) { return 0; }
+		data += h - position;
+		length -= (uint32_t) (h - position);
+		position = h;
+	}
+	
+	const uint64_t l = limit();
+	if (position >= l) { return 0; }
+	if (position + length > l) { length = (uint32_t) (l - position); }
+	if (length == 0) { return 0; }
+	
+	copyIn(position, data, length);
+	
+	// Record the range, merging it with any pending ranges it touches.
+	uint64_t start = position;
+	uint64_t end = position + length;
+	std::map<uint64_t, uint64_t>::iterator it = pending.upper_bound(start);
+	if (it != pending.begin()) {
+		std::map<uint64_t, uint64_t>::iterator prev = std::prev(it);
+		if (prev->second >= start) { 
+			start = prev->first;
+			if (prev->second > end) { end = prev->second; }
+			it = pending.erase(prev);
+		}
+	}
+	
+	while (it != pending.end() && it->first <= end) {
+		if (it->second > end) { end = it->second; }
+		it = pending.erase(it);
+	}
+	
+	pending.insert(std::pair<uint64_t, uint64_t>(start, end));
+	
+	const uint64_t nh = advance(h);
+	if (nh != h) { head.store(nh, std::memory_order_release); }
+	
+	return length;
+}
+
+
+// --- READ ---
+// Reads up to 'len' bytes from the buffer into 'bytes'. Consumer thread only.
+// Returns the number of bytes read, which is 0 if the buffer is empty.
+uint32_t RingBuffer::read(uint8_t* bytes, uint32_t len) {
+	if (buffer == 0) { return 0; }
+
+	const uint64_t t = tail.load(std::memory_order_relaxed);
+	uint64_t available = headCache - t;
+	if (available < len) {
+		headCache = head.load(std::memory_order_acquire);
+		available = headCache - t;
+	}
+
+	if (len > available) { len = (uint32_t) available; }
+	if (len == 0) { return 0; }
+
+	const uint32_t offset = (uint32_t) (t % capacity);
+	const uint32_t first = (capacity - offset < len) ? capacity - offset : len;
+	memcpy(bytes, buffer + offset, first);
+	if (first < len) {
+		memcpy(bytes + first, buffer, len - first);
+	}
+
+	tail.store(t + len, std::memory_order_release);
+	
+	// Release the part of the retained window which has fallen behind.
+	if (t + len > retain && t + len - retain > low.load(std::memory_order_relaxed)) {
+		low.store(t + len - retain, std::memory_order_release);
+	}
+
+	return len;
+}
+
+
+// --- SEEK ---
+// Moves the read position to 'position', which must lie within ['low', 'head'], i.e. inside the 
+// retained window or the unread data. Consumer thread only.
+// Returns false if the position is not in the buffer, in which case nothing changes.
+bool RingBuffer::seek(uint64_t position) {
+	if (buffer == 0) { return false; }
+	
+	headCache = head.load(std::memory_order_acquire);
+	const uint64_t l = low.load(std::memory_order_relaxed);
+	if (position < l || position > headCache) { return false; }
+	
+	tail.store(position, std::memory_order_release);
+	if (position > retain && position - retain > l) {
+		low.store(position - retain, std::memory_order_release);
+	}
+	
+	return true;
+}
+
+
+// --- PEEK ---
+// Provides direct access to up to 'len' bytes starting at 'position', without moving the read 
+// position. The data is returned in up to two spans, the second one being empty unless the range
+// wraps around. Consumer thread only, or the producer while the writers are blocked.
+// Returns the total number of bytes in the spans, which is 0 if 'position' is not in the buffer.
+uint32_t RingBuffer::peek(uint64_t position, uint32_t len, RingBufferSpan spans[2]) const {
+	spans[0].length = 0;
+	spans[1].length = 0;
+	if (buffer == 0) { return 0; }
+	
+	const uint64_t h = head.load(std::memory_order_acquire);
+	const uint64_t l = low.load(std::memory_order_relaxed);
+	if (position < l || position >= h) { return 0; }
+	if (h - position < len) { len = (uint32_t) (h - position); }
+	
+	const uint32_t offset = (uint32_t) (position % capacity);
+	spans[0].data = buffer + offset;
+	spans[0].length = (capacity - offset < len) ? capacity - offset : len;
+	spans[1].data = buffer;
+	spans[1].length = len - spans[0].length;
+	
+	return len;
+}
+
+
+// --- SET PIN ---
+// Keeps the data from 'position' onwards from being overwritten, even after it has been read, 
+// until the pin is moved or cleared. UINT64_MAX clears the pin. The caller has to ensure that
+// 'position' is not below the current 'low' position. Safe to call from either side.
+void RingBuffer::setPin(uint64_t position) {
+	pin.store(position, std::memory_order_release);
+}
+
+
+// --- UNREAD ---
+// Number of bytes written, but not yet read. Safe to call from either side.
+uint32_t RingBuffer::unread() const {
+	const uint64_t t = tail.load(std::memory_order_acquire);
+	const uint64_t h = head.load(std::memory_order_acquire);
+	return (h > t) ? (uint32_t) (h - t) : 0;
+}
+
+
+// --- FREE ---
+// Number of bytes which can currently be written, without overwriting unread data or the 
+// retained window. Safe to call from either side.
+uint32_t RingBuffer::free() const {
+	const uint64_t l = low.load(std::memory_order_acquire);
+	const uint64_t h = head.load(std::memory_order_acquire);
+	return (h > l) ? capacity - (uint32_t) (h - l) : capacity;
+}
+
+
+// --- READ POSITION ---
+uint64_t RingBuffer::readPosition() const {
+	return tail.load(std::memory_order_acquire);
+}
+
+
+// --- WRITE POSITION ---
+uint64_t RingBuffer::writePosition() const {
+	return head.load(std::memory_order_acquire);
+}
+
+
+// --- LOW POSITION ---
+// Lowest position still available for reading, i.e. the start of the retained window.
+uint64_t RingBuffer::lowPosition() const {
+	return low.load(std::memory_order_acquire);
+}
+
+
+// --- PIN POSITION ---
+// Position set with setPin(), or UINT64_MAX if no pin is set.
+uint64_t RingBuffer::pinPosition() const {
+	return pin.load(std::memory_order_acquire);
+}
@@ -0,0 +1,95 @@
+/*
+	ringbuffer.h - Header for the RingBuffer class.
+
+	Revision 0
+
+	Features:
+			- Lock-free single-producer, single-consumer (SPSC) byte ring buffer.
+			- Read and write positions are absolute 64-bit byte counters, which allows them to
+				map directly onto file offsets.
+			- Optionally retains a window of already read data, which the consumer can seek
+				back into.
+			- Accepts data for positions past the write position, e.g. out of order responses 
+				to pipelined requests. The write position advances once the gap has been filled.
+			- Writable spans can be reserved and committed, so that data can be written in place.
+			- A pin keeps written data from being overwritten while other threads send it on.
+
+	Notes:
+			- Exactly one thread may call write() and exactly one thread may call read()
+				concurrently. reset() and init() require both sides to be quiescent.
+*/
+
+
+#ifndef RINGBUFFER_H
+#define RINGBUFFER_H
+
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+
+
+struct RingBufferSpan {
+	uint8_t* data;
+	uint32_t length;
+};
+
+
+// Size of a cache line on the targeted platforms. Used to keep the producer and consumer
+// counters from false sharing.
+#define RINGBUFFER_CACHE_LINE 64
+
+
+class RingBuffer {
+	uint8_t* buffer = 0;		// Pointer to buffer.
+	uint32_t capacity = 0;		// Total capacity of buffer in bytes.
+	uint32_t retain = 0;		// Number of read bytes to keep available behind the read position.
+
+	// Producer side. 'head' is the absolute position of the next byte to be written.
+	alignas(RINGBUFFER_CACHE_LINE) std::atomic<uint64_t> head = { 0 };
+	uint64_t lowCache = 0;		// Producer's last observed value of 'low'.
+	std::map<uint64_t, uint64_t> pending;	// Ranges written past 'head', start to end.
+	std::atomic<uint64_t> pin = { UINT64_MAX };	// Lowest position which may not be overwritten.
+
+	// Consumer side. 'tail' is the absolute position of the next byte to be read, 'low' the
+	// lowest position which the producer may not overwrite yet.
+	alignas(RINGBUFFER_CACHE_LINE) std::atomic<uint64_t> tail = { 0 };
+	std::atomic<uint64_t> low = { 0 };
+	uint64_t headCache = 0;		// Consumer's last observed value of 'head'.
+
+	// Pad the end so that neighbouring objects don't share the consumer's cache line.
+	uint8_t padding[RINGBUFFER_CACHE_LINE - sizeof(uint64_t)];
+
+	void copyIn(uint64_t position, const uint8_t* data, uint32_t length);
+	uint64_t advance(uint64_t h);
+	uint64_t limit();
+
+public:
+	RingBuffer() { }
+	~RingBuffer();
+	RingBuffer(const RingBuffer&) = delete;
+	RingBuffer& operator=(const RingBuffer&) = delete;
+
+	bool init(uint32_t capacity, uint32_t retain = 0);
+	void cleanup();
+	void reset(uint64_t position = 0);
+
+	uint32_t write(const uint8_t* data, uint32_t length);
+	uint32_t reserve(uint32_t length, RingBufferSpan spans[2]);
+	void commit(uint32_t length);
+	uint32_t writeAt(uint64_t position, const uint8_t* data, uint32_t length);
+	uint32_t read(uint8_t* bytes, uint32_t len);
+	bool seek(uint64_t position);
+	uint32_t peek(uint64_t position, uint32_t len, RingBufferSpan spans[2]) const;
+	void setPin(uint64_t position);
+
+	uint32_t size() const { return capacity; }
+	uint32_t unread() const;
+	uint32_t free() const;
+	uint64_t readPosition() const;
+	uint64_t writePosition() const;
+	uint64_t lowPosition() const;
+	uint64_t pinPosition() const;
+};
+
+#endif
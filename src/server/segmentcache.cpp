@@ -0,0 +1,210 @@
+/*
+	segmentcache.cpp - Implementation of the SegmentCache class.
+
+	Revision 0
+
+	Notes:
+			- Each segment covers the file range [key * segmentSize, (key + 1) * segmentSize) and
+				holds a single contiguous valid range within it.
+*/
+
+
+#include "segmentcache.h"
+
+#include <cstring>
+
+
+// --- DESTRUCTOR ---
+SegmentCache::~SegmentCache() {
+	cleanup();
+}
+
+
+// --- INIT ---
+// Allocates the arena for as many segments of 'segmentSize' bytes as fit into 'budget' bytes.
+// Returns false if fewer than two segments fit, in which case the cache stays disabled.
+bool SegmentCache::init(uint32_t budget, uint32_t segmentSize) {
+	cleanup();
+	if (segmentSize == 0 || budget / segmentSize < 2) { return false; }
+
+	uint32_t count = budget / segmentSize;
+	arena = new uint8_t[(size_t) count * segmentSize];
+	this->segmentSize = segmentSize;
+	segments.resize(count);
+	for (uint32_t i = 0; i < count; ++i) {
+		segments[i].data = arena + ((size_t) i * segmentSize);
+	}
+
+	clear();
+
+	return true;
+}
+
+
+// --- CLEAN UP ---
+void SegmentCache::cleanup() {
+	std::lock_guard<std::mutex> lk(mutex);
+	if (arena != 0) {
+		delete[] arena;
+		arena = 0;
+	}
+
+	segments.clear();
+	index.clear();
+	lru.clear();
+	freeSlots.clear();
+	segmentSize = 0;
+}
+
+
+// --- CLEAR ---
+// Drops all cached data, e.g. when a new file is started. Keeps the arena and the counters.
+void SegmentCache::clear() {
+	std::lock_guard<std::mutex> lk(mutex);
+	index.clear();
+	lru.clear();
+	freeSlots.clear();
+	for (uint32_t i = 0; i < segments.size(); ++i) {
+		segments[i].used = false;
+		segments[i].low = 0;
+		segments[i].high = 0;
+		freeSlots.push_back((uint32_t) segments.size() - 1 - i);
+	}
+}
+
+
+// --- ACQUIRE ---
+// Returns the segment for 'key', assigning a free or least recently used slot if it's not in the
+// cache yet. Mutex must be held.
+SegmentCache::Segment* SegmentCache::acquire(uint64_t key) {
+	std::map<uint64_t, uint32_t>::iterator it = index.find(key);
+	if (it != index.end()) { return &segments[it->second]; }
+
+	uint32_t slot;
+	if (!freeSlots.empty()) {
+		slot = freeSlots.back();
+		freeSlots.pop_back();
+	}
+	else {
+		// Evict the least recently used segment.
+		slot = lru.back();
+		lru.pop_back();
+		index.erase(segments[slot].key);
+		evictions++;
+	}
+
+	Segment &seg = segments[slot];
+	seg.key = key;
+	seg.low = 0;
+	seg.high = 0;
+	seg.used = true;
+	lru.push_front(slot);
+	seg.lru = lru.begin();
+	index.insert(std::pair<uint64_t, uint32_t>(key, slot));
+
+	return &seg;
+}
+
+
+// --- TOUCH ---
+// Marks the segment as most recently used. Mutex must be held.
+void SegmentCache::touch(Segment &seg) {
+	lru.splice(lru.begin(), lru, seg.lru);
+}
+
+
+// --- INSERT ---
+// Copies file data starting at 'offset' into the cache.
+void SegmentCache::insert(uint64_t offset, const uint8_t* data, uint32_t length) {
+	std::lock_guard<std::mutex> lk(mutex);
+	if (arena == 0) { return; }
+
+	while (length > 0) {
+		uint64_t key = offset / segmentSize;
+		uint32_t start = (uint32_t) (offset % segmentSize);
+		uint32_t n = segmentSize - start;
+		if (n > length) { n = length; }
+
+		Segment* seg = acquire(key);
+		memcpy(seg->data + start, data, n);
+		if (seg->high == seg->low || start > seg->high || start + n < seg->low) {
+			// Empty, or not adjacent to the existing valid range. Replace it.
+			seg->low = start;
+			seg->high = start + n;
+		}
+		else {
+			// Extend the valid range.
+			if (start < seg->low) 		{ seg->low = start; }
+			if (start + n > seg->high) 	{ seg->high = start + n; }
+		}
+
+		touch(*seg);
+		offset += n;
+		data += n;
+		length -= n;
+	}
+}
+
+
+// --- SPAN ---
+// Sets 'data' to the cached bytes at file 'offset', within the segment containing it.
+// The pointer stays valid until the next call to insert().
+// Returns the number of bytes available at 'data', or 0 if 'offset' is not cached.
+uint32_t SegmentCache::span(uint64_t offset, const uint8_t* &data) {
+	std::lock_guard<std::mutex> lk(mutex);
+	if (arena == 0) { return 0; }
+
+	std::map<uint64_t, uint32_t>::iterator it = index.find(offset / segmentSize);
+	if (it == index.end()) { return 0; }
+
+	Segment &seg = segments[it->second];
+	uint32_t start = (uint32_t) (offset % segmentSize);
+	if (start < seg.low || start >= seg.high) { return 0; }
+
+	touch(seg);
+	data = seg.data + start;
+
+	return seg.high - start;
+}
+
+
+// --- LOOKUP ---
+// Returns the number of contiguous cached bytes starting at file 'offset', up to 'max' bytes.
+// Updates the hit & miss counters.
+uint64_t SegmentCache::lookup(uint64_t offset, uint64_t max) {
+	std::lock_guard<std::mutex> lk(mutex);
+	if (arena == 0) { return 0; }
+
+	uint64_t run = 0;
+	while (run < max) {
+		std::map<uint64_t, uint32_t>::iterator it = index.find(offset / segmentSize);
+		if (it == index.end()) { break; }
+
+		Segment &seg = segments[it->second];
+		uint32_t start = (uint32_t) (offset % segmentSize);
+		if (start < seg.low || start >= seg.high) { break; }
+
+		run += seg.high - start;
+		offset += seg.high - start;
+		if (seg.high < segmentSize) { break; }
+	}
+
+	if (run > 0) 	{ hits++; }
+	else 			{ misses++; }
+
+	return (run > max) ? max : run;
+}
+
+
+// --- STATS ---
+SegmentCacheStats SegmentCache::stats() {
+	std::lock_guard<std::mutex> lk(mutex);
+	SegmentCacheStats st;
+	st.hits = hits;
+	st.misses = misses;
+	st.evictions = evictions;
+	st.segments = (uint32_t) segments.size();
+	st.used = (uint32_t) index.size();
+
+	return st;
+}
@@ -0,0 +1,82 @@
+/*
+	segmentcache.h - Header for the SegmentCache class.
+
+	Revision 0
+
+	Features:
+			- Caches disjoint byte ranges of a media file in fixed-size segments, taken from a
+				single pre-allocated arena.
+			- Segments are keyed by file offset and evicted in least recently used order.
+			- Keeps hit, miss and eviction counters.
+
+	Notes:
+			- Used by DataBuffer to keep data which would otherwise be lost when the ring buffer is
+				reset on an out-of-buffer seek, e.g. the index at the end of an MP4 file.
+*/
+
+
+#ifndef SEGMENTCACHE_H
+#define SEGMENTCACHE_H
+
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <mutex>
+#include <vector>
+
+
+struct SegmentCacheStats {
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t evictions;
+	uint32_t segments;		// Total number of segments.
+	uint32_t used;			// Number of segments holding data.
+};
+
+
+class SegmentCache {
+	struct Segment {
+		uint64_t key;		// Segment index in the file (file offset / segment size).
+		uint32_t low;		// First valid byte in the segment.
+		uint32_t high;		// Last valid byte in the segment, plus one.
+		uint8_t* data;		// Start of this segment in the arena.
+		std::list<uint32_t>::iterator lru;
+		bool used;
+	};
+
+	uint8_t* arena = 0;
+	uint32_t segmentSize = 0;
+	std::vector<Segment> segments;
+	std::map<uint64_t, uint32_t> index;	// Segment key to slot in 'segments'.
+	std::list<uint32_t> lru;				// Used slots, most recently used first.
+	std::vector<uint32_t> freeSlots;
+	std::mutex mutex;
+
+	std::atomic<uint64_t> hits = { 0 };
+	std::atomic<uint64_t> misses = { 0 };
+	std::atomic<uint64_t> evictions = { 0 };
+
+	Segment* acquire(uint64_t key);
+	void touch(Segment &seg);
+
+public:
+	SegmentCache() { }
+	~SegmentCache();
+	SegmentCache(const SegmentCache&) = delete;
+	SegmentCache& operator=(const SegmentCache&) = delete;
+
+	bool init(uint32_t budget, uint32_t segmentSize);
+	void cleanup();
+	void clear();
+	bool enabled() { return arena != 0; }
+
+	void insert(uint64_t offset, const uint8_t* data, uint32_t length);
+	uint32_t span(uint64_t offset, const uint8_t* &data);
+	uint64_t lookup(uint64_t offset, uint64_t max);
+
+	SegmentCacheStats stats();
+};
+
+#endif
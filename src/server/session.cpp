@@ -0,0 +1,299 @@
+/*
+	session.cpp - Implementation of the cast session classes.
+	
+	Revision 0
+	
+	Notes:
+			- A session's data buffer is shared with the player while it plays the session. The
+				buffer thus stays valid if the session gets removed during playback.
+*/
+
+
+//#define DEBUG 1
+
+#include "session.h"
+
+#ifdef DEBUG
+#include <iostream>
+#endif
+
+
+// Static initialisations.
+std::mutex SessionManager::sessionsMutex;
+std::map<uint32_t, CastSessionPtr> SessionManager::sessions;
+CastSessionPtr SessionManager::active;
+std::atomic<uint32_t> SessionManager::activeHandle = { 0 };
+SessionConfig SessionManager::config;
+DataRequestHandler SessionManager::requestHandler;
+SeekRequestCallback SessionManager::seekHandler;
+std::mutex SessionManager::streamTrackQueueMutex;
+std::queue<std::string> SessionManager::streamTrackQueue;
+
+
+// --- CONSTRUCTOR ---
+CastSession::CastSession(uint32_t handle) {
+	this->handle = handle;
+	buffer = std::make_shared<DataBuffer>();
+}
+
+
+// --- DESTRUCTOR ---
+CastSession::~CastSession() {
+	stop();
+}
+
+
+// --- INIT ---
+// Allocates the data buffer and configures it for this session.
+// Returns false if the buffer could not be allocated.
+bool CastSession::init(const SessionConfig &config, DataRequestHandler handler,
+															SeekRequestCallback seek) {
+	requestHandler = handler;
+	
+	if (!buffer->init(config.bufferSize)) { return false; }
+	buffer->setBlockSizeLimits(config.blockSizeMin, config.blockSizeMax);
+	buffer->setWatermarks(config.lowWatermark, config.highWatermark);
+	buffer->setRequestWindow(config.requestWindow);
+	buffer->setSeekRequestCallback(seek);
+	buffer->setSessionHandle(handle);
+	buffer->setDataRequestCondition(&requestCV, &requestMutex, &requestPending);
+	
+	running = true;
+	requestThread = std::thread(&CastSession::requestLoop, this);
+	
+	return true;
+}
+
+
+// --- START ---
+// Starts requesting data from the client.
+bool CastSession::start() {
+	return buffer->start();
+}
+
+
+// --- STOP ---
+// Stops requesting data, and wakes up any reader waiting for data from the client.
+void CastSession::stop() {
+	buffer->abort();
+	
+	if (!running) { return; }
+	
+	requestMutex.lock();
+	running = false;
+	requestMutex.unlock();
+	requestCV.notify_one();
+	
+	if (requestThread.joinable()) { requestThread.join(); }
+}
+
+
+// --- REQUEST LOOP ---
+// Waits until the data buffer signals that it has room for more data, then sends as many requests
+// as the request window and the free space in the buffer allow.
+void CastSession::requestLoop() {
+	std::unique_lock<std::mutex> lk(requestMutex);
+	while (running) {
+		requestCV.wait(lk, [this]() { return requestPending || !running; });
+		if (!running) { break; }
+		
+		requestPending = false;
+		lk.unlock();
+		uint64_t offset;
+		uint32_t length;
+		while (running && buffer->nextRequest(offset, length)) {
+#ifdef DEBUG
+			std::cout << "Session " << handle << ": requesting " << length << " bytes at "
+						<< offset << "." << std::endl;
+#endif
+			if (!requestHandler || !requestHandler(handle, offset, length)) { break; }
+		}
+		
+		lk.lock();
+	}
+}
+
+
+// --- GET HANDLE ---
+uint32_t CastSession::getHandle() {
+	return handle;
+}
+
+
+// --- GET BUFFER ---
+std::shared_ptr<DataBuffer> CastSession::getBuffer() {
+	return buffer;
+}
+
+
+// --- READY ---
+// Returns true if the session has data ready for playback.
+bool CastSession::ready() {
+	return buffer->getUnread() > 0 || buffer->isEof();
+}
+
+
+// --- INIT ---
+// Sets the configuration and handlers for new sessions.
+void SessionManager::init(const SessionConfig &config, DataRequestHandler handler,
+																SeekRequestCallback seek) {
+	std::lock_guard<std::mutex> lk(sessionsMutex);
+	SessionManager::config = config;
+	requestHandler = handler;
+	seekHandler = seek;
+}
+
+
+// --- CLEAN UP ---
+// Stops and removes all sessions.
+void SessionManager::cleanup() {
+	std::map<uint32_t, CastSessionPtr> old;
+	sessionsMutex.lock();
+	old.swap(sessions);
+	active.reset();
+	sessionsMutex.unlock();
+	
+	std::map<uint32_t, CastSessionPtr>::iterator it;
+	for (it = old.begin(); it != old.end(); ++it) {
+		it->second->stop();
+	}
+}
+
+
+// --- CREATE ---
+// Creates a new session for the client with the given handle, replacing any existing session of
+// this client.
+// Returns an empty pointer if the maximum number of sessions has been reached, or the buffer could
+// not be allocated.
+CastSessionPtr SessionManager::create(uint32_t handle) {
+	remove(handle);
+	
+	std::lock_guard<std::mutex> lk(sessionsMutex);
+	if (sessions.size() >= config.maxSessions) { return CastSessionPtr(); }
+	
+	CastSessionPtr session = std::make_shared<CastSession>(handle);
+	if (!session->init(config, requestHandler, seekHandler)) { return CastSessionPtr(); }
+	sessions.insert(std::pair<uint32_t, CastSessionPtr>(handle, session));
+	
+	return session;
+}
+
+
+// --- GET ---
+// Returns the session of the client with the given handle, or an empty pointer.
+CastSessionPtr SessionManager::get(uint32_t handle) {
+	std::lock_guard<std::mutex> lk(sessionsMutex);
+	std::map<uint32_t, CastSessionPtr>::iterator it = sessions.find(handle);
+	if (it == sessions.end()) { return CastSessionPtr(); }
+	
+	return it->second;
+}
+
+
+// --- REMOVE ---
+// Stops and removes the session of the client with the given handle, if any. If it is the active
+// session, the player's reads from its buffer fail from here on.
+void SessionManager::remove(uint32_t handle) {
+	CastSessionPtr session;
+	sessionsMutex.lock();
+	std::map<uint32_t, CastSessionPtr>::iterator it = sessions.find(handle);
+	if (it != sessions.end()) {
+		session = it->second;
+		sessions.erase(it);
+		if (active == session) { active.reset(); }
+	}
+	
+	sessionsMutex.unlock();
+	
+	if (session) { session->stop(); }
+}
+
+
+// --- GET ACTIVE ---
+// Returns the session which is being played back, or an empty pointer.
+CastSessionPtr SessionManager::getActive() {
+	std::lock_guard<std::mutex> lk(sessionsMutex);
+	return active;
+}
+
+
+// --- SET ACTIVE ---
+// Sets the session which is being played back. An empty pointer clears it.
+void SessionManager::setActive(CastSessionPtr session) {
+	std::lock_guard<std::mutex> lk(sessionsMutex);
+	active = session;
+	if (session) { activeHandle = session->getHandle(); }
+}
+
+
+// --- GET ACTIVE HANDLE ---
+// Returns the handle of the client of the active session, or of the last active session if none
+// is being played back.
+uint32_t SessionManager::getActiveHandle() {
+	return activeHandle;
+}
+
+
+// --- NEXT READY ---
+// Returns a session other than the active one which has data ready for playback, or an empty 
+// pointer.
+CastSessionPtr SessionManager::nextReady() {
+	std::lock_guard<std::mutex> lk(sessionsMutex);
+	std::map<uint32_t, CastSessionPtr>::iterator it;
+	for (it = sessions.begin(); it != sessions.end(); ++it) {
+		if (it->second != active && it->second->ready()) { return it->second; }
+	}
+	
+	return CastSessionPtr();
+}
+
+
+// --- SET REQUEST WINDOW ---
+// Sets the request window for new and existing sessions.
+void SessionManager::setRequestWindow(uint32_t max) {
+	std::lock_guard<std::mutex> lk(sessionsMutex);
+	config.requestWindow = max;
+	std::map<uint32_t, CastSessionPtr>::iterator it;
+	for (it = sessions.begin(); it != sessions.end(); ++it) {
+		it->second->getBuffer()->setRequestWindow(max);
+	}
+}
+
+
+// --- ADD STREAM TRACK ---
+// Add a streaming track to the queue.
+void SessionManager::addStreamTrack(std::string track) {
+	streamTrackQueueMutex.lock();
+	streamTrackQueue.push(track);
+	streamTrackQueueMutex.unlock();
+}
+
+
+// --- HAS STREAM TRACK ---
+bool SessionManager::hasStreamTrack() {
+	std::lock_guard<std::mutex> lk(streamTrackQueueMutex);
+	return !streamTrackQueue.empty();
+}
+
+
+// --- GET STREAM TRACK ---
+// Returns the next stream string in the queue, or an empty string if queue is empty.
+std::string SessionManager::getStreamTrack() {
+	std::lock_guard<std::mutex> lk(streamTrackQueueMutex);
+	if (streamTrackQueue.empty()) { return std::string(); }
+	std::string tStr = streamTrackQueue.front();
+	streamTrackQueue.pop();
+	
+	return tStr;
+}
+
+
+// --- PEEK STREAM TRACK ---
+// Returns the next stream string in the queue without removing it, or an empty string if the queue
+// is empty.
+std::string SessionManager::peekStreamTrack() {
+	std::lock_guard<std::mutex> lk(streamTrackQueueMutex);
+	if (streamTrackQueue.empty()) { return std::string(); }
+	
+	return streamTrackQueue.front();
+}
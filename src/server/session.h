@@ -0,0 +1,108 @@
+/*
+	session.h - Header for the cast session classes.
+	
+	Revision 0
+	
+	Features:
+			- Keeps the state of each client casting to this receiver in its own session.
+			- Every session has its own data buffer and data request thread, so that several
+				clients can buffer media at the same time.
+	
+	Notes:
+			- Only one session is played back at a time: the active session. The others keep
+				buffering until they become the active session.
+*/
+
+
+#ifndef SESSION_H
+#define SESSION_H
+
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+
+#include "databuffer.h"
+
+
+// Sends a data request for 'length' bytes at 'offset' to the client with the given handle.
+// Returns false if the request could not be sent.
+typedef std::function<bool(uint32_t handle, uint64_t offset, uint32_t length)> DataRequestHandler;
+
+
+struct SessionConfig {
+	uint32_t bufferSize = 20971520;		// Size of each session's data buffer, in bytes.
+	uint32_t blockSizeMin = 65536;
+	uint32_t blockSizeMax = 8388608;
+	uint32_t lowWatermark = 25;			// Percentage of the buffer size.
+	uint32_t highWatermark = 75;		// Percentage of the buffer size.
+	uint32_t requestWindow = 4;
+	uint32_t maxSessions = 2;			// Sessions which can buffer at the same time.
+};
+
+
+class CastSession {
+	uint32_t handle;
+	std::shared_ptr<DataBuffer> buffer;
+	DataRequestHandler requestHandler;
+	std::thread requestThread;
+	std::mutex requestMutex;
+	std::condition_variable requestCV;
+	bool requestPending = false;		// Set by the buffer under requestMutex.
+	std::atomic<bool> running = { false };
+	
+	void requestLoop();
+
+public:
+	CastSession(uint32_t handle);
+	~CastSession();
+	
+	bool init(const SessionConfig &config, DataRequestHandler handler, SeekRequestCallback seek);
+	bool start();
+	void stop();
+	uint32_t getHandle();
+	std::shared_ptr<DataBuffer> getBuffer();
+	bool ready();
+};
+
+typedef std::shared_ptr<CastSession> CastSessionPtr;
+
+
+class SessionManager {
+	static std::mutex sessionsMutex;
+	static std::map<uint32_t, CastSessionPtr> sessions;
+	static CastSessionPtr active;
+	static std::atomic<uint32_t> activeHandle;
+	static SessionConfig config;
+	static DataRequestHandler requestHandler;
+	static SeekRequestCallback seekHandler;
+	
+	static std::mutex streamTrackQueueMutex;
+	static std::queue<std::string> streamTrackQueue;
+
+public:
+	static void init(const SessionConfig &config, DataRequestHandler handler,
+															SeekRequestCallback seek);
+	static void cleanup();
+	static CastSessionPtr create(uint32_t handle);
+	static CastSessionPtr get(uint32_t handle);
+	static void remove(uint32_t handle);
+	static CastSessionPtr getActive();
+	static void setActive(CastSessionPtr session);
+	static uint32_t getActiveHandle();
+	static CastSessionPtr nextReady();
+	static void setRequestWindow(uint32_t max);
+	
+	static void addStreamTrack(std::string track);
+	static bool hasStreamTrack();
+	static std::string getStreamTrack();
+	static std::string peekStreamTrack();
+};
+
+#endif
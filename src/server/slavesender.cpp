@@ -0,0 +1,265 @@
+/*
+	slavesender.cpp - Implementation of the slave remote sender class.
+
+	Revision 0
+
+	Notes:
+			- Queued chunks keep their data in the master's buffer from being overwritten. The
+				queue depth thus also limits how much of the buffer a slow slave can hold on to.
+*/
+
+
+//#define DEBUG 1
+
+#include "slavesender.h"
+#include "logging.h"
+
+#include <iostream>
+
+
+// --- CONSTRUCTOR ---
+SlaveSender::SlaveSender(uint32_t handle, const std::string &name, SlaveSendHandler handler,
+														const SlaveSenderConfig &config) {
+	this->handle = handle;
+	this->name = name;
+	this->handler = handler;
+	this->config = config;
+	if (this->config.queueDepth == 0) { this->config.queueDepth = 1; }
+}
+
+
+// --- DESTRUCTOR ---
+SlaveSender::~SlaveSender() {
+	stop();
+}
+
+
+// --- START ---
+// Starts the send thread.
+bool SlaveSender::start() {
+	std::unique_lock<std::mutex> lk(queueMutex);
+	if (running) { return false; }
+
+	running = true;
+	sendThread = std::thread(&SlaveSender::run, this);
+
+	return true;
+}
+
+
+// --- STOP ---
+// Stops the send thread. Any data still in the queue is discarded.
+void SlaveSender::stop() {
+	std::deque<SlaveData> discarded;
+	std::unique_lock<std::mutex> lk(queueMutex);
+	running = false;
+	discarded.swap(queue);
+	lk.unlock();
+
+	dataCV.notify_one();
+	spaceCV.notify_all();
+
+	if (sendThread.joinable()) { sendThread.join(); }
+}
+
+
+// --- SEND ---
+// Queues a chunk of the master's buffer for sending to the slave. The buffer is kept alive until
+// the chunk has been sent.
+// Returns false if the slave has been dropped.
+bool SlaveSender::send(std::shared_ptr<DataBuffer> buffer, MediaChunkPtr chunk, int64_t then) {
+	SlaveData item;
+	item.buffer = buffer;
+	item.chunk = chunk;
+	item.done = chunk->done;
+	item.then = then;
+
+	return enqueue(item);
+}
+
+
+// Queues a copy of the data for sending to the slave.
+// Returns false if the slave has been dropped.
+bool SlaveSender::send(const char* data, uint32_t length, bool done, int64_t then) {
+	SlaveData item;
+	item.data.assign(data, length);
+	item.done = done;
+	item.then = then;
+
+	return enqueue(item);
+}
+
+
+// --- ENQUEUE ---
+// Adds the item to the queue. If the queue is full, the lag policy decides whether to wait for the
+// slave to catch up, or to drop it.
+bool SlaveSender::enqueue(SlaveData &item) {
+	std::unique_lock<std::mutex> lk(queueMutex);
+	if (dropped || !running) { return false; }
+
+	if (queue.size() >= config.queueDepth) {
+		if (config.policy == SLAVE_LAG_WAIT) {
+			spaceCV.wait_for(lk, std::chrono::milliseconds(config.lagTimeout), [this] {
+				return queue.size() < config.queueDepth || dropped || !running;
+			});
+		}
+
+		if (dropped || !running) { return false; }
+		if (queue.size() >= config.queueDepth) {
+			NC_LOG_WARNING(LOG_SUB_SLAVE, "Slave %s lags behind by %zu blocks. Dropping it.", 
+							name.c_str(), queue.size());
+			lk.unlock();
+			drop();
+			return false;
+		}
+	}
+
+	item.time = std::chrono::steady_clock::now();
+	queue.push_back(std::move(item));
+	if (queue.size() > stats.queuedMax) { stats.queuedMax = queue.size(); }
+	lk.unlock();
+
+	dataCV.notify_one();
+
+	return true;
+}
+
+
+// --- FLUSH ---
+// Waits up to 'timeout' milliseconds for all queued data to be sent.
+// Returns false if the queue was not emptied in time, or the slave got dropped.
+bool SlaveSender::flush(uint32_t timeout) {
+	std::unique_lock<std::mutex> lk(queueMutex);
+	spaceCV.wait_for(lk, std::chrono::milliseconds(timeout), [this] {
+		return (queue.empty() && !sending) || dropped || !running;
+	});
+
+	return queue.empty() && !sending && !dropped;
+}
+
+
+// --- DROP ---
+// Stops sending to the slave. Queued chunks are released, so that they no longer hold on to the
+// master's buffer.
+void SlaveSender::drop() {
+	std::deque<SlaveData> discarded;
+	std::unique_lock<std::mutex> lk(queueMutex);
+	dropped = true;
+	discarded.swap(queue);
+	lk.unlock();
+
+	dataCV.notify_one();
+	spaceCV.notify_all();
+}
+
+
+// --- SEND BLOCK ---
+// Sends a block to the slave and updates the statistics.
+bool SlaveSender::sendBlock(const uint8_t* data, uint32_t length, bool done, int64_t then) {
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	if (!handler || !handler(handle, data, length, done, then)) { return false; }
+
+	uint64_t elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+									std::chrono::steady_clock::now() - start).count();
+	if (elapsed == 0) { elapsed = 1; }
+
+	uint64_t sample = ((uint64_t) length * 1000000) / elapsed;
+	if (sample > UINT32_MAX) { sample = UINT32_MAX; }
+
+	std::unique_lock<std::mutex> lk(queueMutex);
+	stats.bytesSent += length;
+	stats.blocksSent++;
+	if (stats.throughput == 0) 	{ stats.throughput = (uint32_t) sample; }
+	else 						{ stats.throughput = (uint32_t) ((3 * (uint64_t) stats.throughput + sample) / 4); }
+	if (stats.sendTime == 0) 	{ stats.sendTime = (uint32_t) elapsed; }
+	else 						{ stats.sendTime = (uint32_t) ((3 * (uint64_t) stats.sendTime + elapsed) / 4); }
+
+	return true;
+}
+
+
+// --- RUN ---
+// Sends the queued data to the slave, in order.
+void SlaveSender::run() {
+	std::unique_lock<std::mutex> lk(queueMutex);
+	while (running && !dropped) {
+		dataCV.wait(lk, [this] { return !queue.empty() || !running || dropped; });
+		if (!running || dropped) { break; }
+
+		SlaveData item = std::move(queue.front());
+		queue.pop_front();
+		sending = true;
+		lk.unlock();
+		spaceCV.notify_all();
+
+		bool ok;
+		if (item.chunk) {
+			// Data which wraps around the end of the buffer is sent in two parts.
+			RingBufferSpan* spans = item.chunk->spans;
+			ok = sendBlock(spans[0].data, spans[0].length, item.done && spans[1].length == 0, 
+																					item.then);
+			if (ok && spans[1].length > 0) {
+				ok = sendBlock(spans[1].data, spans[1].length, item.done, item.then);
+			}
+		}
+		else {
+			ok = sendBlock((const uint8_t*) item.data.data(), item.data.length(), item.done, item.then);
+		}
+
+#ifdef DEBUG
+		std::cout << "Slave " << name << ": sent block, " << (ok ? "OK" : "failed") << "."
+					<< std::endl;
+#endif
+
+		// Release the chunk before taking the lock, as this may wake up the master's buffer.
+		item.chunk.reset();
+		item.buffer.reset();
+
+		if (!ok) {
+			NC_LOG_WARNING(LOG_SUB_SLAVE, "Sending data to slave %s failed. Dropping it.", name.c_str());
+			lk.lock();
+			sending = false;
+			lk.unlock();
+			drop();
+			lk.lock();
+			break;
+		}
+
+		lk.lock();
+		sending = false;
+		if (queue.empty()) { spaceCV.notify_all(); }
+	}
+}
+
+
+// --- IS DROPPED ---
+bool SlaveSender::isDropped() {
+	return dropped;
+}
+
+
+// --- GET HANDLE ---
+uint32_t SlaveSender::getHandle() {
+	return handle;
+}
+
+
+// --- GET NAME ---
+std::string SlaveSender::getName() {
+	return name;
+}
+
+
+// --- GET STATS ---
+SlaveSenderStats SlaveSender::getStats() {
+	std::unique_lock<std::mutex> lk(queueMutex);
+	SlaveSenderStats current = stats;
+	current.queued = queue.size();
+	current.dropped = dropped;
+	if (!queue.empty()) {
+		current.lag = std::chrono::duration_cast<std::chrono::milliseconds>(
+							std::chrono::steady_clock::now() - queue.front().time).count();
+	}
+
+	return current;
+}
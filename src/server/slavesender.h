@@ -0,0 +1,113 @@
+/*
+	slavesender.h - Header for the slave remote sender class.
+
+	Revision 0
+
+	Features:
+			- Sends the media data of a master server to a single slave remote, from its own thread.
+			- Keeps a queue of bounded depth per slave, so that slow slaves do not hold up others.
+			- Keeps throughput and lag statistics for each slave.
+
+	Notes:
+			- A slave which falls too far behind, or which fails to receive data, is dropped. Its
+				stream would otherwise be missing data.
+*/
+
+
+#ifndef SLAVESENDER_H
+#define SLAVESENDER_H
+
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "databuffer.h"
+
+
+// Sends a block of media data to the slave remote with the given handle. 'then' is the time in the
+// slave's clock at which it should start playback, or 0. Returns false if the send failed.
+typedef std::function<bool(uint32_t handle, const uint8_t* data, uint32_t length, bool done,
+																	int64_t then)> SlaveSendHandler;
+
+
+// What to do with a slave whose queue is full.
+enum SlaveLagPolicy {
+	SLAVE_LAG_WAIT = 0,		// Hold up the master until the slave catches up, or drop it.
+	SLAVE_LAG_DROP			// Drop the slave right away.
+};
+
+
+struct SlaveSenderConfig {
+	uint32_t queueDepth = 8;			// Maximum number of blocks queued per slave.
+	uint32_t lagTimeout = 2000;			// Milliseconds to wait for a full queue with SLAVE_LAG_WAIT.
+	SlaveLagPolicy policy = SLAVE_LAG_WAIT;
+};
+
+
+struct SlaveSenderStats {
+	uint64_t bytesSent = 0;
+	uint32_t blocksSent = 0;
+	uint32_t queued = 0;			// Blocks currently in the queue.
+	uint32_t queuedMax = 0;			// Highest number of blocks in the queue so far.
+	uint32_t throughput = 0;		// Smoothed throughput to the slave, in bytes per second.
+	uint32_t sendTime = 0;			// Smoothed time per send, in microseconds.
+	uint32_t lag = 0;				// Time the oldest queued block has been waiting, in milliseconds.
+	bool dropped = false;
+};
+
+
+class SlaveSender {
+	struct SlaveData {
+		std::shared_ptr<DataBuffer> buffer;	// Keeps the buffer alive while the chunk is queued.
+		MediaChunkPtr chunk;		// Data in the master's buffer, or
+		std::string data;			// a copy of data which did not make it into the buffer.
+		bool done;
+		int64_t then;
+		std::chrono::steady_clock::time_point time;	// When the data was queued.
+	};
+
+	uint32_t handle;
+	std::string name;
+	SlaveSendHandler handler;
+	SlaveSenderConfig config;
+	std::thread sendThread;
+	std::mutex queueMutex;
+	std::condition_variable dataCV;		// Signalled when data is queued.
+	std::condition_variable spaceCV;	// Signalled when the queue has room, or is empty.
+	std::deque<SlaveData> queue;
+	bool running = false;
+	bool sending = false;				// True while a block is being sent.
+	std::atomic<bool> dropped = { false };
+	SlaveSenderStats stats;
+
+	bool enqueue(SlaveData &item);
+	bool sendBlock(const uint8_t* data, uint32_t length, bool done, int64_t then);
+	void drop();
+	void run();
+
+public:
+	SlaveSender(uint32_t handle, const std::string &name, SlaveSendHandler handler,
+														const SlaveSenderConfig &config);
+	~SlaveSender();
+
+	bool start();
+	void stop();
+	bool send(std::shared_ptr<DataBuffer> buffer, MediaChunkPtr chunk, int64_t then);
+	bool send(const char* data, uint32_t length, bool done, int64_t then);
+	bool flush(uint32_t timeout);
+	bool isDropped();
+	uint32_t getHandle();
+	std::string getName();
+	SlaveSenderStats getStats();
+};
+
+typedef std::shared_ptr<SlaveSender> SlaveSenderPtr;
+
+#endif
@@ -0,0 +1,230 @@
+/*
+	statuspublisher.cpp - Implementation of the playback status publisher class.
+
+	Revision 0
+
+	Notes:
+			- A routine update waits out the rest of the interval since the previous update, and
+				takes the status only then, so that all changes in between end up in one update.
+*/
+
+
+//#define DEBUG 1
+
+#include "statuspublisher.h"
+
+#ifdef DEBUG
+#include <iostream>
+#endif
+
+
+// --- DIFF ---
+// Returns the fields (StatusField mask) which differ from the other status.
+uint32_t PlaybackStatus::diff(const PlaybackStatus &other) const {
+	uint32_t fields = 0;
+	if (status != other.status) { fields |= STATUS_FIELD_STATUS; }
+	if (playing != other.playing) { fields |= STATUS_FIELD_PLAYING; }
+	if (duration != other.duration) { fields |= STATUS_FIELD_DURATION; }
+	if (position != other.position) { fields |= STATUS_FIELD_POSITION; }
+	if (title != other.title) { fields |= STATUS_FIELD_TITLE; }
+	if (artist != other.artist) { fields |= STATUS_FIELD_ARTIST; }
+	if (volume != other.volume) { fields |= STATUS_FIELD_VOLUME; }
+	if (ttff != other.ttff) { fields |= STATUS_FIELD_TTFF; }
+	if (hasSyncError != other.hasSyncError || syncError != other.syncError) {
+		fields |= STATUS_FIELD_SYNC_ERROR;
+	}
+
+	return fields;
+}
+
+
+// --- CONSTRUCTOR ---
+StatusPublisher::StatusPublisher(StatusSnapshotHandler snapshot, StatusSendHandler send,
+													const StatusPublisherConfig &config) {
+	snapshotHandler = snapshot;
+	sendHandler = send;
+	this->config = config;
+}
+
+
+// --- DESTRUCTOR ---
+StatusPublisher::~StatusPublisher() {
+	stop();
+}
+
+
+// --- SET CONFIG ---
+void StatusPublisher::setConfig(const StatusPublisherConfig &config) {
+	std::lock_guard<std::mutex> lk(publishMutex);
+	this->config = config;
+}
+
+
+// --- START ---
+// Starts the publish thread.
+bool StatusPublisher::start() {
+	std::lock_guard<std::mutex> lk(publishMutex);
+	if (running) { return false; }
+
+	running = true;
+	pending = false;
+	urgent = false;
+	lastPublish = std::chrono::steady_clock::time_point();
+	publishThread = std::thread(&StatusPublisher::run, this);
+
+	return true;
+}
+
+
+// --- STOP ---
+// Stops the publish thread. Pending updates are not sent.
+void StatusPublisher::stop() {
+	std::unique_lock<std::mutex> lk(publishMutex);
+	running = false;
+	lk.unlock();
+	publishCV.notify_one();
+
+	if (publishThread.joinable()) { publishThread.join(); }
+}
+
+
+// --- NOTIFY ---
+// Reports a routine change of the status, e.g. new data or a new position. The clients get it with
+// the next update, at most one interval from the previous one.
+void StatusPublisher::notify() {
+	std::unique_lock<std::mutex> lk(publishMutex);
+	stats.notified++;
+	if (pending || urgent) { return; }
+
+	pending = true;
+	lk.unlock();
+	publishCV.notify_one();
+}
+
+
+// --- TRANSITION ---
+// Reports a change of the playback state, e.g. start, pause or stop. The clients get it right away.
+void StatusPublisher::transition() {
+	{
+		std::lock_guard<std::mutex> lk(statusMutex);
+		cacheValid = false;
+	}
+
+	std::unique_lock<std::mutex> lk(publishMutex);
+	stats.notified++;
+	urgent = true;
+	lk.unlock();
+	publishCV.notify_one();
+}
+
+
+// --- RESEND ALL ---
+// Makes the next update include all fields, e.g. for clients which missed earlier updates, and
+// schedules it like a routine update.
+void StatusPublisher::resendAll() {
+	std::unique_lock<std::mutex> lk(publishMutex);
+	full = true;
+	if (pending || urgent) { return; }
+
+	pending = true;
+	lk.unlock();
+	publishCV.notify_one();
+}
+
+
+// --- GET STATUS ---
+// Returns the current status. A status taken less than an interval ago is reused, unless the
+// playback state changed since.
+PlaybackStatus StatusPublisher::getStatus() {
+	PlaybackStatus status;
+	getStatus(status);
+
+	return status;
+}
+
+
+// Copies the current status into 'status', which keeps the storage of its strings.
+void StatusPublisher::getStatus(PlaybackStatus &status) {
+	uint32_t interval;
+	{
+		std::lock_guard<std::mutex> lk(publishMutex);
+		interval = config.interval;
+	}
+
+	std::lock_guard<std::mutex> lk(statusMutex);
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	if (!cacheValid || now - cachedTime >= std::chrono::milliseconds(interval)) {
+		snapshotHandler(cached);
+		cachedTime = now;
+		cacheValid = true;
+	}
+
+	status = cached;
+}
+
+
+// --- GET STATS ---
+StatusPublisherStats StatusPublisher::getStats() {
+	std::lock_guard<std::mutex> lk(publishMutex);
+	return stats;
+}
+
+
+// --- PUBLISH ---
+// Takes the status, and sends what changed since the last update. The status is taken into the
+// same object each time, so that its strings keep their storage.
+void StatusPublisher::publish(bool all) {
+	snapshotHandler(taken);
+
+	uint32_t fields;
+	{
+		std::lock_guard<std::mutex> lk(statusMutex);
+		fields = (all || !hasSent) ? (uint32_t) STATUS_FIELD_ALL : taken.diff(sent);
+		sent = taken;
+		hasSent = true;
+		cached = taken;
+		cachedTime = std::chrono::steady_clock::now();
+		cacheValid = true;
+	}
+
+	if (fields == 0) { return; }
+
+	fields |= STATUS_FIELD_STATUS;
+	sendHandler(taken, fields);
+
+	std::lock_guard<std::mutex> lk(publishMutex);
+	stats.published++;
+
+#ifdef DEBUG
+	std::cout << "StatusPublisher: sent fields 0x" << std::hex << fields << std::dec << std::endl;
+#endif
+}
+
+
+// --- RUN ---
+void StatusPublisher::run() {
+	std::unique_lock<std::mutex> lk(publishMutex);
+	while (running) {
+		publishCV.wait(lk, [this] { return !running || pending || urgent; });
+		if (!running) { break; }
+
+		// Routine updates wait for the end of the interval, collecting further changes.
+		if (!urgent) {
+			std::chrono::steady_clock::time_point next = lastPublish
+											+ std::chrono::milliseconds(config.interval);
+			publishCV.wait_until(lk, next, [this] { return !running || urgent; });
+			if (!running) { break; }
+		}
+
+		bool all = full;
+		pending = false;
+		urgent = false;
+		full = false;
+		lk.unlock();
+
+		publish(all);
+
+		lk.lock();
+		lastPublish = std::chrono::steady_clock::now();
+	}
+}
@@ -0,0 +1,123 @@
+/*
+	statuspublisher.h - Header for the playback status publisher class.
+
+	Revision 0
+
+	Features:
+			- Sends the playback status to the clients from its own thread.
+			- Coalesces changes: routine updates (e.g. a new data block) are sent at most once per
+				interval, state transitions (e.g. pause, stop) right away.
+			- Sends only the fields which changed since the last update.
+			- Keeps the last status, so that status requests need not collect it again.
+
+	Notes:
+			- The 'status' field is part of every update, so that clients can tell a status
+				update from other maps.
+*/
+
+
+#ifndef STATUSPUBLISHER_H
+#define STATUSPUBLISHER_H
+
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+
+// Fields of the playback status, as a bit mask.
+enum StatusField {
+	STATUS_FIELD_STATUS		= 0x001,
+	STATUS_FIELD_PLAYING	= 0x002,
+	STATUS_FIELD_DURATION	= 0x004,
+	STATUS_FIELD_POSITION	= 0x008,
+	STATUS_FIELD_TITLE		= 0x010,
+	STATUS_FIELD_ARTIST		= 0x020,
+	STATUS_FIELD_VOLUME		= 0x040,
+	STATUS_FIELD_TTFF		= 0x080,
+	STATUS_FIELD_SYNC_ERROR	= 0x100,
+	STATUS_FIELD_ALL		= 0x1ff
+};
+
+
+// Playback status, as sent to the clients.
+struct PlaybackStatus {
+	uint32_t status = 0;		// NYMPH_PLAYBACK_STATUS_*.
+	bool playing = false;
+	uint64_t duration = 0;		// Seconds.
+	double position = 0.0;		// Seconds with remainder.
+	std::string title;
+	std::string artist;
+	uint32_t volume = 0;
+	uint32_t ttff = 0;			// Time to first frame, in milliseconds.
+	bool hasSyncError = false;	// Slave mode only.
+	int64_t syncError = 0;		// Microseconds.
+
+	uint32_t diff(const PlaybackStatus &other) const;
+};
+
+
+// Fills in the current playback status.
+typedef std::function<void(PlaybackStatus &status)> StatusSnapshotHandler;
+
+// Sends the fields in 'fields' (StatusField mask) of the status to the clients.
+typedef std::function<void(const PlaybackStatus &status, uint32_t fields)> StatusSendHandler;
+
+
+struct StatusPublisherConfig {
+	uint32_t interval = 500;		// Minimum milliseconds between routine updates.
+};
+
+
+struct StatusPublisherStats {
+	uint32_t notified = 0;		// Changes reported.
+	uint32_t published = 0;		// Updates sent.
+};
+
+
+class StatusPublisher {
+	StatusSnapshotHandler snapshotHandler;
+	StatusSendHandler sendHandler;
+	StatusPublisherConfig config;
+
+	std::thread publishThread;
+	std::mutex publishMutex;
+	std::condition_variable publishCV;
+	bool running = false;
+	bool pending = false;			// A routine update is due.
+	bool urgent = false;			// An update is due right away.
+	bool full = false;				// The next update sends all fields.
+	std::chrono::steady_clock::time_point lastPublish;
+	StatusPublisherStats stats;
+
+	std::mutex statusMutex;
+	PlaybackStatus sent;			// Status as of the last update.
+	bool hasSent = false;
+	PlaybackStatus taken;			// Status taken by the publish thread.
+	PlaybackStatus cached;			// Most recent status.
+	std::chrono::steady_clock::time_point cachedTime;
+	bool cacheValid = false;
+
+	void publish(bool all);
+	void run();
+
+public:
+	StatusPublisher(StatusSnapshotHandler snapshot, StatusSendHandler send,
+													const StatusPublisherConfig &config);
+	~StatusPublisher();
+
+	void setConfig(const StatusPublisherConfig &config);
+	bool start();
+	void stop();
+	void notify();
+	void transition();
+	void resendAll();
+	PlaybackStatus getStatus();
+	void getStatus(PlaybackStatus &status);
+	StatusPublisherStats getStats();
+};
+
+#endif
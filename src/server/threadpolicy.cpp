@@ -0,0 +1,220 @@
+/*
+	threadpolicy.cpp - Implementation of the ThreadPolicy class.
+
+	Revision 0
+
+	Notes:
+			- Threads inherit the affinity of the thread which creates them. Pinning the thread
+				which opens a codec therefore also pins the codec's own threads.
+			- Realtime priority uses SCHED_FIFO, which needs CAP_SYS_NICE or an rtprio limit.
+*/
+
+
+#include "threadpolicy.h"
+
+#include <cstdlib>
+#include <sstream>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+
+// Static initialisations.
+std::vector<DecoderThreadRule> ThreadPolicy::rules;
+std::vector<int> ThreadPolicy::cores[THREAD_ROLES];
+int ThreadPolicy::audioPriority = 0;
+
+
+// Splits 'spec' at each 'separator'.
+static std::vector<std::string> split(const std::string &spec, char separator) {
+	std::vector<std::string> parts;
+	std::istringstream in(spec);
+	std::string part;
+	while (std::getline(in, part, separator)) {
+		parts.push_back(part);
+	}
+
+	return parts;
+}
+
+
+// Parses a non-negative number, taking up all of 's'.
+static bool parseNumber(const std::string &s, int &value) {
+	if (s.empty() || s.size() > 6) { return false; }
+	for (int i = 0; i < s.size(); ++i) {
+		if (s[i] < '0' || s[i] > '9') { return false; }
+	}
+
+	value = atoi(s.c_str());
+	return true;
+}
+
+
+// --- PARSE RULE ---
+// Parses a rule of the form 'codec[@max_height]:type[:threads]'.
+bool ThreadPolicy::parseRule(const std::string &spec, DecoderThreadRule &rule) {
+	std::vector<std::string> parts = split(spec, ':');
+	if (parts.size() < 2 || parts.size() > 3) { return false; }
+
+	rule = DecoderThreadRule();
+	size_t at = parts[0].find('@');
+	rule.codec = parts[0].substr(0, at);
+	if (rule.codec.empty()) { return false; }
+	if (at != std::string::npos && !parseNumber(parts[0].substr(at + 1), rule.maxHeight)) {
+		return false;
+	}
+
+	if 		(parts[1] == "auto")	{ rule.threading.type = THREAD_TYPE_AUTO; }
+	else if (parts[1] == "frame")	{ rule.threading.type = THREAD_TYPE_FRAME; }
+	else if (parts[1] == "slice")	{ rule.threading.type = THREAD_TYPE_SLICE; }
+	else { return false; }
+
+	if (parts.size() == 3 && !parseNumber(parts[2], rule.threading.threads)) { return false; }
+
+	return true;
+}
+
+
+// --- PARSE CORES ---
+// Parses a set of cores of the form '0,2-3'. An empty string is the empty set.
+bool ThreadPolicy::parseCores(const std::string &spec, std::vector<int> &cores) {
+	cores.clear();
+	if (spec.empty()) { return true; }
+	if (spec.back() == ',') { return false; }
+
+	std::vector<std::string> parts = split(spec, ',');
+	for (int i = 0; i < parts.size(); ++i) {
+		size_t dash = parts[i].find('-');
+		int first, last;
+		if (!parseNumber(parts[i].substr(0, dash), first)) { return false; }
+		last = first;
+		if (dash != std::string::npos && !parseNumber(parts[i].substr(dash + 1), last)) {
+			return false;
+		}
+
+		if (last < first || last >= 1024) { return false; }
+		for (int c = first; c <= last; ++c) {
+			cores.push_back(c);
+		}
+	}
+
+	return true;
+}
+
+
+// --- SET RULES ---
+// Replaces the rules with those in 'spec'. Keeps the current rules if any of them is invalid.
+bool ThreadPolicy::setRules(const std::string &spec) {
+	std::vector<DecoderThreadRule> parsed;
+	std::vector<std::string> parts = split(spec, ',');
+	for (int i = 0; i < parts.size(); ++i) {
+		if (parts[i].empty()) { continue; }
+
+		DecoderThreadRule rule;
+		if (!parseRule(parts[i], rule)) { return false; }
+		parsed.push_back(rule);
+	}
+
+	rules = parsed;
+	return true;
+}
+
+
+// --- SELECT ---
+// Returns the threading of the first rule which matches the codec and height (0 if unknown), or
+// the default threading if none does.
+DecoderThreading ThreadPolicy::select(const std::string &codec, int height) {
+	for (int i = 0; i < rules.size(); ++i) {
+		const DecoderThreadRule &rule = rules[i];
+		if (rule.codec != "*" && rule.codec != codec) { continue; }
+		if (rule.maxHeight > 0 && height > rule.maxHeight) { continue; }
+
+		return rule.threading;
+	}
+
+	return DecoderThreading();
+}
+
+
+// --- SET CORES ---
+bool ThreadPolicy::setCores(ThreadRole role, const std::string &spec) {
+	std::vector<int> parsed;
+	if (!parseCores(spec, parsed)) { return false; }
+
+	cores[role] = parsed;
+	return true;
+}
+
+
+// --- GET CORES ---
+std::vector<int> ThreadPolicy::getCores(ThreadRole role) {
+	return cores[role];
+}
+
+
+// --- SET AUDIO PRIORITY ---
+// Sets the SCHED_FIFO priority (1 - 99) of the audio output thread. 0 leaves it as is.
+void ThreadPolicy::setAudioPriority(int priority) {
+	if (priority < 0) { priority = 0; }
+	if (priority > 99) { priority = 99; }
+	audioPriority = priority;
+}
+
+
+// --- GET AFFINITY ---
+// Returns the cores which the calling thread may run on.
+bool ThreadPolicy::getAffinity(std::vector<int> &cores) {
+	cores.clear();
+#ifdef __linux__
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	if (pthread_getaffinity_np(pthread_self(), sizeof(set), &set) != 0) { return false; }
+
+	for (int c = 0; c < CPU_SETSIZE; ++c) {
+		if (CPU_ISSET(c, &set)) { cores.push_back(c); }
+	}
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+
+// --- SET AFFINITY ---
+// Limits the calling thread to the given cores. An empty set leaves the affinity as is.
+bool ThreadPolicy::setAffinity(const std::vector<int> &cores) {
+	if (cores.empty()) { return true; }
+
+#ifdef __linux__
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for (int i = 0; i < cores.size(); ++i) {
+		if (cores[i] < CPU_SETSIZE) { CPU_SET(cores[i], &set); }
+	}
+
+	return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+	return false;
+#endif
+}
+
+
+// --- APPLY ---
+// Applies the cores of the role, and for the audio output thread the realtime priority, to the
+// calling thread. Returns false if any of these failed.
+bool ThreadPolicy::apply(ThreadRole role) {
+	bool ok = setAffinity(cores[role]);
+
+#ifdef __linux__
+	if (role == THREAD_ROLE_AUDIO_OUTPUT && audioPriority > 0) {
+		struct sched_param param;
+		param.sched_priority = audioPriority;
+		ok = (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0) && ok;
+	}
+#endif
+
+	return ok;
+}
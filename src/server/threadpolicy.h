@@ -0,0 +1,85 @@
+/*
+	threadpolicy.h - Header for the ThreadPolicy class.
+
+	Revision 0
+
+	Features:
+			- Chooses the decoder threading (frame or slice threading, and the number of threads)
+				per codec and picture height, from a list of rules.
+			- Pins the player's threads to sets of cores, per role: video decoding, audio and
+				rendering.
+			- Runs the audio output thread with realtime priority.
+
+	Notes:
+			- Rules take the form 'codec[@max_height]:type[:threads]', separated by commas, e.g.
+				'hevc@1080:slice:3,hevc:frame:2,*:auto:0'. The first matching rule applies. The
+				codec is the FFmpeg codec name, or '*' for any codec. The type is 'auto', 'frame'
+				or 'slice'. Zero threads leaves the count to FFmpeg.
+			- Core sets take the form '2,3' or '2-3'. An empty set leaves the affinity as is.
+			- Boards can set default rules with DECODER_THREADS_DEFAULT in their platform file.
+			- Affinity and priority are only supported on Linux. Elsewhere apply() does nothing.
+*/
+
+
+#ifndef THREADPOLICY_H
+#define THREADPOLICY_H
+
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+#ifndef DECODER_THREADS_DEFAULT
+#define DECODER_THREADS_DEFAULT ""
+#endif
+
+
+enum ThreadType {
+	THREAD_TYPE_AUTO = 0,
+	THREAD_TYPE_FRAME,
+	THREAD_TYPE_SLICE
+};
+
+
+enum ThreadRole {
+	THREAD_ROLE_VIDEO_DECODE = 0,	// Video decoder thread, and the codec's own threads.
+	THREAD_ROLE_AUDIO_DECODE,		// Audio decoder thread.
+	THREAD_ROLE_AUDIO_OUTPUT,		// Thread of the audio device callback.
+	THREAD_ROLE_RENDER,				// Event loop thread, which displays the video.
+	THREAD_ROLES
+};
+
+
+struct DecoderThreading {
+	ThreadType type = THREAD_TYPE_AUTO;
+	int threads = 0;				// 0: chosen by FFmpeg.
+};
+
+
+struct DecoderThreadRule {
+	std::string codec;				// '*' for any codec.
+	int maxHeight = 0;				// 0: any height.
+	DecoderThreading threading;
+};
+
+
+class ThreadPolicy {
+	static std::vector<DecoderThreadRule> rules;
+	static std::vector<int> cores[THREAD_ROLES];
+	static int audioPriority;
+
+public:
+	static bool parseRule(const std::string &spec, DecoderThreadRule &rule);
+	static bool parseCores(const std::string &spec, std::vector<int> &cores);
+	static bool setRules(const std::string &spec);
+	static DecoderThreading select(const std::string &codec, int height);
+	static bool setCores(ThreadRole role, const std::string &spec);
+	static std::vector<int> getCores(ThreadRole role);
+	static void setAudioPriority(int priority);
+	static bool getAffinity(std::vector<int> &cores);
+	static bool setAffinity(const std::vector<int> &cores);
+	static bool apply(ThreadRole role);
+};
+
+#endif
@@ -0,0 +1,581 @@
+/*
+	bench_cast.cpp - End-to-end cast benchmark, with a synthetic client on a simulated network.
+
+	Benchmarks:
+	- For each scenario, a synthetic file gets cast to a server through the regular client calls:
+		'connect', 'session_start', and 'session_data_offset' in answer to the server's
+		'MediaReadCallback' and 'MediaSeekCallback'. The server is expected to be built with the
+		dummy player ('make PROFILING=1'), which reads from the data buffer at a steady rate. At
+		the start it seeks to near the end of the file and back, as players do to probe a file.
+	- The network is simulated in the client. A callback takes effect after the scenario's
+		latency plus jitter. Each block then goes over a link with the scenario's bandwidth, and
+		arrives after the latency plus jitter. Blocks arrive in order, as with TCP.
+
+	Output:
+	- JSON on standard output, per scenario: time to first byte, ingest rate, seek round trips
+		as seen by the client, and the underruns and seek times from the server's metrics.
+
+	Usage:
+	- bench_cast [-s <server> -c <configuration>] [-i <IP address>] [-l <ms>] [-j <ms>]
+			[-b <kbit/s>] [-m <MB>] [-t <seconds>]
+		With a server binary, a server gets started for each scenario, writing its output to
+		bench_cast_server.log. Otherwise the running server at the IP address is used.
+		With any of latency, jitter or bandwidth, that single scenario is run instead of the
+		built-in ones.
+
+	Notes:
+	- The server runs as a separate process, as it keeps its state in globals and listens on
+		the fixed port 4004. It is restarted for each scenario, for a clean state.
+*/
+
+
+#include <nymph/nymph.h>
+
+#include "../server/sarge.h"
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <cstdlib>
+#include <cstdio>
+
+#include <csignal>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+
+typedef std::chrono::steady_clock Clock;
+
+#define BENCH_PORT 4004
+#define BENCH_SEEK_BLOCK (64 * 1024)	// Sent in answer to a seek, as with 'block_size_min'.
+#define BENCH_MAX_BLOCK (8 * 1024 * 1024)	// As with 'block_size_max'.
+
+
+struct Scenario {
+	std::string name;
+	uint32_t latency;		// One-way, in milliseconds.
+	uint32_t jitter;		// Milliseconds, added to or taken from the latency.
+	uint32_t bandwidth;		// kbit/s, or 0 for no limit.
+};
+
+
+// Bandwidth covers the rate at which the dummy player reads, which averages 12 Mbit/s.
+static const Scenario builtinScenarios[] = {
+	{ "loopback", 0, 0, 0 },
+	{ "lan", 1, 0, 100000 },
+	{ "wifi", 5, 3, 30000 },
+	{ "wifi_poor", 20, 15, 10000 },
+	{ "wan", 50, 10, 8000 }
+};
+
+
+// A block on its way to the server.
+struct Delivery {
+	uint64_t offset;
+	uint32_t length;
+	bool seek;						// Answer to a seek request.
+	Clock::time_point received;		// When the client got the request.
+	Clock::time_point arrival;		// When the block reaches the server.
+};
+
+
+struct Result {
+	bool completed = false;
+	double ttfb = -1;				// Milliseconds.
+	uint64_t bytes = 0;
+	uint32_t blocks = 0;
+	double ingest = 0;				// Mbit/s.
+	double duration = 0;			// Seconds.
+	uint32_t seeks = 0;
+	double seekMean = 0;			// Milliseconds, as seen by the client.
+	double seekMax = 0;
+	double underruns = 0;			// From the server's metrics.
+	double serverSeeks = 0;
+	double serverSeekMean = 0;		// Milliseconds.
+	uint32_t errors = 0;
+};
+
+
+// Globals.
+uint32_t handle = 0;
+std::string data;					// Content of the synthetic file, repeated.
+uint64_t filesize = 0;
+Scenario scenario;
+std::mt19937 jitterRandom(1);
+
+std::mutex linkMutex;
+std::condition_variable linkCv;
+std::deque<Delivery> inFlight;
+Clock::time_point linkFree;			// When the link is done sending the blocks queued so far.
+Clock::time_point lastArrival;
+std::atomic<bool> linkRunning = { false };
+std::atomic<bool> stopped = { false };
+Clock::time_point sessionStart;
+
+// Results of the running scenario, written by the link thread.
+Result result;
+Clock::time_point firstByte;
+Clock::time_point lastByte;
+double seekTotal = 0;
+
+
+// --- DELAY ---
+// One-way latency plus jitter, in microseconds. Call with the link mutex held.
+int64_t delay() {
+	int64_t d = (int64_t) scenario.latency * 1000;
+	if (scenario.jitter > 0) {
+		int64_t j = (int64_t) scenario.jitter * 1000;
+		d += std::uniform_int_distribution<int64_t>(-j, j)(jitterRandom);
+	}
+
+	return (d < 0) ? 0 : d;
+}
+
+
+// --- TRANSMIT ---
+// Puts a block on the simulated link: it starts sending once the request has reached the client
+// and the link is free, and arrives one latency after it has been sent.
+void transmit(uint64_t offset, uint32_t length, bool seek) {
+	Clock::time_point now = Clock::now();
+	if (offset >= filesize) { return; }
+	if (length > filesize - offset) { length = filesize - offset; }
+	if (length > BENCH_MAX_BLOCK) { length = BENCH_MAX_BLOCK; }
+
+	std::lock_guard<std::mutex> lk(linkMutex);
+	Delivery d;
+	d.offset = offset;
+	d.length = length;
+	d.seek = seek;
+	d.received = now;
+
+	Clock::time_point start = now + std::chrono::microseconds(delay());
+	if (start < linkFree) { start = linkFree; }
+	if (scenario.bandwidth > 0) {
+		start += std::chrono::microseconds((uint64_t) length * 8 * 1000 / scenario.bandwidth);
+	}
+
+	linkFree = start;
+	d.arrival = start + std::chrono::microseconds(delay());
+	if (d.arrival < lastArrival) { d.arrival = lastArrival; }
+	lastArrival = d.arrival;
+
+	inFlight.push_back(d);
+	linkCv.notify_all();
+}
+
+
+// --- MEDIA READ CALLBACK ---
+// void MediaReadCallback(uint64 offset, uint32 length)
+void MediaReadCallback(uint32_t session, NymphMessage* msg, void* data) {
+	uint64_t offset = msg->parameters()[0]->getUint64();
+	uint32_t length = msg->parameters()[1]->getUint32();
+	msg->discard();
+
+	transmit(offset, length, false);
+}
+
+
+// --- MEDIA SEEK CALLBACK ---
+// The server expects a block at the new offset.
+// void MediaSeekCallback(uint64 offset)
+void MediaSeekCallback(uint32_t session, NymphMessage* msg, void* data) {
+	uint64_t offset = msg->parameters()[0]->getUint64();
+	msg->discard();
+
+	transmit(offset, BENCH_SEEK_BLOCK, true);
+}
+
+
+// --- MEDIA STOP CALLBACK ---
+// The server has played the whole file.
+void MediaStopCallback(uint32_t session, NymphMessage* msg, void* data) {
+	msg->discard();
+
+	{
+		std::lock_guard<std::mutex> lk(linkMutex);
+		stopped = true;
+	}
+
+	linkCv.notify_all();
+}
+
+
+// --- MEDIA STATUS CALLBACK ---
+void MediaStatusCallback(uint32_t session, NymphMessage* msg, void* data) {
+	msg->discard();
+}
+
+
+// --- RECEIVE FROM APP CALLBACK ---
+void ReceiveFromAppCallback(uint32_t session, NymphMessage* msg, void* data) {
+	msg->discard();
+}
+
+
+// --- DELIVER ---
+// Delivers the blocks to the server as they arrive.
+void deliver() {
+	std::unique_lock<std::mutex> lk(linkMutex);
+	while (linkRunning) {
+		if (inFlight.empty()) {
+			linkCv.wait(lk);
+			continue;
+		}
+
+		Delivery d = inFlight.front();
+		if (Clock::now() < d.arrival) {
+			linkCv.wait_until(lk, d.arrival);
+			continue;
+		}
+
+		inFlight.pop_front();
+		lk.unlock();
+
+		std::vector<NymphType*> values;
+		values.push_back(new NymphType((char*) data.data() + d.offset % (data.size() / 2),
+																		d.length, false));
+		values.push_back(new NymphType(d.offset + d.length >= filesize));
+		values.push_back(new NymphType(d.offset));
+		NymphType* returnValue = 0;
+		std::string res;
+		bool ok = NymphRemoteServer::callMethod(handle, "session_data_offset", values,
+																		returnValue, res);
+		Clock::time_point now = Clock::now();
+		if (ok && returnValue->getUint8() == 0) {
+			if (result.blocks == 0) {
+				firstByte = now;
+				result.ttfb = std::chrono::duration<double, std::milli>(now - sessionStart).count();
+			}
+
+			lastByte = now;
+			result.blocks++;
+			result.bytes += d.length;
+			if (d.seek) {
+				double rtt = std::chrono::duration<double, std::milli>(now - d.received).count();
+				result.seeks++;
+				seekTotal += rtt;
+				result.seekMax = std::max(result.seekMax, rtt);
+			}
+		}
+		else {
+			result.errors++;
+		}
+
+		delete returnValue;
+		lk.lock();
+	}
+}
+
+
+// --- CALL ---
+// Calls a method without parameters. Returns null on failure.
+NymphType* call(const std::string &method) {
+	std::vector<NymphType*> values;
+	NymphType* returnValue = 0;
+	std::string res;
+	if (!NymphRemoteServer::callMethod(handle, method, values, returnValue, res)) {
+		std::cerr << "Calling " << method << " failed: " << res << std::endl;
+		return 0;
+	}
+
+	return returnValue;
+}
+
+
+// --- METRIC ---
+// Returns the value of the metric with this name in the Prometheus text, or 0 if not found.
+double metric(const std::string &text, const std::string &name) {
+	std::string line = "\n" + name + " ";
+	size_t pos = text.find(line);
+	if (pos == std::string::npos) { return 0; }
+
+	return atof(text.c_str() + pos + line.size());
+}
+
+
+// --- SERVER METRICS ---
+// Reads the underruns, and the number and total time of seeks in the data buffer.
+bool serverMetrics(double &underruns, double &seeks, double &seekSum) {
+	NymphType* text = call("metrics_get");
+	if (!text) { return false; }
+
+	std::string t = "\n" + std::string(text->getChar(), text->string_length());
+	underruns = metric(t, "nymphcast_buffer_underruns_total");
+	seeks = metric(t, "nymphcast_buffer_seek_seconds_count");
+	seekSum = metric(t, "nymphcast_buffer_seek_seconds_sum");
+	delete text;
+
+	return true;
+}
+
+
+// --- START SERVER ---
+// Starts the server, and waits until it accepts a connection. Returns the process ID, or -1.
+pid_t startServer(const std::string &server, const std::string &config, const std::string &ip) {
+	pid_t pid = fork();
+	if (pid < 0) { return -1; }
+	if (pid == 0) {
+		int fd = open("bench_cast_server.log", O_WRONLY | O_CREAT | O_APPEND, 0644);
+		if (fd >= 0) {
+			dup2(fd, STDOUT_FILENO);
+			dup2(fd, STDERR_FILENO);
+			close(fd);
+		}
+
+		execl(server.c_str(), server.c_str(), "-c", config.c_str(), (char*) 0);
+		_exit(127);
+	}
+
+	for (int i = 0; i < 100; ++i) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		std::string res;
+		if (NymphRemoteServer::connect(ip, BENCH_PORT, handle, 0, res)) { return pid; }
+		if (waitpid(pid, 0, WNOHANG) == pid) { return -1; }
+	}
+
+	kill(pid, SIGKILL);
+	waitpid(pid, 0, 0);
+	return -1;
+}
+
+
+// --- STOP SERVER ---
+void stopServer(pid_t pid) {
+	kill(pid, SIGINT);
+	for (int i = 0; i < 100; ++i) {
+		if (waitpid(pid, 0, WNOHANG) == pid) { return; }
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	}
+
+	kill(pid, SIGKILL);
+	waitpid(pid, 0, 0);
+}
+
+
+// --- RUN SCENARIO ---
+// Casts the file, and waits until the server has played it, or for the time-out.
+bool runScenario(uint32_t timeout, Result &res) {
+	std::vector<NymphType*> values;
+	values.push_back(new NymphType((char*) "bench_cast", 10, false));
+	NymphType* returnValue = 0;
+	std::string error;
+	if (!NymphRemoteServer::callMethod(handle, "connect", values, returnValue, error)) {
+		std::cerr << "Calling connect failed: " << error << std::endl;
+		return false;
+	}
+
+	delete returnValue;
+
+	double underruns0 = 0, seeks0 = 0, seekSum0 = 0;
+	serverMetrics(underruns0, seeks0, seekSum0);
+
+	result = Result();
+	seekTotal = 0;
+	stopped = false;
+	linkFree = lastArrival = Clock::now();
+	inFlight.clear();
+	linkRunning = true;
+	std::thread linkThread(deliver);
+
+	// struct fileInfo { uint32 filesize }
+	std::map<std::string, NymphPair>* pairs = new std::map<std::string, NymphPair>();
+	NymphPair pair;
+	std::string* key = new std::string("filesize");
+	pair.key = new NymphType(key, true);
+	pair.value = new NymphType((uint32_t) filesize);
+	pairs->insert(std::pair<std::string, NymphPair>(*key, pair));
+
+	values.clear();
+	values.push_back(new NymphType(pairs, true));
+	sessionStart = Clock::now();
+	returnValue = 0;
+	bool ok = NymphRemoteServer::callMethod(handle, "session_start", values, returnValue, error);
+	ok = ok && returnValue->getUint8() == 0;
+	delete returnValue;
+	if (!ok) {
+		std::cerr << "Starting the session failed: " << error << std::endl;
+	}
+	else {
+		std::unique_lock<std::mutex> lk(linkMutex);
+		linkCv.wait_until(lk, sessionStart + std::chrono::seconds(timeout), 
+															[] { return stopped.load(); });
+	}
+
+	{
+		std::lock_guard<std::mutex> lk(linkMutex);
+		linkRunning = false;
+	}
+
+	linkCv.notify_all();
+	linkThread.join();
+
+	delete call("session_end");
+
+	res = result;
+	res.completed = stopped;
+	res.duration = std::chrono::duration<double>(Clock::now() - sessionStart).count();
+	if (lastByte > firstByte) {
+		res.ingest = res.bytes * 8 / std::chrono::duration<double>(lastByte - firstByte).count()
+																						/ 1e6;
+	}
+
+	if (res.seeks > 0) { res.seekMean = seekTotal / res.seeks; }
+
+	double underruns1 = 0, seeks1 = 0, seekSum1 = 0;
+	if (serverMetrics(underruns1, seeks1, seekSum1)) {
+		res.underruns = underruns1 - underruns0;
+		res.serverSeeks = seeks1 - seeks0;
+		if (res.serverSeeks > 0) {
+			res.serverSeekMean = (seekSum1 - seekSum0) * 1000 / res.serverSeeks;
+		}
+	}
+
+	return ok;
+}
+
+
+std::string jsonResult(const Scenario &s, bool ok, const Result &r) {
+	char buf[1024];
+	snprintf(buf, sizeof(buf),
+		"\t\t{\n"
+		"\t\t\t\"scenario\": \"%s\",\n"
+		"\t\t\t\"latency_ms\": %u,\n"
+		"\t\t\t\"jitter_ms\": %u,\n"
+		"\t\t\t\"bandwidth_kbit_s\": %u,\n"
+		"\t\t\t\"ok\": %s,\n"
+		"\t\t\t\"completed\": %s,\n"
+		"\t\t\t\"duration_s\": %.3f,\n"
+		"\t\t\t\"ttfb_ms\": %.3f,\n"
+		"\t\t\t\"bytes\": %llu,\n"
+		"\t\t\t\"blocks\": %u,\n"
+		"\t\t\t\"ingest_mbit_s\": %.3f,\n"
+		"\t\t\t\"seeks\": %u,\n"
+		"\t\t\t\"seek_rtt_mean_ms\": %.3f,\n"
+		"\t\t\t\"seek_rtt_max_ms\": %.3f,\n"
+		"\t\t\t\"server_seeks\": %.0f,\n"
+		"\t\t\t\"server_seek_mean_ms\": %.3f,\n"
+		"\t\t\t\"underruns\": %.0f,\n"
+		"\t\t\t\"errors\": %u\n"
+		"\t\t}",
+		s.name.c_str(), s.latency, s.jitter, s.bandwidth, ok ? "true" : "false",
+		r.completed ? "true" : "false", r.duration, r.ttfb, (unsigned long long) r.bytes,
+		r.blocks, r.ingest, r.seeks, r.seekMean, r.seekMax, r.serverSeeks, r.serverSeekMean,
+		r.underruns, r.errors);
+
+	return buf;
+}
+
+
+// --- LOG FUNCTION ---
+void logFunction(int level, std::string logStr) {
+	std::cerr << level << " - " << logStr << std::endl;
+}
+
+
+int main(int argc, char** argv) {
+	Sarge sarge;
+	sarge.setArgument("h", "help", "Get this help message.", false);
+	sarge.setArgument("s", "server", "Server binary to start for each scenario.", true);
+	sarge.setArgument("c", "configuration", "Configuration file for the started server.", true);
+	sarge.setArgument("i", "ip", "IP address of the server. Default: 127.0.0.1.", true);
+	sarge.setArgument("l", "latency", "One-way latency, in milliseconds.", true);
+	sarge.setArgument("j", "jitter", "Jitter, in milliseconds.", true);
+	sarge.setArgument("b", "bandwidth", "Bandwidth, in kbit/s. 0 for no limit.", true);
+	sarge.setArgument("m", "size", "Size of the cast file, in MB. Default: 32.", true);
+	sarge.setArgument("t", "timeout", "Time-out per scenario, in seconds. Default: 120.", true);
+	sarge.setDescription("NymphCast cast benchmark. Casts a synthetic file over a simulated network.");
+	sarge.setUsage("bench_cast <options>");
+
+	sarge.parseArguments(argc, argv);
+	if (sarge.exists("help")) {
+		sarge.printHelp();
+		return 0;
+	}
+
+	std::string server, config, value;
+	std::string ip = "127.0.0.1";
+	sarge.getFlag("ip", ip);
+	if (sarge.getFlag("server", server) && !sarge.getFlag("configuration", config)) {
+		std::cerr << "A started server needs a configuration file." << std::endl;
+		return 1;
+	}
+
+	std::vector<Scenario> scenarios;
+	if (sarge.exists("latency") || sarge.exists("jitter") || sarge.exists("bandwidth")) {
+		Scenario s = { "custom", 0, 0, 0 };
+		if (sarge.getFlag("latency", value)) { s.latency = std::stoul(value); }
+		if (sarge.getFlag("jitter", value)) { s.jitter = std::stoul(value); }
+		if (sarge.getFlag("bandwidth", value)) { s.bandwidth = std::stoul(value); }
+		scenarios.push_back(s);
+	}
+	else {
+		scenarios.assign(builtinScenarios, builtinScenarios + sizeof(builtinScenarios) /
+																	sizeof(builtinScenarios[0]));
+	}
+
+	filesize = 32 * 1024 * 1024;
+	if (sarge.getFlag("size", value)) { filesize = std::stoull(value) * 1024 * 1024; }
+	uint32_t timeout = 120;
+	if (sarge.getFlag("timeout", value)) { timeout = std::stoul(value); }
+
+	// Blocks are taken from a pattern twice the maximum block size, at their offset modulo half
+	// of it, so that the content varies with the offset.
+	data.resize(2 * BENCH_MAX_BLOCK);
+	for (size_t i = 0; i < data.size(); ++i) {
+		data[i] = (char) (i * 31 + (i >> 12));
+	}
+
+	long nymphTimeout = 5000;
+	NymphRemoteServer::init(logFunction, NYMPH_LOG_LEVEL_WARNING, nymphTimeout);
+	NymphRemoteServer::registerCallback("MediaReadCallback", MediaReadCallback, 0);
+	NymphRemoteServer::registerCallback("MediaSeekCallback", MediaSeekCallback, 0);
+	NymphRemoteServer::registerCallback("MediaStopCallback", MediaStopCallback, 0);
+	NymphRemoteServer::registerCallback("MediaStatusCallback", MediaStatusCallback, 0);
+	NymphRemoteServer::registerCallback("ReceiveFromAppCallback", ReceiveFromAppCallback, 0);
+
+	std::ostringstream out;
+	out << "{\n\t\"file_bytes\": " << filesize << ",\n\t\"scenarios\": [\n";
+	bool allOk = true;
+	for (int i = 0; i < scenarios.size(); ++i) {
+		scenario = scenarios[i];
+		std::cerr << "Scenario " << scenario.name << "..." << std::endl;
+
+		pid_t pid = -1;
+		std::string error;
+		if (!server.empty()) {
+			pid = startServer(server, config, ip);
+			if (pid < 0) {
+				std::cerr << "Failed to start the server." << std::endl;
+				return 1;
+			}
+		}
+		else if (!NymphRemoteServer::connect(ip, BENCH_PORT, handle, 0, error)) {
+			std::cerr << "Failed to connect to " << ip << ": " << error << std::endl;
+			return 1;
+		}
+
+		Result r;
+		bool ok = runScenario(timeout, r);
+		allOk = allOk && ok && r.completed && r.errors == 0;
+		out << jsonResult(scenario, ok, r) << (i + 1 < scenarios.size() ? "," : "") << "\n";
+
+		NymphRemoteServer::disconnect(handle, error);
+		if (pid > 0) { stopServer(pid); }
+	}
+
+	out << "\t]\n}\n";
+	std::cout << out.str();
+
+	NymphRemoteServer::shutdown();
+	return allOk ? 0 : 1;
+}
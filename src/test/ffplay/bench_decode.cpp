@@ -0,0 +1,421 @@
+/*
+	bench_decode.cpp - Decode throughput of the ffplay pipeline, without audio or video output.
+
+	Benchmarks:
+	- Each file of the corpus is played through the read thread, the decoders and the audio and
+		video filters, as fast as they go. The decoded frames are taken off the frame queues and
+		discarded, where the audio device and the display would take them at playback speed.
+
+	Output:
+	- JSON on standard output. For each file and for the corpus: packets and frames per second of
+		each stage, CPU time per packet or frame of each pipeline thread, the process CPU time
+		per frame, and the peak RSS.
+
+	Usage:
+	- bench_decode <file or folder> [...]. Folders are read one level deep.
+
+	Notes:
+	- There is no audio device. The audio filters still convert to the format a device would
+		get, but the resampling for clock sync in the audio callback is not included.
+	- Video is converted to YUV420P, as for a renderer which supports it. Texture upload and
+		scaling for display are not included.
+	- A file which makes no progress for BENCH_STALL_TIMEOUT is reported as failed.
+*/
+
+#include "ffplay.h"			// Not "types.h", as this folder has its own.
+#include "stream_handler.h"
+#include "audio_renderer.h"
+#include "frame_queue.h"
+#include "../../server/metrics.h"
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <filesystem>
+#include <algorithm>
+#include <cstdlib>
+#include <cstdio>
+
+#include <pthread.h>
+#include <time.h>
+#include <sys/resource.h>
+
+namespace fs = std::filesystem;
+
+
+#define BENCH_STALL_TIMEOUT 10000		// Milliseconds.
+
+
+// Globals normally defined by the server and Ffplay.
+FileMetaInfo file_meta;
+std::atomic<bool> playerStarted = { false };
+std::atomic<bool> castingUrl = { false };
+std::string castUrl;
+Poco::Condition gCon;
+Poco::Condition playerCon;
+Poco::Mutex playerMutex;
+const uint32_t nymph_seek_event = SDL_RegisterEvents(1);
+
+int is_full_screen;
+int64_t audio_callback_time;
+unsigned sws_flags = SWS_BICUBIC;
+AVPacket flush_pkt;
+
+// Player options: no display, no subtitles, no frame drops and no exit at the end of a file.
+AVInputFormat *file_iformat;
+const char *input_filename;
+const char *window_title;
+int default_width  = 640;
+int default_height = 480;
+std::atomic<int> screen_width  = { 0 };
+std::atomic<int> screen_height = { 0 };
+int screen_left = SDL_WINDOWPOS_CENTERED;
+int screen_top = SDL_WINDOWPOS_CENTERED;
+int audio_disable = 0;
+int video_disable = 0;
+int subtitle_disable = 1;
+const char* wanted_stream_spec[AVMEDIA_TYPE_NB] = {0};
+int seek_by_bytes = -1;
+float seek_interval = 10;
+int display_disable = 1;
+bool gui_enable = false;
+bool screensaver_enable = false;
+int borderless;
+int alwaysontop;
+int startup_volume = 100;
+int show_status = 0;
+int av_sync_type = AV_SYNC_AUDIO_MASTER;
+int64_t start_time = AV_NOPTS_VALUE;
+int64_t duration = AV_NOPTS_VALUE;
+int fast = 0;
+int genpts = 0;
+int lowres = 0;
+int decoder_reorder_pts = -1;
+int autoexit = 0;
+int exit_on_keydown;
+int exit_on_mousedown;
+int loop = 1;
+int framedrop = 0;
+int infinite_buffer = -1;
+enum ShowMode show_mode = SHOW_MODE_NONE;
+const char *audio_codec_name;
+const char *subtitle_codec_name;
+const char *video_codec_name;
+double rdftspeed = 0.02;
+int64_t cursor_last_shown;
+int cursor_hidden = 0;
+#if CONFIG_AVFILTER
+const char **vfilters_list = NULL;
+int nb_vfilters = 0;
+char *afilters = NULL;
+#endif
+int autorotate = 1;
+int find_stream_info = 1;
+int filter_nbthreads = 0;
+std::atomic<uint32_t> audio_volume = { 100 };
+
+const char program_name[] = "bench_decode";
+const int program_birth_year = 2003;
+void show_help_default(const char *opt, const char *arg) { }
+
+
+// Counts of the pipeline stages, from the player's metrics.
+struct StageCounts {
+	uint64_t packets = 0;
+	uint64_t audioDecoded = 0;
+	uint64_t audioQueued = 0;
+	uint64_t videoDecoded = 0;
+	uint64_t videoQueued = 0;
+
+	static StageCounts now();
+	StageCounts operator-(const StageCounts &other) const;
+};
+
+
+struct FileResult {
+	std::string file;
+	bool ok = false;
+	double mediaSeconds = 0;
+	double wallSeconds = 0;
+	StageCounts counts;
+	double readCpu = 0;				// Seconds of CPU time, per thread.
+	double audioCpu = 0;
+	double videoCpu = 0;
+	double processCpu = 0;
+	long peakRss = 0;				// kB.
+};
+
+
+StageCounts StageCounts::now() {
+	static MetricCounter* packets = Metrics::counter("nymphcast_packets_read_total", "");
+	static MetricCounter* audioDecoded =
+				Metrics::counter("nymphcast_frames_decoded_total{stream=\"audio\"}", "");
+	static MetricCounter* audioQueued =
+				Metrics::counter("nymphcast_frames_queued_total{stream=\"audio\"}", "");
+	static MetricCounter* videoDecoded =
+				Metrics::counter("nymphcast_frames_decoded_total{stream=\"video\"}", "");
+	static MetricCounter* videoQueued =
+				Metrics::counter("nymphcast_frames_queued_total{stream=\"video\"}", "");
+
+	StageCounts c;
+	c.packets = packets->get();
+	c.audioDecoded = audioDecoded->get();
+	c.audioQueued = audioQueued->get();
+	c.videoDecoded = videoDecoded->get();
+	c.videoQueued = videoQueued->get();
+	return c;
+}
+
+
+StageCounts StageCounts::operator-(const StageCounts &other) const {
+	StageCounts c;
+	c.packets = packets - other.packets;
+	c.audioDecoded = audioDecoded - other.audioDecoded;
+	c.audioQueued = audioQueued - other.audioQueued;
+	c.videoDecoded = videoDecoded - other.videoDecoded;
+	c.videoQueued = videoQueued - other.videoQueued;
+	return c;
+}
+
+
+// Returns the CPU time used by the thread so far, in seconds, or 0 if it is not running.
+double threadCpu(SDL_Thread* thread) {
+	if (!thread) { return 0; }
+
+	clockid_t clock;
+	if (pthread_getcpuclockid((pthread_t) SDL_GetThreadID(thread), &clock) != 0) { return 0; }
+
+	struct timespec ts;
+	clock_gettime(clock, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+// Returns the CPU time used by the process so far, in seconds.
+double processCpu(long &peakRss) {
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	peakRss = usage.ru_maxrss;
+	return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+			usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+
+// Takes the decoded frames off the queue, as the audio device or the display would. Returns the
+// number of frames taken.
+int drain(FrameQueue* f) {
+	int n = 0;
+	while (FrameQueueC::frame_queue_nb_remaining(f) > 0) {
+		FrameQueueC::frame_queue_next(f);
+		n++;
+	}
+
+	return n;
+}
+
+
+// True once the file has been read, and all of its frames decoded and taken off the queues.
+bool finished(VideoState* is) {
+	return is->eof &&
+		(!is->audio_st || (is->auddec.finished == is->audioq.serial &&
+							FrameQueueC::frame_queue_nb_remaining(&is->sampq) == 0)) &&
+		(!is->video_st || (is->viddec.finished == is->videoq.serial &&
+							FrameQueueC::frame_queue_nb_remaining(&is->pictq) == 0));
+}
+
+
+FileResult bench_file(const std::string &path) {
+	FileResult result;
+	result.file = path;
+	std::cerr << "Decoding " << path << "..." << std::endl;
+
+	long rss;
+	StageCounts before = StageCounts::now();
+	double cpuBefore = processCpu(rss);
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	VideoState* is = StreamHandler::stream_open(path.c_str(), file_iformat, 0);
+	if (!is) { return result; }
+
+	// Drain the queues until the end of the file, waiting on the decoders while they are empty.
+	StageCounts progress = before;
+	std::chrono::steady_clock::time_point lastProgress = begin;
+	while (!finished(is)) {
+		int n = drain(&is->sampq) + drain(&is->pictq);
+		if (n > 0) { continue; }
+
+		FrameQueue* f = is->video_st ? &is->pictq : &is->sampq;
+		SDL_LockMutex(f->mutex);
+		if (FrameQueueC::frame_queue_nb_remaining(f) == 0) {
+			SDL_CondWaitTimeout(f->cond, f->mutex, 1);
+		}
+
+		SDL_UnlockMutex(f->mutex);
+
+		StageCounts current = StageCounts::now();
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		if (current.packets != progress.packets || current.audioQueued != progress.audioQueued ||
+				current.videoQueued != progress.videoQueued) {
+			progress = current;
+			lastProgress = now;
+		}
+		else if (std::chrono::duration_cast<std::chrono::milliseconds>(now - lastProgress).count()
+																		> BENCH_STALL_TIMEOUT) {
+			std::cerr << "No progress, giving up on " << path << "." << std::endl;
+			break;
+		}
+	}
+
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+	result.ok = finished(is);
+	result.wallSeconds = std::chrono::duration<double>(end - begin).count();
+	result.counts = StageCounts::now() - before;
+	result.readCpu = threadCpu(is->read_tid);
+	result.audioCpu = threadCpu(is->auddec.decoder_tid);
+	result.videoCpu = threadCpu(is->viddec.decoder_tid);
+	result.processCpu = processCpu(result.peakRss) - cpuBefore;
+	if (is->ic && is->ic->duration > 0) {
+		result.mediaSeconds = (double) is->ic->duration / AV_TIME_BASE;
+	}
+
+	StreamHandler::stream_close(is);
+	return result;
+}
+
+
+std::string jsonString(const std::string &s) {
+	std::string out = "\"";
+	for (int i = 0; i < s.size(); ++i) {
+		if (s[i] == '"' || s[i] == '\\') { out += '\\'; }
+		if ((unsigned char) s[i] < 0x20) { out += ' '; continue; }
+		out += s[i];
+	}
+
+	return out + "\"";
+}
+
+
+// Rate per second, and CPU time per item in µs, or 0 for no items.
+double perSecond(uint64_t count, double seconds) { return seconds > 0 ? count / seconds : 0; }
+double usPer(double cpu, uint64_t count) { return count > 0 ? cpu * 1e6 / count : 0; }
+
+
+std::string jsonResult(const FileResult &r, const std::string &indent) {
+	const StageCounts &c = r.counts;
+	uint64_t frames = c.audioDecoded + c.videoDecoded;
+	char buf[2048];
+	snprintf(buf, sizeof(buf),
+		"%s\"ok\": %s,\n"
+		"%s\"media_s\": %.3f,\n"
+		"%s\"wall_s\": %.3f,\n"
+		"%s\"speed\": %.2f,\n"
+		"%s\"stages\": {\n"
+		"%s\t\"demux\": { \"packets\": %llu, \"per_s\": %.1f },\n"
+		"%s\t\"audio_decode\": { \"frames\": %llu, \"per_s\": %.1f },\n"
+		"%s\t\"audio_filter\": { \"frames\": %llu, \"per_s\": %.1f },\n"
+		"%s\t\"video_decode\": { \"frames\": %llu, \"per_s\": %.1f },\n"
+		"%s\t\"video_filter\": { \"frames\": %llu, \"per_s\": %.1f }\n"
+		"%s},\n"
+		"%s\"threads\": {\n"
+		"%s\t\"read\": { \"cpu_s\": %.3f, \"cpu_us_per_packet\": %.1f },\n"
+		"%s\t\"audio\": { \"cpu_s\": %.3f, \"cpu_us_per_frame\": %.1f },\n"
+		"%s\t\"video\": { \"cpu_s\": %.3f, \"cpu_us_per_frame\": %.1f }\n"
+		"%s},\n"
+		"%s\"process_cpu_s\": %.3f,\n"
+		"%s\"cpu_us_per_frame\": %.1f,\n"
+		"%s\"peak_rss_kb\": %ld\n",
+		indent.c_str(), r.ok ? "true" : "false",
+		indent.c_str(), r.mediaSeconds,
+		indent.c_str(), r.wallSeconds,
+		indent.c_str(), r.wallSeconds > 0 ? r.mediaSeconds / r.wallSeconds : 0,
+		indent.c_str(),
+		indent.c_str(), (unsigned long long) c.packets, perSecond(c.packets, r.wallSeconds),
+		indent.c_str(), (unsigned long long) c.audioDecoded, perSecond(c.audioDecoded, r.wallSeconds),
+		indent.c_str(), (unsigned long long) c.audioQueued, perSecond(c.audioQueued, r.wallSeconds),
+		indent.c_str(), (unsigned long long) c.videoDecoded, perSecond(c.videoDecoded, r.wallSeconds),
+		indent.c_str(), (unsigned long long) c.videoQueued, perSecond(c.videoQueued, r.wallSeconds),
+		indent.c_str(),
+		indent.c_str(),
+		indent.c_str(), r.readCpu, usPer(r.readCpu, c.packets),
+		indent.c_str(), r.audioCpu, usPer(r.audioCpu, c.audioDecoded),
+		indent.c_str(), r.videoCpu, usPer(r.videoCpu, c.videoDecoded),
+		indent.c_str(),
+		indent.c_str(), r.processCpu,
+		indent.c_str(), usPer(r.processCpu, frames),
+		indent.c_str(), r.peakRss);
+
+	return buf;
+}
+
+
+int main(int argc, char** argv) {
+	if (argc < 2) {
+		std::cerr << "Usage: bench_decode <file or folder> [...]" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	// The corpus, in a stable order.
+	std::vector<std::string> files;
+	for (int i = 1; i < argc; ++i) {
+		std::error_code ec;
+		if (fs::is_directory(argv[i], ec)) {
+			std::vector<std::string> folder;
+			for (const fs::directory_entry &entry : fs::directory_iterator(argv[i], ec)) {
+				if (entry.is_regular_file()) { folder.push_back(entry.path().string()); }
+			}
+
+			std::sort(folder.begin(), folder.end());
+			files.insert(files.end(), folder.begin(), folder.end());
+		}
+		else {
+			files.push_back(argv[i]);
+		}
+	}
+
+	av_init_packet(&flush_pkt);
+	flush_pkt.data = (uint8_t*) &flush_pkt;
+	avdevice_register_all();
+	init_opts();
+	av_log_set_flags(AV_LOG_SKIP_REPEATED);
+	av_log_set_level(AV_LOG_ERROR);
+
+	// No audio device, and a renderer which takes YUV420P.
+	AudioRenderer::setNullSink(true);
+	renderer_info.num_texture_formats = 1;
+	renderer_info.texture_formats[0] = SDL_PIXELFORMAT_IYUV;
+
+	std::vector<FileResult> results;
+	FileResult total;
+	total.ok = true;
+	for (int i = 0; i < files.size(); ++i) {
+		FileResult r = bench_file(files[i]);
+		results.push_back(r);
+		if (!r.ok) { total.ok = false; }
+		total.mediaSeconds += r.mediaSeconds;
+		total.wallSeconds += r.wallSeconds;
+		total.counts.packets += r.counts.packets;
+		total.counts.audioDecoded += r.counts.audioDecoded;
+		total.counts.audioQueued += r.counts.audioQueued;
+		total.counts.videoDecoded += r.counts.videoDecoded;
+		total.counts.videoQueued += r.counts.videoQueued;
+		total.readCpu += r.readCpu;
+		total.audioCpu += r.audioCpu;
+		total.videoCpu += r.videoCpu;
+		total.processCpu += r.processCpu;
+		total.peakRss = std::max(total.peakRss, r.peakRss);
+	}
+
+	std::ostringstream out;
+	out << "{\n\t\"files\": [\n";
+	for (int i = 0; i < results.size(); ++i) {
+		out << "\t\t{\n\t\t\t\"file\": " << jsonString(results[i].file) << ",\n";
+		out << jsonResult(results[i], "\t\t\t");
+		out << "\t\t}" << (i + 1 < results.size() ? "," : "") << "\n";
+	}
+
+	out << "\t],\n\t\"total\": {\n" << jsonResult(total, "\t\t") << "\t}\n}\n";
+	std::cout << out.str();
+
+	return total.ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,108 @@
+/*
+	bench_packet_queue.cpp - Put/get throughput of the ffplay packet queue.
+
+	Benchmarks:
+	- The read thread putting packets, and a decoder thread getting them, with and without the
+		pool of list nodes. Without the pool, every packet allocates and frees a node.
+	- The same, with a single thread doing both, which shows the allocator cost alone.
+
+	Notes:
+	- Packets are empty, so that only the queue itself gets measured.
+*/
+
+#include "packet_queue.h"		// Not "types.h", as this folder has its own.
+
+#include <iostream>
+#include <thread>
+#include <chrono>
+#include <cstdlib>
+
+
+AVPacket flush_pkt;
+
+#define BENCH_PACKETS 2000000
+#define BENCH_DEPTH 64		// Packets queued at most, as with MIN_FRAMES and up.
+
+
+// Returns the packets per second, or 0 on failure.
+double bench_threaded(int max_free) {
+	PacketQueue q;
+	if (PacketQueueC::packet_queue_init(&q) < 0) { return 0; }
+	q.max_free = max_free;
+	PacketQueueC::packet_queue_start(&q);
+
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	std::thread consumer([&q] {
+		AVPacket pkt;
+		int serial;
+		for (int i = 0; i < BENCH_PACKETS + 1; ++i) {		// Includes the flush packet.
+			if (PacketQueueC::packet_queue_get(&q, &pkt, 1, &serial) < 0) { return; }
+		}
+	});
+
+	for (int i = 0; i < BENCH_PACKETS; ++i) {
+		while (q.nb_packets >= BENCH_DEPTH) { std::this_thread::yield(); }
+		PacketQueueC::packet_queue_put_nullpacket(&q, 0);
+	}
+
+	consumer.join();
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+	PacketQueueC::packet_queue_destroy(&q);
+
+	double seconds = std::chrono::duration<double>(end - begin).count();
+	return BENCH_PACKETS / seconds;
+}
+
+
+double bench_single(int max_free) {
+	PacketQueue q;
+	if (PacketQueueC::packet_queue_init(&q) < 0) { return 0; }
+	q.max_free = max_free;
+	PacketQueueC::packet_queue_start(&q);
+
+	AVPacket pkt;
+	int serial;
+	PacketQueueC::packet_queue_get(&q, &pkt, 0, &serial);		// The flush packet.
+
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	for (int i = 0; i < BENCH_PACKETS / BENCH_DEPTH; ++i) {
+		for (int j = 0; j < BENCH_DEPTH; ++j) {
+			PacketQueueC::packet_queue_put_nullpacket(&q, 0);
+		}
+
+		for (int j = 0; j < BENCH_DEPTH; ++j) {
+			PacketQueueC::packet_queue_get(&q, &pkt, 0, &serial);
+		}
+	}
+
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+	PacketQueueC::packet_queue_destroy(&q);
+
+	double seconds = std::chrono::duration<double>(end - begin).count();
+	return BENCH_PACKETS / seconds;
+}
+
+
+int main() {
+	av_init_packet(&flush_pkt);
+	flush_pkt.data = (uint8_t*) &flush_pkt;
+
+	std::cout << "Packets: " << BENCH_PACKETS << ", queue depth: " << BENCH_DEPTH << std::endl;
+
+	double single = bench_single(0);
+	double singlePool = bench_single(PACKET_QUEUE_POOL_SIZE);
+	std::cout << "\nSingle thread, allocated nodes: " << (uint64_t) single << " packets/s\n";
+	std::cout << "Single thread, pooled nodes:    " << (uint64_t) singlePool << " packets/s\n";
+
+	double threaded = bench_threaded(0);
+	double threadedPool = bench_threaded(PACKET_QUEUE_POOL_SIZE);
+	std::cout << "\nTwo threads, allocated nodes:   " << (uint64_t) threaded << " packets/s\n";
+	std::cout << "Two threads, pooled nodes:      " << (uint64_t) threadedPool << " packets/s\n";
+
+	if (single == 0 || singlePool == 0 || threaded == 0 || threadedPool == 0) {
+		std::cout << "\n*** Packet queue benchmark failed.\n";
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,182 @@
+/*
+	test_clientregistry.cpp - Tests for the ClientRegistry class.
+
+	Tests:
+	- Lifecycle: clients can be added once, found, and removed.
+	- Client string: the client ID and capabilities are split, and unknown capabilities ignored.
+	- Eviction: only clients which failed and have not been seen within the timeout get removed.
+	- Concurrency: lookups, status broadcasts and clients connecting and disconnecting, all from
+		separate threads. A client removed during a broadcast must remain valid for the broadcast.
+*/
+
+#include "../server/clientregistry.h"
+
+#include <iostream>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <cstdlib>
+
+
+int test_lifecycle() {
+	std::cout << "\n*** Test lifecycle ***\n";
+
+	ClientRegistry registry;
+	if (!registry.add(1, "Phone") || registry.add(1, "Phone again") || !registry.add(17, "Tablet")) {
+		std::cout << "*** Test lifecycle: add failed.\n";
+		return EXIT_FAILURE;
+	}
+
+	CastClientPtr client = registry.get(1);
+	if (!client || client->name != "Phone" || registry.size() != 2 || !registry.contains(17)) {
+		std::cout << "*** Test lifecycle: lookup failed.\n";
+		return EXIT_FAILURE;
+	}
+
+	if (!registry.remove(1) || registry.remove(1) || registry.get(1) || registry.size() != 1) {
+		std::cout << "*** Test lifecycle: remove failed.\n";
+		return EXIT_FAILURE;
+	}
+
+	// The instance obtained before the removal remains valid.
+	if (client->name != "Phone") {
+		std::cout << "*** Test lifecycle: removed client invalid.\n";
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+
+int test_client_string() {
+	std::cout << "\n*** Test client string ***\n";
+
+	std::string name;
+	if (ClientRegistry::parseClientString("Phone", name) != 0 || name != "Phone") {
+		std::cout << "*** Test client string: plain ID not parsed.\n";
+		return EXIT_FAILURE;
+	}
+
+	if (ClientRegistry::parseClientString("Phone;future;status_delta", name) 
+			!= CLIENT_CAP_STATUS_DELTA || name != "Phone") {
+		std::cout << "*** Test client string: capabilities not parsed.\n";
+		return EXIT_FAILURE;
+	}
+
+	ClientRegistry registry;
+	registry.add(1, name, CLIENT_CAP_STATUS_DELTA);
+	if (!registry.get(1) || registry.get(1)->caps != CLIENT_CAP_STATUS_DELTA) {
+		std::cout << "*** Test client string: capabilities not kept.\n";
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+
+int test_eviction() {
+	std::cout << "\n*** Test eviction ***\n";
+
+	ClientRegistry registry;
+	registry.add(1, "Failing");
+	registry.add(2, "Failing, but seen");
+	registry.add(3, "Quiet");
+
+	registry.fail(1);
+	registry.fail(2);
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+	// Nothing is older than the timeout yet.
+	if (!registry.evict(1000).empty()) {
+		std::cout << "*** Test eviction: evicted too early.\n";
+		return EXIT_FAILURE;
+	}
+
+	registry.touch(2);
+	registry.fail(2);
+	std::vector<int> evicted = registry.evict(25);
+	if (evicted.size() != 1 || evicted[0] != 1 || !registry.contains(2) || !registry.contains(3)) {
+		std::cout << "*** Test eviction: wrong clients evicted.\n";
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+
+int test_concurrency() {
+	std::cout << "\n*** Test concurrency ***\n";
+
+	ClientRegistry registry;
+	std::atomic<bool> running = { true };
+	std::atomic<uint32_t> broadcasts = { 0 };
+	std::atomic<uint32_t> lookups = { 0 };
+
+	// Clients connecting and disconnecting.
+	std::thread connector([&] {
+		int handle = 0;
+		while (running) {
+			registry.add(handle % 64, "Client");
+			registry.remove((handle + 32) % 64);
+			handle++;
+		}
+	});
+
+	// Status broadcasts, which use every client found.
+	std::thread broadcaster([&] {
+		while (running) {
+			std::vector<int> handles = registry.handles();
+			for (int i = 0; i < handles.size(); ++i) {
+				CastClientPtr client = registry.get(handles[i]);
+				if (client) {
+					client->failures++;
+					client->lastSeen = ClientRegistry::now();
+				}
+			}
+
+			registry.evict(0);
+			broadcasts++;
+		}
+	});
+
+	// RPC handlers looking up their client.
+	std::thread handler([&] {
+		int handle = 0;
+		while (running) {
+			CastClientPtr client = registry.get(handle++ % 64);
+			if (client) { client->filesize = 1; }
+			registry.touch(handle % 64);
+			lookups++;
+		}
+	});
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(500));
+	running = false;
+	connector.join();
+	broadcaster.join();
+	handler.join();
+
+	uint32_t found = registry.handles().size();
+	std::cout << "Broadcasts: " << broadcasts << ", lookups: " << lookups << ", clients: "
+				<< registry.size() << std::endl;
+	if (found != registry.size() || broadcasts == 0 || lookups == 0) {
+		std::cout << "*** Test concurrency: inconsistent registry.\n";
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+
+int main() {
+	int res = test_lifecycle()
+		|| test_client_string()
+		|| test_eviction()
+		|| test_concurrency();
+
+	if (res == EXIT_SUCCESS) {
+		std::cout << "\n* * * Client registry tests completed successfully * * *\n";
+	}
+
+	return res;
+}
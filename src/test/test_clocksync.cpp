@@ -0,0 +1,205 @@
+/*
+	test_clocksync.cpp - Tests for the ClockSync class.
+
+	Tests:
+	- Loopback: exchanges with the local clock, through a real thread, must yield no offset. The
+		update handler gets called after each periodic exchange.
+	- Offset and drift: a simulated slave clock with an offset and drift, behind a network with
+		random, asymmetric delays. The estimate must follow the slave clock.
+	- Outliers: a single badly delayed exchange must not move the estimate.
+	- Conversion: converting master time to slave time and back must yield the original time.
+*/
+
+#include "../server/clocksync.h"
+
+#include <iostream>
+#include <random>
+#include <thread>
+#include <chrono>
+#include <cstdlib>
+
+
+// Simulated network and slave clock. Master time is virtual, so that the tests run instantly.
+int64_t masterTime = 1600000000000000;
+int64_t slaveBase = 1600000000000000;
+int64_t slaveOffset = 0;		// Microseconds.
+double slaveDrift = 0.0;		// Parts per million.
+int64_t forcedDelay = 0;		// Extra one-way delay for the next exchange, in microseconds.
+std::mt19937 rng(42);
+std::exponential_distribution<double> jitter(1.0 / 2000.0);		// Mean of 2 ms.
+
+
+int64_t virtualNow() {
+	return masterTime;
+}
+
+
+int64_t slaveTime(int64_t master) {
+	return master + slaveOffset + (int64_t) ((double) (master - slaveBase) * slaveDrift / 1000000.0);
+}
+
+
+bool simulatedExchange(uint32_t handle, int64_t t0, int64_t &t1, int64_t &t2) {
+	masterTime += 1000 + (int64_t) jitter(rng) + forcedDelay;
+	t1 = slaveTime(masterTime);
+	masterTime += 50;
+	t2 = slaveTime(masterTime);
+	masterTime += 1000 + (int64_t) jitter(rng);
+	forcedDelay = 0;
+
+	return true;
+}
+
+
+bool loopbackExchange(uint32_t handle, int64_t t0, int64_t &t1, int64_t &t2) {
+	std::this_thread::sleep_for(std::chrono::microseconds(500));
+	t1 = ClockSync::now();
+	t2 = ClockSync::now();
+	std::this_thread::sleep_for(std::chrono::microseconds(500));
+
+	return true;
+}
+
+
+int test_loopback() {
+	std::cout << "\n*** Test loopback ***\n";
+
+	ClockSyncConfig config;
+	config.samples = 4;
+	config.interval = 10;
+	ClockSync clock(1, loopbackExchange, config);
+	int updates = 0;
+	clock.setUpdateHandler([&updates](ClockSync &c) { updates++; });
+	if (!clock.sync()) {
+		std::cout << "*** Test loopback: sync failed.\n";
+		return EXIT_FAILURE;
+	}
+
+	clock.start();
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	clock.stop();
+
+	int64_t offset = clock.getOffset();
+	std::cout << "Offset: " << offset << " us, delay: " << clock.getDelay() << " us.\n";
+	if (std::abs(offset) > 500 || clock.getDelay() < 1000 || updates == 0) {
+		std::cout << "*** Test loopback: wrong estimate.\n";
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+
+int test_offset_drift() {
+	std::cout << "\n*** Test offset and drift ***\n";
+	slaveOffset = 123456;
+	slaveDrift = 50.0;
+
+	ClockSyncConfig config;
+	ClockSync clock(1, simulatedExchange, config, virtualNow);
+	if (!clock.sync()) {
+		std::cout << "*** Test offset and drift: sync failed.\n";
+		return EXIT_FAILURE;
+	}
+
+	// Initial estimate, from a burst of exchanges.
+	int64_t error = clock.toRemote(masterTime) - slaveTime(masterTime);
+	std::cout << "Initial error: " << error << " us.\n";
+	if (std::abs(error) > 1000) {
+		std::cout << "*** Test offset and drift: initial error too large.\n";
+		return EXIT_FAILURE;
+	}
+
+	// Re-synchronise every 5 seconds for ten minutes.
+	for (int i = 0; i < 120; ++i) {
+		masterTime += 5000000;
+		clock.exchange();
+	}
+
+	error = clock.toRemote(masterTime) - slaveTime(masterTime);
+	double drift = clock.getDrift();
+	std::cout << "Error: " << error << " us, drift: " << drift << " ppm.\n";
+	if (std::abs(error) > 500 || std::abs(drift - slaveDrift) > 5.0) {
+		std::cout << "*** Test offset and drift: estimate off.\n";
+		return EXIT_FAILURE;
+	}
+
+	// Predict 30 seconds ahead without further exchanges.
+	int64_t ahead = masterTime + 30000000;
+	error = clock.toRemote(ahead) - slaveTime(ahead);
+	std::cout << "Error 30 s ahead: " << error << " us.\n";
+	if (std::abs(error) > 1000) {
+		std::cout << "*** Test offset and drift: prediction off.\n";
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+
+int test_outliers() {
+	std::cout << "\n*** Test outliers ***\n";
+	slaveOffset = -50000;
+	slaveDrift = 0.0;
+
+	ClockSyncConfig config;
+	ClockSync clock(1, simulatedExchange, config, virtualNow);
+	for (int i = 0; i < 16; ++i) {
+		masterTime += 1000000;
+		clock.exchange();
+	}
+
+	int64_t before = clock.getOffset();
+
+	// One exchange with 200 ms of extra delay in one direction only.
+	masterTime += 1000000;
+	forcedDelay = 200000;
+	clock.exchange();
+	int64_t after = clock.getOffset();
+
+	std::cout << "Offset before: " << before << " us, after: " << after << " us.\n";
+	if (std::abs(after - before) > 500 || std::abs(after - slaveOffset) > 1000) {
+		std::cout << "*** Test outliers: outlier moved the estimate.\n";
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+
+int test_conversion() {
+	std::cout << "\n*** Test conversion ***\n";
+	slaveOffset = 2500000;
+	slaveDrift = -80.0;
+
+	ClockSyncConfig config;
+	ClockSync clock(1, simulatedExchange, config, virtualNow);
+	for (int i = 0; i < 32; ++i) {
+		masterTime += 2000000;
+		clock.exchange();
+	}
+
+	int64_t start = masterTime + 500000;
+	int64_t back = clock.toLocal(clock.toRemote(start));
+	std::cout << "Round trip error: " << back - start << " us.\n";
+	if (std::abs(back - start) > 1) {
+		std::cout << "*** Test conversion: conversion not reversible.\n";
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+
+int main() {
+	int res = test_loopback()
+		|| test_offset_drift()
+		|| test_outliers()
+		|| test_conversion();
+
+	if (res == EXIT_SUCCESS) {
+		std::cout << "\n* * * Clock sync tests completed successfully * * *\n";
+	}
+
+	return res;
+}
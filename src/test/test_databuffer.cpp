@@ -15,6 +15,7 @@
 
 // Globals
 uint8_t lastnum = 0;
+DataBuffer db;
 std::condition_variable dataRequestCv;
 std::atomic<bool> running = { true };
 
@@ -29,7 +30,7 @@ void dataRequestFunction() {
 	
 	// Create and share condition variable with DataBuffer class.
 	std::mutex dataRequestMtx;
-	DataBuffer::setDataRequestCondition(&dataRequestCv);
+	db.setDataRequestCondition(&dataRequestCv);
 	
 	std::cout << "Entering data request loop..." << std::endl;
 	
@@ -43,23 +44,27 @@ void dataRequestFunction() {
 			break;
 		}
 				
-		// Write into the buffer. We use a 10 byte pattern.
-		std::string data;
-		for (uint32_t i = 0; i < 10; ++i) {
-			data.append(1, (char) lastnum++);
-		}
+		// Answer each outstanding request with the requested number of bytes of the pattern.
+		uint64_t offset;
+		uint32_t length;
+		while (lastnum < 100 && db.nextRequest(offset, length)) {
+			std::string data;
+			for (uint32_t i = 0; i < length && lastnum < 100; ++i) {
+				data.append(1, (char) lastnum++);
+			}
 		
-		uint32_t wrote = DataBuffer::write(data);
+			uint32_t wrote = db.write(data);
 		
-		std::cout << "Wrote " << wrote << " \t- ";
-		for (uint32_t i = 0; i < wrote; ++i) {
-			std::cout << (uint16_t) data[i] << " ";
-		}
+			std::cout << "Wrote " << wrote << " \t- ";
+			for (uint32_t i = 0; i < wrote; ++i) {
+				std::cout << (uint16_t) data[i] << " ";
+			}
 		
-		std::cout << std::endl;
+			std::cout << std::endl;
 		
-		if (lastnum >= 100) {
-			DataBuffer::setEof(true);
+			if (lastnum >= 100) {
+				db.setEof(true);
+			}
 		}
 	}
 }
@@ -69,10 +74,10 @@ int main() {
 	std::cout << "Running DataBuffer test..." << std::endl;
 	
 	// Create 20 byte buffer.
-	DataBuffer::init(20); 
+	db.init(20); 
 	
 	// Set seek handler.
-	//DataBuffer::setSeekRequestCallback(seekingHandler);
+	//db.setSeekRequestCallback(seekingHandler);
 	
 	// Start the data request handler in its own thread.
 	std::thread drq(dataRequestFunction);
@@ -85,15 +90,23 @@ int main() {
 	uint8_t bytes[8];
 	uint8_t expected = 0;
 	bool abort = false;
-	while (!DataBuffer::isEof()) {
-		uint32_t read = DataBuffer::read(8, bytes);
+	uint32_t retries = 0;
+	while (!db.isEof()) {
+		uint32_t read = db.read(8, bytes);
 		if (read == 0) {
+			// The buffer may run empty while the next block is on its way.
+			if (retries++ < 1000) {
+				std::this_thread::sleep_for(1ms);
+				continue;
+			}
+			
 			std::cout << "Failed to read. Aborting." << std::endl;
 			break;
 		}
 		
+		retries = 0;
 		std::cout << "Read " << read << "\t- ";
-		for (uint32_t i = 0; i < 8; ++i) {
+		for (uint32_t i = 0; i < read; ++i) {
 			std::cout << (uint16_t) bytes[i] << " ";
 			
 			if (expected++ != bytes[i]) {
@@ -4,10 +4,19 @@
 // - Wrap-around: Alternatingly write a number of bytes in the databuffer and read them from the buffer.
 // - Reset:
 // - Seek:
+// - Seek window: seeks inside the retained window must not call the seek request callback.
+// - Segment cache: data dropped by an out-of-window seek must be served from the cache.
+// - Pipelined: multiple requests in flight, answered out of order with tagged data.
+// - Watermarks: refills start below the low watermark and stop at the high watermark. Reads on
+//		an empty buffer block until data arrives.
+// - Chunks: data referenced by a chunk must not be overwritten until the chunk is released.
 
 #include "../server/databuffer.h"
+#include "../server/session.h"
 #include <iostream>
 #include <vector>
+#include <thread>
+#include <chrono>
 
 template< typename T >
 char to_char( T v )
@@ -21,6 +30,8 @@ int to_int( T v )
 	return static_cast<int>( v );
 }
 
+DataBuffer db;
+
 std::string create_range(int begin, int end)
 {
 	std::string data;
@@ -78,7 +89,7 @@ int test_wraparound()
 
 	const int size_buffer = 20;
 
-	DataBuffer::init(size_buffer);
+	db.init(size_buffer);
 
 	const int Nrepeat_size     = 30;
 	const int size_write_begin = 3;
@@ -88,8 +99,8 @@ int test_wraparound()
 	{
 		const int size_read = size_write;
 
-		// DataBuffer::cleanup();
-		// DataBuffer::init(size_buffer);
+		// db.cleanup();
+		// db.init(size_buffer);
 
 		const int b = 1;
 		const int e = size_write + 1;
@@ -99,8 +110,8 @@ int test_wraparound()
 		{
 			std::vector<uint8_t> bytes(size_read, to_char(99));
 
-			const uint32_t Nw = DataBuffer::write(data);
-			const uint32_t Nr = DataBuffer::read(size_read, bytes.data());
+			const uint32_t Nw = db.write(data);
+			const uint32_t Nr = db.read(size_read, bytes.data());
 
 			std::cout << "*** Test wraparound: Iteration #" << i+1 << ":\n";
 
@@ -126,7 +137,7 @@ int test_reset()
 
 	const int size_buffer = 20;
 
-	DataBuffer::init(size_buffer);
+	db.init(size_buffer);
 
 	const int size_write = 3;
 	const int size_read  = size_write;
@@ -139,16 +150,16 @@ int test_reset()
 	{
 		std::vector<uint8_t> bytes(size_read, to_char(99));
 
-		const uint32_t Nw = DataBuffer::write(data);
+		const uint32_t Nw = db.write(data);
 
 #if 0
-		if ( Nw != DataBuffer::size() )
+		if ( Nw != db.size() )
 		{
-			std::cout << "*** Test reset: expecting '" << Nw << "' items in buffer, got '" << DataBuffer::size() << "'\n";
+			std::cout << "*** Test reset: expecting '" << Nw << "' items in buffer, got '" << db.size() << "'\n";
 			return EXIT_FAILURE;
 		}
 #endif
-		const uint32_t Nr = DataBuffer::read(size_read, bytes.data());
+		const uint32_t Nr = db.read(size_read, bytes.data());
 
 		if ( Nr != Nw || create_data(bytes) != data)
 		{
@@ -161,13 +172,13 @@ int test_reset()
 	{
 		std::vector<uint8_t> bytes(size_read, to_char(99));
 
-		const uint32_t Nw = DataBuffer::write(data);
+		const uint32_t Nw = db.write(data);
 
 		// clear buffer, keep allocated memory:
 		std::cout << "*** Test reset: Reset buffer\n";
-		DataBuffer::reset();
+		db.reset();
 
-		const uint32_t Nr = DataBuffer::read(size_read, bytes.data());
+		const uint32_t Nr = db.read(size_read, bytes.data());
 
 		if ( Nr != 0 || bytes[0] != to_char(99))
 		{
@@ -186,7 +197,7 @@ int test_reset()
 
 // --- SEEKING HANDLER ---
 void seekingHandler(uint32_t session, int64_t offset) {
-	if (DataBuffer::seeking()) {
+	if (db.seeking()) {
 		const int size_write = 3;
 		const int size_read  = size_write;
 
@@ -194,7 +205,7 @@ void seekingHandler(uint32_t session, int64_t offset) {
 		const int e = size_write + 1;
 		std::string data = create_range(b, e);
 		
-		const uint32_t Nw = DataBuffer::write(data);
+		const uint32_t Nw = db.write(data);
 				
 		return; 
 	}
@@ -207,9 +218,9 @@ int test_seek()
 
 	const int size_buffer = 20;
 
-	DataBuffer::init(size_buffer);
+	db.init(size_buffer);
 
-	DataBuffer::setSeekRequestCallback(seekingHandler);
+	db.setSeekRequestCallback(seekingHandler);
 
 	const int size_write = 3;
 	const int size_read  = size_write;
@@ -220,13 +231,13 @@ int test_seek()
 
 	// test various variants of seeking:
 	{
-		const uint32_t Nw = DataBuffer::write(data);
-		DataBuffer::setFileSize(Nw);
+		const uint32_t Nw = db.write(data);
+		db.setFileSize(Nw);
 
 		// seek start:
 		std::cout << "\n*** Test seek: seek(DB_SEEK_START) ***\n";													
 		{
-			const int64_t Ns = DataBuffer::seek(DB_SEEK_START, 1);
+			const int64_t Ns = db.seek(DB_SEEK_START, 1);
 
 			if ( Ns != 1 )
 			{
@@ -238,7 +249,7 @@ int test_seek()
 		// seek current:
 		std::cout << "\n*** Test seek: seek(DB_SEEK_CURRENT) ***\n";
 		{
-			const int64_t Ns = DataBuffer::seek(DB_SEEK_CURRENT, 1);
+			const int64_t Ns = db.seek(DB_SEEK_CURRENT, 1);
 
 			if ( Ns != 2 )
 			{
@@ -250,7 +261,7 @@ int test_seek()
 		// seek end:
 		std::cout << "\n*** Test seek: seek(DB_SEEK_END) ***\n";
 		{
-			const int64_t  Ns = DataBuffer::seek(DB_SEEK_END, 0);
+			const int64_t  Ns = db.seek(DB_SEEK_END, 0);
 
 			if ( Ns != 2 )
 			{
@@ -264,8 +275,8 @@ int test_seek()
 		{
 			std::vector<uint8_t> bytes(size_read, to_char(99));
 
-			const int64_t  Ns = DataBuffer::seek(DB_SEEK_START, 0);
-			const uint32_t Nr = DataBuffer::read(size_read, bytes.data());
+			const int64_t  Ns = db.seek(DB_SEEK_START, 0);
+			const uint32_t Nr = db.read(size_read, bytes.data());
 
 			if ( Nr != Nw || create_data(bytes) != data)
 			{
@@ -278,7 +289,7 @@ int test_seek()
 			// verify buffer is empty now: suggestion: add public method `size()`:
 			{
 #if 0
-				if ( 0 != DataBuffer::size() )
+				if ( 0 != db.size() )
 				{
 					std::cout << "*** Test seek: expecting empty buffer***\n";
 					return EXIT_FAILURE;
@@ -286,7 +297,7 @@ int test_seek()
 #else
 				std::vector<uint8_t> bytes(size_read, to_char(99));
 
-				const uint32_t Nr = DataBuffer::read(size_read, bytes.data());
+				const uint32_t Nr = db.read(size_read, bytes.data());
 
 				if ( Nr != 0 || bytes[0] != to_char(99))
 				{
@@ -307,11 +318,497 @@ int test_seek()
 	return EXIT_SUCCESS;
 }
 
+int seekRequests = 0;
+
+void countingSeekHandler(uint32_t session, int64_t offset) {
+	seekRequests++;
+	if (db.seeking()) {
+		std::string data = create_range(offset, offset + 10);
+		db.write(data);
+	}
+}
+
+
+int test_seek_window()
+{
+	std::cout << "\n*** Test seek window ***\n";
+
+	const int size_buffer = 100;
+
+	db.init(size_buffer);
+	db.setSeekRequestCallback(countingSeekHandler);
+	seekRequests = 0;
+
+	std::string data = create_range(0, 60);
+	db.write(data);
+	db.setFileSize(100);
+
+	std::vector<uint8_t> bytes(40, to_char(99));
+	db.read(40, bytes.data());
+
+	// Seek back into already read data, then forward into unread data.
+	if ( db.seek(DB_SEEK_START, 30) != 30 || db.seek(DB_SEEK_CURRENT, 20) != 50 
+		|| db.seek(DB_SEEK_START, 25) != 25 || seekRequests != 0 )
+	{
+		std::cout << "*** Test seek window: local seek failed, or requested data from client.\n";
+		return EXIT_FAILURE;
+	}
+
+	std::vector<uint8_t> window(10, to_char(99));
+	if ( db.read(10, window.data()) != 10 || create_data(window) != create_range(25, 35) )
+	{
+		std::cout << "*** Test seek window: wrong data after local seek:\n";
+		print("*** ", window, "\n");
+		return EXIT_FAILURE;
+	}
+
+	// Seek outside of the window: must go to the client.
+	if ( db.seek(DB_SEEK_START, 80) != 80 || seekRequests != 1 )
+	{
+		std::cout << "*** Test seek window: seek outside of window did not request data.\n";
+		return EXIT_FAILURE;
+	}
+
+	if ( db.read(10, window.data()) != 10 || create_data(window) != create_range(80, 90) )
+	{
+		std::cout << "*** Test seek window: wrong data after remote seek:\n";
+		print("*** ", window, "\n");
+		return EXIT_FAILURE;
+	}
+
+	std::cout << "\n* * * Seek window tests completed successfully * * *\n";
+
+	return EXIT_SUCCESS;
+}
+
+void blockSeekHandler(uint32_t session, int64_t offset) {
+	seekRequests++;
+	if (db.seeking()) {
+		std::string data = create_range(offset, offset + 10000);
+		db.write(data);
+	}
+}
+
+
+int test_segment_cache()
+{
+	std::cout << "\n*** Test segment cache ***\n";
+
+	// 32 kB of the 128 kB go to the segment cache, in 4 kB segments.
+	db.init(128 * 1024, 4096);
+	db.setSeekRequestCallback(blockSeekHandler);
+	db.setFileSize(1024 * 1024);
+	seekRequests = 0;
+
+	std::string data = create_range(0, 30000);
+	db.write(data);
+
+	std::vector<uint8_t> bytes(10000, to_char(99));
+	db.read(10000, bytes.data());
+
+	// Jump far ahead, as when reading an index at the end of the file. This is a cache miss.
+	if ( db.seek(DB_SEEK_START, 900000) != 900000 || seekRequests != 1 )
+	{
+		std::cout << "*** Test segment cache: remote seek failed.\n";
+		return EXIT_FAILURE;
+	}
+
+	db.read(100, bytes.data());
+
+	// Jump back. The data around the old read position is served from the cache, and the client
+	// is asked for the data following the cached range.
+	if ( db.seek(DB_SEEK_START, 5000) != 5000 || seekRequests != 2 )
+	{
+		std::cout << "*** Test segment cache: cached seek failed.\n";
+		return EXIT_FAILURE;
+	}
+
+	if ( db.read(10000, bytes.data()) != 10000 || create_data(bytes) != create_range(5000, 15000) )
+	{
+		std::cout << "*** Test segment cache: wrong data read from cache.\n";
+		return EXIT_FAILURE;
+	}
+
+	// Read across the end of the cached range into the data from the client.
+	std::vector<uint8_t> tail(8000, to_char(99));
+	if ( db.read(8000, tail.data()) != 8000 || create_data(tail) != create_range(15000, 23000) )
+	{
+		std::cout << "*** Test segment cache: wrong data read past cached range.\n";
+		return EXIT_FAILURE;
+	}
+
+	SegmentCacheStats stats = db.cacheStats();
+	std::cout << "Hits: " << stats.hits << ", misses: " << stats.misses << ", evictions: " 
+				<< stats.evictions << ", used: " << stats.used << "/" << stats.segments << "\n";
+	if ( stats.hits != 1 || stats.misses != 1 || stats.segments != 8 )
+	{
+		std::cout << "*** Test segment cache: unexpected counters.\n";
+		return EXIT_FAILURE;
+	}
+
+	std::cout << "\n* * * Segment cache tests completed successfully * * *\n";
+
+	return EXIT_SUCCESS;
+}
+
+int test_pipelined()
+{
+	std::cout << "\n*** Test pipelined requests ***\n";
+
+	// 64 kB buffer without segment cache, 4 kB blocks and up to four requests in flight.
+	db.init(64 * 1024, 64 * 1024);
+	db.setFileSize(40000);
+	db.setBlockSizeLimits(4096, 4096);
+	db.setRequestWindow(4);
+
+	// Until the client has sent tagged data, only one request is sent at a time.
+	uint64_t offset;
+	uint32_t length;
+	if ( !db.nextRequest(offset, length) || offset != 0 || length != 4096 
+			|| db.nextRequest(offset, length) )
+	{
+		std::cout << "*** Test pipelined: unexpected first request.\n";
+		return EXIT_FAILURE;
+	}
+
+	std::string data = create_range(0, 4096);
+	db.writeAt(0, data.data(), data.length(), false);
+
+	// The buffer is nearly empty, so the window grows.
+	std::vector<uint64_t> offsets;
+	while ( db.nextRequest(offset, length) )
+		offsets.push_back(offset);
+
+	if ( offsets.size() != 2 || offsets[0] != 4096 || offsets[1] != 8192 )
+	{
+		std::cout << "*** Test pipelined: expected two requests, got " << offsets.size() << ".\n";
+		return EXIT_FAILURE;
+	}
+
+	// Answer the second request first. Its data must not become readable before the gap is filled.
+	data = create_range(8192, 12288);
+	db.writeAt(8192, data.data(), data.length(), false);
+
+	std::vector<uint8_t> bytes(8192, to_char(99));
+	if ( db.read(8192, bytes.data()) != 4096 )
+	{
+		std::cout << "*** Test pipelined: data past gap was readable.\n";
+		return EXIT_FAILURE;
+	}
+
+	// Data which was not requested is dropped.
+	data = create_range(20000, 24096);
+	if ( db.writeAt(20000, data.data(), data.length(), false) != 0 )
+	{
+		std::cout << "*** Test pipelined: unrequested data was accepted.\n";
+		return EXIT_FAILURE;
+	}
+
+	data = create_range(4096, 8192);
+	db.writeAt(4096, data.data(), data.length(), false);
+	if ( db.read(8192, bytes.data()) != 8192 || create_data(bytes) != create_range(4096, 12288) )
+	{
+		std::cout << "*** Test pipelined: wrong data after filling gap.\n";
+		return EXIT_FAILURE;
+	}
+
+	// Request the rest of the file, answering each batch in reverse order.
+	while ( true )
+	{
+		std::vector< std::pair<uint64_t, uint32_t> > batch;
+		while ( db.nextRequest(offset, length) )
+			batch.push_back(std::make_pair(offset, length));
+
+		if ( batch.empty() )
+			break;
+
+		for ( int i = batch.size() - 1; i >= 0; --i )
+		{
+			uint64_t end = batch[i].first + batch[i].second;
+			data = create_range(batch[i].first, end);
+			db.writeAt(batch[i].first, data.data(), data.length(), end == 40000);
+		}
+	}
+
+	std::vector<uint8_t> rest(40000 - 12288, to_char(99));
+	if ( !db.isEof() || db.read(rest.size(), rest.data()) != rest.size() 
+			|| create_data(rest) != create_range(12288, 40000) )
+	{
+		std::cout << "*** Test pipelined: wrong data at end of file. EOF: " << db.isEof() << "\n";
+		return EXIT_FAILURE;
+	}
+
+	std::cout << "Window: " << db.getRequestWindow() << "\n";
+	std::cout << "\n* * * Pipelined request tests completed successfully * * *\n";
+
+	return EXIT_SUCCESS;
+}
+
+int test_watermarks()
+{
+	std::cout << "\n*** Test watermarks ***\n";
+
+	// 64 kB buffer without segment cache, 4 kB blocks. Refill below 16 kB, up to 48 kB.
+	db.init(64 * 1024, 64 * 1024);
+	db.setFileSize(1024 * 1024);
+	db.setBlockSizeLimits(4096, 4096);
+	db.setRequestWindow(1);
+	db.setWatermarks(25, 75);
+
+	// Fill up to the high watermark.
+	uint64_t offset;
+	uint32_t length;
+	while ( db.nextRequest(offset, length) )
+	{
+		std::string data = create_range(offset, offset + length);
+		db.write(data);
+	}
+
+	std::vector<uint8_t> bytes(48 * 1024, to_char(99));
+	if ( db.read(bytes.size(), bytes.data()) != 48 * 1024 )
+	{
+		std::cout << "*** Test watermarks: buffer not filled up to the high watermark.\n";
+		return EXIT_FAILURE;
+	}
+
+	// Refill, then read down to just above the low watermark. No refill starts.
+	while ( db.nextRequest(offset, length) )
+	{
+		std::string data = create_range(offset, offset + length);
+		db.write(data);
+	}
+
+	db.read(32 * 1024, bytes.data());
+	if ( db.nextRequest(offset, length) )
+	{
+		std::cout << "*** Test watermarks: refill started above the low watermark.\n";
+		return EXIT_FAILURE;
+	}
+
+	// Below the low watermark a refill starts.
+	db.read(1, bytes.data());
+	if ( !db.nextRequest(offset, length) || offset != 96 * 1024 )
+	{
+		std::cout << "*** Test watermarks: no refill below the low watermark.\n";
+		return EXIT_FAILURE;
+	}
+
+	std::string data = create_range(offset, offset + length);
+	db.write(data);
+	db.read(bytes.size(), bytes.data());
+
+	// A read on the empty buffer waits for the data to arrive.
+	std::condition_variable dataRequestCv;
+	db.setDataRequestCondition(&dataRequestCv);
+	std::thread writer([]() {
+		uint64_t offset;
+		uint32_t length;
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		if ( db.nextRequest(offset, length) )
+		{
+			std::string data = create_range(offset, offset + length);
+			db.write(data);
+		}
+	});
+
+	uint32_t n = db.read(4096, bytes.data());
+	writer.join();
+	db.setDataRequestCondition(0);
+	if ( n != 4096 )
+	{
+		std::cout << "*** Test watermarks: blocking read returned " << n << " bytes.\n";
+		return EXIT_FAILURE;
+	}
+
+	std::cout << "\n* * * Watermark tests completed successfully * * *\n";
+
+	return EXIT_SUCCESS;
+}
+
+int test_chunks()
+{
+	std::cout << "\n*** Test chunks ***\n";
+
+	// 64 kB buffer without segment cache, 16 kB of which is retained.
+	db.init(64 * 1024, 64 * 1024);
+	db.setFileSize(1024 * 1024);
+
+	uint64_t position;
+	std::string data = create_range(0, 40000);
+	db.write(data.data(), data.length(), position);
+	MediaChunkPtr chunk = db.getChunk(position, 40000, false);
+	if ( !chunk || chunk->length != 40000 || db.getChunk(50000, 100, false) )
+	{
+		std::cout << "*** Test chunks: unexpected chunk.\n";
+		return EXIT_FAILURE;
+	}
+
+	// Reading everything moves the retained window past the chunk, but the chunk keeps its data
+	// from being overwritten.
+	std::vector<uint8_t> bytes(40000, to_char(99));
+	db.read(bytes.size(), bytes.data());
+	data = create_range(40000, 80000);
+	if ( db.write(data) != 64 * 1024 - 40000 )
+	{
+		std::cout << "*** Test chunks: wrote over data in use by a chunk.\n";
+		return EXIT_FAILURE;
+	}
+
+	if ( db.write(data) != 0 )
+	{
+		std::cout << "*** Test chunks: wrote into a full buffer.\n";
+		return EXIT_FAILURE;
+	}
+
+	std::string chunkData((const char*) chunk->spans[0].data, chunk->spans[0].length);
+	chunkData.append((const char*) chunk->spans[1].data, chunk->spans[1].length);
+	if ( chunkData != create_range(0, 40000) )
+	{
+		std::cout << "*** Test chunks: chunk data changed.\n";
+		return EXIT_FAILURE;
+	}
+
+	// Data requests only cover space which can be written, so not the space held by the chunk.
+	uint64_t offset;
+	uint32_t length;
+	db.setBlockSizeLimits(4096, 4096);
+	bytes.resize(20000);
+	db.read(bytes.size(), bytes.data());
+	if ( db.nextRequest(offset, length) )
+	{
+		std::cout << "*** Test chunks: requested data for space in use by a chunk.\n";
+		return EXIT_FAILURE;
+	}
+
+	// Once released, the space up to the retained window can be requested and written again.
+	chunk.reset();
+	if ( !db.nextRequest(offset, length) || offset != 64 * 1024 )
+	{
+		std::cout << "*** Test chunks: no request after release.\n";
+		return EXIT_FAILURE;
+	}
+
+	data = create_range(64 * 1024, 64 * 1024 + 10000);
+	if ( db.write(data) != 10000 )
+	{
+		std::cout << "*** Test chunks: space not available after release.\n";
+		return EXIT_FAILURE;
+	}
+
+	std::cout << "\n* * * Chunk tests completed successfully * * *\n";
+
+	return EXIT_SUCCESS;
+}
+
+// Answers data requests by writing the requested range into the session's buffer. The data of
+// the session with handle 2 is offset by 100, so that the sessions can be told apart.
+bool sessionRequestHandler(uint32_t handle, uint64_t offset, uint32_t length)
+{
+	CastSessionPtr session = SessionManager::get(handle);
+	if ( !session )
+		return false;
+
+	const int b = (int) offset + (handle == 2 ? 100 : 0);
+	std::string data = create_range(b, b + (int) length);
+	session->getBuffer()->write(data);
+
+	return true;
+}
+
+int test_sessions()
+{
+	std::cout << "\n*** Test sessions ***\n";
+
+	SessionConfig config;
+	config.bufferSize = 64 * 1024;
+	config.blockSizeMin = 4096;
+	config.blockSizeMax = 4096;
+	config.requestWindow = 1;
+	config.maxSessions = 2;
+	SessionManager::init(config, sessionRequestHandler, 0);
+
+	CastSessionPtr s1 = SessionManager::create(1);
+	CastSessionPtr s2 = SessionManager::create(2);
+	if ( !s1 || !s2 || SessionManager::create(3) || s1->getBuffer() == s2->getBuffer() )
+	{
+		std::cout << "*** Test sessions: unexpected session limit or shared buffer.\n";
+		return EXIT_FAILURE;
+	}
+
+	// Each session keeps the format hint of its own file.
+	MediaFormatHint hint;
+	hint.container = "flac";
+	s1->getBuffer()->setFormatHint(hint);
+	if ( s1->getBuffer()->getFormatHint().container != "flac"
+			|| !s2->getBuffer()->getFormatHint().container.empty() )
+	{
+		std::cout << "*** Test sessions: wrong format hint.\n";
+		return EXIT_FAILURE;
+	}
+
+	// Both sessions buffer at the same time, each from its own client.
+	s1->getBuffer()->setFileSize(1024 * 1024);
+	s2->getBuffer()->setFileSize(1024 * 1024);
+	s1->start();
+	s2->start();
+
+	std::vector<uint8_t> bytes(1000, to_char(99));
+	if ( s1->getBuffer()->read(bytes.size(), bytes.data()) != bytes.size()
+			|| create_data(bytes) != create_range(0, 1000) )
+	{
+		std::cout << "*** Test sessions: wrong data in first session.\n";
+		return EXIT_FAILURE;
+	}
+
+	if ( s2->getBuffer()->read(bytes.size(), bytes.data()) != bytes.size()
+			|| create_data(bytes) != create_range(100, 1100) )
+	{
+		std::cout << "*** Test sessions: wrong data in second session.\n";
+		return EXIT_FAILURE;
+	}
+
+	// The session which isn't played back is the next one to play.
+	SessionManager::setActive(s1);
+	if ( SessionManager::nextReady() != s2 || SessionManager::getActiveHandle() != 1 )
+	{
+		std::cout << "*** Test sessions: wrong next session.\n";
+		return EXIT_FAILURE;
+	}
+
+	// A new session of the same client replaces the old one, and stops its buffer.
+	CastSessionPtr s1b = SessionManager::create(1);
+	if ( !s1b || s1b == s1 || SessionManager::get(1) != s1b || SessionManager::getActive()
+			|| s1->getBuffer()->read(bytes.size(), bytes.data()) != 0 )
+	{
+		std::cout << "*** Test sessions: session not replaced.\n";
+		return EXIT_FAILURE;
+	}
+
+	SessionManager::remove(2);
+	if ( SessionManager::get(2) || !SessionManager::create(3) )
+	{
+		std::cout << "*** Test sessions: session not removed.\n";
+		return EXIT_FAILURE;
+	}
+
+	SessionManager::cleanup();
+
+	std::cout << "\n* * * Session tests completed successfully * * *\n";
+
+	return EXIT_SUCCESS;
+}
+
 int main()
 {
 	return test_wraparound()
 		|| test_reset()
-		|| test_seek();
+		|| test_seek()
+		|| test_seek_window()
+		|| test_segment_cache()
+		|| test_pipelined()
+		|| test_watermarks()
+		|| test_chunks()
+		|| test_sessions();
 }
 
 // g++ -std=c++17 -g3 -O0 -o bin/test_databuffer_mm -I../. ../server/databuffer.cpp test_databuffer_mm.cpp -pthread
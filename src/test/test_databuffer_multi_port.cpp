@@ -48,8 +48,8 @@ void Logger::error(std::string msg, std::string file, std::string &line) {
 }
 	
 
-void finishPlayback() {
-	// 
+bool finishPlayback() {
+	return false;
 }
 
 
@@ -58,6 +58,7 @@ Poco::Mutex gMutex;
 
 uint32_t chunk_size = 200 * 1024; // 200 kB
 const char* chunk;
+std::shared_ptr<DataBuffer> db = std::make_shared<DataBuffer>();
 FfplayDummy ffplay;
 Poco::Thread avThread;
 
@@ -71,7 +72,7 @@ std::mutex dataRequestMtx;
 // This function can be signalled with the condition variable to request data from the client.
 void dataRequestFunction() {
 	// Create and share condition variable with DataBuffer class.
-	DataBuffer::setDataRequestCondition(&dataRequestCv);
+	db->setDataRequestCondition(&dataRequestCv);
 	
 	while (running) {
 		// Wait for the condition to be signalled.
@@ -83,13 +84,13 @@ void dataRequestFunction() {
 			std::cout << "Shutting down data request function..." << std::endl;
 			break;
 		}
-		else if (!DataBuffer::dataRequestPending) { continue; } // Spurious wake-up.
+		else if (!db->dataRequestPending) { continue; } // Spurious wake-up.
 		
 		std::cout << "Asking for data..." << std::endl;
 	
 		// Write into buffer after a brief delay.
 		std::this_thread::sleep_for(std::chrono::milliseconds(1));
-		DataBuffer::write(chunk, chunk_size);
+		db->write(chunk, chunk_size);
 		
 		if (!playerRunning) {
 			// Start the ffplay dummy thread.
@@ -103,12 +104,12 @@ void dataRequestFunction() {
 
 // --- SEEKING HANDLER ---
 void seekingHandler(uint32_t session, int64_t offset) {
-	if (DataBuffer::seeking()) {
+	if (db->seeking()) {
 		std::cout << "Seeking..." << std::endl;
 	
 		// Write into buffer after a brief delay.
 		std::this_thread::sleep_for(std::chrono::milliseconds(100));
-		DataBuffer::write(chunk, chunk_size);
+		db->write(chunk, chunk_size);
 	}
 }
 
@@ -125,15 +126,16 @@ int main() {
 	
 	// Init DataBuffer.
 	uint32_t buffer_size = 1 * (1024 * 1024); // 1 MB
-	DataBuffer::init(buffer_size);
-	DataBuffer::setSeekRequestCallback(seekingHandler);
+	db->init(buffer_size);
+	db->setSeekRequestCallback(seekingHandler);
+	ffplay.setDataBuffer(db);
 	
 	// Start the data request handler in its own thread.
 	std::thread drq(dataRequestFunction);
 	
 	std::this_thread::sleep_for(std::chrono::milliseconds(100));
 	
-	if (!DataBuffer::start()) {
+	if (!db->start()) {
 		std::cerr << "DataBuffer start failed." << std::endl;
 		return 1;
 	}
@@ -152,7 +154,7 @@ int main() {
 	// Clean-up.
 	running = false;
 	ffplay.quit();
-	DataBuffer::cleanup();
+	db->cleanup();
 	dataRequestCv.notify_one();
 	drq.join();
 	avThread.join();
@@ -0,0 +1,162 @@
+/*
+	test_keyframeindex.cpp - Tests for the KeyframeIndex class.
+
+	Tests:
+	- Lookup: a seek target resolves to the last keyframe before it, and only within the range
+		covered by the index.
+	- Spacing: keyframes closer than the spacing to an indexed keyframe are skipped, also when
+		they arrive out of order, as after a seek back.
+	- Persistence: a saved index loads back for the same key only.
+*/
+
+#include "../server/keyframeindex.h"
+
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+
+
+int test_lookup() {
+	std::cout << "\n*** Test lookup ***\n";
+
+	// A keyframe every 2 seconds, at 100 kB per second.
+	KeyframeIndex index;
+	for (int64_t s = 0; s < 60; s += 2) {
+		index.add(s * 1000000, s * 100000 + 188);
+	}
+
+	KeyframeEntry entry;
+	if (!index.lookup(31500000, entry) || entry.pts != 30000000 || entry.pos != 3000188) {
+		std::cout << "*** Test lookup: wrong keyframe.\n";
+		return EXIT_FAILURE;
+	}
+
+	if (!index.lookup(40000000, entry) || entry.pts != 40000000) {
+		std::cout << "*** Test lookup: exact target not found.\n";
+		return EXIT_FAILURE;
+	}
+
+	// Before the first keyframe, and well past the last one, the index cannot help.
+	index.reset();
+	index.add(10000000, 1000188);
+	index.add(12000000, 1200188);
+	if (index.lookup(5000000, entry) || index.lookup(30000000, entry)) {
+		std::cout << "*** Test lookup: target outside the index resolved.\n";
+		return EXIT_FAILURE;
+	}
+
+	if (!index.lookup(12400000, entry) || entry.pts != 12000000) {
+		std::cout << "*** Test lookup: target just past the index not resolved.\n";
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+
+int test_spacing() {
+	std::cout << "\n*** Test spacing ***\n";
+
+	// Audio: every packet of 26 ms is a keyframe.
+	KeyframeIndex index(500000);
+	for (int64_t t = 0; t < 10000000; t += 26122) {
+		index.add(t, t / 10);
+	}
+
+	std::cout << "Entries: " << index.size() << std::endl;
+	if (index.size() < 19 || index.size() > 21) {
+		std::cout << "*** Test spacing: wrong number of entries.\n";
+		return EXIT_FAILURE;
+	}
+
+	// A seek back re-reads part of the file, which adds nothing new.
+	size_t size = index.size();
+	for (int64_t t = 4000000; t < 6000000; t += 26122) {
+		index.add(t, t / 10);
+	}
+
+	if (index.size() != size) {
+		std::cout << "*** Test spacing: duplicate entries added.\n";
+		return EXIT_FAILURE;
+	}
+
+	// A seek ahead leaves a gap, which gets filled in after a seek back.
+	index.reset();
+	index.add(0, 0);
+	index.add(20000000, 2000000);
+	index.add(10000000, 1000000);
+	index.add(10100000, 1010000);
+	KeyframeEntry entry;
+	if (index.size() != 3 || !index.lookup(15000000, entry) || entry.pts != 10000000) {
+		std::cout << "*** Test spacing: out of order entry not inserted.\n";
+		return EXIT_FAILURE;
+	}
+
+	// Invalid byte offsets are not indexed.
+	if (index.add(30000000, -1)) {
+		std::cout << "*** Test spacing: invalid offset added.\n";
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+
+int test_persistence() {
+	std::cout << "\n*** Test persistence ***\n";
+
+	const char* path = "test_keyframeindex.idx";
+	uint64_t key = KeyframeIndex::hash("movie.ts", 8);
+	uint64_t otherKey = KeyframeIndex::hash("movie2.ts", 9);
+	if (key == otherKey || key != KeyframeIndex::hash("movie.ts", 8)) {
+		std::cout << "*** Test persistence: bad key.\n";
+		return EXIT_FAILURE;
+	}
+
+	KeyframeIndex index;
+	index.reset(key);
+	for (int64_t s = 0; s < 100; ++s) {
+		index.add(s * 1000000, s * 188000);
+	}
+
+	if (!index.save(path)) {
+		std::cout << "*** Test persistence: save failed.\n";
+		return EXIT_FAILURE;
+	}
+
+	KeyframeIndex loaded;
+	KeyframeEntry entry;
+	if (loaded.load(path, otherKey) || loaded.size() != 0 || loaded.getKey() != otherKey) {
+		std::cout << "*** Test persistence: index for another file loaded.\n";
+		std::remove(path);
+		return EXIT_FAILURE;
+	}
+
+	if (!loaded.load(path, key) || loaded.size() != 100 || !loaded.lookup(42500000, entry)
+			|| entry.pos != 42 * 188000) {
+		std::cout << "*** Test persistence: load failed.\n";
+		std::remove(path);
+		return EXIT_FAILURE;
+	}
+
+	std::remove(path);
+	if (loaded.load(path, key)) {
+		std::cout << "*** Test persistence: missing file loaded.\n";
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+
+int main() {
+	int res = test_lookup()
+		|| test_spacing()
+		|| test_persistence();
+
+	if (res == EXIT_SUCCESS) {
+		std::cout << "\n* * * Keyframe index tests completed successfully * * *\n";
+	}
+
+	return res;
+}
@@ -0,0 +1,160 @@
+/*
+	test_logging.cpp - Tests for the Logging class.
+
+	Tests:
+	- Levels: messages above the level of their subsystem are not logged, and their arguments
+		are not evaluated.
+	- Ordering: messages from several threads all reach the sink, in order per thread.
+	- Overflow: with the drain thread stopped, messages beyond the ring size are dropped and
+		counted, without blocking.
+*/
+
+#include "../server/logging.h"
+
+#include <iostream>
+#include <thread>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+
+
+int evaluated = 0;
+
+int expensive() {
+	evaluated++;
+	return 42;
+}
+
+
+int test_levels() {
+	std::cout << "\n*** Test levels ***\n";
+
+	std::vector<LogRecord> records;
+	Logging::clearSinks();
+	Logging::addSink([&records](const LogRecord &record) { records.push_back(record); });
+	Logging::setLevel(LOG_LEVEL_INFO);
+	Logging::setLevel(LOG_SUB_READ, LOG_LEVEL_WARNING);
+	Logging::setLevel(LOG_SUB_DATA, LOG_LEVEL_TRACE);
+
+	NC_LOG_INFO(LOG_SUB_READ, "Read %d bytes.", expensive());
+	NC_LOG_TRACE(LOG_SUB_CORE, "Value: %d", expensive());
+	NC_LOG_WARNING(LOG_SUB_READ, "Seek failed at %d.", 1024);
+	NC_LOG_TRACE(LOG_SUB_DATA, "Asking for %d bytes.", 32768);
+	Logging::flush();
+
+	if (evaluated != 0) {
+		std::cout << "*** Test levels: disabled message arguments evaluated.\n";
+		return EXIT_FAILURE;
+	}
+
+	if (records.size() != 2 || records[0].subsystem != LOG_SUB_READ
+			|| records[0].level != LOG_LEVEL_WARNING || strcmp(records[0].message, "Seek failed at 1024.")
+			|| strcmp(records[1].message, "Asking for 32768 bytes.")) {
+		std::cout << "*** Test levels: wrong messages logged.\n";
+		return EXIT_FAILURE;
+	}
+
+	if (Logging::parseLevel("debug", LOG_LEVEL_INFO) != LOG_LEVEL_DEBUG
+			|| Logging::parseLevel("loud", LOG_LEVEL_INFO) != LOG_LEVEL_INFO) {
+		std::cout << "*** Test levels: level names not parsed.\n";
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+
+int test_ordering() {
+	std::cout << "\n*** Test ordering ***\n";
+
+	const int threadCount = 4;
+	const int messages = 20000;
+	int next[threadCount] = { 0 };		// Dropped messages leave gaps.
+	bool ordered = true;
+	uint64_t received = 0;
+	Logging::clearSinks();
+	Logging::addSink([&](const LogRecord &record) {
+		int t, n;
+		if (sscanf(record.message, "Thread %d, message %d", &t, &n) != 2 || n < next[t]) {
+			ordered = false;
+			return;
+		}
+
+		next[t] = n + 1;
+		received++;
+	});
+
+	Logging::setLevel(LOG_LEVEL_INFO);
+	Logging::start();
+	LogStats before = Logging::getStats();
+	std::vector<std::thread> threads;
+	for (int t = 0; t < threadCount; ++t) {
+		threads.push_back(std::thread([t, messages] {
+			for (int i = 0; i < messages; ++i) {
+				NC_LOG_INFO(LOG_SUB_CORE, "Thread %d, message %d", t, i);
+				if (i % 128 == 0) { std::this_thread::sleep_for(std::chrono::milliseconds(1)); }
+			}
+		}));
+	}
+
+	for (int t = 0; t < threadCount; ++t) {
+		threads[t].join();
+	}
+
+	Logging::stop();
+	LogStats after = Logging::getStats();
+	uint64_t sent = after.written - before.written;
+	std::cout << "Sent: " << sent << ", received: " << received << ", dropped: "
+				<< after.dropped - before.dropped << std::endl;
+	if (!ordered || received != sent) {
+		std::cout << "*** Test ordering: messages lost or out of order.\n";
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+
+int test_overflow() {
+	std::cout << "\n*** Test overflow ***\n";
+
+	uint64_t received = 0;
+	Logging::clearSinks();
+	Logging::addSink([&received](const LogRecord &record) { received++; });
+
+	LogStats before = Logging::getStats();
+	for (int i = 0; i < LOG_RING_SIZE + 100; ++i) {
+		NC_LOG_ERROR(LOG_SUB_STATUS, "Message %d", i);
+	}
+
+	LogStats after = Logging::getStats();
+	Logging::flush();
+	if (after.dropped - before.dropped != 100 || received != LOG_RING_SIZE) {
+		std::cout << "*** Test overflow: wrong number of messages dropped.\n";
+		return EXIT_FAILURE;
+	}
+
+	// Once drained, the ring takes messages again.
+	NC_LOG_ERROR(LOG_SUB_STATUS, "After overflow");
+	Logging::flush();
+	if (received != LOG_RING_SIZE + 1) {
+		std::cout << "*** Test overflow: ring not reusable.\n";
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+
+int main() {
+	int res = test_levels()
+		|| test_ordering()
+		|| test_overflow();
+
+	if (res == EXIT_SUCCESS) {
+		std::cout << "\n* * * Logging tests completed successfully * * *\n";
+	}
+
+	return res;
+}
@@ -0,0 +1,181 @@
+/*
+	test_metrics.cpp - Tests for the Metrics registry.
+
+	Tests:
+	- Buckets: each value falls in a bucket whose range holds it, with the relative error which
+		the number of sub-buckets allows.
+	- Histogram: counts, percentiles and counts below a boundary, also with threads recording
+		concurrently.
+	- Registry: the same name returns the same metric, and a name in use by another type of
+		metric is refused.
+	- Export: the text output lists each metric family once, with its labels and buckets.
+*/
+
+#include "../server/metrics.h"
+
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <cstdlib>
+
+
+int test_buckets() {
+	std::cout << "\n*** Test buckets ***\n";
+
+	for (uint64_t v = 0; v < (1ULL << 20); v += 1 + v / 64) {
+		int index = MetricHistogram::bucketIndex(v);
+		uint64_t low = MetricHistogram::bucketLow(index);
+		uint64_t high = MetricHistogram::bucketLow(index + 1);
+		if (v < low || v >= high) {
+			std::cout << "*** Test buckets: " << v << " not in bucket " << index << ".\n";
+			return EXIT_FAILURE;
+		}
+
+		if ((high - low) * METRIC_HISTOGRAM_SUB_BUCKETS > low && high - low > 1) {
+			std::cout << "*** Test buckets: bucket " << index << " too wide.\n";
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (MetricHistogram::bucketIndex(UINT64_MAX) != METRIC_HISTOGRAM_BUCKETS - 1) {
+		std::cout << "*** Test buckets: large value not clamped.\n";
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+
+int test_histogram() {
+	std::cout << "\n*** Test histogram ***\n";
+
+	// 1 to 10,000 µs, once each.
+	MetricHistogram h;
+	for (int v = 1; v <= 10000; ++v) {
+		h.record(v);
+	}
+
+	uint64_t p50 = h.percentile(50);
+	uint64_t p99 = h.percentile(99);
+	std::cout << "p50: " << p50 << ", p99: " << p99 << std::endl;
+	if (h.getCount() != 10000 || h.getSum() != 50005000 || p50 < 5000 || p50 > 5000 * 17 / 16
+			|| p99 < 9900 || p99 > 9900 * 17 / 16) {
+		std::cout << "*** Test histogram: wrong count, sum or percentiles.\n";
+		return EXIT_FAILURE;
+	}
+
+	if (h.countBelow(1024) != 1023 || h.countBelow(1ULL << 40) != 10000) {
+		std::cout << "*** Test histogram: wrong count below boundary.\n";
+		return EXIT_FAILURE;
+	}
+
+	h.reset();
+	const int threadCount = 4;
+	const int values = 100000;
+	std::vector<std::thread> threads;
+	for (int t = 0; t < threadCount; ++t) {
+		threads.push_back(std::thread([&h, values] {
+			for (int i = 0; i < values; ++i) { h.record(i % 100); }
+		}));
+	}
+
+	for (int t = 0; t < threadCount; ++t) {
+		threads[t].join();
+	}
+
+	if (h.getCount() != threadCount * values || h.countBelow(64) != threadCount * values * 64 / 100) {
+		std::cout << "*** Test histogram: values lost with concurrent recording.\n";
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+
+int test_registry() {
+	std::cout << "\n*** Test registry ***\n";
+
+	MetricCounter* c = Metrics::counter("test_reads_total", "Reads.");
+	if (!c || c != Metrics::counter("test_reads_total", "Reads.")) {
+		std::cout << "*** Test registry: counter not shared.\n";
+		return EXIT_FAILURE;
+	}
+
+	if (Metrics::gauge("test_reads_total", "Reads.") != 0) {
+		std::cout << "*** Test registry: name reused for another type.\n";
+		return EXIT_FAILURE;
+	}
+
+	MetricGauge* g = Metrics::gauge("test_level", "Level.");
+	g->set(2.5);
+	g->add(-1);
+	if (g->get() != 1.5) {
+		std::cout << "*** Test registry: wrong gauge value.\n";
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+
+int test_export() {
+	std::cout << "\n*** Test export ***\n";
+
+	Metrics::counter("test_drops_total{reason=\"late\"}", "Dropped frames.")->add(3);
+	Metrics::counter("test_drops_total{reason=\"early\"}", "Dropped frames.")->add(2);
+	Metrics::counter("test_drops_other_total", "Other drops.")->add();
+	MetricHistogram* h = Metrics::histogram("test_latency_seconds{op=\"seek\"}", "Latency.");
+	h->record(100);
+	h->record(3000000);
+	int collected = 0;
+	Metrics::addCollector([&collected] {
+		collected++;
+		Metrics::gauge("test_fill_bytes", "Fill.")->set(4096);
+	});
+
+	std::string text = Metrics::exportText();
+	std::cout << text;
+	const char* expected[] = {
+		"# TYPE test_drops_total counter\n"
+		"test_drops_total{reason=\"early\"} 2\n"
+		"test_drops_total{reason=\"late\"} 3\n",
+		"# TYPE test_latency_seconds histogram\n",
+		"test_latency_seconds_bucket{op=\"seek\",le=\"1.6e-05\"} 0\n",
+		"test_latency_seconds_bucket{op=\"seek\",le=\"0.000128\"} 1\n",
+		"test_latency_seconds_bucket{op=\"seek\",le=\"2.097152\"} 1\n",
+		"test_latency_seconds_bucket{op=\"seek\",le=\"4.194304\"} 2\n",
+		"test_latency_seconds_bucket{op=\"seek\",le=\"+Inf\"} 2\n",
+		"test_latency_seconds_sum{op=\"seek\"} 3.0001\n",
+		"test_latency_seconds_count{op=\"seek\"} 2\n",
+		"test_fill_bytes 4096\n",
+		"test_drops_other_total 1\n"
+	};
+
+	for (int i = 0; i < sizeof(expected) / sizeof(expected[0]); ++i) {
+		if (text.find(expected[i]) == std::string::npos) {
+			std::cout << "*** Test export: missing: " << expected[i];
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (collected != 1 || text.find("# HELP test_drops_total") != text.rfind("# HELP test_drops_total")) {
+		std::cout << "*** Test export: collector not run, or family listed twice.\n";
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+
+int main() {
+	int res = test_buckets()
+		|| test_histogram()
+		|| test_registry()
+		|| test_export();
+
+	if (res == EXIT_SUCCESS) {
+		std::cout << "\n* * * Metrics tests completed successfully * * *\n";
+	}
+
+	return res;
+}
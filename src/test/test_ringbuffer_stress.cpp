@@ -0,0 +1,247 @@
+/*
+	test_ringbuffer_stress.cpp - Two-thread stress test for the RingBuffer class.
+
+	Tests:
+	- A producer and a consumer thread hammer a small ring buffer with randomised chunk sizes.
+	- The consumer verifies every byte against the expected pattern and position.
+	- With a retained window, the consumer randomly seeks back into already read data while the
+		producer keeps writing.
+	- Out of order writes only become readable once the gap before them has been filled.
+*/
+
+#include "../server/ringbuffer.h"
+
+#include <iostream>
+#include <thread>
+#include <atomic>
+#include <random>
+#include <vector>
+#include <chrono>
+
+
+// The byte expected at absolute stream position 'pos'. Mixes in the higher bits so that
+// a read from the wrong lap of the buffer is detected.
+inline uint8_t pattern(uint64_t pos) {
+	return (uint8_t) ((pos * 2654435761u) >> 7 ^ (pos >> 13));
+}
+
+
+int test_stress(uint32_t capacity, uint64_t total, uint32_t maxChunk, uint32_t retain = 0) {
+	std::cout << "\n*** Test stress: capacity " << capacity << ", total " << total
+				<< ", max chunk " << maxChunk << ", retain " << retain << " ***\n";
+
+	RingBuffer ring;
+	if (!ring.init(capacity, retain)) {
+		std::cout << "*** Test stress: init failed.\n";
+		return EXIT_FAILURE;
+	}
+
+	std::atomic<bool> failed = { false };
+
+	std::thread producer([&]() {
+		std::mt19937 rng(1234);
+		std::uniform_int_distribution<uint32_t> dist(1, maxChunk);
+		std::vector<uint8_t> chunk(maxChunk);
+		uint64_t pos = 0;
+		while (pos < total && !failed) {
+			uint32_t len = dist(rng);
+			if (len > total - pos) { len = (uint32_t) (total - pos); }
+			for (uint32_t i = 0; i < len; ++i) { chunk[i] = pattern(pos + i); }
+
+			uint32_t done = 0;
+			while (done < len && !failed) {
+				uint32_t n = ring.write(chunk.data() + done, len - done);
+				if (n == 0) { std::this_thread::yield(); }
+				done += n;
+			}
+
+			pos += len;
+		}
+	});
+
+	std::mt19937 rng(4321);
+	std::uniform_int_distribution<uint32_t> dist(1, maxChunk);
+	std::vector<uint8_t> bytes(maxChunk);
+	uint64_t pos = 0;
+	uint64_t seeks = 0;
+	while (pos < total) {
+		if (retain > 0 && rng() % 16 == 0) {
+			// Seek back to a random position inside the retained window.
+			uint64_t low = ring.lowPosition();
+			if (low > pos) {
+				std::cout << "*** Test stress: low position " << low << " past read position.\n";
+				failed = true;
+				break;
+			}
+			
+			uint64_t target = pos - (rng() % (pos - low + 1));
+			if (!ring.seek(target)) {
+				std::cout << "*** Test stress: seek to " << target << " failed. Low: " << low << "\n";
+				failed = true;
+				break;
+			}
+			
+			pos = target;
+			seeks++;
+		}
+		
+		uint32_t n = ring.read(bytes.data(), dist(rng));
+		if (n == 0) { std::this_thread::yield(); continue; }
+
+		for (uint32_t i = 0; i < n; ++i) {
+			if (bytes[i] != pattern(pos + i)) {
+				std::cout << "*** Test stress: mismatch at position " << pos + i << ": got "
+							<< (int) bytes[i] << ", expected " << (int) pattern(pos + i) << "\n";
+				failed = true;
+				break;
+			}
+		}
+
+		if (failed) { break; }
+		pos += n;
+
+		if (ring.readPosition() != pos) {
+			std::cout << "*** Test stress: read position " << ring.readPosition()
+						<< ", expected " << pos << "\n";
+			failed = true;
+			break;
+		}
+	}
+
+	producer.join();
+
+	if (failed) { return EXIT_FAILURE; }
+
+	if (ring.unread() != 0 || ring.writePosition() != total) {
+		std::cout << "*** Test stress: unexpected end state. Unread: " << ring.unread()
+					<< ", write position: " << ring.writePosition() << "\n";
+		return EXIT_FAILURE;
+	}
+
+	std::cout << "Seeks: " << seeks << "\n";
+	std::cout << "\n* * * Stress test completed successfully * * *\n";
+
+	return EXIT_SUCCESS;
+}
+
+
+int test_reset() {
+	std::cout << "\n*** Test reset ***\n";
+
+	RingBuffer ring;
+	ring.init(16);
+
+	uint8_t data[10] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 };
+	ring.write(data, 10);
+	ring.reset(1000);
+
+	uint8_t bytes[10];
+	if (ring.read(bytes, 10) != 0 || ring.readPosition() != 1000 || ring.writePosition() != 1000) {
+		std::cout << "*** Test reset: buffer not empty at new position after reset.\n";
+		return EXIT_FAILURE;
+	}
+
+	// Fill beyond capacity: only 16 bytes may be accepted.
+	uint32_t n = ring.write(data, 10);
+	n += ring.write(data, 10);
+	if (n != 16 || ring.free() != 0) {
+		std::cout << "*** Test reset: wrote " << n << " bytes into 16 byte buffer.\n";
+		return EXIT_FAILURE;
+	}
+
+	// Retained window: read data stays available to seek back into.
+	ring.init(16, 4);
+	ring.write(data, 10);
+	ring.read(bytes, 8);
+	if (ring.lowPosition() != 4 || ring.free() != 10 || !ring.seek(5) || ring.seek(3) || ring.seek(11)) {
+		std::cout << "*** Test reset: retained window incorrect. Low: " << ring.lowPosition() << "\n";
+		return EXIT_FAILURE;
+	}
+	
+	if (ring.read(bytes, 10) != 5 || bytes[0] != 6 || bytes[4] != 10) {
+		std::cout << "*** Test reset: read after seek back returned wrong data.\n";
+		return EXIT_FAILURE;
+	}
+
+	std::cout << "\n* * * Reset tests completed successfully * * *\n";
+
+	return EXIT_SUCCESS;
+}
+
+
+int test_write_at() {
+	std::cout << "\n*** Test write at ***\n";
+
+	RingBuffer ring;
+	ring.init(32);
+
+	uint8_t data[40];
+	for (uint32_t i = 0; i < 40; ++i) { data[i] = pattern(i); }
+
+	// Two ranges past the write position, one overlapping another.
+	ring.writeAt(20, data + 20, 8);
+	ring.writeAt(10, data + 10, 6);
+	ring.writeAt(14, data + 14, 4);
+	if (ring.writePosition() != 0 || ring.unread() != 0) {
+		std::cout << "*** Test write at: data past the gap became readable.\n";
+		return EXIT_FAILURE;
+	}
+
+	// Beyond the free space, only part of the data is accepted.
+	if (ring.writeAt(28, data + 28, 12) != 4) {
+		std::cout << "*** Test write at: wrote past the free space.\n";
+		return EXIT_FAILURE;
+	}
+
+	// Filling the gaps moves the write position over all pending ranges.
+	ring.writeAt(0, data, 10);
+	if (ring.writePosition() != 18) {
+		std::cout << "*** Test write at: write position " << ring.writePosition() << ", expected 18.\n";
+		return EXIT_FAILURE;
+	}
+
+	ring.write(data + 18, 2);
+	uint8_t bytes[32];
+	if (ring.writePosition() != 32 || ring.read(bytes, 32) != 32) {
+		std::cout << "*** Test write at: write position " << ring.writePosition() << ", expected 32.\n";
+		return EXIT_FAILURE;
+	}
+
+	for (uint32_t i = 0; i < 32; ++i) {
+		if (bytes[i] != pattern(i)) {
+			std::cout << "*** Test write at: mismatch at position " << i << "\n";
+			return EXIT_FAILURE;
+		}
+	}
+
+	// Data before the write position is skipped.
+	if (ring.writeAt(30, data + 30, 4) != 2 || ring.writePosition() != 34) {
+		std::cout << "*** Test write at: overlap with written data not skipped.\n";
+		return EXIT_FAILURE;
+	}
+
+	std::cout << "\n* * * Write at tests completed successfully * * *\n";
+
+	return EXIT_SUCCESS;
+}
+
+
+int main() {
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+
+	int res = test_reset()
+		|| test_write_at()
+		|| test_stress(4099, 64 * 1024 * 1024, 1500)
+		|| test_stress(1024 * 1024, 256 * 1024 * 1024, 256 * 1024)
+		|| test_stress(7, 1024 * 1024, 11)
+		|| test_stress(4099, 64 * 1024 * 1024, 1500, 1024)
+		|| test_stress(1024 * 1024, 256 * 1024 * 1024, 256 * 1024, 256 * 1024);
+
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+	std::cout << "Duration: " << std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count()
+				<< " ms.\n";
+
+	return res;
+}
+
+// g++ -std=c++17 -O2 -o bin/test_ringbuffer_stress -I../. ../server/ringbuffer.cpp test_ringbuffer_stress.cpp -pthread
@@ -0,0 +1,272 @@
+/*
+	test_slavesender.cpp - Tests for the SlaveSender class.
+
+	Tests:
+	- Fan-out: a slow slave must not hold up the other slaves. All slaves get the data in order.
+	- Wait policy: a full queue holds up the master until the slave catches up.
+	- Drop policy: a slave whose queue is full gets dropped.
+	- Failure: a slave which fails to receive data gets dropped.
+	- Chunks: data is sent from a chunk of the data buffer, in two parts if it wraps around.
+*/
+
+#include "../server/slavesender.h"
+
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <chrono>
+
+
+// Received data per slave handle.
+std::mutex receivedMutex;
+std::map<uint32_t, std::string> received;
+std::map<uint32_t, uint32_t> delays;		// Milliseconds per send, per slave handle.
+std::atomic<bool> failSends = { false };
+
+
+bool receive(uint32_t handle, const uint8_t* data, uint32_t length, bool done, int64_t then) {
+	if (failSends) { return false; }
+
+	uint32_t delay = 0;
+	{
+		std::lock_guard<std::mutex> lk(receivedMutex);
+		received[handle].append((const char*) data, length);
+		delay = delays[handle];
+	}
+
+	if (delay > 0) { std::this_thread::sleep_for(std::chrono::milliseconds(delay)); }
+
+	return true;
+}
+
+
+void resetReceived() {
+	std::lock_guard<std::mutex> lk(receivedMutex);
+	received.clear();
+	delays.clear();
+	failSends = false;
+}
+
+
+std::string block(int n) {
+	return std::string(1000, (char) ('a' + n % 26));
+}
+
+
+int test_fanout() {
+	std::cout << "\n*** Test fan-out ***\n";
+	resetReceived();
+
+	SlaveSenderConfig config;
+	config.queueDepth = 16;
+	delays[1] = 50;		// Slow slave.
+
+	std::vector<SlaveSenderPtr> senders;
+	for (uint32_t i = 1; i <= 4; ++i) {
+		senders.push_back(std::make_shared<SlaveSender>(i, "slave", receive, config));
+		senders.back()->start();
+	}
+
+	std::string expected;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (int n = 0; n < 10; ++n) {
+		std::string b = block(n);
+		expected += b;
+		for (int i = 0; i < senders.size(); ++i) {
+			if (!senders[i]->send(b.data(), b.length(), n == 9, 0)) {
+				std::cout << "*** Test fan-out: send failed.\n";
+				return EXIT_FAILURE;
+			}
+		}
+	}
+
+	uint64_t queueTime = std::chrono::duration_cast<std::chrono::milliseconds>(
+							std::chrono::steady_clock::now() - start).count();
+	if (queueTime > 40) {
+		std::cout << "*** Test fan-out: queueing took " << queueTime << " ms.\n";
+		return EXIT_FAILURE;
+	}
+
+	for (int i = 1; i < senders.size(); ++i) {
+		if (!senders[i]->flush(100)) {
+			std::cout << "*** Test fan-out: fast slave " << i + 1 << " held up.\n";
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (!senders[0]->flush(2000)) {
+		std::cout << "*** Test fan-out: slow slave did not finish.\n";
+		return EXIT_FAILURE;
+	}
+
+	for (uint32_t i = 1; i <= 4; ++i) {
+		if (received[i] != expected) {
+			std::cout << "*** Test fan-out: slave " << i << " received wrong data.\n";
+			return EXIT_FAILURE;
+		}
+	}
+
+	SlaveSenderStats st = senders[0]->getStats();
+	if (st.bytesSent != expected.length() || st.blocksSent != 10 || st.queued != 0) {
+		std::cout << "*** Test fan-out: wrong stats: " << st.bytesSent << " bytes, "
+					<< st.blocksSent << " blocks, " << st.queued << " queued.\n";
+		return EXIT_FAILURE;
+	}
+
+	std::cout << "Slow slave: " << st.throughput << " B/s, " << st.sendTime << " us per block, "
+				<< st.queuedMax << " blocks max queued.\n";
+
+	return EXIT_SUCCESS;
+}
+
+
+int test_wait_policy() {
+	std::cout << "\n*** Test wait policy ***\n";
+	resetReceived();
+
+	SlaveSenderConfig config;
+	config.queueDepth = 2;
+	config.lagTimeout = 1000;
+	config.policy = SLAVE_LAG_WAIT;
+	delays[1] = 10;
+
+	SlaveSender sender(1, "slave", receive, config);
+	sender.start();
+
+	std::string expected;
+	for (int n = 0; n < 10; ++n) {
+		std::string b = block(n);
+		expected += b;
+		if (!sender.send(b.data(), b.length(), n == 9, 0)) {
+			std::cout << "*** Test wait policy: slave dropped.\n";
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (!sender.flush(1000) || received[1] != expected || sender.getStats().queuedMax > 2) {
+		std::cout << "*** Test wait policy: data not received correctly.\n";
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+
+int test_drop_policy() {
+	std::cout << "\n*** Test drop policy ***\n";
+	resetReceived();
+
+	SlaveSenderConfig config;
+	config.queueDepth = 2;
+	config.policy = SLAVE_LAG_DROP;
+	delays[1] = 200;
+
+	SlaveSender sender(1, "slave", receive, config);
+	sender.start();
+
+	bool dropped = false;
+	for (int n = 0; n < 10 && !dropped; ++n) {
+		std::string b = block(n);
+		dropped = !sender.send(b.data(), b.length(), false, 0);
+	}
+
+	if (!dropped || !sender.isDropped() || sender.getStats().queued != 0) {
+		std::cout << "*** Test drop policy: lagging slave was not dropped.\n";
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+
+int test_failure() {
+	std::cout << "\n*** Test failure ***\n";
+	resetReceived();
+	failSends = true;
+
+	SlaveSenderConfig config;
+	SlaveSender sender(1, "slave", receive, config);
+	sender.start();
+
+	std::string b = block(0);
+	sender.send(b.data(), b.length(), false, 0);
+	sender.flush(1000);
+	if (!sender.isDropped() || sender.send(b.data(), b.length(), false, 0)) {
+		std::cout << "*** Test failure: failing slave was not dropped.\n";
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+
+int test_chunks() {
+	std::cout << "\n*** Test chunks ***\n";
+	resetReceived();
+
+	std::shared_ptr<DataBuffer> buffer = std::make_shared<DataBuffer>();
+	if (!buffer->init(4096, 4096)) {
+		std::cout << "*** Test chunks: buffer init failed.\n";
+		return EXIT_FAILURE;
+	}
+
+	buffer->setFileSize(10000);
+	buffer->start();
+
+	SlaveSenderConfig config;
+	SlaveSender sender(1, "slave", receive, config);
+	sender.start();
+
+	// Write and read blocks until one wraps around the end of the buffer.
+	std::string expected;
+	std::vector<uint8_t> out(1500);
+	bool wrapped = false;
+	for (int n = 0; n < 6; ++n) {
+		std::string b(1500, (char) ('a' + n));
+		uint64_t position;
+		if (buffer->write(b.data(), b.length(), position) != b.length()) {
+			std::cout << "*** Test chunks: write failed.\n";
+			return EXIT_FAILURE;
+		}
+
+		MediaChunkPtr chunk = buffer->getChunk(position, b.length(), false);
+		if (!chunk) {
+			std::cout << "*** Test chunks: no chunk.\n";
+			return EXIT_FAILURE;
+		}
+
+		if (chunk->spans[1].length > 0) { wrapped = true; }
+		expected += b;
+		sender.send(buffer, chunk, 0);
+		chunk.reset();
+
+		if (!sender.flush(1000)) {
+			std::cout << "*** Test chunks: send failed.\n";
+			return EXIT_FAILURE;
+		}
+
+		buffer->read(b.length(), out.data());
+	}
+
+	if (!wrapped || received[1] != expected) {
+		std::cout << "*** Test chunks: data not received correctly.\n";
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+
+int main() {
+	int res = test_fanout()
+		|| test_wait_policy()
+		|| test_drop_policy()
+		|| test_failure()
+		|| test_chunks();
+
+	if (res == EXIT_SUCCESS) {
+		std::cout << "\n* * * Slave sender tests completed successfully * * *\n";
+	}
+
+	return res;
+}
@@ -0,0 +1,226 @@
+/*
+	test_statuspublisher.cpp - Tests for the StatusPublisher class.
+
+	Tests:
+	- Coalescing: a burst of routine changes results in few updates, one interval apart.
+	- Transitions: a state transition gets sent right away, without waiting for the interval.
+	- Deltas: the first update contains all fields, later ones only what changed, plus the status.
+	- Cache: status requests within an interval reuse the status, until a transition.
+*/
+
+#include "../server/statuspublisher.h"
+
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <cstdlib>
+
+
+// Status as collected by the server, and the updates sent to the clients.
+std::mutex statusMutex;
+PlaybackStatus current;
+std::atomic<uint32_t> snapshots = { 0 };
+std::vector<uint32_t> sentFields;
+std::vector<std::chrono::steady_clock::time_point> sentTimes;
+
+
+void snapshot(PlaybackStatus &status) {
+	std::lock_guard<std::mutex> lk(statusMutex);
+	status = current;
+	snapshots++;
+}
+
+
+void send(const PlaybackStatus &status, uint32_t fields) {
+	std::lock_guard<std::mutex> lk(statusMutex);
+	sentFields.push_back(fields);
+	sentTimes.push_back(std::chrono::steady_clock::now());
+}
+
+
+void reset() {
+	std::lock_guard<std::mutex> lk(statusMutex);
+	current = PlaybackStatus();
+	sentFields.clear();
+	sentTimes.clear();
+	snapshots = 0;
+}
+
+
+size_t sentCount() {
+	std::lock_guard<std::mutex> lk(statusMutex);
+	return sentFields.size();
+}
+
+
+int test_coalescing() {
+	std::cout << "\n*** Test coalescing ***\n";
+	reset();
+
+	StatusPublisherConfig config;
+	config.interval = 50;
+	StatusPublisher publisher(snapshot, send, config);
+	publisher.start();
+
+	// A new data block every millisecond, for 300 milliseconds.
+	for (int i = 0; i < 300; ++i) {
+		{
+			std::lock_guard<std::mutex> lk(statusMutex);
+			current.position += 0.01;
+		}
+
+		publisher.notify();
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	publisher.stop();
+
+	std::lock_guard<std::mutex> lk(statusMutex);
+	std::cout << "Notified: " << publisher.getStats().notified << ", sent: " << sentFields.size()
+				<< std::endl;
+	if (sentFields.size() < 2 || sentFields.size() > 20) {
+		std::cout << "*** Test coalescing: wrong number of updates.\n";
+		return EXIT_FAILURE;
+	}
+
+	for (int i = 1; i < sentTimes.size(); ++i) {
+		if (sentTimes[i] - sentTimes[i - 1] < std::chrono::milliseconds(45)) {
+			std::cout << "*** Test coalescing: updates closer than the interval.\n";
+			return EXIT_FAILURE;
+		}
+	}
+
+	return EXIT_SUCCESS;
+}
+
+
+int test_transitions() {
+	std::cout << "\n*** Test transitions ***\n";
+	reset();
+
+	StatusPublisherConfig config;
+	config.interval = 10000;
+	StatusPublisher publisher(snapshot, send, config);
+	publisher.start();
+
+	// The first routine change gets sent right away. Any further ones wait for the interval.
+	publisher.notify();
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	size_t before = sentCount();
+
+	{
+		std::lock_guard<std::mutex> lk(statusMutex);
+		current.status = 3;
+		current.playing = true;
+	}
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	publisher.transition();
+	while (sentCount() == before && std::chrono::steady_clock::now() - start < std::chrono::seconds(1)) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	std::chrono::milliseconds took = std::chrono::duration_cast<std::chrono::milliseconds>(
+												std::chrono::steady_clock::now() - start);
+	publisher.stop();
+
+	std::cout << "Transition sent after " << took.count() << " ms.\n";
+	if (sentCount() == before || took > std::chrono::milliseconds(100)) {
+		std::cout << "*** Test transitions: transition not sent right away.\n";
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+
+int test_deltas() {
+	std::cout << "\n*** Test deltas ***\n";
+	reset();
+
+	StatusPublisherConfig config;
+	config.interval = 1;
+	StatusPublisher publisher(snapshot, send, config);
+	publisher.start();
+
+	publisher.transition();
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+	{
+		std::lock_guard<std::mutex> lk(statusMutex);
+		current.title = "Title";
+		current.position = 1.5;
+	}
+
+	publisher.transition();
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+	// No change: nothing gets sent.
+	publisher.transition();
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+	publisher.resendAll();
+	publisher.transition();
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	publisher.stop();
+
+	std::lock_guard<std::mutex> lk(statusMutex);
+	uint32_t expected = STATUS_FIELD_STATUS | STATUS_FIELD_TITLE | STATUS_FIELD_POSITION;
+	if (sentFields.size() != 3 || sentFields[0] != STATUS_FIELD_ALL || sentFields[1] != expected
+			|| sentFields[2] != STATUS_FIELD_ALL) {
+		std::cout << "*** Test deltas: wrong fields sent.\n";
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+
+int test_cache() {
+	std::cout << "\n*** Test cache ***\n";
+	reset();
+
+	StatusPublisherConfig config;
+	config.interval = 10000;
+	StatusPublisher publisher(snapshot, send, config);
+
+	for (int i = 0; i < 100; ++i) {
+		publisher.getStatus();
+	}
+
+	uint32_t cached = snapshots;
+	{
+		std::lock_guard<std::mutex> lk(statusMutex);
+		current.status = 2;
+	}
+
+	// The transition is not sent, as the publisher is not running, but invalidates the cache.
+	publisher.transition();
+	PlaybackStatus status = publisher.getStatus();
+
+	std::cout << "Snapshots for 100 requests: " << cached << ", after a transition: " << snapshots
+				<< std::endl;
+	if (cached != 1 || snapshots != 2 || status.status != 2) {
+		std::cout << "*** Test cache: status not reused.\n";
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+
+int main() {
+	int res = test_coalescing()
+		|| test_transitions()
+		|| test_deltas()
+		|| test_cache();
+
+	if (res == EXIT_SUCCESS) {
+		std::cout << "\n* * * Status publisher tests completed successfully * * *\n";
+	}
+
+	return res;
+}
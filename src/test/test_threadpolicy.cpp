@@ -0,0 +1,169 @@
+/*
+	test_threadpolicy.cpp - Tests for the ThreadPolicy class.
+
+	Tests:
+	- Parsing: valid and invalid rules and core sets.
+	- Selection: the first rule matching the codec and height applies, and the default applies
+		without a match. Invalid rules leave the current rules in place.
+	- Affinity: applying a role limits the calling thread to the role's cores, and the saved
+		affinity can be restored.
+*/
+
+#include "../server/threadpolicy.h"
+
+#include <iostream>
+#include <thread>
+#include <cstdlib>
+
+
+int test_parsing() {
+	std::cout << "\n*** Test parsing ***\n";
+
+	DecoderThreadRule rule;
+	if (!ThreadPolicy::parseRule("hevc@1080:slice:3", rule) || rule.codec != "hevc" ||
+			rule.maxHeight != 1080 || rule.threading.type != THREAD_TYPE_SLICE ||
+			rule.threading.threads != 3) {
+		std::cout << "*** Test parsing: full rule not parsed.\n";
+		return EXIT_FAILURE;
+	}
+
+	if (!ThreadPolicy::parseRule("*:frame", rule) || rule.codec != "*" || rule.maxHeight != 0 ||
+			rule.threading.type != THREAD_TYPE_FRAME || rule.threading.threads != 0) {
+		std::cout << "*** Test parsing: short rule not parsed.\n";
+		return EXIT_FAILURE;
+	}
+
+	const char* invalid[] = { "", "hevc", "hevc:wave", "hevc:frame:x", "@720:auto", "h264@:auto",
+								"h264:auto:2:1", "hevc:frame:-1" };
+	for (int i = 0; i < sizeof(invalid) / sizeof(invalid[0]); ++i) {
+		if (ThreadPolicy::parseRule(invalid[i], rule)) {
+			std::cout << "*** Test parsing: accepted rule '" << invalid[i] << "'.\n";
+			return EXIT_FAILURE;
+		}
+	}
+
+	std::vector<int> cores;
+	if (!ThreadPolicy::parseCores("0,2-4", cores) || cores.size() != 4 || cores[0] != 0 ||
+			cores[1] != 2 || cores[3] != 4) {
+		std::cout << "*** Test parsing: cores not parsed.\n";
+		return EXIT_FAILURE;
+	}
+
+	if (!ThreadPolicy::parseCores("", cores) || !cores.empty() ||
+			ThreadPolicy::parseCores("3-1", cores) || ThreadPolicy::parseCores("1,", cores) ||
+			ThreadPolicy::parseCores("a", cores)) {
+		std::cout << "*** Test parsing: wrong handling of empty or invalid core sets.\n";
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+
+int test_selection() {
+	std::cout << "\n*** Test selection ***\n";
+
+	if (ThreadPolicy::select("hevc", 2160).type != THREAD_TYPE_AUTO ||
+			ThreadPolicy::select("hevc", 2160).threads != 0) {
+		std::cout << "*** Test selection: no default without rules.\n";
+		return EXIT_FAILURE;
+	}
+
+	if (!ThreadPolicy::setRules("hevc@1080:slice:3,hevc:frame:2,*:auto:4")) {
+		std::cout << "*** Test selection: rules not set.\n";
+		return EXIT_FAILURE;
+	}
+
+	DecoderThreading t = ThreadPolicy::select("hevc", 720);
+	if (t.type != THREAD_TYPE_SLICE || t.threads != 3) {
+		std::cout << "*** Test selection: wrong rule for 720p HEVC.\n";
+		return EXIT_FAILURE;
+	}
+
+	t = ThreadPolicy::select("hevc", 2160);
+	if (t.type != THREAD_TYPE_FRAME || t.threads != 2) {
+		std::cout << "*** Test selection: wrong rule for 2160p HEVC.\n";
+		return EXIT_FAILURE;
+	}
+
+	t = ThreadPolicy::select("aac", 0);
+	if (t.type != THREAD_TYPE_AUTO || t.threads != 4) {
+		std::cout << "*** Test selection: wrong rule for AAC.\n";
+		return EXIT_FAILURE;
+	}
+
+	if (ThreadPolicy::setRules("h264:frame:2,h264:bad") ||
+			ThreadPolicy::select("hevc", 720).threads != 3) {
+		std::cout << "*** Test selection: invalid rules replaced the current ones.\n";
+		return EXIT_FAILURE;
+	}
+
+	ThreadPolicy::setRules("");
+	return EXIT_SUCCESS;
+}
+
+
+int test_affinity() {
+	std::cout << "\n*** Test affinity ***\n";
+
+#ifdef __linux__
+	std::vector<int> saved;
+	if (!ThreadPolicy::getAffinity(saved) || saved.empty()) {
+		std::cout << "*** Test affinity: no affinity.\n";
+		return EXIT_FAILURE;
+	}
+
+	// Pin a thread to the last core it may use.
+	std::string core = std::to_string(saved.back());
+	if (!ThreadPolicy::setCores(THREAD_ROLE_VIDEO_DECODE, core)) {
+		std::cout << "*** Test affinity: cores not set.\n";
+		return EXIT_FAILURE;
+	}
+
+	int res = EXIT_SUCCESS;
+	std::thread t([&res, &saved] {
+		std::vector<int> before, pinned, after;
+		ThreadPolicy::getAffinity(before);
+		if (!ThreadPolicy::apply(THREAD_ROLE_VIDEO_DECODE) || !ThreadPolicy::getAffinity(pinned) ||
+				pinned.size() != 1 || pinned[0] != saved.back()) {
+			std::cout << "*** Test affinity: thread not pinned.\n";
+			res = EXIT_FAILURE;
+			return;
+		}
+
+		if (!ThreadPolicy::setAffinity(before) || !ThreadPolicy::getAffinity(after) ||
+				after != before) {
+			std::cout << "*** Test affinity: affinity not restored.\n";
+			res = EXIT_FAILURE;
+		}
+	});
+
+	t.join();
+
+	// The pinning applies to that thread only, and roles without cores change nothing.
+	std::vector<int> current;
+	ThreadPolicy::getAffinity(current);
+	if (res == EXIT_SUCCESS && (current != saved || !ThreadPolicy::apply(THREAD_ROLE_RENDER))) {
+		std::cout << "*** Test affinity: other threads affected.\n";
+		res = EXIT_FAILURE;
+	}
+
+	ThreadPolicy::setCores(THREAD_ROLE_VIDEO_DECODE, "");
+	return res;
+#else
+	return EXIT_SUCCESS;
+#endif
+}
+
+
+int main() {
+	int res = test_parsing()
+		|| test_selection()
+		|| test_affinity();
+
+	if (res == EXIT_SUCCESS) {
+		std::cout << "\n* * * Thread policy tests completed successfully * * *\n";
+	}
+
+	return res;
+}